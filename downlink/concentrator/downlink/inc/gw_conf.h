@@ -0,0 +1,125 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Gateway configuration of the concentrator applications: the SX1301_conf
+	and gateway_conf objects of debug_conf.json, or of global_conf.json
+	overridden by local_conf.json, parsed once into a typed structure and
+	checked before anything is configured. The result can be kept in a binary
+	snapshot, reused as long as the JSON files do not change.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _GW_CONF_H
+#define _GW_CONF_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+
+#include "loragw_hal.h"
+#include "loragw_spi.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define GW_CONF_SUCCESS		 0
+#define GW_CONF_ERROR		-1
+
+#define GW_CONF_PATH_SIZE	256	/* maximum length of a file path, including the terminating null */
+#define GW_CONF_DEV_MAX		64	/* maximum number of devices in "devices" */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct gw_conf_s
+@brief Gateway configuration, after the local overrides; no pointer, so that it
+can be written to a file as is
+*/
+struct gw_conf_s {
+	/* SX1301_conf */
+	struct lgw_conf_board_s	board;
+	struct lgw_conf_rxrf_s	rxrf[LGW_RF_CHAIN_NB];	/*!> "radio_0" and "radio_1" */
+	struct lgw_conf_rxif_s	rxif[LGW_IF_CHAIN_NB];	/*!> "chan_multiSF_0" to "chan_multiSF_7", "chan_Lora_std", "chan_FSK" */
+	/* gateway_conf */
+	uint64_t		gateway_id;		/*!> "gateway_ID", mandatory */
+	char			cal_cache_file[LGW_CAL_PATH_SIZE];	/*!> "calibration_cache", disabled if empty */
+	struct lgw_spi_conf_s	spi;	/*!> "spi_speed" and "spi_chunk_size", 0 for the library defaults */
+	char			spi_trace_file[GW_CONF_PATH_SIZE];	/*!> "spi_trace_record" or "spi_trace_replay", disabled if empty */
+	bool			spi_trace_replay;	/*!> replay the trace instead of recording it */
+	char			gps_tty_path[64];	/*!> "gps_tty_path", no GPS if empty */
+	char			capture_file[GW_CONF_PATH_SIZE];	/*!> "capture_file", disabled if empty */
+	uint32_t		capture_nb;		/*!> "capture_size", 0 for the default of the application */
+	uint64_t		router_id;		/*!> "router_ID", 0 for the default of the application */
+	int				dev_nb;			/*!> number of "devices", 0 for the default of the application */
+	uint64_t		dev_eui[GW_CONF_DEV_MAX];	/*!> "devices", DevEUI of the test nodes */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Clear a configuration: everything disabled, library and application defaults
+@param conf pointer to the configuration to initialize
+*/
+void gw_conf_init(struct gw_conf_s *conf);
+
+/**
+@brief Parse one JSON file and merge it into a configuration
+@param conf pointer to the configuration, the entries present in the file replace its values
+@param conf_file JSON file, with comments
+@return GW_CONF_ERROR if the file is not valid JSON or an entry has an invalid value, GW_CONF_SUCCESS else
+
+A radio or channel object replaces the whole radio or channel, a "devices"
+array replaces the whole list; the other entries are replaced one by one.
+*/
+int gw_conf_parse(struct gw_conf_s *conf, const char *conf_file);
+
+/**
+@brief Check the consistency of a configuration, once all the files are merged
+@param conf pointer to the configuration
+@return GW_CONF_ERROR if an entry is missing or two entries contradict each other, GW_CONF_SUCCESS else
+*/
+int gw_conf_check(const struct gw_conf_s *conf);
+
+/**
+@brief Load the configuration of the current directory
+@param conf pointer to the configuration to fill
+@param snapshot binary snapshot of the configuration, NULL to always parse the JSON files
+@return GW_CONF_ERROR if there is no configuration file or the configuration is invalid, GW_CONF_SUCCESS else
+
+Reads debug_conf.json alone if present, else global_conf.json then
+local_conf.json. If the snapshot was made from the same files (same names
+and contents), it is read instead of parsing them; else it is rewritten
+after a successful parse. The snapshot is specific to the host and to the
+build of the application.
+*/
+int gw_conf_load(struct gw_conf_s *conf, const char *snapshot);
+
+/**
+@brief Submit the SX1301 part of a configuration to the HAL
+@param conf pointer to the configuration
+@return GW_CONF_ERROR if the HAL refuses a radio or channel, GW_CONF_SUCCESS else
+*/
+int gw_conf_apply(const struct gw_conf_s *conf);
+
+/**
+@brief Print a configuration on stderr, one line per radio, channel and option
+@param conf pointer to the configuration
+*/
+void gw_conf_print(const struct gw_conf_s *conf);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -8,6 +8,12 @@
 
 Description:
 	Configure LoRa concentrator and record received packets in a log file
+	Packets go through three threads linked by lock-free rings: RX (fetches
+	the FIFO), processing (join responses and tests) and writer (CSV log), so
+	that neither the log file nor the tests delay the next fetch.
+	With a GPS, a fourth thread keeps a time reference synchronized on the PPS
+	and the packets are stamped with the UTC time of their reception instead
+	of the host clock at the fetch.
 
 License: Revised BSD License, see LICENSE.TXT file include in the project
 Maintainer: Sylvain Miermont
@@ -31,11 +37,21 @@ Maintainer: Sylvain Miermont
 #include <string.h>		/* memset */
 #include <signal.h>		/* sigaction */
 #include <time.h>		/* time clock_gettime strftime gmtime clock_nanosleep*/
-#include <unistd.h>		/* getopt access */
+#include <unistd.h>		/* getopt access read close */
 #include <stdlib.h>		/* atoi */
+#include <pthread.h>	/* pthread_create pthread_mutex */
+#include <poll.h>		/* poll */
 
 #include "parson.h"
 #include "loragw_hal.h"
+#include "loragw_aux.h"
+#include "loragw_spi.h"
+#include "loragw_trace.h"
+#include "loragw_ring.h"
+#include "loragw_txq.h"
+#include "loragw_gps.h"
+#include "loragw_ctl.h"
+#include "gw_conf.h"
 
 /* CONSTANTS */
 
@@ -47,7 +63,19 @@ Maintainer: Sylvain Miermont
 #define JOIN_RESPONSE_DELAY 2000000 // 6 seconds in us
 #define JOIN_RF_CHAIN 0
 #define JOIN_RESPONSE_POWER 14
+#define RX_WAIT_MS 100 // longest wait for a packet before checking the exit signals
+#define FETCH_PKT_NB 16 // packets fetched at once
+#define GPS_POLL_MS 100 // longest wait for the GPS before checking the exit signals
+#define GPS_REF_MAX_AGE 30 // seconds without PPS sync before the host clock is used again
 #define MSG_PER_SETTING 5
+#define PIPE_RING_NB 256 // packets buffered between two threads
+#define PIPE_IDLE_MS 1 // sleep of a thread that found its input ring empty
+#define LOG_LINE_SIZE 1024
+#define CTL_WAIT_MS 100 // longest wait for a control command before checking the exit signals
+#define CTL_ACK_MS 1000 // longest wait for a campaign command to reach the writer thread
+#define CMD_RING_NB 4 // campaign commands buffered between the main and writer threads
+#define CAMPAIGN_START 1 // close the log file and open the one of the next campaign
+#define CAMPAIGN_STOP 2 // close the log file, packets are no longer logged nor answered
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
 
@@ -86,15 +114,22 @@ Maintainer: Sylvain Miermont
 #define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
 #define MSG(args...)	fprintf(stderr,"loragw_pkt_logger: " args) /* message that is destined to the user */
 
+/* stop flags and campaign state shared between threads */
+#define STORE_RELEASE(a,v)	__atomic_store_n(&(a), (v), __ATOMIC_RELEASE)
+#define LOAD_ACQUIRE(a)		__atomic_load_n(&(a), __ATOMIC_ACQUIRE)
+
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 
 /* signal handling variables */
 struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
-static int exit_sig = 0; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
-static int quit_sig = 0; /* 1 -> application terminates without shutting down the hardware */
+static volatile sig_atomic_t exit_sig = 0; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
+static volatile sig_atomic_t quit_sig = 0; /* 1 -> application terminates without shutting down the hardware */
+static volatile sig_atomic_t stats_sig = 0; /* 1 -> the RX thread prints the HAL statistics (SIGUSR1) */
 /* configuration variables needed by the application  */
+struct gw_conf_s gw_conf; /* merged configuration files */
+char *conf_snapshot = NULL; /* binary snapshot of the configuration (-c), always parse the files if NULL */
 uint64_t lgwm = 0; /* LoRa gateway MAC address */
 char lgwm_str[17];
 
@@ -102,19 +137,76 @@ char lgwm_str[17];
 time_t now_time;
 time_t log_start_time;
 FILE * log_file = NULL;
-char log_file_name[64];
+char log_file_name[GW_CONF_PATH_SIZE];
 static struct lgw_pkt_tx_s join_response;
 
+/* downlink test schedule, used by the processing thread only */
+static struct lgw_txq_s txq;
+static uint32_t test_now; /* concentrator counter when the test was scheduled */
+static uint32_t test_time; /* end of the last packet scheduled by the test */
+static uint32_t test_gap; /* silence requested before the next packet of the test, in us */
+unsigned long pkt_in_log = 0; /* count the number of packet written in each log file */
+int log_rotate_interval = 3600; /* by default, rotation every hour */
+
+/* GPS time reference */
+static int gps_tty_fd = -1; /* GPS serial port, -1 if there is no GPS */
+static int gps_stop = 0; /* 1 -> the GPS thread exits */
+static pthread_mutex_t mx_timeref = PTHREAD_MUTEX_INITIALIZER; /* protects the GPS time reference and its fit */
+static struct tref time_reference_gps; /* time reference used for timestamp -> UTC conversion */
+static struct tref_fit gps_fit; /* PPS sync points of the time reference */
+static bool gps_ref_valid = false; /* is the time reference valid */
+
+/* receive pipeline */
+struct pipe_item_s {
+	struct timespec utc; /* UTC time of the packet, from the GPS time reference or the host clock at the fetch */
+	bool utc_gps; /* utc comes from the GPS time reference */
+	struct lgw_pkt_rx_s pkt;
+};
+static struct lgw_ring_s rx_ring; /* RX thread -> processing thread */
+static struct lgw_ring_s log_ring; /* processing thread -> writer thread */
+static pthread_mutex_t mx_concent = PTHREAD_MUTEX_INITIALIZER; /* serializes the HAL calls of the RX and processing threads */
+static int proc_stop = 0; /* 1 -> the RX thread exited, the processing thread empties its ring and exits */
+static int log_stop = 0; /* 1 -> the processing thread exited, the writer thread empties its ring and exits */
+static int rx_error = 0; /* 1 -> packet fetch failed */
+
+/* daemon mode (-d): campaigns started and stopped on the control socket, the
+concentrator stays started between them; the writer thread switches the log
+file, the processing thread only logs and answers joins during a campaign */
+struct campaign_cmd_s {
+	int type; /* CAMPAIGN_xxx */
+	uint32_t seq; /* written to campaign_ack by the writer thread once done */
+	char file[GW_CONF_PATH_SIZE]; /* log file of CAMPAIGN_START, default name if empty */
+};
+char *ctl_path = NULL; /* control socket, NULL to log from start to exit */
+static struct lgw_ctl_s ctl; /* used by the main thread only */
+static struct lgw_ring_s cmd_ring; /* campaign commands, main thread -> writer thread */
+static int campaign_on = 1; /* packets are logged and joins answered, written by the writer thread */
+static uint32_t campaign_ack = 0; /* seq of the last command done by the writer thread */
+static bool campaign_failed = false; /* the writer thread could not create the log file of that command */
+static int campaign_nb = 0; /* campaigns started, used by the main thread only */
+static uint32_t ctl_seq = 0; /* last command sent, used by the main thread only */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
 static void sig_handler(int sigio);
 
-int parse_SX1301_configuration(const char * conf_file);
+void configure_gateway(void);
+void configure_calibration(void);
+void configure_spi(void);
+int configure_trace(void);
+void finish_trace(void);
+void print_stats(void);
 
-int parse_gateway_configuration(const char * conf_file);
+int open_log(const char *name);
 
-void open_log(void);
+void switch_log(const struct campaign_cmd_s *cmd);
+
+double campaign_send(int type, const char *file);
+
+void control_command(const char *line);
+
+void run_control(void);
 
 void usage (void);
 
@@ -122,6 +214,24 @@ int compare_id(struct lgw_pkt_rx_s*);
 
 void test_power();
 
+void test_sleep(unsigned int s);
+
+int schedule_packet(void);
+
+void run_txq(void);
+
+int format_log_line(char *line, int size, const struct pipe_item_s *item);
+
+bool fetch_utc(const struct lgw_pkt_rx_s *pkt, int nb_pkt, struct timespec *utc);
+
+void *thread_rx(void *arg);
+
+void *thread_proc(void *arg);
+
+void *thread_writer(void *arg);
+
+void *thread_gps(void *arg);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -130,272 +240,238 @@ static void sig_handler(int sigio) {
 		quit_sig = 1;;
 	} else if ((sigio == SIGINT) || (sigio == SIGTERM)) {
 		exit_sig = 1;
+	} else if (sigio == SIGUSR1) {
+		stats_sig = 1;
 	}
 }
 
-int parse_SX1301_configuration(const char * conf_file) {
-	int i;
-	const char conf_obj[] = "SX1301_conf";
-	char param_name[32]; /* used to generate variable parameter names */
-	const char *str; /* used to store string value from JSON object */
-	struct lgw_conf_board_s boardconf;
-	struct lgw_conf_rxrf_s rfconf;
-	struct lgw_conf_rxif_s ifconf;
-	JSON_Value *root_val;
-	JSON_Object *root = NULL;
-	JSON_Object *conf = NULL;
-	JSON_Value *val;
-	uint32_t sf, bw;
-	
-	/* try to parse JSON */
-	root_val = json_parse_file_with_comments(conf_file);
-	root = json_value_get_object(root_val);
-	if (root == NULL) {
-		MSG("ERROR: %s id not a valid JSON file\n", conf_file);
+/* load the configuration files (or their snapshot), exit if they are invalid */
+void configure_gateway(void) {
+	if (gw_conf_load(&gw_conf, conf_snapshot) != GW_CONF_SUCCESS) {
+		MSG("ERROR: invalid or missing configuration, exiting\n");
 		exit(EXIT_FAILURE);
 	}
-	conf = json_object_get_object(root, conf_obj);
-	if (conf == NULL) {
-		MSG("INFO: %s does not contain a JSON object named %s\n", conf_file, conf_obj);
-		return -1;
-	} else {
-		MSG("INFO: %s does contain a JSON object named %s, parsing SX1301 parameters\n", conf_file, conf_obj);
+	gw_conf_print(&gw_conf);
+	if (gw_conf_apply(&gw_conf) != GW_CONF_SUCCESS) {
+		MSG("ERROR: configuration refused by the HAL, exiting\n");
+		exit(EXIT_FAILURE);
 	}
+	lgwm = gw_conf.gateway_id;
+}
 
-	/* set board configuration */
-	memset(&boardconf, 0, sizeof boardconf); /* initialize configuration structure */
-	val = json_object_get_value(conf, "lorawan_public"); /* fetch value (if possible) */
-	if (json_value_get_type(val) == JSONBoolean) {
-		boardconf.lorawan_public = (bool)json_value_get_boolean(val);
-	} else {
-		MSG("WARNING: Data type for lorawan_public seems wrong, please check\n");
-		boardconf.lorawan_public = false;
+/* reuse the calibration of the previous start of this gateway, if a cache file is configured */
+void configure_calibration(void) {
+	struct lgw_conf_cal_s calconf;
+
+	if (gw_conf.cal_cache_file[0] == '\0') {
+		return;
 	}
-	val = json_object_get_value(conf, "clksrc"); /* fetch value (if possible) */
-	if (json_value_get_type(val) == JSONNumber) {
-		boardconf.clksrc = (uint8_t)json_value_get_number(val);
-	} else {
-		MSG("WARNING: Data type for clksrc seems wrong, please check\n");
-		boardconf.clksrc = 0;
-	}
-	MSG("INFO: lorawan_public %d, clksrc %d\n", boardconf.lorawan_public, boardconf.clksrc);
-	/* all parameters parsed, submitting configuration to the HAL */
-        if (lgw_board_setconf(boardconf) != LGW_HAL_SUCCESS) {
-                MSG("WARNING: Failed to configure board\n");
-	}
-
-	/* set configuration for RF chains */
-	for (i = 0; i < LGW_RF_CHAIN_NB; ++i) {
-		memset(&rfconf, 0, sizeof(rfconf)); /* initialize configuration structure */
-		sprintf(param_name, "radio_%i", i); /* compose parameter path inside JSON structure */
-		val = json_object_get_value(conf, param_name); /* fetch value (if possible) */
-		if (json_value_get_type(val) != JSONObject) {
-			MSG("INFO: no configuration for radio %i\n", i);
-			continue;
-		}
-		/* there is an object to configure that radio, let's parse it */
-		sprintf(param_name, "radio_%i.enable", i);
-		val = json_object_dotget_value(conf, param_name);
-		if (json_value_get_type(val) == JSONBoolean) {
-			rfconf.enable = (bool)json_value_get_boolean(val);
-		} else {
-			rfconf.enable = false;
-		}
-		if (rfconf.enable == false) { /* radio disabled, nothing else to parse */
-			MSG("INFO: radio %i disabled\n", i);
-		} else  { /* radio enabled, will parse the other parameters */
-			snprintf(param_name, sizeof param_name, "radio_%i.freq", i);
-			rfconf.freq_hz = (uint32_t)json_object_dotget_number(conf, param_name);
-			snprintf(param_name, sizeof param_name, "radio_%i.rssi_offset", i);
-			rfconf.rssi_offset = (float)json_object_dotget_number(conf, param_name);
-			snprintf(param_name, sizeof param_name, "radio_%i.type", i);
-			str = json_object_dotget_string(conf, param_name);
-			if (!strncmp(str, "SX1255", 6)) {
-				rfconf.type = LGW_RADIO_TYPE_SX1255;
-			} else if (!strncmp(str, "SX1257", 6)) {
-				rfconf.type = LGW_RADIO_TYPE_SX1257;
-			} else {
-				MSG("WARNING: invalid radio type: %s (should be SX1255 or SX1257)\n", str);
-			}
-			snprintf(param_name, sizeof param_name, "radio_%i.tx_enable", i);
-			val = json_object_dotget_value(conf, param_name);
-			if (json_value_get_type(val) == JSONBoolean) {
-				rfconf.tx_enable = (bool)json_value_get_boolean(val);
-			} else {
-				rfconf.tx_enable = false;
-			}
-			MSG("INFO: radio %i enabled (type %s), center frequency %u, RSSI offset %f, tx enabled %d\n", i, str, rfconf.freq_hz, rfconf.rssi_offset, rfconf.tx_enable);
-		}
-		/* all parameters parsed, submitting configuration to the HAL */
-		if (lgw_rxrf_setconf(i, rfconf) != LGW_HAL_SUCCESS) {
-			MSG("WARNING: invalid configuration for radio %i\n", i);
-		}
+	memset(&calconf, 0, sizeof calconf);
+	calconf.cache_enable = true;
+	calconf.board_id = lgwm;
+	memcpy(calconf.cache_file, gw_conf.cal_cache_file, sizeof calconf.cache_file); /* same size, always terminated */
+	if (lgw_cal_setconf(calconf) != LGW_HAL_SUCCESS) {
+		MSG("WARNING: failed to configure the calibration cache\n");
 	}
-	
-	/* set configuration for LoRa multi-SF channels (bandwidth cannot be set) */
-	for (i = 0; i < LGW_MULTI_NB; ++i) {
-		memset(&ifconf, 0, sizeof(ifconf)); /* initialize configuration structure */
-		sprintf(param_name, "chan_multiSF_%i", i); /* compose parameter path inside JSON structure */
-		val = json_object_get_value(conf, param_name); /* fetch value (if possible) */
-		if (json_value_get_type(val) != JSONObject) {
-			MSG("INFO: no configuration for LoRa multi-SF channel %i\n", i);
-			continue;
-		}
-		/* there is an object to configure that LoRa multi-SF channel, let's parse it */
-		sprintf(param_name, "chan_multiSF_%i.enable", i);
-		val = json_object_dotget_value(conf, param_name);
-		if (json_value_get_type(val) == JSONBoolean) {
-			ifconf.enable = (bool)json_value_get_boolean(val);
-		} else {
-			ifconf.enable = false;
-		}
-		if (ifconf.enable == false) { /* LoRa multi-SF channel disabled, nothing else to parse */
-			MSG("INFO: LoRa multi-SF channel %i disabled\n", i);
-		} else  { /* LoRa multi-SF channel enabled, will parse the other parameters */
-			sprintf(param_name, "chan_multiSF_%i.radio", i);
-			ifconf.rf_chain = (uint32_t)json_object_dotget_number(conf, param_name);
-			sprintf(param_name, "chan_multiSF_%i.if", i);
-			ifconf.freq_hz = (int32_t)json_object_dotget_number(conf, param_name);
-			// TODO: handle individual SF enabling and disabling (spread_factor)
-			MSG("INFO: LoRa multi-SF channel %i enabled, radio %i selected, IF %i Hz, 125 kHz bandwidth, SF 7 to 12\n", i, ifconf.rf_chain, ifconf.freq_hz);
-		}
-		/* all parameters parsed, submitting configuration to the HAL */
-		if (lgw_rxif_setconf(i, ifconf) != LGW_HAL_SUCCESS) {
-			MSG("WARNING: invalid configuration for LoRa multi-SF channel %i\n", i);
-		}
+}
+
+/* apply the SPI settings of the configuration file, before lgw_start opens the link */
+void configure_spi(void) {
+	if ((gw_conf.spi.speed_hz == 0) && (gw_conf.spi.chunk_size == 0)) {
+		return;
 	}
-	
-	/* set configuration for LoRa standard channel */
-	memset(&ifconf, 0, sizeof(ifconf)); /* initialize configuration structure */
-	val = json_object_get_value(conf, "chan_Lora_std"); /* fetch value (if possible) */
-	if (json_value_get_type(val) != JSONObject) {
-		MSG("INFO: no configuration for LoRa standard channel\n");
-	} else {
-		val = json_object_dotget_value(conf, "chan_Lora_std.enable");
-		if (json_value_get_type(val) == JSONBoolean) {
-			ifconf.enable = (bool)json_value_get_boolean(val);
-		} else {
-			ifconf.enable = false;
-		}
-		if (ifconf.enable == false) {
-			MSG("INFO: LoRa standard channel %i disabled\n", i);
-		} else  {
-			ifconf.rf_chain = (uint32_t)json_object_dotget_number(conf, "chan_Lora_std.radio");
-			ifconf.freq_hz = (int32_t)json_object_dotget_number(conf, "chan_Lora_std.if");
-			bw = (uint32_t)json_object_dotget_number(conf, "chan_Lora_std.bandwidth");
-			switch(bw) {
-				case 500000: ifconf.bandwidth = BW_500KHZ; break;
-				case 250000: ifconf.bandwidth = BW_250KHZ; break;
-				case 125000: ifconf.bandwidth = BW_125KHZ; break;
-				default: ifconf.bandwidth = BW_UNDEFINED;
-			}
-			sf = (uint32_t)json_object_dotget_number(conf, "chan_Lora_std.spread_factor");
-			switch(sf) {
-				case  7: ifconf.datarate = DR_LORA_SF7;  break;
-				case  8: ifconf.datarate = DR_LORA_SF8;  break;
-				case  9: ifconf.datarate = DR_LORA_SF9;  break;
-				case 10: ifconf.datarate = DR_LORA_SF10; break;
-				case 11: ifconf.datarate = DR_LORA_SF11; break;
-				case 12: ifconf.datarate = DR_LORA_SF12; break;
-				default: ifconf.datarate = DR_UNDEFINED;
-			}
-			MSG("INFO: LoRa standard channel enabled, radio %i selected, IF %i Hz, %u Hz bandwidth, SF %u\n", ifconf.rf_chain, ifconf.freq_hz, bw, sf);
-		}
-		if (lgw_rxif_setconf(8, ifconf) != LGW_HAL_SUCCESS) {
-			MSG("WARNING: invalid configuration for LoRa standard channel\n");
-		}
+	if (lgw_spi_setconf(NULL, gw_conf.spi) != LGW_SPI_SUCCESS) {
+		MSG("WARNING: invalid SPI settings, library defaults used\n");
 	}
-	
-	/* set configuration for FSK channel */
-	memset(&ifconf, 0, sizeof(ifconf)); /* initialize configuration structure */
-	val = json_object_get_value(conf, "chan_FSK"); /* fetch value (if possible) */
-	if (json_value_get_type(val) != JSONObject) {
-		MSG("INFO: no configuration for FSK channel\n");
-	} else {
-		val = json_object_dotget_value(conf, "chan_FSK.enable");
-		if (json_value_get_type(val) == JSONBoolean) {
-			ifconf.enable = (bool)json_value_get_boolean(val);
-		} else {
-			ifconf.enable = false;
-		}
-		if (ifconf.enable == false) {
-			MSG("INFO: FSK channel %i disabled\n", i);
-		} else  {
-			ifconf.rf_chain = (uint32_t)json_object_dotget_number(conf, "chan_FSK.radio");
-			ifconf.freq_hz = (int32_t)json_object_dotget_number(conf, "chan_FSK.if");
-			bw = (uint32_t)json_object_dotget_number(conf, "chan_FSK.bandwidth");
-			if      (bw <= 7800)   ifconf.bandwidth = BW_7K8HZ;
-			else if (bw <= 15600)  ifconf.bandwidth = BW_15K6HZ;
-			else if (bw <= 31200)  ifconf.bandwidth = BW_31K2HZ;
-			else if (bw <= 62500)  ifconf.bandwidth = BW_62K5HZ;
-			else if (bw <= 125000) ifconf.bandwidth = BW_125KHZ;
-			else if (bw <= 250000) ifconf.bandwidth = BW_250KHZ;
-			else if (bw <= 500000) ifconf.bandwidth = BW_500KHZ;
-			else ifconf.bandwidth = BW_UNDEFINED;
-			ifconf.datarate = (uint32_t)json_object_dotget_number(conf, "chan_FSK.datarate");
-			MSG("INFO: FSK channel enabled, radio %i selected, IF %i Hz, %u Hz bandwidth, %u bps datarate\n", ifconf.rf_chain, ifconf.freq_hz, bw, ifconf.datarate);
-		}
-		if (lgw_rxif_setconf(9, ifconf) != LGW_HAL_SUCCESS) {
-			MSG("WARNING: invalid configuration for FSK channel\n");
-		}
-	}
-	json_value_free(root_val);
-	return 0;
 }
 
-int parse_gateway_configuration(const char * conf_file) {
-	const char conf_obj[] = "gateway_conf";
-	JSON_Value *root_val;
-	JSON_Object *root = NULL;
-	JSON_Object *conf = NULL;
-	unsigned long long ull = 0;
-	
-	/* try to parse JSON */
-	root_val = json_parse_file_with_comments(conf_file);
-	root = json_value_get_object(root_val);
-	if (root == NULL) {
-		MSG("ERROR: %s id not a valid JSON file\n", conf_file);
-		exit(EXIT_FAILURE);
+/* start recording or replaying the SPI traffic, before lgw_start opens the link */
+int configure_trace(void) {
+	int i;
+
+	if (gw_conf.spi_trace_file[0] == '\0') {
+		return 0;
 	}
-	conf = json_object_get_object(root, conf_obj);
-	if (conf == NULL) {
-		MSG("INFO: %s does not contain a JSON object named %s\n", conf_file, conf_obj);
+	i = gw_conf.spi_trace_replay ? lgw_trace_replay(gw_conf.spi_trace_file) : lgw_trace_record(gw_conf.spi_trace_file);
+	if (i != LGW_TRACE_SUCCESS) {
+		MSG("ERROR: failed to %s SPI trace %s\n", gw_conf.spi_trace_replay ? "read" : "create", gw_conf.spi_trace_file);
 		return -1;
-	} else {
-		MSG("INFO: %s does contain a JSON object named %s, parsing gateway parameters\n", conf_file, conf_obj);
 	}
-	
-	/* getting network parameters (only those necessary for the packet logger) */
-	sscanf(json_object_dotget_string(conf, "gateway_ID"), "%llx", &ull);
-	lgwm = ull;
-	MSG("INFO: gateway MAC address is configured to %016llX\n", ull);
-	
-	json_value_free(root_val);
 	return 0;
 }
 
-void open_log(void) {
+/* close the SPI trace and report what was recorded or replayed */
+void finish_trace(void) {
+	struct lgw_trace_stat_s st;
+
+	if (gw_conf.spi_trace_file[0] == '\0') {
+		return;
+	}
+	lgw_trace_stat(&st);
+	if (st.mode == LGW_TRACE_RECORD) {
+		MSG("INFO: %u SPI transactions recorded in %s, %llu bytes\n", st.nb_record, gw_conf.spi_trace_file, (unsigned long long)st.nb_byte);
+	} else if (st.mode == LGW_TRACE_REPLAY) {
+		MSG("INFO: %u of %u SPI transactions replayed, %u call(s) not matching the trace\n", st.nb_record, st.nb_total, st.nb_mismatch);
+	}
+	lgw_trace_stop();
+}
+
+/* print the HAL performance counters, lgw_get_stats needs no lock */
+void print_stats(void) {
+	struct lgw_stats_s st;
+	const struct lgw_stats_hist_s *h;
+	int i, j;
+
+	lgw_get_stats(&st);
+	MSG("INFO: SPI: %llu transactions, %llu bytes written, %llu bytes read, %llu page switches\n", (unsigned long long)st.spi_nb, (unsigned long long)st.spi_bytes_w, (unsigned long long)st.spi_bytes_r, (unsigned long long)st.page_switch);
+	MSG("INFO: RX: %u fetches, %u packets (%u CRC OK, %u CRC bad, %u no CRC), %u errors\n", st.rx_fetch, st.rx_pkt, st.rx_crc_ok, st.rx_crc_bad, st.rx_no_crc, st.rx_error);
+	MSG("INFO: TX: %u packets, %u errors\n", st.tx_pkt, st.tx_error);
+	for (i = 0; i < 2; ++i) {
+		h = (i == 0) ? &st.rx_time : &st.tx_time;
+		if (h->nb == 0) {
+			continue;
+		}
+		MSG("INFO: %s latency: average %llu us, max %u us, histogram (us:count)", (i == 0) ? "RX" : "TX", (unsigned long long)(h->total_us / h->nb), h->max_us);
+		for (j = 0; j < LGW_STATS_HIST_NB; ++j) {
+			if (h->hist[j] != 0) {
+				fprintf(stderr, " %u:%u", (j == 0) ? 0 : 1u << j, h->hist[j]);
+			}
+		}
+		fprintf(stderr, "\n");
+	}
+	if (gps_tty_fd >= 0) {
+		pthread_mutex_lock(&mx_timeref);
+		MSG("INFO: GPS: time reference %s, %u PPS sync point(s) rejected, clock error %+.3f ppm, residuals %.2f us\n", gps_ref_valid ? "valid" : "not valid", gps_fit.nb_reject, (gps_fit.xtal_err - 1.0) * 1E6, gps_fit.res_us);
+		pthread_mutex_unlock(&mx_timeref);
+	}
+}
+
+/* open a log file, pktlog_<gateway ID>_<UTC date>.csv if name is NULL, -1 on failure */
+int open_log(const char *name) {
 	int i;
 	char iso_date[20];
 	
 	strftime(iso_date,ARRAY_SIZE(iso_date),"%Y%m%dT%H%M%SZ",gmtime(&now_time)); /* format yyyymmddThhmmssZ */
 	log_start_time = now_time; /* keep track of when the log was started, for log rotation */
 	
-	sprintf(log_file_name, "pktlog_%s_%s.csv", lgwm_str, iso_date);
+	if (name == NULL) {
+		sprintf(log_file_name, "pktlog_%s_%s.csv", lgwm_str, iso_date);
+	} else {
+		snprintf(log_file_name, sizeof log_file_name, "%s", name);
+	}
 	log_file = fopen(log_file_name, "a"); /* create log file, append if file already exist */
 	if (log_file == NULL) {
 		MSG("ERROR: impossible to create log file %s\n", log_file_name);
-		exit(EXIT_FAILURE);
+		return -1;
 	}
 	
-	i = fprintf(log_file, "\"gateway ID\",\"node MAC\",\"UTC timestamp\",\"us count\",\"frequency\",\"RF chain\",\"RX chain\",\"status\",\"size\",\"modulation\",\"bandwidth\",\"datarate\",\"coderate\",\"RSSI\",\"SNR\",\"payload\"\n");
+	i = fprintf(log_file, "\"gateway ID\",\"node MAC\",\"UTC timestamp\",\"us count\",\"frequency\",\"RF chain\",\"RX chain\",\"status\",\"size\",\"modulation\",\"bandwidth\",\"datarate\",\"coderate\",\"RSSI\",\"SNR\",\"payload\",\"time source\"\n");
 	if (i < 0) {
 		MSG("ERROR: impossible to write to log file %s\n", log_file_name);
-		exit(EXIT_FAILURE);
+		fclose(log_file);
+		log_file = NULL;
+		return -1;
 	}
 	
 	MSG("INFO: Now writing to log file %s\n", log_file_name);
-	return;
+	return 0;
+}
+
+/* close the log file of the last campaign and create the one of the next, in the writer thread */
+void switch_log(const struct campaign_cmd_s *cmd) {
+	bool failed = false;
+
+	if (log_file != NULL) {
+		fclose(log_file);
+		log_file = NULL;
+		MSG("INFO: log file %s closed, %lu packet(s) recorded\n", log_file_name, pkt_in_log);
+	}
+	if (cmd->type == CAMPAIGN_START) {
+		STORE_RELEASE(pkt_in_log, 0);
+		time(&now_time);
+		failed = (open_log((cmd->file[0] != '\0') ? cmd->file : NULL) != 0);
+	}
+	STORE_RELEASE(campaign_on, (log_file != NULL) ? 1 : 0);
+	STORE_RELEASE(campaign_failed, failed);
+	STORE_RELEASE(campaign_ack, cmd->seq);
+}
+
+/* send a campaign command and wait for the writer thread, the time taken in ms, -1 if it did not answer */
+double campaign_send(int type, const char *file) {
+	struct campaign_cmd_s cmd;
+	struct timespec t0, t1;
+	int i;
+
+	memset(&cmd, 0, sizeof cmd);
+	cmd.type = type;
+	cmd.seq = ++ctl_seq;
+	strncpy(cmd.file, file, sizeof cmd.file - 1);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (lgw_ring_push(&cmd_ring, &cmd) != LGW_RING_SUCCESS) {
+		return -1.0;
+	}
+	for (i = 0; LOAD_ACQUIRE(campaign_ack) != cmd.seq; ++i) {
+		if (i >= 10 * CTL_ACK_MS) {
+			return -1.0;
+		}
+		wait_us(100);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0.tv_sec) * 1E3 + (t1.tv_nsec - t0.tv_nsec) / 1E6;
+}
+
+/* execute one command of the control socket and reply to it */
+void control_command(const char *line) {
+	char verb[16] = "";
+	char arg[GW_CONF_PATH_SIZE] = "";
+	double ms;
+
+	sscanf(line, "%15s %255s", verb, arg); /* GW_CONF_PATH_SIZE - 1, no space in the file name */
+	if (strcmp(verb, "start") == 0) {
+		ms = campaign_send(CAMPAIGN_START, arg);
+		if (ms < 0.0) {
+			lgw_ctl_reply(&ctl, "ERROR campaign not started, the writer thread did not answer");
+		} else if (LOAD_ACQUIRE(campaign_failed)) {
+			lgw_ctl_reply(&ctl, "ERROR campaign not started, could not create log file");
+		} else {
+			++campaign_nb;
+			/* log_file_name is only changed by the next command */
+			MSG("INFO: campaign %d started, log in %s (%.1f ms)\n", campaign_nb, log_file_name, ms);
+			lgw_ctl_reply(&ctl, "OK campaign %d started, log in %s, %.1f ms", campaign_nb, log_file_name, ms);
+		}
+	} else if (strcmp(verb, "stop") == 0) {
+		ms = campaign_send(CAMPAIGN_STOP, "");
+		if (ms < 0.0) {
+			lgw_ctl_reply(&ctl, "ERROR campaign not stopped, the writer thread did not answer");
+		} else {
+			MSG("INFO: campaign %d stopped\n", campaign_nb);
+			lgw_ctl_reply(&ctl, "OK campaign %d stopped, %lu packet(s) logged", campaign_nb, LOAD_ACQUIRE(pkt_in_log));
+		}
+	} else if (strcmp(verb, "status") == 0) {
+		lgw_ctl_reply(&ctl, "OK campaign %d %s, %lu packet(s) logged", campaign_nb, LOAD_ACQUIRE(campaign_on) ? "running" : "stopped", LOAD_ACQUIRE(pkt_in_log));
+	} else if (strcmp(verb, "quit") == 0) {
+		lgw_ctl_reply(&ctl, "OK exiting");
+		STORE_RELEASE(exit_sig, 1);
+	} else {
+		lgw_ctl_reply(&ctl, "ERROR unknown command, expected start [<file>], stop, status or quit");
+	}
+}
+
+/* daemon mode: serve the control socket until a signal, a quit command or a fetch error */
+void run_control(void) {
+	char line[LGW_CTL_LINE_SIZE];
+	int i;
+
+	MSG("INFO: waiting for campaigns on %s\n", ctl_path);
+	while ((quit_sig != 1) && (LOAD_ACQUIRE(exit_sig) != 1) && (LOAD_ACQUIRE(rx_error) != 1)) {
+		i = lgw_ctl_wait(&ctl, CTL_WAIT_MS, line, sizeof line);
+		if (i == 1) {
+			control_command(line);
+		} else if (i == LGW_CTL_ERROR) {
+			MSG("ERROR: control socket failed, exiting\n");
+			STORE_RELEASE(exit_sig, 1);
+		}
+	}
 }
 
 /* describe command line options */
@@ -404,6 +480,8 @@ void usage(void) {
 	printf( "Available options:\n");
 	printf( " -h print this help\n");
 	printf( " -r <int> rotate log file every N seconds (-1 disable log rotation)\n");
+	printf( " -c <file> keep a snapshot of the configuration, reused while the JSON files do not change\n");
+	printf( " -d <socket> daemon mode: wait for campaigns to be started on this control socket, -r is not used\n");
 }
 
 /*compare router id and device id */
@@ -572,57 +650,55 @@ void wait_response(){
 		 if (param_response == 0){
 		 clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL);
 		 //construct_start_msg();
-		 lgw_send(join_response);
+		 lgw_send_ptr(&join_response);
 	 }
 	}
 }*/
 
 void test_packet(){
 	int i,j,next_packet_size;
-	sleep(6);
+	test_sleep(6);
 	for(i=1 ; i < 10 ; i ++){
 		next_packet_size = i*5;
 		construct_start_msg(join_response.bandwidth, join_response.coderate,join_response.datarate, 14, next_packet_size);
-		lgw_send(join_response);		
-		sleep(1);
+		schedule_packet();		
+		test_sleep(1);
 		join_response.payload[0] = 1;
  		join_response.size=next_packet_size;	
 		for(j=0 ; j < MSG_PER_SETTING ; j++){
-			sleep(2);
-			lgw_send(join_response);
+			schedule_packet();
 		}	
-		sleep(2);	
+		test_sleep(2);	
 	}
-	sleep(2);
+	test_sleep(2);
 	construct_end_msg();
-	lgw_send(join_response);	
+	schedule_packet();	
 }
 
 
 void test_power(){
 	int i,j,next_power;
-	sleep(2);
+	test_sleep(2);
 	for(i=0 ; i < 8 ; i ++){
 		next_power = 2 + i*2;
 		construct_start_msg(join_response.bandwidth, join_response.coderate,join_response.datarate, next_power, join_response.size);
-		lgw_send(join_response);
-		sleep(1);
+		schedule_packet();
+		test_sleep(1);
 		join_response.rf_power = next_power;
 		for(j=0 ; j < MSG_PER_SETTING; j++){
-			sleep(1);
 			construct_msg();
-			lgw_send(join_response);
+			schedule_packet();
 		}
-		sleep(1);
+		test_sleep(1);
 	}
 	construct_end_msg();
-	lgw_send(join_response);
+	schedule_packet();
 }
 
 
 void test_coderate(){
 	int i,j,next_coderate;
-	sleep(3);
+	test_sleep(3);
 	for(i=0 ; i < 4 ; i ++){
 		switch(i){
 			case 0 : 
@@ -641,24 +717,23 @@ void test_coderate(){
 				break;
 		}
 		construct_start_msg(join_response.bandwidth, next_coderate,join_response.datarate, 14, join_response.size);
-		lgw_send(join_response);
-		sleep(1);
+		schedule_packet();
+		test_sleep(1);
 		join_response.coderate=next_coderate;
 		for(j=0 ; j < MSG_PER_SETTING ; j++){
-			sleep(1);
 			construct_msg();
-			lgw_send(join_response);
+			schedule_packet();
 		}
-		sleep(1);	
+		test_sleep(1);	
 	}
 	construct_end_msg();
-	lgw_send(join_response);
+	schedule_packet();
 }
 
 
 void test_sf(){
 	int i,j,next_datarate;
-	sleep(6);
+	test_sleep(6);
 	for(i=0 ; i < 6 ; i ++){
 		switch(i){
 			case 5 : 
@@ -683,26 +758,25 @@ void test_sf(){
 				break;
 		}
 		construct_start_msg(join_response.bandwidth, join_response.coderate,next_datarate, 14, join_response.size);
-		lgw_send(join_response);
-		sleep(1);
+		schedule_packet();
+		test_sleep(1);
 		join_response.datarate=next_datarate;
 		for(j=0 ; j < MSG_PER_SETTING ; j++){
-			sleep(1);
 			construct_msg();
-			lgw_send(join_response);
+			schedule_packet();
 		}
-		sleep(1);		
+		test_sleep(1);		
 	}
 	construct_end_msg();
-	lgw_send(join_response);
+	schedule_packet();
 }
 
 void test_bandwidth(){
 	
 	int i,j,next_bandwidth;
-	sleep(2);
+	test_sleep(2);
 	for(i=0 ; i < 2 ; i ++){
-		sleep(1);
+		test_sleep(1);
 		switch(i){
 			case 0 : 
 				next_bandwidth=BW_125KHZ;
@@ -714,24 +788,371 @@ void test_bandwidth(){
 				break;
 		}
 		construct_start_msg(next_bandwidth, join_response.coderate,join_response.datarate, 14, join_response.size);
-		lgw_send(join_response);
-		sleep(1);
+		schedule_packet();
+		test_sleep(1);
 		join_response.bandwidth=next_bandwidth;
 		for(j=0 ; j < MSG_PER_SETTING ; j++){
-			sleep(1);
 			construct_msg();
-			lgw_send(join_response);
+			schedule_packet();
 		}	
 	}
 	construct_end_msg();
-	lgw_send(join_response);
+	schedule_packet();
 }
 
 void send_join_response(struct lgw_pkt_rx_s* received) {
 	setParamTx(received);
-	lgw_send(join_response);
-	join_response.tx_mode = IMMEDIATE;
+	pthread_mutex_lock(&mx_concent);
+	lgw_get_instcnt(&test_now);
+	pthread_mutex_unlock(&mx_concent);
+	if (lgw_txq_enqueue(&txq, &join_response, test_now) != LGW_TXQ_SUCCESS) {
+		MSG("WARNING: join response not queued, a test is still running\n");
+		return;
+	}
+	test_time = join_response.count_us + lgw_time_on_air(&join_response);
+	test_gap = 0;
 	UPDATE_TEST();
+	MSG("INFO: %s test scheduled, %d packet(s) queued\n", TEST_STRING, lgw_txq_count(&txq));
+}
+
+/* silence before the next packet of a test */
+void test_sleep(unsigned int s) {
+	test_gap += s * 1000000;
+}
+
+/* queue join_response after the previous packet of the test, the TX queue loads it in the concentrator on time */
+int schedule_packet(void) {
+	int i;
+
+	join_response.tx_mode = TIMESTAMPED;
+	join_response.count_us = test_time + ((test_gap > txq.guard_us) ? test_gap : txq.guard_us);
+	i = lgw_txq_enqueue(&txq, &join_response, test_now);
+	if (i != LGW_TXQ_SUCCESS) {
+		MSG("WARNING: test packet rejected by the TX queue (%d)\n", i);
+	}
+	test_time = join_response.count_us + lgw_time_on_air(&join_response);
+	test_gap = 0;
+	return i;
+}
+
+/* hand the queued packets to the concentrator when their slot is near */
+void run_txq(void) {
+	static struct timespec due; /* when lgw_txq_run must be called again */
+	struct timespec now;
+	uint32_t next_us;
+
+	if (lgw_txq_count(&txq) == 0) {
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if ((now.tv_sec < due.tv_sec) || ((now.tv_sec == due.tv_sec) && (now.tv_nsec < due.tv_nsec))) {
+		return;
+	}
+	pthread_mutex_lock(&mx_concent);
+	if (lgw_txq_run(&txq, &next_us) != LGW_TXQ_SUCCESS) {
+		MSG("WARNING: failed to send a queued packet\n");
+	}
+	pthread_mutex_unlock(&mx_concent);
+	due.tv_sec = now.tv_sec + next_us / 1000000;
+	due.tv_nsec = now.tv_nsec + (next_us % 1000000) * 1000;
+	if (due.tv_nsec >= 1000000000) {
+		due.tv_sec += 1;
+		due.tv_nsec -= 1000000000;
+	}
+}
+
+/* format a whole CSV line, so that it reaches the log file in a single write */
+int format_log_line(char *line, int size, const struct pipe_item_s *item) {
+	const struct lgw_pkt_rx_s *p = &item->pkt;
+	const char *status, *modulation, *bandwidth, *datarate, *coderate;
+	char fsk_datarate[16];
+	struct tm x;
+	int n, j;
+
+	switch(p->status) {
+		case STAT_CRC_OK:	status = "\"CRC_OK\" ,"; break;
+		case STAT_CRC_BAD:	status = "\"CRC_BAD\","; break;
+		case STAT_NO_CRC:	status = "\"NO_CRC\" ,"; break;
+		case STAT_UNDEFINED:status = "\"UNDEF\"  ,"; break;
+		default: status = "\"ERR\"    ,";
+	}
+
+	switch(p->modulation) {
+		case MOD_LORA:	modulation = "\"LORA\","; break;
+		case MOD_FSK:	modulation = "\"FSK\" ,"; break;
+		default: modulation = "\"ERR\" ,";
+	}
+
+	switch(p->bandwidth) {
+		case BW_500KHZ:	bandwidth = "500000,"; break;
+		case BW_250KHZ:	bandwidth = "250000,"; break;
+		case BW_125KHZ:	bandwidth = "125000,"; break;
+		case BW_62K5HZ:	bandwidth = "62500 ,"; break;
+		case BW_31K2HZ:	bandwidth = "31200 ,"; break;
+		case BW_15K6HZ:	bandwidth = "15600 ,"; break;
+		case BW_7K8HZ:	bandwidth = "7800  ,"; break;
+		case BW_UNDEFINED: bandwidth = "0     ,"; break;
+		default: bandwidth = "-1    ,";
+	}
+
+	if (p->modulation == MOD_LORA) {
+		switch (p->datarate) {
+			case DR_LORA_SF7:	datarate = "\"SF7\"   ,"; break;
+			case DR_LORA_SF8:	datarate = "\"SF8\"   ,"; break;
+			case DR_LORA_SF9:	datarate = "\"SF9\"   ,"; break;
+			case DR_LORA_SF10:	datarate = "\"SF10\"  ,"; break;
+			case DR_LORA_SF11:	datarate = "\"SF11\"  ,"; break;
+			case DR_LORA_SF12:	datarate = "\"SF12\"  ,"; break;
+			default: datarate = "\"ERR\"   ,";
+		}
+	} else if (p->modulation == MOD_FSK) {
+		sprintf(fsk_datarate, "\"%6u\",", p->datarate);
+		datarate = fsk_datarate;
+	} else {
+		datarate = "\"ERR\"   ,";
+	}
+
+	switch (p->coderate) {
+		case CR_LORA_4_5:	coderate = "\"4/5\","; break;
+		case CR_LORA_4_6:	coderate = "\"2/3\","; break;
+		case CR_LORA_4_7:	coderate = "\"4/7\","; break;
+		case CR_LORA_4_8:	coderate = "\"1/2\","; break;
+		case CR_UNDEFINED:	coderate = "\"\"   ,"; break;
+		default: coderate = "\"ERR\",";
+	}
+
+	/* gateway ID, node MAC (TODO: need to parse payload), UTC timestamp, internal clock, RX frequency, RF chain, RX modem/IF chain */
+	gmtime_r(&item->utc.tv_sec, &x);
+	n = snprintf(line, size, "\"%08X%08X\",\"\",\"%04i-%02i-%02i %02i:%02i:%02i.%06liZ\",%10u,%10u,%u,%2d,", (uint32_t)(lgwm >> 32), (uint32_t)(lgwm & 0xFFFFFFFF), (x.tm_year)+1900, (x.tm_mon)+1, x.tm_mday, x.tm_hour, x.tm_min, x.tm_sec, (item->utc.tv_nsec)/1000, p->count_us, p->freq_hz, p->rf_chain, p->if_chain);
+
+	/* status, payload size, modulation, bandwidth, datarate, coderate, RSSI, SNR */
+	n += snprintf(line + n, size - n, "%s%3u,%s%s%s%s%+.0f,%+5.1f,", status, p->size, modulation, bandwidth, datarate, coderate, p->rssi, p->snr);
+
+	/* hex-encoded payload (bundled in 32-bit words) */
+	line[n++] = '"';
+	for (j = 0; j < p->size; ++j) {
+		if ((j > 0) && (j%4 == 0)) line[n++] = '-';
+		n += sprintf(line + n, "%02X", p->payload[j]);
+	}
+	line[n++] = '"';
+
+	/* UTC timestamp source */
+	n += snprintf(line + n, size - n, ",\"%s\"\n", item->utc_gps ? "GPS" : "host");
+	return n;
+}
+
+/* UTC time of the packets of a fetch: from their timestamps while the GPS time
+reference is valid, else the host clock; returns true for GPS time */
+bool fetch_utc(const struct lgw_pkt_rx_s *pkt, int nb_pkt, struct timespec *utc) {
+	uint32_t count_us[FETCH_PKT_NB];
+	struct timespec host;
+	struct tref ref;
+	bool valid;
+	int i;
+
+	clock_gettime(CLOCK_REALTIME, &host);
+	pthread_mutex_lock(&mx_timeref); /* only held by the GPS thread for a sync, never for I/O */
+	ref = time_reference_gps;
+	valid = gps_ref_valid;
+	pthread_mutex_unlock(&mx_timeref);
+
+	if (valid && (nb_pkt <= FETCH_PKT_NB) && (difftime(host.tv_sec, ref.systime) <= GPS_REF_MAX_AGE)) {
+		for (i = 0; i < nb_pkt; ++i) {
+			count_us[i] = pkt[i].count_us;
+		}
+		if (lgw_cnt2utc_n(ref, count_us, utc, nb_pkt) == LGW_GPS_SUCCESS) {
+			return true;
+		}
+	}
+	for (i = 0; i < nb_pkt; ++i) {
+		utc[i] = host;
+	}
+	return false;
+}
+
+/* fetch packets into rx_ring, sleep on the concentrator while the FIFO is empty */
+void *thread_rx(void *arg) {
+	struct lgw_pkt_rx_s rxpkt[FETCH_PKT_NB]; /* array containing up to 16 inbound packets metadata */
+	struct timespec utc[FETCH_PKT_NB];
+	struct pipe_item_s item;
+	int i, nb_pkt;
+	uint32_t nb_drop = 0;
+
+	(void)arg;
+	while ((LOAD_ACQUIRE(quit_sig) != 1) && (LOAD_ACQUIRE(exit_sig) != 1)) {
+		if (stats_sig == 1) {
+			stats_sig = 0;
+			print_stats();
+		}
+		pthread_mutex_lock(&mx_concent);
+		nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+		pthread_mutex_unlock(&mx_concent);
+		if (nb_pkt == LGW_HAL_ERROR) {
+			MSG("ERROR: failed packet fetch, exiting\n");
+			STORE_RELEASE(rx_error, 1);
+			break;
+		} else if (nb_pkt == 0) {
+			lgw_rx_wait(RX_WAIT_MS); /* no register access, the processing thread can send meanwhile */
+			continue;
+		}
+
+		item.utc_gps = fetch_utc(rxpkt, nb_pkt, utc);
+		for (i=0; i < nb_pkt; ++i) {
+			item.utc = utc[i];
+			item.pkt = rxpkt[i];
+			lgw_ring_push(&rx_ring, &item);
+		}
+		if (lgw_ring_drops(&rx_ring) != nb_drop) {
+			nb_drop = lgw_ring_drops(&rx_ring);
+			MSG("WARNING: processing thread late, %u packet(s) dropped so far\n", nb_drop);
+		}
+	}
+	return NULL;
+}
+
+/* join responses and tests */
+void *thread_proc(void *arg) {
+	struct pipe_item_s item;
+	float average_snr=0;
+	int packet_counter=0;
+
+	(void)arg;
+	lgw_txq_init(&txq);
+	for (;;) {
+		run_txq();
+		if (lgw_ring_pop(&rx_ring, &item) != LGW_RING_SUCCESS) {
+			if (LOAD_ACQUIRE(proc_stop) == 1) {
+				break;
+			}
+			wait_ms(PIPE_IDLE_MS);
+			continue;
+		}
+		if (LOAD_ACQUIRE(campaign_on) == 0) {
+			continue; /* between two campaigns */
+		}
+
+		lgw_ring_push(&log_ring, &item);
+
+		if (compare_id(&item.pkt)==0) {
+			if(packet_counter!=0){
+				write_results(average_snr,packet_counter,&item.pkt);
+			}
+			send_join_response(&item.pkt);
+			packet_counter=0;
+			average_snr=0;
+		}
+	}
+	return NULL;
+}
+
+/* CSV log, flushed when there is nothing left to write, rotated when idle */
+void *thread_writer(void *arg) {
+	struct campaign_cmd_s cmd;
+	struct pipe_item_s item;
+	char line[LOG_LINE_SIZE];
+	int dirty = 0;
+
+	(void)arg;
+	for (;;) {
+		if (lgw_ring_pop(&cmd_ring, &cmd) == LGW_RING_SUCCESS) {
+			switch_log(&cmd); /* packets still in log_ring go to the next file */
+			dirty = 0; /* flushed by fclose */
+		}
+		if (lgw_ring_pop(&log_ring, &item) == LGW_RING_SUCCESS) {
+			if (log_file != NULL) {
+				fwrite(line, 1, format_log_line(line, sizeof line, &item), log_file);
+				STORE_RELEASE(pkt_in_log, pkt_in_log + 1);
+				dirty = 1;
+			}
+			continue;
+		}
+
+		if (dirty == 1) {
+			fflush(log_file);
+			dirty = 0;
+		}
+		if (LOAD_ACQUIRE(log_stop) == 1) {
+			break;
+		}
+
+		/* check time and rotate log file if necessary */
+		time(&now_time);
+		if ((log_rotate_interval > 0) && (difftime(now_time, log_start_time) > log_rotate_interval)) {
+			fclose(log_file);
+			MSG("INFO: log file %s closed, %lu packet(s) recorded\n", log_file_name, pkt_in_log);
+			STORE_RELEASE(pkt_in_log, 0);
+			if (open_log(NULL) != 0) {
+				exit(EXIT_FAILURE);
+			}
+		}
+		wait_ms(PIPE_IDLE_MS);
+	}
+	return NULL;
+}
+
+/* read the GPS, and synchronize the time reference on the PPS at each RMC sentence */
+void *thread_gps(void *arg) {
+	char serial_buff[128];
+	struct pollfd pfd;
+	struct timespec utc;
+	uint32_t trig_tstamp;
+	uint32_t toggle_tstamp, nb_toggle;
+	uint32_t nb_drop = 0;
+	ssize_t nb_char;
+	bool valid = false;
+	int i, n, used;
+
+	(void)arg;
+	pfd.fd = gps_tty_fd;
+	pfd.events = POLLIN;
+	while (LOAD_ACQUIRE(gps_stop) != 1) {
+		if (poll(&pfd, 1, GPS_POLL_MS) <= 0) {
+			continue;
+		}
+		nb_char = read(gps_tty_fd, serial_buff, sizeof serial_buff);
+		if (nb_char <= 0) {
+			MSG("WARNING: GPS read failed, packets are stamped with the host clock from now on\n");
+			break;
+		}
+
+		/* sentences can be split across reads */
+		for (n = 0; n < nb_char; n += used) {
+			if (lgw_parse_nmea_stream(serial_buff + n, nb_char - n, &used) != NMEA_RMC) {
+				continue;
+			}
+			if (lgw_gps_get(&utc, NULL, NULL) != LGW_GPS_SUCCESS) {
+				continue; /* no fix, the reference holds over until it is too old */
+			}
+			/* timestamp latched on the PPS that started this second, unless a
+			counter read of another thread suspended the capture since */
+			pthread_mutex_lock(&mx_concent);
+			i = lgw_get_trigcnt(&trig_tstamp);
+			if (i == LGW_HAL_SUCCESS) {
+				i = lgw_get_gps_toggle(&nb_toggle, &toggle_tstamp);
+			}
+			pthread_mutex_unlock(&mx_concent);
+			if (i != LGW_HAL_SUCCESS) {
+				continue;
+			}
+			if ((nb_toggle != 0) && ((trig_tstamp - toggle_tstamp) < LGW_GPS_TOGGLE_US)) {
+				if (nb_drop++ == 0) {
+					MSG("INFO: PPS timestamp overwritten by a counter read, sync point dropped (not shown again)\n");
+				}
+				continue;
+			}
+			pthread_mutex_lock(&mx_timeref);
+			if (lgw_gps_sync_fit(&gps_fit, &time_reference_gps, trig_tstamp, utc) == LGW_GPS_SUCCESS) {
+				gps_ref_valid = true;
+			}
+			i = (gps_ref_valid && !valid);
+			valid = gps_ref_valid;
+			pthread_mutex_unlock(&mx_timeref);
+			if (i) {
+				MSG("INFO: GPS time reference synchronized, packets are stamped with GPS time\n");
+			}
+		}
+	}
+	return NULL;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -739,34 +1160,13 @@ void send_join_response(struct lgw_pkt_rx_s* received) {
 
 int main(int argc, char **argv)
 {
-	int i, j; /* loop and temporary variables */
-	struct timespec sleep_time = {0, 3000000}; /* 3 ms */
-	
-	float average_snr=0;
-	int packet_counter=0;
-	
-	/* clock and log rotation management */
-	int log_rotate_interval = 3600; /* by default, rotation every hour */
-	int time_check = 0; /* variable used to limit the number of calls to time() function */
-	unsigned long pkt_in_log = 0; /* count the number of packet written in each log file */
-	
-	/* configuration file related */
-	const char global_conf_fname[] = "global_conf.json"; /* contain global (typ. network-wide) configuration */
-	const char local_conf_fname[] = "local_conf.json"; /* contain node specific configuration, overwrite global parameters for parameters that are defined in both */
-	const char debug_conf_fname[] = "debug_conf.json"; /* if present, all other configuration files are ignored */
+	int i; /* loop and temporary variables */
 	
-	/* allocate memory for packet fetching and processing */
-	struct lgw_pkt_rx_s rxpkt[16]; /* array containing up to 16 inbound packets metadata */
-	struct lgw_pkt_rx_s *p; /* pointer on a RX packet */
-	int nb_pkt;
-	
-	/* local timestamp variables until we get accurate GPS time */
-	struct timespec fetch_time;
-	char fetch_timestamp[30];
-	struct tm * x;
+	/* receive pipeline threads */
+	pthread_t thrid_rx, thrid_proc, thrid_writer, thrid_gps;
 	
 	/* parse command line options */
-	while ((i = getopt (argc, argv, "hr:")) != -1) {
+	while ((i = getopt (argc, argv, "hr:c:d:")) != -1) {
 		switch (i) {
 			case 'h':
 				usage();
@@ -781,6 +1181,14 @@ int main(int argc, char **argv)
 				}
 				break;
 			
+			case 'c':
+				conf_snapshot = optarg;
+				break;
+			
+			case 'd':
+				ctl_path = optarg;
+				break;
+			
 			default:
 				MSG("ERROR: argument parsing use -h option for help\n");
 				usage();
@@ -795,34 +1203,22 @@ int main(int argc, char **argv)
 	sigaction(SIGQUIT, &sigact, NULL);
 	sigaction(SIGINT, &sigact, NULL);
 	sigaction(SIGTERM, &sigact, NULL);
+	sigaction(SIGUSR1, &sigact, NULL);
 	
-	/* configuration files management */
-	if (access(debug_conf_fname, R_OK) == 0) {
-	/* if there is a debug conf, parse only the debug conf */
-		MSG("INFO: found debug configuration file %s, other configuration files will be ignored\n", debug_conf_fname);
-		parse_SX1301_configuration(debug_conf_fname);
-		parse_gateway_configuration(debug_conf_fname);
-	} else if (access(global_conf_fname, R_OK) == 0) {
-	/* if there is a global conf, parse it and then try to parse local conf  */
-		MSG("INFO: found global configuration file %s, trying to parse it\n", global_conf_fname);
-		parse_SX1301_configuration(global_conf_fname);
-		parse_gateway_configuration(global_conf_fname);
-		if (access(local_conf_fname, R_OK) == 0) {
-			MSG("INFO: found local configuration file %s, trying to parse it\n", local_conf_fname);
-			parse_SX1301_configuration(local_conf_fname);
-			parse_gateway_configuration(local_conf_fname);
-		}
-	} else if (access(local_conf_fname, R_OK) == 0) {
-	/* if there is only a local conf, parse it and that's all */
-		MSG("INFO: found local configuration file %s, trying to parse it\n", local_conf_fname);
-		parse_SX1301_configuration(local_conf_fname);
-		parse_gateway_configuration(local_conf_fname);
-	} else {
-		MSG("ERROR: failed to find any configuration file named %s, %s or %s\n", global_conf_fname, local_conf_fname, debug_conf_fname);
+	configure_gateway();
+	
+	/* control socket (optional), before the concentrator is started */
+	if ((ctl_path != NULL) && (lgw_ctl_open(&ctl, ctl_path) != LGW_CTL_SUCCESS)) {
+		MSG("ERROR: impossible to create control socket %s\n", ctl_path);
 		return EXIT_FAILURE;
 	}
 	
 	/* starting the concentrator */
+	configure_calibration();
+	configure_spi();
+	if (configure_trace() != 0) {
+		return EXIT_FAILURE;
+	}
 	i = lgw_start();
 	if (i == LGW_HAL_SUCCESS) {
 		MSG("INFO: concentrator started, packet can now be received\n");
@@ -834,156 +1230,74 @@ int main(int argc, char **argv)
 	/* transform the MAC address into a string */
 	sprintf(lgwm_str, "%08X%08X", (uint32_t)(lgwm >> 32), (uint32_t)(lgwm & 0xFFFFFFFF));
 	
-	/* opening log file and writing CSV header*/
-	time(&now_time);
-	open_log();
-	
-	/* main loop */
-	while ((quit_sig != 1) && (exit_sig != 1)) {
-		/* fetch packets */
-		nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
-		if (nb_pkt == LGW_HAL_ERROR) {
-			MSG("ERROR: failed packet fetch, exiting\n");
+	/* opening log file and writing CSV header, in daemon mode when a campaign is started */
+	if (ctl_path == NULL) {
+		time(&now_time);
+		if (open_log(NULL) != 0) {
 			return EXIT_FAILURE;
-		} else if (nb_pkt == 0) {
-			clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-		} else {			
-			/* local timestamp generation until we get accurate GPS time */
-			clock_gettime(CLOCK_REALTIME, &fetch_time);
-			x = gmtime(&(fetch_time.tv_sec));
-			sprintf(fetch_timestamp,"%04i-%02i-%02i %02i:%02i:%02i.%03liZ",(x->tm_year)+1900,(x->tm_mon)+1,x->tm_mday,x->tm_hour,x->tm_min,x->tm_sec,(fetch_time.tv_nsec)/1000000); /* ISO 8601 format */
-		}
-		
-		/* log packets */
-		
-		for (i=0; i < nb_pkt; ++i) {
-			p = &rxpkt[i];
-			
-			if (compare_id(p)==0) {
-				if(packet_counter!=0){
-					write_results(average_snr,packet_counter,p);
-				}
-				send_join_response(p);
-				packet_counter=0;
-				average_snr=0;
-			}
-		
-			/* writing gateway ID */
-			fprintf(log_file, "\"%08X%08X\",", (uint32_t)(lgwm >> 32), (uint32_t)(lgwm & 0xFFFFFFFF));
-			
-			/* writing node MAC address */
-			fputs("\"\",", log_file); // TODO: need to parse payload
-			
-			/* writing UTC timestamp*/
-			fprintf(log_file, "\"%s\",", fetch_timestamp);
-			// TODO: replace with GPS time when available
-			
-			/* writing internal clock */
-			fprintf(log_file, "%10u,", p->count_us);
-			
-			/* writing RX frequency */
-			fprintf(log_file, "%10u,", p->freq_hz);
-			
-			/* writing RF chain */
-			fprintf(log_file, "%u,", p->rf_chain);
-			
-			/* writing RX modem/IF chain */
-			fprintf(log_file, "%2d,", p->if_chain);
-			
-			/* writing status */
-			switch(p->status) {
-				case STAT_CRC_OK:	fputs("\"CRC_OK\" ,", log_file); break;
-				case STAT_CRC_BAD:	fputs("\"CRC_BAD\",", log_file); break;
-				case STAT_NO_CRC:	fputs("\"NO_CRC\" ,", log_file); break;
-				case STAT_UNDEFINED:fputs("\"UNDEF\"  ,", log_file); break;
-				default: fputs("\"ERR\"    ,", log_file);
-			}
-			
-			/* writing payload size */
-			fprintf(log_file, "%3u,", p->size);
-			
-			/* writing modulation */
-			switch(p->modulation) {
-				case MOD_LORA:	fputs("\"LORA\",", log_file); break;
-				case MOD_FSK:	fputs("\"FSK\" ,", log_file); break;
-				default: fputs("\"ERR\" ,", log_file);
-			}
-			
-			/* writing bandwidth */
-			switch(p->bandwidth) {
-				case BW_500KHZ:	fputs("500000,", log_file); break;
-				case BW_250KHZ:	fputs("250000,", log_file); break;
-				case BW_125KHZ:	fputs("125000,", log_file); break;
-				case BW_62K5HZ:	fputs("62500 ,", log_file); break;
-				case BW_31K2HZ:	fputs("31200 ,", log_file); break;
-				case BW_15K6HZ:	fputs("15600 ,", log_file); break;
-				case BW_7K8HZ:	fputs("7800  ,", log_file); break;
-				case BW_UNDEFINED: fputs("0     ,", log_file); break;
-				default: fputs("-1    ,", log_file);
-			}
-			
-			/* writing datarate */
-			if (p->modulation == MOD_LORA) {
-				switch (p->datarate) {
-					case DR_LORA_SF7:	fputs("\"SF7\"   ,", log_file); break;
-					case DR_LORA_SF8:	fputs("\"SF8\"   ,", log_file); break;
-					case DR_LORA_SF9:	fputs("\"SF9\"   ,", log_file); break;
-					case DR_LORA_SF10:	fputs("\"SF10\"  ,", log_file); break;
-					case DR_LORA_SF11:	fputs("\"SF11\"  ,", log_file); break;
-					case DR_LORA_SF12:	fputs("\"SF12\"  ,", log_file); break;
-					default: fputs("\"ERR\"   ,", log_file);
-				}
-			} else if (p->modulation == MOD_FSK) {
-				fprintf(log_file, "\"%6u\",", p->datarate);
-			} else {
-				fputs("\"ERR\"   ,", log_file);
-			}
-			
-			/* writing coderate */
-			switch (p->coderate) {
-				case CR_LORA_4_5:	fputs("\"4/5\",", log_file); break;
-				case CR_LORA_4_6:	fputs("\"2/3\",", log_file); break;
-				case CR_LORA_4_7:	fputs("\"4/7\",", log_file); break;
-				case CR_LORA_4_8:	fputs("\"1/2\",", log_file); break;
-				case CR_UNDEFINED:	fputs("\"\"   ,", log_file); break;
-				default: fputs("\"ERR\",", log_file);
-			}
-
-		
-			
-			/* writing packet RSSI */
-			fprintf(log_file, "%+.0f,", p->rssi);
-			
-			/* writing packet average SNR */
-			fprintf(log_file, "%+5.1f,", p->snr);
-			
-			/* writing hex-encoded payload (bundled in 32-bit words) */
-			fputs("\"", log_file);
-			for (j = 0; j < p->size; ++j) {
-				if ((j > 0) && (j%4 == 0)) fputs("-", log_file);
-				fprintf(log_file, "%02X", p->payload[j]);
-			}
-			
-			/* end of log file line */
-			fputs("\"\n", log_file);
-			fflush(log_file);
-			++pkt_in_log;
 		}
-		
-		/* check time and rotate log file if necessary */
-		++time_check;
-		if (time_check >= 8) {
-			time_check = 0;
-			time(&now_time);
-			if (difftime(now_time, log_start_time) > log_rotate_interval) {
-				fclose(log_file);
-				MSG("INFO: log file %s closed, %lu packet(s) recorded\n", log_file_name, pkt_in_log);
-				pkt_in_log = 0;
-				open_log();
+	} else {
+		campaign_on = 0;
+		log_rotate_interval = -1;
+	}
+	
+	/* allocate the rings between the threads */
+	if ((lgw_ring_init(&rx_ring, sizeof(struct pipe_item_s), PIPE_RING_NB) != LGW_RING_SUCCESS) || (lgw_ring_init(&log_ring, sizeof(struct pipe_item_s), PIPE_RING_NB) != LGW_RING_SUCCESS) || (lgw_ring_init(&cmd_ring, sizeof(struct campaign_cmd_s), CMD_RING_NB) != LGW_RING_SUCCESS)) {
+		MSG("ERROR: failed to allocate the receive pipeline\n");
+		return EXIT_FAILURE;
+	}
+	
+	/* GPS (optional), packets are stamped with the host clock until its time reference is valid */
+	if (gw_conf.gps_tty_path[0] != '\0') {
+		lgw_gps_fit_init(&gps_fit);
+		if (lgw_gps_enable(gw_conf.gps_tty_path, NULL, 0, &gps_tty_fd) != LGW_GPS_SUCCESS) {
+			MSG("WARNING: impossible to open GPS serial port %s, packets are stamped with the host clock\n", gw_conf.gps_tty_path);
+			if (gps_tty_fd > 0) {
+				close(gps_tty_fd);
 			}
+			gps_tty_fd = -1;
+		} else if (pthread_create(&thrid_gps, NULL, thread_gps, NULL) != 0) {
+			MSG("ERROR: impossible to create the GPS thread\n");
+			return EXIT_FAILURE;
 		}
 	}
 	
+	/* spawn the threads, the consumers first */
+	if ((pthread_create(&thrid_writer, NULL, thread_writer, NULL) != 0) || (pthread_create(&thrid_proc, NULL, thread_proc, NULL) != 0) || (pthread_create(&thrid_rx, NULL, thread_rx, NULL) != 0)) {
+		MSG("ERROR: impossible to create the receive pipeline threads\n");
+		return EXIT_FAILURE;
+	}
+	
+	/* the RX thread runs until a signal is received (or a quit command in daemon
+	mode) or a fetch fails, then each thread empties its input ring before
+	exiting */
+	if (ctl_path != NULL) {
+		run_control();
+	}
+	pthread_join(thrid_rx, NULL);
+	if (gps_tty_fd >= 0) {
+		STORE_RELEASE(gps_stop, 1);
+		pthread_join(thrid_gps, NULL);
+	}
+	STORE_RELEASE(proc_stop, 1);
+	pthread_join(thrid_proc, NULL);
+	STORE_RELEASE(log_stop, 1);
+	pthread_join(thrid_writer, NULL);
+	if (lgw_ring_drops(&rx_ring) + lgw_ring_drops(&log_ring) > 0) {
+		MSG("WARNING: %u packet(s) dropped in the receive pipeline\n", lgw_ring_drops(&rx_ring) + lgw_ring_drops(&log_ring));
+	}
+	lgw_ring_free(&rx_ring);
+	lgw_ring_free(&log_ring);
+	lgw_ring_free(&cmd_ring);
+	if (ctl_path != NULL) {
+		lgw_ctl_close(&ctl);
+	}
+	if (rx_error == 1) {
+		print_stats();
+		finish_trace(); /* also the normal end of a replay */
+		return EXIT_FAILURE;
+	}
+	
 	if (exit_sig == 1) {
 		/* clean up before leaving */
 		i = lgw_stop();
@@ -992,10 +1306,17 @@ int main(int argc, char **argv)
 		} else {
 			MSG("WARNING: failed to stop concentrator successfully\n");
 		}
-		fclose(log_file);
-		MSG("INFO: log file %s closed, %lu packet(s) recorded\n", log_file_name, pkt_in_log);
+		if (log_file != NULL) {
+			fclose(log_file);
+			MSG("INFO: log file %s closed, %lu packet(s) recorded\n", log_file_name, pkt_in_log);
+		}
 	}
 	
+	print_stats();
+	finish_trace();
+	if (gps_tty_fd >= 0) {
+		close(gps_tty_fd);
+	}
 	MSG("INFO: Exiting packet logger program\n");
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,720 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Gateway configuration: single parse of the JSON files, checks and snapshot
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* fprintf fopen fread fwrite rename */
+#include <string.h>		/* memset memcmp strlen strncmp */
+#include <time.h>		/* clock_gettime */
+#include <unistd.h>		/* access */
+
+#include "parson.h"
+#include "gw_conf.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define MSG(args...)	fprintf(stderr, "gw_conf: " args) /* message that is destined to the user */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define IF_CHAIN_LORA_STD	8	/* IF chain of "chan_Lora_std" */
+#define IF_CHAIN_FSK		9	/* IF chain of "chan_FSK" */
+
+#define SNAPSHOT_VERSION	1	/* format of the snapshot file */
+#define FNV_OFFSET		0xCBF29CE484222325ULL	/* FNV-1a 64-bit hash */
+#define FNV_PRIME		0x00000100000001B3ULL
+
+static const char debug_conf_fname[] = "debug_conf.json"; /* if present, all other configuration files are ignored */
+static const char global_conf_fname[] = "global_conf.json"; /* global (typ. network-wide) configuration */
+static const char local_conf_fname[] = "local_conf.json"; /* node specific configuration, overrides the global parameters */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* header of the snapshot file, followed by the struct gw_conf_s */
+struct snapshot_hdr_s {
+	char		magic[4];	/* "GWCF" */
+	uint32_t	version;	/* SNAPSHOT_VERSION */
+	uint32_t	conf_size;	/* sizeof(struct gw_conf_s) of the program that wrote it */
+	uint32_t	reserved;
+	uint64_t	key;		/* hash of the names and contents of the JSON files */
+	uint64_t	check;		/* hash of the configuration that follows */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+uint64_t fnv_add(uint64_t h, const void *data, size_t size);
+
+int conf_files(const char **files);
+
+uint64_t conf_key(const char **files, int nb);
+
+int snapshot_load(struct gw_conf_s *conf, const char *snapshot, uint64_t key);
+
+int snapshot_save(const struct gw_conf_s *conf, const char *snapshot, uint64_t key);
+
+void if_name(int if_chain, char *name, size_t size);
+
+const char *bw_str(uint8_t bandwidth);
+
+const char *sf_str(uint32_t datarate);
+
+int get_hex(const JSON_Object *obj, const char *name, uint64_t *v);
+
+int get_path(const JSON_Object *obj, const char *name, char *path, size_t size);
+
+int parse_sx1301(struct gw_conf_s *conf, const JSON_Object *sx, const char *conf_file);
+
+int parse_radio(struct lgw_conf_rxrf_s *rf, const JSON_Object *obj, const char *conf_file, const char *name);
+
+int parse_chan(struct lgw_conf_rxif_s *ifc, int if_chain, const JSON_Object *obj, const char *conf_file, const char *name);
+
+int parse_gateway(struct gw_conf_s *conf, const JSON_Object *gw, const char *conf_file);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+uint64_t fnv_add(uint64_t h, const void *data, size_t size) {
+	const uint8_t *b = data;
+	size_t i;
+
+	for (i = 0; i < size; ++i) {
+		h = (h ^ b[i]) * FNV_PRIME;
+	}
+	return h;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* configuration files to read, in order, the last one overrides the others */
+int conf_files(const char **files) {
+	int nb = 0;
+
+	if (access(debug_conf_fname, R_OK) == 0) {
+		MSG("INFO: found debug configuration file %s, other configuration files will be ignored\n", debug_conf_fname);
+		files[0] = debug_conf_fname;
+		return 1;
+	}
+	if (access(global_conf_fname, R_OK) == 0) {
+		files[nb++] = global_conf_fname;
+	}
+	if (access(local_conf_fname, R_OK) == 0) {
+		files[nb++] = local_conf_fname;
+	}
+	return nb;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* hash of the names and contents of the files, 0 if one cannot be read */
+uint64_t conf_key(const char **files, int nb) {
+	uint8_t buf[4096];
+	uint64_t h = FNV_OFFSET;
+	size_t n;
+	FILE *f;
+	int i;
+
+	for (i = 0; i < nb; ++i) {
+		h = fnv_add(h, files[i], strlen(files[i]) + 1);
+		f = fopen(files[i], "rb");
+		if (f == NULL) {
+			return 0;
+		}
+		while ((n = fread(buf, 1, sizeof buf, f)) > 0) {
+			h = fnv_add(h, buf, n);
+		}
+		fclose(f);
+	}
+	return h;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int snapshot_load(struct gw_conf_s *conf, const char *snapshot, uint64_t key) {
+	struct snapshot_hdr_s hdr;
+	size_t n;
+	FILE *f;
+
+	f = fopen(snapshot, "rb");
+	if (f == NULL) {
+		return GW_CONF_ERROR;
+	}
+	n = fread(&hdr, sizeof hdr, 1, f);
+	n += fread(conf, sizeof *conf, 1, f);
+	fclose(f);
+	if ((n != 2) || (memcmp(hdr.magic, "GWCF", 4) != 0) || (hdr.version != SNAPSHOT_VERSION) || (hdr.conf_size != sizeof *conf)) {
+		MSG("WARNING: %s is not a configuration snapshot of this program, ignored\n", snapshot);
+		return GW_CONF_ERROR;
+	}
+	if (hdr.key != key) {
+		MSG("INFO: configuration files changed since %s was written\n", snapshot);
+		return GW_CONF_ERROR;
+	}
+	if (hdr.check != fnv_add(FNV_OFFSET, conf, sizeof *conf)) {
+		MSG("WARNING: configuration snapshot %s is corrupted, ignored\n", snapshot);
+		return GW_CONF_ERROR;
+	}
+	return GW_CONF_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* write the snapshot through a temporary file so that a crash never leaves a partial one */
+int snapshot_save(const struct gw_conf_s *conf, const char *snapshot, uint64_t key) {
+	char tmp_file[GW_CONF_PATH_SIZE + 4];
+	struct snapshot_hdr_s hdr;
+	FILE *f;
+	int err = 0;
+
+	if (strlen(snapshot) >= GW_CONF_PATH_SIZE) {
+		MSG("WARNING: configuration snapshot path %s is too long\n", snapshot);
+		return GW_CONF_ERROR;
+	}
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, "GWCF", 4);
+	hdr.version = SNAPSHOT_VERSION;
+	hdr.conf_size = sizeof *conf;
+	hdr.key = key;
+	hdr.check = fnv_add(FNV_OFFSET, conf, sizeof *conf);
+
+	snprintf(tmp_file, sizeof tmp_file, "%s.tmp", snapshot);
+	f = fopen(tmp_file, "wb");
+	if (f == NULL) {
+		MSG("WARNING: failed to create configuration snapshot %s\n", tmp_file);
+		return GW_CONF_ERROR;
+	}
+	if ((fwrite(&hdr, sizeof hdr, 1, f) != 1) || (fwrite(conf, sizeof *conf, 1, f) != 1)) {
+		err = 1;
+	}
+	err |= fclose(f);
+	if ((err != 0) || (rename(tmp_file, snapshot) != 0)) {
+		MSG("WARNING: failed to write configuration snapshot %s\n", snapshot);
+		remove(tmp_file);
+		return GW_CONF_ERROR;
+	}
+	return GW_CONF_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* name of the JSON object of an IF chain */
+void if_name(int if_chain, char *name, size_t size) {
+	if (if_chain == IF_CHAIN_LORA_STD) {
+		snprintf(name, size, "chan_Lora_std");
+	} else if (if_chain == IF_CHAIN_FSK) {
+		snprintf(name, size, "chan_FSK");
+	} else {
+		snprintf(name, size, "chan_multiSF_%i", if_chain);
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+const char *bw_str(uint8_t bandwidth) {
+	switch (bandwidth) {
+		case BW_500KHZ: return "500 kHz";
+		case BW_250KHZ: return "250 kHz";
+		case BW_125KHZ: return "125 kHz";
+		case BW_62K5HZ: return "62.5 kHz";
+		case BW_31K2HZ: return "31.2 kHz";
+		case BW_15K6HZ: return "15.6 kHz";
+		case BW_7K8HZ: return "7.8 kHz";
+		default: return "default";
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+const char *sf_str(uint32_t datarate) {
+	switch (datarate) {
+		case DR_LORA_SF7: return "7";
+		case DR_LORA_SF8: return "8";
+		case DR_LORA_SF9: return "9";
+		case DR_LORA_SF10: return "10";
+		case DR_LORA_SF11: return "11";
+		case DR_LORA_SF12: return "12";
+		default: return "default";
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* hexadecimal string entry: 1 if read, 0 if absent, -1 if invalid */
+int get_hex(const JSON_Object *obj, const char *name, uint64_t *v) {
+	const char *str;
+	unsigned long long ull;
+
+	str = json_object_get_string(obj, name);
+	if (str == NULL) {
+		return (json_object_get_value(obj, name) == NULL) ? 0 : -1;
+	}
+	if (sscanf(str, "%llx", &ull) != 1) {
+		return -1;
+	}
+	*v = ull;
+	return 1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* file path entry: 1 if read, 0 if absent, -1 if not a string or too long */
+int get_path(const JSON_Object *obj, const char *name, char *path, size_t size) {
+	const char *str;
+
+	str = json_object_get_string(obj, name);
+	if (str == NULL) {
+		return (json_object_get_value(obj, name) == NULL) ? 0 : -1;
+	}
+	if (strlen(str) >= size) {
+		return -1;
+	}
+	strcpy(path, str);
+	return 1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int parse_sx1301(struct gw_conf_s *conf, const JSON_Object *sx, const char *conf_file) {
+	char name[32];
+	const JSON_Object *obj;
+	const JSON_Value *val;
+	int i;
+	int err = 0;
+
+	/* board */
+	val = json_object_get_value(sx, "lorawan_public");
+	if (json_value_get_type(val) == JSONBoolean) {
+		conf->board.lorawan_public = (bool)json_value_get_boolean(val);
+	} else if (val != NULL) {
+		MSG("ERROR: lorawan_public of %s is not a boolean\n", conf_file);
+		err = 1;
+	}
+	val = json_object_get_value(sx, "clksrc");
+	if (json_value_get_type(val) == JSONNumber) {
+		conf->board.clksrc = (uint8_t)json_value_get_number(val);
+	} else if (val != NULL) {
+		MSG("ERROR: clksrc of %s is not a number\n", conf_file);
+		err = 1;
+	}
+
+	/* each radio or channel object found replaces the previous one */
+	for (i = 0; i < LGW_RF_CHAIN_NB; ++i) {
+		snprintf(name, sizeof name, "radio_%i", i);
+		obj = json_object_get_object(sx, name);
+		if ((obj != NULL) && (parse_radio(&conf->rxrf[i], obj, conf_file, name) != GW_CONF_SUCCESS)) {
+			err = 1;
+		}
+	}
+	for (i = 0; i < LGW_IF_CHAIN_NB; ++i) {
+		if_name(i, name, sizeof name);
+		obj = json_object_get_object(sx, name);
+		if ((obj != NULL) && (parse_chan(&conf->rxif[i], i, obj, conf_file, name) != GW_CONF_SUCCESS)) {
+			err = 1;
+		}
+	}
+	return (err == 0) ? GW_CONF_SUCCESS : GW_CONF_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int parse_radio(struct lgw_conf_rxrf_s *rf, const JSON_Object *obj, const char *conf_file, const char *name) {
+	const char *str;
+
+	memset(rf, 0, sizeof *rf);
+	rf->enable = (json_object_get_boolean(obj, "enable") == 1);
+	if (rf->enable == false) { /* radio disabled, nothing else to parse */
+		return GW_CONF_SUCCESS;
+	}
+	rf->freq_hz = (uint32_t)json_object_get_number(obj, "freq");
+	rf->rssi_offset = (float)json_object_get_number(obj, "rssi_offset");
+	rf->tx_enable = (json_object_get_boolean(obj, "tx_enable") == 1);
+	str = json_object_get_string(obj, "type");
+	if ((str != NULL) && !strncmp(str, "SX1255", 6)) {
+		rf->type = LGW_RADIO_TYPE_SX1255;
+	} else if ((str != NULL) && !strncmp(str, "SX1257", 6)) {
+		rf->type = LGW_RADIO_TYPE_SX1257;
+	} else {
+		MSG("ERROR: invalid type for %s of %s: %s (should be SX1255 or SX1257)\n", name, conf_file, (str != NULL) ? str : "none");
+		return GW_CONF_ERROR;
+	}
+	return GW_CONF_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int parse_chan(struct lgw_conf_rxif_s *ifc, int if_chain, const JSON_Object *obj, const char *conf_file, const char *name) {
+	uint32_t bw, sf;
+
+	memset(ifc, 0, sizeof *ifc);
+	ifc->enable = (json_object_get_boolean(obj, "enable") == 1);
+	if (ifc->enable == false) { /* channel disabled, nothing else to parse */
+		return GW_CONF_SUCCESS;
+	}
+	ifc->rf_chain = (uint8_t)json_object_get_number(obj, "radio");
+	ifc->freq_hz = (int32_t)json_object_get_number(obj, "if");
+	bw = (uint32_t)json_object_get_number(obj, "bandwidth"); /* 0 if absent, HAL default */
+
+	if (if_chain == IF_CHAIN_LORA_STD) {
+		switch (bw) {
+			case 0: ifc->bandwidth = BW_UNDEFINED; break;
+			case 500000: ifc->bandwidth = BW_500KHZ; break;
+			case 250000: ifc->bandwidth = BW_250KHZ; break;
+			case 125000: ifc->bandwidth = BW_125KHZ; break;
+			default:
+				MSG("ERROR: invalid bandwidth for %s of %s: %u Hz (should be 125000, 250000 or 500000)\n", name, conf_file, bw);
+				return GW_CONF_ERROR;
+		}
+		sf = (uint32_t)json_object_get_number(obj, "spread_factor");
+		switch (sf) {
+			case  0: ifc->datarate = DR_UNDEFINED; break;
+			case  7: ifc->datarate = DR_LORA_SF7;  break;
+			case  8: ifc->datarate = DR_LORA_SF8;  break;
+			case  9: ifc->datarate = DR_LORA_SF9;  break;
+			case 10: ifc->datarate = DR_LORA_SF10; break;
+			case 11: ifc->datarate = DR_LORA_SF11; break;
+			case 12: ifc->datarate = DR_LORA_SF12; break;
+			default:
+				MSG("ERROR: invalid spread_factor for %s of %s: %u (should be 7 to 12)\n", name, conf_file, sf);
+				return GW_CONF_ERROR;
+		}
+	} else if (if_chain == IF_CHAIN_FSK) {
+		if      (bw == 0)      ifc->bandwidth = BW_UNDEFINED;
+		else if (bw <= 7800)   ifc->bandwidth = BW_7K8HZ;
+		else if (bw <= 15600)  ifc->bandwidth = BW_15K6HZ;
+		else if (bw <= 31200)  ifc->bandwidth = BW_31K2HZ;
+		else if (bw <= 62500)  ifc->bandwidth = BW_62K5HZ;
+		else if (bw <= 125000) ifc->bandwidth = BW_125KHZ;
+		else if (bw <= 250000) ifc->bandwidth = BW_250KHZ;
+		else if (bw <= 500000) ifc->bandwidth = BW_500KHZ;
+		else {
+			MSG("ERROR: invalid bandwidth for %s of %s: %u Hz (500 kHz at most)\n", name, conf_file, bw);
+			return GW_CONF_ERROR;
+		}
+		ifc->datarate = (uint32_t)json_object_get_number(obj, "datarate");
+	}
+	/* TODO: handle individual SF enabling and disabling (spread_factor) of the multi-SF channels */
+	return GW_CONF_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int parse_gateway(struct gw_conf_s *conf, const JSON_Object *gw, const char *conf_file) {
+	const JSON_Value *val;
+	const JSON_Array *arr;
+	unsigned long long eui;
+	int i, j;
+	int err = 0;
+
+	/* getting network parameters (only those necessary for the packet logger) */
+	if (get_hex(gw, "gateway_ID", &conf->gateway_id) < 0) {
+		MSG("ERROR: gateway_ID of %s is not a hexadecimal string\n", conf_file);
+		err = 1;
+	}
+
+	/* calibration cache, SPI settings and trace, GPS, raw capture (all optional) */
+	if (get_path(gw, "calibration_cache", conf->cal_cache_file, sizeof conf->cal_cache_file) < 0) {
+		MSG("ERROR: calibration_cache of %s is not a path or is too long\n", conf_file);
+		err = 1;
+	}
+	val = json_object_get_value(gw, "spi_speed");
+	if (json_value_get_type(val) == JSONNumber) {
+		conf->spi.speed_hz = (uint32_t)json_value_get_number(val);
+	}
+	val = json_object_get_value(gw, "spi_chunk_size");
+	if (json_value_get_type(val) == JSONNumber) {
+		conf->spi.chunk_size = (uint16_t)json_value_get_number(val);
+	}
+	switch (get_path(gw, "spi_trace_record", conf->spi_trace_file, sizeof conf->spi_trace_file)) {
+		case 1: conf->spi_trace_replay = false; break;
+		case -1: MSG("ERROR: spi_trace_record of %s is not a path or is too long\n", conf_file); err = 1; break;
+	}
+	switch (get_path(gw, "spi_trace_replay", conf->spi_trace_file, sizeof conf->spi_trace_file)) {
+		case 1: conf->spi_trace_replay = true; break;
+		case -1: MSG("ERROR: spi_trace_replay of %s is not a path or is too long\n", conf_file); err = 1; break;
+	}
+	if (get_path(gw, "gps_tty_path", conf->gps_tty_path, sizeof conf->gps_tty_path) < 0) {
+		MSG("ERROR: gps_tty_path of %s is not a path or is too long\n", conf_file);
+		err = 1;
+	}
+	if (get_path(gw, "capture_file", conf->capture_file, sizeof conf->capture_file) < 0) {
+		MSG("ERROR: capture_file of %s is not a path or is too long\n", conf_file);
+		err = 1;
+	}
+	val = json_object_get_value(gw, "capture_size");
+	if (json_value_get_type(val) == JSONNumber) {
+		conf->capture_nb = (uint32_t)json_value_get_number(val);
+	}
+
+	/* test network and devices (optional), replace the ones of a previous file */
+	if (get_hex(gw, "router_ID", &conf->router_id) < 0) {
+		MSG("ERROR: router_ID of %s is not a hexadecimal string\n", conf_file);
+		err = 1;
+	}
+	arr = json_object_get_array(gw, "devices");
+	if (arr != NULL) {
+		conf->dev_nb = 0;
+		for (i = 0; i < (int)json_array_get_count(arr); ++i) {
+			val = json_array_get_value(arr, i);
+			if ((json_value_get_type(val) != JSONString) || (sscanf(json_value_get_string(val), "%llx", &eui) != 1)) {
+				MSG("WARNING: device %d of %s is not a hexadecimal DevEUI, ignored\n", i, conf_file);
+				continue;
+			}
+			if (conf->dev_nb >= GW_CONF_DEV_MAX) {
+				MSG("WARNING: more than %d devices in %s, the next ones are ignored\n", GW_CONF_DEV_MAX, conf_file);
+				break;
+			}
+			for (j = 0; (j < conf->dev_nb) && (conf->dev_eui[j] != eui); ++j);
+			if (j < conf->dev_nb) {
+				MSG("WARNING: device %016llX listed twice in %s\n", eui, conf_file);
+				continue;
+			}
+			conf->dev_eui[conf->dev_nb++] = eui;
+		}
+	}
+	return (err == 0) ? GW_CONF_SUCCESS : GW_CONF_ERROR;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void gw_conf_init(struct gw_conf_s *conf) {
+	memset(conf, 0, sizeof *conf); /* also the padding, the snapshot is hashed as is */
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int gw_conf_parse(struct gw_conf_s *conf, const char *conf_file) {
+	JSON_Value *root_val;
+	const JSON_Object *root;
+	const JSON_Object *sx;
+	const JSON_Object *gw;
+	int err = 0;
+
+	/* one parse for both objects */
+	root_val = json_parse_file_with_comments(conf_file);
+	root = json_value_get_object(root_val);
+	if (root == NULL) {
+		MSG("ERROR: %s is not a valid JSON file\n", conf_file);
+		if (root_val != NULL) {
+			json_value_free(root_val);
+		}
+		return GW_CONF_ERROR;
+	}
+	sx = json_object_get_object(root, "SX1301_conf");
+	gw = json_object_get_object(root, "gateway_conf");
+	if ((sx == NULL) && (gw == NULL)) {
+		MSG("WARNING: %s contains neither SX1301_conf nor gateway_conf\n", conf_file);
+	}
+	if ((sx != NULL) && (parse_sx1301(conf, sx, conf_file) != GW_CONF_SUCCESS)) {
+		err = 1;
+	}
+	if ((gw != NULL) && (parse_gateway(conf, gw, conf_file) != GW_CONF_SUCCESS)) {
+		err = 1;
+	}
+	json_value_free(root_val);
+	return (err == 0) ? GW_CONF_SUCCESS : GW_CONF_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int gw_conf_check(const struct gw_conf_s *conf) {
+	const struct lgw_conf_rxif_s *ifc;
+	char name[32];
+	int i;
+	int err = 0;
+
+	if (conf->gateway_id == 0) {
+		MSG("ERROR: no gateway_ID in gateway_conf\n");
+		err = 1;
+	}
+	if (conf->board.clksrc >= LGW_RF_CHAIN_NB) {
+		MSG("ERROR: clksrc %u is not a radio\n", conf->board.clksrc);
+		err = 1;
+	}
+	for (i = 0; i < LGW_RF_CHAIN_NB; ++i) {
+		if (conf->rxrf[i].enable && (conf->rxrf[i].freq_hz == 0)) {
+			MSG("ERROR: radio_%i is enabled without freq\n", i);
+			err = 1;
+		}
+	}
+	for (i = 0; i < LGW_IF_CHAIN_NB; ++i) {
+		ifc = &conf->rxif[i];
+		if (ifc->enable == false) {
+			continue;
+		}
+		if ((ifc->rf_chain >= LGW_RF_CHAIN_NB) || (conf->rxrf[ifc->rf_chain].enable == false)) {
+			if_name(i, name, sizeof name);
+			MSG("ERROR: %s is enabled on radio %u, which is not an enabled radio\n", name, ifc->rf_chain);
+			err = 1;
+		}
+	}
+	if (conf->spi_trace_replay && (conf->spi_trace_file[0] == '\0')) {
+		MSG("ERROR: SPI trace replay without trace file\n");
+		err = 1;
+	}
+	return (err == 0) ? GW_CONF_SUCCESS : GW_CONF_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int gw_conf_load(struct gw_conf_s *conf, const char *snapshot) {
+	const char *files[2];
+	struct timespec t0, t1;
+	uint64_t key = 0;
+	int i, nb;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	nb = conf_files(files);
+	if (nb == 0) {
+		MSG("ERROR: failed to find any configuration file named %s, %s or %s\n", global_conf_fname, local_conf_fname, debug_conf_fname);
+		return GW_CONF_ERROR;
+	}
+
+	/* same files as the snapshot, no parse */
+	if (snapshot != NULL) {
+		key = conf_key(files, nb);
+		if ((key != 0) && (snapshot_load(conf, snapshot, key) == GW_CONF_SUCCESS) && (gw_conf_check(conf) == GW_CONF_SUCCESS)) {
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			MSG("INFO: configuration restored from snapshot %s in %ld us\n", snapshot, (long)((t1.tv_sec - t0.tv_sec) * 1000000 + (t1.tv_nsec - t0.tv_nsec) / 1000));
+			return GW_CONF_SUCCESS;
+		}
+	}
+
+	gw_conf_init(conf);
+	for (i = 0; i < nb; ++i) {
+		MSG("INFO: parsing configuration file %s\n", files[i]);
+		if (gw_conf_parse(conf, files[i]) != GW_CONF_SUCCESS) {
+			return GW_CONF_ERROR;
+		}
+	}
+	if (gw_conf_check(conf) != GW_CONF_SUCCESS) {
+		return GW_CONF_ERROR;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	MSG("INFO: configuration parsed in %ld us\n", (long)((t1.tv_sec - t0.tv_sec) * 1000000 + (t1.tv_nsec - t0.tv_nsec) / 1000));
+	if ((key != 0) && (snapshot_save(conf, snapshot, key) == GW_CONF_SUCCESS)) {
+		MSG("INFO: configuration snapshot written to %s\n", snapshot);
+	}
+	return GW_CONF_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int gw_conf_apply(const struct gw_conf_s *conf) {
+	char name[32];
+	int i;
+	int err = 0;
+
+	if (lgw_board_setconf(conf->board) != LGW_HAL_SUCCESS) {
+		MSG("ERROR: failed to configure board\n");
+		err = 1;
+	}
+	/* disabled radios and channels keep the HAL defaults */
+	for (i = 0; i < LGW_RF_CHAIN_NB; ++i) {
+		if (conf->rxrf[i].enable && (lgw_rxrf_setconf(i, conf->rxrf[i]) != LGW_HAL_SUCCESS)) {
+			MSG("ERROR: invalid configuration for radio %i\n", i);
+			err = 1;
+		}
+	}
+	for (i = 0; i < LGW_IF_CHAIN_NB; ++i) {
+		if (conf->rxif[i].enable && (lgw_rxif_setconf(i, conf->rxif[i]) != LGW_HAL_SUCCESS)) {
+			if_name(i, name, sizeof name);
+			MSG("ERROR: invalid configuration for %s\n", name);
+			err = 1;
+		}
+	}
+	return (err == 0) ? GW_CONF_SUCCESS : GW_CONF_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void gw_conf_print(const struct gw_conf_s *conf) {
+	const struct lgw_conf_rxrf_s *rf;
+	const struct lgw_conf_rxif_s *ifc;
+	char name[32];
+	int i;
+
+	MSG("INFO: lorawan_public %d, clksrc %d\n", conf->board.lorawan_public, conf->board.clksrc);
+	for (i = 0; i < LGW_RF_CHAIN_NB; ++i) {
+		rf = &conf->rxrf[i];
+		if (rf->enable) {
+			MSG("INFO: radio %i enabled (type %s), center frequency %u, RSSI offset %f, tx enabled %d\n", i, (rf->type == LGW_RADIO_TYPE_SX1255) ? "SX1255" : "SX1257", rf->freq_hz, rf->rssi_offset, rf->tx_enable);
+		} else {
+			MSG("INFO: radio %i disabled\n", i);
+		}
+	}
+	for (i = 0; i < LGW_IF_CHAIN_NB; ++i) {
+		ifc = &conf->rxif[i];
+		if (ifc->enable == false) {
+			if_name(i, name, sizeof name);
+			MSG("INFO: %s disabled\n", name);
+		} else if (i == IF_CHAIN_LORA_STD) {
+			MSG("INFO: LoRa standard channel enabled, radio %i selected, IF %i Hz, %s bandwidth, SF %s\n", ifc->rf_chain, ifc->freq_hz, bw_str(ifc->bandwidth), sf_str(ifc->datarate));
+		} else if (i == IF_CHAIN_FSK) {
+			MSG("INFO: FSK channel enabled, radio %i selected, IF %i Hz, %s bandwidth, %u bps datarate\n", ifc->rf_chain, ifc->freq_hz, bw_str(ifc->bandwidth), ifc->datarate);
+		} else {
+			MSG("INFO: LoRa multi-SF channel %i enabled, radio %i selected, IF %i Hz, 125 kHz bandwidth, SF 7 to 12\n", i, ifc->rf_chain, ifc->freq_hz);
+		}
+	}
+
+	MSG("INFO: gateway MAC address is configured to %016llX\n", (unsigned long long)conf->gateway_id);
+	if (conf->cal_cache_file[0] != '\0') {
+		MSG("INFO: calibration results are cached in %s\n", conf->cal_cache_file);
+	}
+	if (conf->spi.speed_hz != 0) {
+		MSG("INFO: SPI clock is configured to %u Hz\n", conf->spi.speed_hz);
+	}
+	if (conf->spi.chunk_size != 0) {
+		MSG("INFO: SPI bursts are split in chunks of %u bytes\n", conf->spi.chunk_size);
+	}
+	if (conf->spi_trace_file[0] != '\0') {
+		if (conf->spi_trace_replay) {
+			MSG("INFO: SPI transactions are replayed from %s, the concentrator is not accessed\n", conf->spi_trace_file);
+		} else {
+			MSG("INFO: SPI transactions are recorded in %s\n", conf->spi_trace_file);
+		}
+	}
+	if (conf->gps_tty_path[0] != '\0') {
+		MSG("INFO: GPS serial port is configured to %s\n", conf->gps_tty_path);
+	}
+	if (conf->capture_file[0] != '\0') {
+		MSG("INFO: received packets are captured in %s\n", conf->capture_file);
+	}
+	if (conf->capture_nb != 0) {
+		MSG("INFO: capture file holds the last %u packets\n", conf->capture_nb);
+	}
+	if (conf->router_id != 0) {
+		MSG("INFO: router ID is configured to %016llX\n", (unsigned long long)conf->router_id);
+	}
+	if (conf->dev_nb != 0) {
+		MSG("INFO: %d device(s) followed\n", conf->dev_nb);
+	}
+}
+
+/* --- EOF ------------------------------------------------------------------ */
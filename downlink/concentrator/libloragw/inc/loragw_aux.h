@@ -31,6 +31,12 @@ Maintainer: Sylvain Miermont
 */
 void wait_ms(unsigned long t);
 
+/**
+@brief Wait for a certain time (microsecond accuracy)
+@param t number of microseconds to wait.
+*/
+void wait_us(unsigned long t);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
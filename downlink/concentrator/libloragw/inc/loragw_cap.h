@@ -0,0 +1,135 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Raw packet capture: the metadata and first bytes of every received packet
+	in fixed-size records, written to a preallocated file mapped in memory.
+	The file is a ring, the oldest records are overwritten when it is full.
+	Writing a record is a copy in memory, no system call, so the capture can
+	be done from the RX thread; the kernel writes the pages back to the file.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_CAP_H
+#define _LORAGW_CAP_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* FILE */
+#include <time.h>		/* struct timespec */
+
+#include "config.h"	/* library configuration options (dynamically generated) */
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_CAP_SUCCESS		 0
+#define LGW_CAP_ERROR		-1
+
+#define LGW_CAP_PAYLOAD_SIZE	44	/* first bytes of the payload kept in a record */
+#define LGW_CAP_NB_MAX		(16 * 1024 * 1024)	/* maximum number of records in a capture file */
+
+#define LGW_CAP_UTC_GPS		0x01	/* flags: the UTC time comes from the GPS time reference */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_cap_rec_s
+@brief One received packet in a capture file, 96 bytes in host byte order
+*/
+struct lgw_cap_rec_s {
+	int64_t		utc_sec;	/*!> UTC time of the packet, seconds since the Epoch */
+	int32_t		utc_nsec;	/*!> UTC time of the packet, nanoseconds */
+	uint32_t	count_us;	/*!> internal concentrator counter of the packet */
+	uint32_t	freq_hz;	/*!> central frequency of the IF chain */
+	uint32_t	datarate;	/*!> datarate of the packet (SF for LoRa) */
+	float		rssi;		/*!> average packet RSSI in dB */
+	float		snr;		/*!> average packet SNR, in dB (LoRa only) */
+	float		snr_min;	/*!> minimum packet SNR, in dB (LoRa only) */
+	float		snr_max;	/*!> maximum packet SNR, in dB (LoRa only) */
+	uint16_t	crc;		/*!> CRC that was received in the payload */
+	uint16_t	size;		/*!> payload size in bytes, can be more than LGW_CAP_PAYLOAD_SIZE */
+	uint8_t		if_chain;	/*!> by which IF chain was packet received */
+	uint8_t		rf_chain;	/*!> through which RF chain the packet was received */
+	uint8_t		status;		/*!> status of the received packet */
+	uint8_t		modulation;	/*!> modulation used by the packet */
+	uint8_t		bandwidth;	/*!> modulation bandwidth (LoRa only) */
+	uint8_t		coderate;	/*!> error-correcting code of the packet (LoRa only) */
+	uint8_t		flags;		/*!> LGW_CAP_UTC_GPS */
+	uint8_t		reserved;
+	uint8_t		payload[LGW_CAP_PAYLOAD_SIZE];	/*!> first bytes of the payload */
+};
+
+/**
+@struct lgw_cap_s
+@brief Capture file open for writing, used by a single thread
+*/
+struct lgw_cap_s {
+	int			fd;			/*!> capture file */
+	uint8_t		*map;		/*!> mapping of the whole file */
+	size_t		map_size;	/*!> size of the file */
+	uint32_t	nb_rec;		/*!> number of records of the ring */
+	uint32_t	next;		/*!> index of the next record to write */
+	uint64_t	nb_write;	/*!> records written since the file was created */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Create a capture file of a fixed number of records and map it
+@param cap pointer to the capture to initialize
+@param path capture file, created or truncated
+@param nb_rec number of records, from 1 to LGW_CAP_NB_MAX
+@return LGW_CAP_ERROR if the file cannot be created, allocated or mapped, LGW_CAP_SUCCESS else
+
+The whole file is allocated on the storage and its pages are touched, so that
+no allocation nor page fault is left for lgw_cap_write.
+*/
+int lgw_cap_open(struct lgw_cap_s *cap, const char *path, uint32_t nb_rec);
+
+/**
+@brief Write a received packet in the next record of the capture
+@param cap pointer to the capture
+@param pkt received packet
+@param utc UTC time of the packet
+@param utc_gps the UTC time comes from the GPS time reference
+@return LGW_CAP_ERROR if the capture is not open, LGW_CAP_SUCCESS else
+
+Copies the record in the mapping, then updates the number of records in the
+file header, so that a reader of the file never sees a partial record.
+*/
+int lgw_cap_write(struct lgw_cap_s *cap, const struct lgw_pkt_rx_s *pkt, const struct timespec *utc, bool utc_gps);
+
+/**
+@brief Write the capture back to the file and close it
+@param cap pointer to the capture
+@return LGW_CAP_ERROR if the capture is not open or the file could not be written, LGW_CAP_SUCCESS else
+*/
+int lgw_cap_close(struct lgw_cap_s *cap);
+
+/**
+@brief Convert a capture file to CSV, oldest record first
+@param path capture file, written by lgw_cap_write (possibly still open)
+@param out stream that receives the CSV
+@param nb_out number of records converted, can be NULL
+@return LGW_CAP_ERROR if the file is not a valid capture, LGW_CAP_SUCCESS else
+*/
+int lgw_cap_dump(const char *path, FILE *out, uint64_t *nb_out);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,97 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Control socket: a local (UNIX domain) stream socket that takes text
+	commands, one per line, and sends back one line of reply per command. One
+	client at a time, served by a single thread without blocking longer than a
+	given timeout, so that a program can keep its main loop around it.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_CTL_H
+#define _LORAGW_CTL_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stddef.h>		/* size_t */
+
+#include "config.h"	/* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_CTL_SUCCESS		 0
+#define LGW_CTL_ERROR		-1
+
+#define LGW_CTL_LINE_SIZE	256	/* maximum length of a command or reply line, including the newline */
+#define LGW_CTL_PATH_SIZE	108	/* maximum length of the socket path, including the terminating null */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_ctl_s
+@brief Control socket open for listening, used by a single thread
+*/
+struct lgw_ctl_s {
+	int			fd;			/*!> listening socket */
+	int			client;		/*!> connected client, -1 if none */
+	char		path[LGW_CTL_PATH_SIZE];	/*!> socket path, removed by lgw_ctl_close */
+	char		buf[LGW_CTL_LINE_SIZE];		/*!> bytes received from the client, not yet a full line */
+	size_t		len;		/*!> number of bytes in buf */
+	int			discard;	/*!> the line being received is too long, drop it up to its newline */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Create the control socket and listen on it
+@param ctl pointer to the control socket to initialize
+@param path socket path; a socket left there by a previous run is replaced, any other file is not
+@return LGW_CTL_ERROR if the path is too long or the socket cannot be created, LGW_CTL_SUCCESS else
+*/
+int lgw_ctl_open(struct lgw_ctl_s *ctl, const char *path);
+
+/**
+@brief Wait for the next command
+@param ctl pointer to the control socket
+@param timeout_ms maximum waiting time in milliseconds, 0 to only check what is already received
+@param line buffer that receives the command, without its newline
+@param size size of the buffer, up to LGW_CTL_LINE_SIZE is useful
+@return 1 if a command was received, 0 if not before the timeout, LGW_CTL_ERROR if the socket failed
+
+Accepts a client if there is none, and drops it when it disconnects. Commands
+longer than the buffer are dropped, with an error reply to the client.
+*/
+int lgw_ctl_wait(struct lgw_ctl_s *ctl, int timeout_ms, char *line, size_t size);
+
+/**
+@brief Send one line of reply to the client of the last command
+@param ctl pointer to the control socket
+@param fmt printf format of the reply, the newline is added
+@return LGW_CTL_ERROR if there is no client or it disconnected, LGW_CTL_SUCCESS else
+*/
+int lgw_ctl_reply(struct lgw_ctl_s *ctl, const char *fmt, ...);
+
+/**
+@brief Disconnect the client, close the socket and remove its path
+@param ctl pointer to the control socket
+@return LGW_CTL_ERROR if the socket is not open, LGW_CTL_SUCCESS else
+*/
+int lgw_ctl_close(struct lgw_ctl_s *ctl);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -36,6 +36,11 @@ Maintainer: Miguel Luis
 #define LGW_GPIO_LOW	0
 #define LGW_GPIO_HIGH	1
 
+#define LGW_GPIO_EDGE_NONE		0
+#define LGW_GPIO_EDGE_RISING	1
+#define LGW_GPIO_EDGE_FALLING	2
+#define LGW_GPIO_EDGE_BOTH		3
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
@@ -76,6 +81,25 @@ int lgw_gpio_read(int pin);
 */
 int lgw_gpio_write(int pin, int value);
 
+/**
+@brief Selects the edges of the given GPIO input pin that raise an event
+@param pin pin ID to be changed
+@param edge LGW_GPIO_EDGE_NONE/RISING/FALLING/BOTH
+@return status of operation (LGW_GPIO_SUCCESS/LGW_GPIO_ERROR)
+*/
+int lgw_gpio_edge(int pin, int edge);
+
+/**
+@brief Waits until the given GPIO input pin is high
+@param pin pin ID to wait for, its edge must have been set with lgw_gpio_edge
+@param timeout_ms maximum time to wait, in milliseconds
+@return LGW_GPIO_HIGH if the pin is high, LGW_GPIO_LOW on timeout, LGW_GPIO_ERROR else
+
+Sleeps in poll() on the sysfs value file, the caller is woken up by the edge
+event without polling the pin.
+*/
+int lgw_gpio_wait(int pin, int timeout_ms);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
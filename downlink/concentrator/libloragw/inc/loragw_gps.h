@@ -49,6 +49,28 @@ struct tref {
 	double		xtal_err;	/*!> raw clock error (eg. <1 'slow' XTAL) */
 };
 
+#define LGW_GPS_FIT_WIN	32	/* number of sync points kept by lgw_gps_sync_fit */
+
+/**
+@struct tref_fit
+@brief Sliding window of sync points and linear fit of the concentrator clock, for lgw_gps_sync_fit
+*/
+struct tref_fit {
+	int			nb;			/*!> number of sync points in the window */
+	int			last;		/*!> index of the latest sync point */
+	uint32_t	count_us[LGW_GPS_FIT_WIN];	/*!> concentrator timestamps of the sync points */
+	struct timespec utc[LGW_GPS_FIT_WIN];	/*!> UTC times of the sync points */
+	int			nb_aber;	/*!> number of successive rejected sync points */
+	uint32_t	nb_reject;	/*!> total number of rejected sync points */
+	int			nb_used;	/*!> number of sync points used by the fit (outliers excluded) */
+	double		xtal_err;	/*!> fitted clock error, same as the xtal_err of the reference */
+	double		off_us;		/*!> fitted timestamp at the UTC time of the latest sync point, relative to its timestamp, in microseconds */
+	double		xtal_sd;	/*!> standard deviation of xtal_err */
+	double		res_us;		/*!> standard deviation of the fit residuals, in microseconds */
+	double		mean_s;		/*!> mean UTC time of the points used, in seconds since the latest one */
+	double		var_s;		/*!> sum of the squared UTC times of the points used around their mean, in s^2 */
+};
+
 /**
 @struct coord_s
 @brief Geodesic coordinates
@@ -59,6 +81,19 @@ struct coord_s {
 	short		alt;	/*!> altitude in meters (WGS 84 geoid ref.) */
 };
 
+/**
+@struct lgw_gps_fix_s
+@brief Quality of the GPS fix
+*/
+struct lgw_gps_fix_s {
+	char		mode;	/*!> RMC mode: N no fix, A autonomous, D differential */
+	short		nb_sat;	/*!> GGA number of satellites used for the fix */
+	uint8_t		dim;	/*!> GSA navigation mode: 1 no fix, 2 2D fix, 3 3D fix (0 if no GSA received) */
+	float		pdop;	/*!> GSA position dilution of precision */
+	float		hdop;	/*!> GSA horizontal dilution of precision */
+	float		vdop;	/*!> GSA vertical dilution of precision */
+};
+
 /**
 @enum gps_msg
 @brief Type of GPS (and other GNSS) sentences
@@ -120,6 +155,28 @@ lock must be acquired before calling either function.
 */
 enum gps_msg lgw_parse_nmea(char* serial_buff, int buff_size);
 
+/**
+@brief Parse a stream of bytes coming from the GPS system (or other GNSS)
+
+@param data bytes read from the GPS, any number of sentences or part of a sentence
+@param size number of bytes in data
+@param used pointer to a variable to receive the number of bytes consumed (NULL to ignore)
+@return type of the sentence that was completed, UNKNOWN if the bytes were all consumed without completing one
+
+Sentences can be split across calls in any way: the parser keeps its state
+between calls, computes the checksum and parses the fields as the bytes
+arrive, without copying or modifying them. It stops after each complete
+sentence so that the caller can react to it (eg. RMC), and must be called
+again with the remaining bytes (data + *used, size - *used).
+RMC, GGA, ZDA and GSA sentences are applied to the same variables as
+lgw_parse_nmea once their checksum is verified, other sentences with a valid
+checksum return IGNORED, sentences with a bad checksum or format return
+INVALID.
+The same mutex as lgw_parse_nmea must be used if it runs in another thread
+than lgw_gps_get.
+*/
+enum gps_msg lgw_parse_nmea_stream(const char *data, int size, int *used);
+
 /**
 @brief Get the GPS solution (space & time) for the concentrator
 
@@ -136,6 +193,17 @@ lock must be acquired before calling either function.
 */
 int lgw_gps_get(struct timespec* utc, struct coord_s* loc, struct coord_s* err);
 
+/**
+@brief Get the quality of the GPS fix
+
+@param fix pointer to store the mode, number of satellites and dilutions of precision
+@return success if fix is not NULL
+
+The navigation mode and dilutions of precision are only parsed by
+lgw_parse_nmea_stream (GSA sentences).
+*/
+int lgw_gps_get_fix(struct lgw_gps_fix_s *fix);
+
 /**
 @brief Take a timestamp and UTC time and refresh reference for time conversion
 
@@ -148,6 +216,47 @@ Set systime to 0 in ref to trigger initial synchronization.
 */
 int lgw_gps_sync(struct tref* ref, uint32_t count_us, struct timespec utc);
 
+/**
+@brief Initialize the sync point window used by lgw_gps_sync_fit
+
+@param fit pointer to the window
+@return success if fit is not NULL
+*/
+int lgw_gps_fit_init(struct tref_fit *fit);
+
+/**
+@brief Take a timestamp and UTC time and refresh the reference with a fit over the latest sync points
+
+@param fit window of sync points, initialized by lgw_gps_fit_init
+@param ref pointer to time reference structure, updated when the sync point is accepted
+@param count_us internal timestamp counter of the LoRa concentrator, latched on the PPS
+@param utc UTC time of the PPS, with ns precision (leap seconds are ignored)
+@return success if the sync point was accepted and the time reference refreshed
+
+Alternative to lgw_gps_sync: the clock error is a least squares fit over the
+last LGW_GPS_FIT_WIN sync points instead of the slope between the last two,
+so the PPS jitter is averaged and the clock error follows the drift of the
+crystal. Points further than 4 deviations from the fit are left out of it.
+A new point too far from the prediction of the fit (or out of the +/-10 ppm
+range) is rejected and the reference is kept, so conversions hold over
+through a GPS outage; 3 successive rejected points restart the window.
+Each concentrator needs its own window.
+*/
+int lgw_gps_sync_fit(struct tref_fit *fit, struct tref *ref, uint32_t count_us, struct timespec utc);
+
+/**
+@brief Get the uncertainty of a timestamp converted with the reference of lgw_gps_sync_fit
+
+@param fit window of sync points
+@param count_us internal timestamp counter of the LoRa concentrator
+@param err_us pointer to store the uncertainty (1 standard deviation), in microseconds
+@return success if the window holds a valid fit
+
+The uncertainty is the one of the fit at that point, plus the drift of the
+crystal since the latest sync point (holdover).
+*/
+int lgw_gps_fit_err(const struct tref_fit *fit, uint32_t count_us, double *err_us);
+
 /**
 @brief Convert concentrator timestamp counter value to UTC time
 
@@ -176,6 +285,32 @@ transform an absolute UTC time into a matching internal concentrator timestamp.
 */
 int lgw_utc2cnt(struct tref ref,struct timespec utc, uint32_t* count_us);
 
+/**
+@brief Convert an array of concentrator timestamp counter values to UTC time
+
+@param ref time reference structure required for time conversion
+@param count_us array of internal timestamp counter values
+@param utc array to store the UTC times
+@param nb number of values to convert
+@return success if the function was able to convert the timestamps to UTC
+
+Same result as lgw_cnt2utc on each value (to the nanosecond rounding), with
+the reference checked once: typically used on all the packets of a
+lgw_receive call.
+*/
+int lgw_cnt2utc_n(struct tref ref, const uint32_t *count_us, struct timespec *utc, int nb);
+
+/**
+@brief Convert an array of UTC times to concentrator timestamp counter values
+
+@param ref time reference structure required for time conversion
+@param utc array of UTC times
+@param count_us array to store the internal timestamp counter values
+@param nb number of values to convert
+@return success if the function was able to convert the UTC times to timestamps
+*/
+int lgw_utc2cnt_n(struct tref ref, const struct timespec *utc, uint32_t *count_us, int nb);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -63,6 +63,8 @@ Maintainer: Sylvain Miermont
 #define LGW_DATABUFF_SIZE	1024	/* size in bytes of the RX data buffer (contains payload & metadata) */
 #define LGW_REF_BW		125000	/* typical bandwidth of data channel */
 #define LGW_MULTI_NB		8	/* number of LoRa 'multi SF' chains */
+#define LGW_TX_METADATA_MAX	17	/* max size of the TX metadata sent before the payload (FSK adds the payload size) */
+#define LGW_GPS_TOGGLE_US	10000	/* a trigger timestamp closer than this after a GPS capture suspension comes from it, see lgw_get_gps_toggle */
 #define LGW_IFMODEM_CONFIG {\
 		IF_LORA_MULTI, \
 		IF_LORA_MULTI, \
@@ -79,6 +81,7 @@ Maintainer: Sylvain Miermont
 #if (CFG_BRD_1301IOTSK868 == 1)
 #if (CFG_SPI_NATIVE == 1)
 	#define LGW_SX1301_RESET_PIN	7		/* reset pin for SX1301 (GPIO7 <-> pin 26 on RPi connector) */
+	/* define LGW_SX1301_IRQ_PIN to the GPIO wired to an interrupt output of the SX1301, if any */
 #else
 	/* NOT SUPPORTED */
 #endif
@@ -157,9 +160,19 @@ Maintainer: Sylvain Miermont
 #define RX_ON				2	/* RX modem is receiving */
 #define RX_SUSPENDED		3	/* RX is suspended while a TX is ongoing */
 
+/* values available for the RX FIFO fetch mode */
+#define RX_FETCH_SINGLE		0	/* one FIFO read, one data read and one FIFO advance per packet */
+#define RX_FETCH_BURST		1	/* data of consecutive queued packets read in a single burst */
+
 /* Maximum size of Tx gain LUT */
 #define TX_GAIN_LUT_SIZE_MAX 16
 
+/* calibration cache */
+#define LGW_CAL_PATH_SIZE	256	/* maximum length of the calibration cache file path, including the terminating null */
+
+/* statistics */
+#define LGW_STATS_HIST_NB	20	/* number of buckets of the latency histograms, bucket i counts [2^i, 2^(i+1)) us */
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC TYPES --------------------------------------------------------- */
 
@@ -251,6 +264,107 @@ struct lgw_pkt_tx_s {
 	uint8_t		payload[256]; /*!> buffer containing the payload */
 };
 
+/**
+@struct lgw_tx_desc_s
+@brief Prepared TX descriptor, caching the metadata and TX registers of packets that share the same parameters
+*/
+struct lgw_tx_desc_s {
+	uint32_t	freq_hz;	/*!> center frequency of TX */
+	uint8_t		rf_chain;	/*!> through which RF chain will the packets be sent */
+	int8_t		rf_power;	/*!> TX power, in dBm */
+	uint8_t		modulation; /*!> modulation to use for the packets */
+	uint8_t		bandwidth;	/*!> modulation bandwidth (LoRa only) */
+	uint32_t	datarate;	/*!> TX datarate (baudrate for FSK, SF for LoRa) */
+	uint8_t		coderate;	/*!> error-correcting code of the packets (LoRa only) */
+	bool		invert_pol;	/*!> invert signal polarity, for orthogonal downlinks (LoRa only) */
+	uint8_t		f_dev;		/*!> frequency deviation, in kHz (FSK only) */
+	uint16_t	preamble;	/*!> set the preamble length, 0 for default */
+	bool		no_crc;		/*!> if true, do not send a CRC in the packets */
+	bool		no_header;	/*!> if true, enable implicit header mode (LoRa), fixed length (FSK) */
+	/* computed by lgw_tx_prepare, do not modify */
+	uint32_t	gen;		/*!> HAL configuration the descriptor was computed for */
+	uint8_t		pow_index;	/*!> TX gain LUT index */
+	int8_t		offset_i;	/*!> TX I offset correction for the mixer gain */
+	int8_t		offset_q;	/*!> TX Q offset correction for the mixer gain */
+	uint8_t		dig_gain;	/*!> SX1301 digital gain */
+	uint8_t		meta_size;	/*!> number of metadata bytes before the payload */
+	uint8_t		meta[LGW_TX_METADATA_MAX]; /*!> metadata, without timestamp and payload size */
+};
+
+/**
+@struct lgw_rx_fetch_stat_s
+@brief Structure containing the SPI cost of lgw_receive since the concentrator was started
+*/
+struct lgw_rx_fetch_stat_s {
+	uint32_t	nb_fetch;	/*!> number of calls to lgw_receive */
+	uint32_t	nb_pkt;		/*!> number of packets fetched */
+	uint32_t	nb_spi;		/*!> number of SPI transactions done by lgw_receive */
+	uint32_t	nb_spi_bytes;	/*!> number of data bytes read or written by those transactions */
+	uint32_t	nb_wait;	/*!> number of calls to lgw_receive_wait and lgw_rx_wait */
+	uint32_t	nb_wakeup_irq;	/*!> number of times the wait was ended by the interrupt line */
+	uint32_t	nb_wakeup_poll;	/*!> number of polling sleeps done while waiting (no interrupt line) */
+};
+
+/**
+@struct lgw_fw_mcu_stat_s
+@brief Structure containing the firmware loading statistics of one SX1301 MCU
+*/
+struct lgw_fw_mcu_stat_s {
+	uint32_t	crc;		/*!> CRC-32 of the image last loaded and verified, 0 if unknown */
+	uint32_t	nb_load;	/*!> number of images written to the program RAM */
+	uint32_t	nb_skip;	/*!> number of loads skipped because the image was already in place */
+	uint32_t	nb_fail;	/*!> number of writes whose readback did not match the image */
+	uint32_t	load_us;	/*!> duration of the last write burst, in microseconds */
+	uint32_t	verify_us;	/*!> duration of the last readback and CRC, in microseconds */
+};
+
+/**
+@struct lgw_fw_stat_s
+@brief Structure containing the firmware loading statistics of the arbiter and AGC MCUs
+*/
+struct lgw_fw_stat_s {
+	struct lgw_fw_mcu_stat_s	arb;	/*!> arbiter MCU */
+	struct lgw_fw_mcu_stat_s	agc;	/*!> AGC MCU (calibration and AGC firmwares) */
+};
+
+/**
+@struct lgw_stats_hist_s
+@brief Latency histogram, with log2 buckets
+*/
+struct lgw_stats_hist_s {
+	uint32_t	nb;		/*!> number of calls measured */
+	uint64_t	total_us;	/*!> sum of their durations, in microseconds */
+	uint32_t	max_us;		/*!> longest duration, in microseconds */
+	uint32_t	hist[LGW_STATS_HIST_NB];	/*!> hist[i] counts the calls that took 2^i to 2^(i+1)-1 us (0 us in hist[0], 2^19 us and more in the last one) */
+};
+
+/**
+@struct lgw_stats_s
+@brief Performance counters of the HAL since the program started or lgw_reset_stats
+*/
+struct lgw_stats_s {
+	uint64_t	spi_nb;		/*!> number of SPI transactions on registers (a batch of writes counts as one) */
+	uint64_t	spi_bytes_w;	/*!> number of data bytes written */
+	uint64_t	spi_bytes_r;	/*!> number of data bytes read */
+	uint64_t	page_switch;	/*!> number of register page changes */
+	uint32_t	rx_fetch;	/*!> number of calls to lgw_receive */
+	uint32_t	rx_pkt;		/*!> number of packets fetched */
+	uint32_t	rx_crc_ok;	/*!> packets with a valid CRC */
+	uint32_t	rx_crc_bad;	/*!> packets with a wrong CRC */
+	uint32_t	rx_no_crc;	/*!> packets without CRC */
+	uint32_t	rx_error;	/*!> calls to lgw_receive that returned LGW_HAL_ERROR */
+	uint32_t	tx_pkt;		/*!> packets handed to the concentrator */
+	uint32_t	tx_error;	/*!> packets rejected by lgw_send, lgw_send_ptr or lgw_send_prepared */
+	struct lgw_stats_hist_s	rx_time;	/*!> duration of the lgw_receive calls */
+	struct lgw_stats_hist_s	tx_time;	/*!> duration of the lgw_send_prepared calls (lgw_send and lgw_send_ptr included) */
+};
+
+/**
+@struct lgw_ctx_s
+@brief State of one concentrator (configuration, calibration, SPI connection), opaque
+*/
+struct lgw_ctx_s;
+
 /**
 @struct lgw_tx_gain_s
 @brief Structure containing all gains of Tx chain
@@ -272,6 +386,16 @@ struct lgw_tx_gain_lut_s {
 	uint8_t			size;				/*!> Number of LUT indexes */
 };
 
+/**
+@struct lgw_conf_cal_s
+@brief Configuration of the calibration cache
+*/
+struct lgw_conf_cal_s {
+	bool		cache_enable;	/*!> reuse the results stored in cache_file instead of calibrating, when they match the board and radios */
+	uint64_t	board_id;		/*!> unique identifier of the board (eg. gateway EUI), part of the cache key */
+	char		cache_file[LGW_CAL_PATH_SIZE];	/*!> path of the cache file, written after each successful calibration */
+};
+
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
@@ -306,6 +430,21 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf);
 */
 int lgw_txgain_setconf(struct lgw_tx_gain_lut_s *conf);
 
+/**
+@brief Configure the calibration cache (must configure before start)
+@param conf structure containing the configuration parameters
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+The cache is disabled by default: lgw_start then runs the calibration firmware
+on every start. When it is enabled, lgw_start first looks in the cache file for
+results obtained with the same board ID, radio type, radio frequencies and
+enabled RF chains, and restores the TX I/Q offsets and RX I/Q mismatch
+coefficients instead of calibrating. Results of a new calibration replace the
+content of the file. Delete the file to force a calibration (eg. after a large
+temperature change).
+*/
+int lgw_cal_setconf(struct lgw_conf_cal_s conf);
+
 /**
 @brief Connect to the LoRa concentrator, reset it and configure it according to previously set parameters
 @return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
@@ -326,6 +465,78 @@ int lgw_stop(void);
 */
 int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data);
 
+/**
+@brief Same as lgw_receive, but blocks until at least one packet is received or the timeout expires
+@param max_pkt maximum number of packet that must be retrieved (equal to the size of the array of struct)
+@param pkt_data pointer to an array of struct that will receive the packet metadata and payload pointers
+@param timeout_ms maximum time to wait for a packet, in milliseconds
+@return LGW_HAL_ERROR id the operation failed, else the number of packets retrieved (0 on timeout)
+
+The caller sleeps on the concentrator interrupt line (GPIO edge, see
+LGW_SX1301_IRQ_PIN) when the SPI link has one. Otherwise the FIFO is polled
+with a sleep that doubles, up to 3 ms, while it stays empty and goes back to
+250 us when packets are received.
+*/
+int lgw_receive_wait(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data, uint32_t timeout_ms);
+
+/**
+@brief Sleep until the RX FIFO may hold packets, without fetching them
+@param timeout_ms maximum time to wait, in milliseconds
+@return LGW_HAL_ERROR id the concentrator is not started, LGW_HAL_SUCCESS else
+
+Same sleep as lgw_receive_wait (interrupt line, or polling backoff), but no
+register is accessed. A receive thread can call it without holding the lock
+that serializes its lgw_receive calls with the lgw_send calls of other
+threads, and call lgw_receive when it returns.
+*/
+int lgw_rx_wait(uint32_t timeout_ms);
+
+/**
+@brief Select how lgw_receive fetches packets from the RX FIFO and data buffer
+@param mode RX_FETCH_SINGLE (default) or RX_FETCH_BURST
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+In RX_FETCH_BURST mode, when several packets are queued, the data of the following packets is read in the same burst as the packet at the head of the FIFO (assuming they have the same size), and kept on the host as long as the FIFO address pointer confirms it is valid.
+The FIFO is not polled again once all the packets it reported have been fetched.
+*/
+int lgw_rx_fetch_mode(uint8_t mode);
+
+/**
+@brief Get the SPI transactions statistics of lgw_receive
+@param stat pointer to a structure that will be filled with the statistics since lgw_start
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_rx_fetch_stat(struct lgw_rx_fetch_stat_s *stat);
+
+/**
+@brief Get the firmware loading statistics of the MCUs
+@param stat pointer to a structure that will be filled with the statistics since the program started
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+lgw_start reads the program RAM of an MCU back and compares its CRC with the
+image to load: the image is only written if they differ, and is then read back
+again to be verified. The readback is skipped when the MCU is known to hold
+another image (AGC MCU switching from the calibration firmware to the AGC one).
+*/
+int lgw_fw_stat(struct lgw_fw_stat_s *stat);
+
+/**
+@brief Get the performance counters of the HAL
+@param stats pointer to a structure that will be filled with the counters
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+The counters are always on and kept across lgw_stop/lgw_start. They are updated
+with relaxed atomic operations: lgw_get_stats can be called from any thread,
+without the lock that serializes the other HAL calls, and returns a snapshot in
+which counters of the same call may be one update apart.
+*/
+int lgw_get_stats(struct lgw_stats_s *stats);
+
+/**
+@brief Reset the performance counters of the HAL, SPI traffic included
+*/
+void lgw_reset_stats(void);
+
 /**
 @brief Schedule a packet to be send immediately or after a delay depending on tx_mode
 @param pkt_data structure containing the data and metadata for the packet to send
@@ -338,6 +549,42 @@ In 'triggered' mode (aka PPS/GPS mode), the packet, typically a beacon, is emitt
 */
 int lgw_send(struct lgw_pkt_tx_s pkt_data);
 
+/**
+@brief Same as lgw_send, with the packet passed by pointer
+@param pkt_data pointer to the structure containing the packet to send
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+The TX parameters of the last packet are kept in a descriptor: when the next
+packet has the same frequency, RF chain, power, modulation, bandwidth, datarate,
+coderate, polarity, preamble and CRC/header settings, only its timestamp, size
+and payload are processed.
+*/
+int lgw_send_ptr(const struct lgw_pkt_tx_s *pkt_data);
+
+/**
+@brief Prepare a TX descriptor for packets sharing the same parameters
+@param pkt_data pointer to a packet holding the parameters (tx_mode, count_us, size and payload are ignored)
+@param desc pointer to the descriptor to fill
+@return LGW_HAL_ERROR id the parameters are not valid or the concentrator is not running, LGW_HAL_SUCCESS else
+
+The descriptor holds the TX gain LUT index, the I/Q offset correction, the PLL
+frequency words and all the metadata bytes that do not depend on the packet.
+It must be prepared after lgw_start; if the concentrator is restarted or the TX
+gain LUT is changed, it is recomputed by the next lgw_send_prepared.
+*/
+int lgw_tx_prepare(const struct lgw_pkt_tx_s *pkt_data, struct lgw_tx_desc_s *desc);
+
+/**
+@brief Send a packet using a prepared TX descriptor
+@param desc pointer to a descriptor filled by lgw_tx_prepare
+@param tx_mode select on what event/time the TX is triggered
+@param count_us timestamp for TX trigger in TIMESTAMPED mode
+@param payload pointer to the payload
+@param size payload size in bytes
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+*/
+int lgw_send_prepared(struct lgw_tx_desc_s *desc, uint8_t tx_mode, uint32_t count_us, const uint8_t *payload, uint16_t size);
+
 /**
 @brief Give the the status of different part of the LoRa concentrator
 @param select is used to select what status we want to know 
@@ -356,15 +603,100 @@ int lgw_abort_tx(void);
 @brief Return value of internal counter when latest event (eg GPS pulse) was captured
 @param trig_cnt_us pointer to receive timestamp value
 @return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+After lgw_get_instcnt, and until the next event, the value is the end of the
+capture suspension instead, see lgw_get_gps_toggle.
 */
 int lgw_get_trigcnt(uint32_t* trig_cnt_us);
 
+/**
+@brief Return the current value of the internal counter
+@param inst_cnt_us pointer to receive timestamp value
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+The GPS event capture is suspended while the counter is read: the timestamp
+register follows the counter meanwhile, and keeps the value it had at the end
+of the suspension. lgw_get_trigcnt returns that value until the next PPS
+pulse, and a pulse arriving during those few SPI transactions is lost.
+*/
+int lgw_get_instcnt(uint32_t* inst_cnt_us);
+
+/**
+@brief Return the GPS event capture suspensions made by lgw_get_instcnt
+@param nb_toggle pointer to receive the number of suspensions since lgw_start
+@param toggle_cnt_us pointer to receive the counter value read during the last one
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+A value of lgw_get_trigcnt less than LGW_GPS_TOGGLE_US after toggle_cnt_us
+(and nb_toggle not 0) is the end of the last suspension, not a PPS pulse: it
+must not be used as a sync point. Read it with lgw_get_trigcnt, without any
+lgw_get_instcnt in between.
+*/
+int lgw_get_gps_toggle(uint32_t *nb_toggle, uint32_t *toggle_cnt_us);
+
+/**
+@brief Compute the time a packet will spend on air
+@param pkt_data pointer to the packet (modulation, bandwidth, datarate, coderate, preamble, CRC, header mode and size are used)
+@return time on air in microseconds, 0 if the parameters are invalid
+
+LoRa packets are looked up in tables built at compile time (see loragw_lut),
+the function is cheap enough to be called for every scheduled packet.
+*/
+uint32_t lgw_time_on_air(const struct lgw_pkt_tx_s *pkt_data);
+
 /**
 @brief Allow user to check the version/options of the library once compiled
 @return pointer on a human-readable null terminated string
 */
 const char* lgw_version_info(void);
 
+/**
+@brief Allocate the state of an additional concentrator
+@param spi_dev device the concentrator is connected to, see lgw_spi_open_dev (NULL for the default one)
+@return pointer to the new context, with the default configuration, NULL if the allocation failed
+
+The functions without context parameter act on a default context, that needs
+no allocation. Each context drives its own concentrator: several boards can
+be run from one process, for example with one RX thread per board.
+*/
+struct lgw_ctx_s *lgw_ctx_new(const char *spi_dev);
+
+/**
+@brief Release a context allocated by lgw_ctx_new
+@param ctx context, stopped and not selected by the calling thread
+@return LGW_HAL_ERROR id the context is in use, LGW_HAL_SUCCESS else
+*/
+int lgw_ctx_free(struct lgw_ctx_s *ctx);
+
+/**
+@brief Select the context the functions without context parameter act on, in the calling thread
+@param ctx context allocated by lgw_ctx_new, NULL for the default context
+@return context previously selected by the calling thread, NULL for the default one
+
+The selection also applies to the loragw_reg functions. Calls on the same
+context must be serialized by the application (as for the default context);
+calls on different contexts can be made concurrently. lgw_get_stats and the
+SPI trace cover all the contexts.
+*/
+struct lgw_ctx_s *lgw_ctx_select(struct lgw_ctx_s *ctx);
+
+/**
+@brief Same as lgw_board_setconf, lgw_rxrf_setconf, lgw_rxif_setconf, lgw_txgain_setconf, lgw_start, lgw_stop, lgw_receive, lgw_send_ptr and lgw_status, on a given context
+@param ctx context allocated by lgw_ctx_new, NULL for the default context
+
+The selection of the calling thread is unchanged when they return. The other
+functions of the HAL are available on a context through lgw_ctx_select.
+*/
+int lgw_ctx_board_setconf(struct lgw_ctx_s *ctx, struct lgw_conf_board_s conf);
+int lgw_ctx_rxrf_setconf(struct lgw_ctx_s *ctx, uint8_t rf_chain, struct lgw_conf_rxrf_s conf);
+int lgw_ctx_rxif_setconf(struct lgw_ctx_s *ctx, uint8_t if_chain, struct lgw_conf_rxif_s conf);
+int lgw_ctx_txgain_setconf(struct lgw_ctx_s *ctx, struct lgw_tx_gain_lut_s *conf);
+int lgw_ctx_start(struct lgw_ctx_s *ctx);
+int lgw_ctx_stop(struct lgw_ctx_s *ctx);
+int lgw_ctx_receive(struct lgw_ctx_s *ctx, uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data);
+int lgw_ctx_send(struct lgw_ctx_s *ctx, const struct lgw_pkt_tx_s *pkt_data);
+int lgw_ctx_status(struct lgw_ctx_s *ctx, uint8_t select, uint8_t *code);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
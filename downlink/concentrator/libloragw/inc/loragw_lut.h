@@ -0,0 +1,61 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	LoRa timing lookup tables, generated at compile time: RX timestamp
+	correction (processing delay of the modems) and TX time on air.
+	The tables are indexed by bandwidth, spreading factor and a size term, so
+	that no division nor branch on the packet parameters is needed per packet.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_LUT_H
+#define _LORAGW_LUT_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+
+#include "config.h"	/* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Delay between the end of a LoRa packet and its 'RX finished' timestamp
+@param if_type IF_LORA_STD or IF_LORA_MULTI, modem by which the packet was received
+@param bandwidth BW_125KHZ, BW_250KHZ or BW_500KHZ (always BW_125KHZ for IF_LORA_MULTI)
+@param sf spreading factor, as read in the packet metadata (6 to 12)
+@param cr coding rate, as read in the packet metadata (1 for 4/5 to 4 for 4/8)
+@param crc_en true if the packet has a CRC
+@param size payload size, in bytes
+@return correction to subtract from the raw timestamp, in microseconds, 0 if the parameters are invalid
+*/
+uint32_t lgw_lut_rx_delay(uint8_t if_type, uint8_t bandwidth, uint8_t sf, uint8_t cr, bool crc_en, uint8_t size);
+
+/**
+@brief Time on air of a LoRa packet
+@param bandwidth BW_125KHZ, BW_250KHZ or BW_500KHZ
+@param sf spreading factor (7 to 12)
+@param coderate CR_LORA_4_5 to CR_LORA_4_8
+@param crc_en true if a CRC is sent
+@param no_header true for an implicit header packet
+@param size payload size, in bytes (0 to 255)
+@param preamble number of preamble symbols, as sent by the modem
+@return duration of the packet, in microseconds, 0 if the parameters are invalid
+*/
+uint32_t lgw_lut_lora_toa(uint8_t bandwidth, uint8_t sf, uint8_t coderate, bool crc_en, bool no_header, uint16_t size, uint16_t preamble);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
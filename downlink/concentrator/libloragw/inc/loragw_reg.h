@@ -33,6 +33,7 @@ Maintainer: Sylvain Miermont
 
 #define LGW_REG_SUCCESS	 0
 #define LGW_REG_ERROR	-1
+#define LGW_REG_TIMEOUT	 1	/* lgw_reg_irq_wait returned without interrupt */
 
 /*
 auto generated register mapping for C code : 11-Jul-2013 13:20:40
@@ -370,9 +371,85 @@ this file is autogenerated from registers description
 
 #define LGW_TOTALREGS 326
 
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_reg_s
+@brief Description of a register field in the concentrator register array
+*/
+struct lgw_reg_s {
+	int8_t		page;		/*!< page containing the register (-1 for all pages) */
+	uint8_t		addr;		/*!< base address of the register (7 bit) */
+	uint8_t		offs;		/*!< position of the register LSB (between 0 to 7) */
+	bool		sign;		/*!< 1 indicates the register is signed (2 complem.) */
+	uint8_t		leng;		/*!< number of bits in the register */
+	bool		rdon;		/*!< 1 indicates a read-only register */
+	int32_t		dflt;		/*!< register default value */
+};
+
+/**
+@struct lgw_reg_shadow_stat_s
+@brief SPI accesses avoided by the register shadow since lgw_connect
+*/
+struct lgw_reg_shadow_stat_s {
+	uint32_t	nb_read_saved;	/*!< read-modify-write reads served by the shadow */
+	uint32_t	nb_write_saved;	/*!< writes skipped because the value was unchanged */
+	uint32_t	nb_page_saved;	/*!< page switches avoided by skipped writes */
+};
+
+/**
+@struct lgw_reg_stats_s
+@brief SPI traffic of the register accesses since the program started or lgw_reg_reset_stats
+*/
+struct lgw_reg_stats_s {
+	uint64_t	nb_spi;		/*!< SPI transactions, a multiple write counts as one */
+	uint64_t	nb_byte_w;	/*!< data bytes written */
+	uint64_t	nb_byte_r;	/*!< data bytes read */
+	uint64_t	nb_page_switch;	/*!< writes to the page register */
+};
+
+/**
+@struct lgw_reg_ctx_s
+@brief Connection to one concentrator (SPI link, register page, shadow and write batch), opaque
+*/
+struct lgw_reg_ctx_s;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC VARIABLES ----------------------------------------------------- */
+
+extern const struct lgw_reg_s loregs[LGW_TOTALREGS]; /* register map, indexed by LGW_xxx register ID */
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
+/**
+@brief Allocate the connection state of a concentrator
+@param spi_dev device of the concentrator, see lgw_spi_open_dev (NULL for the default one)
+@return pointer to the new connection, NULL if the allocation failed
+*/
+struct lgw_reg_ctx_s *lgw_reg_ctx_new(const char *spi_dev);
+
+/**
+@brief Release a connection allocated by lgw_reg_ctx_new
+@param ctx connection, must be disconnected and not selected by the calling thread
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_ctx_free(struct lgw_reg_ctx_s *ctx);
+
+/**
+@brief Select the connection used by the register functions in the calling thread
+@param ctx connection allocated by lgw_reg_ctx_new, NULL for the default connection
+@return connection previously selected by the calling thread, NULL for the default one
+
+All the other functions of this module act on the connection selected by the
+calling thread, the default connection until this function is called. Each
+connection must only be used by one thread at a time; different connections
+can be used by different threads concurrently. The SPI traffic counters
+(lgw_reg_stats) are shared by all the connections.
+*/
+struct lgw_reg_ctx_s *lgw_reg_ctx_select(struct lgw_reg_ctx_s *ctx);
+
 /**
 @brief Connect LoRa concentrator by opening SPI link
 @return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
@@ -432,6 +509,167 @@ int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size);
 */
 int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size);
 
+/*
+Register access by page and address, with the same page switching, shadow and
+batch handling as the functions above. They are called by the accessors of
+loragw_reg_acc.h, generated from the loregs table, that have the page, address,
+masks and shifts of one register as constants. The page is -1 for the
+registers common to all pages. No check is done on the register layout nor on
+read-only registers.
+*/
+
+/**
+@brief Write a whole register byte
+@param page page of the register
+@param addr address of the register
+@param val value to write
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_wbyte(int8_t page, uint8_t addr, uint8_t val);
+
+/**
+@brief Write some bits of a register byte, keeping the other ones
+@param page page of the register
+@param addr address of the register
+@param mask bits to write
+@param val new value of those bits, already shifted
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_wbits(int8_t page, uint8_t addr, uint8_t mask, uint8_t val);
+
+/**
+@brief Write a register of 2 to 4 bytes, least significant byte first
+@param page page of the register
+@param addr address of the register
+@param size_byte number of bytes of the register
+@param val value to write
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_wmulti(int8_t page, uint8_t addr, uint8_t size_byte, int32_t val);
+
+/**
+@brief Read a whole register byte
+@param page page of the register
+@param addr address of the register
+@param val pointer to a variable where to write the byte read
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_rbyte(int8_t page, uint8_t addr, uint8_t *val);
+
+/**
+@brief Read a register of 2 to 4 bytes, least significant byte first
+@param page page of the register
+@param addr address of the register
+@param size_byte number of bytes of the register
+@param val pointer to a variable where to write the unsigned value read
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_rmulti(int8_t page, uint8_t addr, uint8_t size_byte, uint32_t *val);
+
+/**
+@brief Burst write starting at a register address
+@param page page of the register
+@param addr address of the register
+@param data pointer to byte array that will be sent to the LoRa concentrator
+@param size size of the transfer, in byte(s)
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_wburst(int8_t page, uint8_t addr, uint8_t *data, uint16_t size);
+
+/**
+@brief Burst read starting at a register address
+@param page page of the register
+@param addr address of the register
+@param data pointer to byte array that will be written from the LoRa concentrator
+@param size size of the transfer, in byte(s)
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_rburst(int8_t page, uint8_t addr, uint8_t *data, uint16_t size);
+
+/**
+@brief Enable or disable the host-side register shadow (enabled by default)
+@param enable true to serve sub-byte writes from the shadow and skip unchanged writes
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+The shadow content is discarded each time it is enabled, it is rebuilt by
+subsequent register reads and writes.
+*/
+int lgw_reg_shadow(bool enable);
+
+/**
+@brief Get the number of SPI accesses saved by the register shadow
+@param stat pointer to a structure where the counters will be copied
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_shadow_stat(struct lgw_reg_shadow_stat_s *stat);
+
+/**
+@brief Get the SPI traffic counters, see lgw_get_stats
+@param stats pointer to a structure that will be filled with the counters
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+The version checks of lgw_connect are not counted.
+*/
+int lgw_reg_stats(struct lgw_reg_stats_s *stats);
+
+/**
+@brief Reset the SPI traffic counters
+*/
+void lgw_reg_reset_stats(void);
+
+/**
+@brief LoRa concentrator register list write, grouped by page
+@param register_id array of register numbers
+@param reg_value array of values to write, reg_value[i] goes to register_id[i]
+@param nb number of registers in the list
+@param nb_page_switch pointer to where the number of page switches of the call is written (can be NULL)
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+Registers of the current page are written first, then the other pages in
+increasing order. Writes to the same page keep the list order. Registers common
+to all pages and registers whose access has a side effect (data ports, buffer
+pointers, commands) are barriers: nothing is moved across them.
+*/
+int lgw_reg_wl(uint16_t *register_id, int32_t *reg_value, uint16_t nb, uint16_t *nb_page_switch);
+
+/**
+@brief LoRa concentrator register list read, grouped by page
+@param register_id array of register numbers
+@param reg_value array where reg_value[i] receives the value of register_id[i]
+@param nb number of registers in the list
+@param nb_page_switch pointer to where the number of page switches of the call is written (can be NULL)
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+Same ordering rules as lgw_reg_wl.
+*/
+int lgw_reg_rl(uint16_t *register_id, int32_t *reg_value, uint16_t nb, uint16_t *nb_page_switch);
+
+/**
+@brief Start queuing register writes instead of sending them one by one
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+Until the matching lgw_reg_batch_commit, lgw_reg_w and lgw_reg_wb (and the page
+switches they need) are queued and sent as a single SPI transaction (see
+lgw_spi_wm). A register read sends the queued writes first. Batches can be
+nested, the queue is sent when the outermost batch is committed.
+*/
+int lgw_reg_batch_begin(void);
+
+/**
+@brief Send the register writes queued since lgw_reg_batch_begin
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_batch_commit(void);
+
+/**
+@brief Wait for the concentrator interrupt line, raised while the RX FIFO is not empty
+@param timeout_ms maximum time to wait, in milliseconds
+@return LGW_REG_SUCCESS on interrupt, LGW_REG_TIMEOUT on timeout, LGW_REG_ERROR if there is no interrupt line
+
+No register is accessed, so one thread can wait while another one reads or writes registers.
+*/
+int lgw_reg_irq_wait(uint32_t timeout_ms);
+
 
 #endif
 
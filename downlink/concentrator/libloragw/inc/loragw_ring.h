@@ -0,0 +1,113 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Bounded single-producer single-consumer ring buffer, used to hand packets
+	from one thread to the next without locking (RX -> processing -> logging).
+	When the ring is full the element is dropped and counted, the producer is
+	never blocked.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_RING_H
+#define _LORAGW_RING_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stddef.h>		/* size_t */
+
+#include "config.h"	/* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_RING_SUCCESS	 0
+#define LGW_RING_ERROR		-1
+#define LGW_RING_FULL		 1	/* element dropped, counted in nb_drop */
+#define LGW_RING_EMPTY		 2	/* nothing to pop */
+
+#define LGW_RING_NB_MAX		65536	/* maximum number of elements in a ring */
+#define LGW_RING_CACHE_LINE	64	/* head and tail are kept on different cache lines */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_ring_s
+@brief Ring buffer shared by exactly one producer thread and one consumer thread
+
+Only the producer writes head and nb_drop, only the consumer writes tail.
+*/
+struct lgw_ring_s {
+	uint8_t		*buf;		/*!> storage for nb_elem elements of elem_size bytes */
+	size_t		elem_size;	/*!> size of one element, in bytes */
+	uint32_t	mask;		/*!> nb_elem - 1, nb_elem is a power of 2 */
+	uint8_t		pad0[LGW_RING_CACHE_LINE];
+	uint32_t	head;		/*!> number of elements pushed (producer) */
+	uint32_t	nb_drop;	/*!> number of elements dropped because the ring was full (producer) */
+	uint8_t		pad1[LGW_RING_CACHE_LINE];
+	uint32_t	tail;		/*!> number of elements popped (consumer) */
+	uint32_t	nb_max;		/*!> highest number of elements seen in the ring by the consumer */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Allocate the storage of a ring
+@param ring pointer to the ring to initialize
+@param elem_size size of one element, in bytes
+@param nb_elem number of elements, must be a power of 2 (up to LGW_RING_NB_MAX)
+@return LGW_RING_ERROR if the parameters are invalid or the allocation failed, LGW_RING_SUCCESS else
+*/
+int lgw_ring_init(struct lgw_ring_s *ring, size_t elem_size, uint32_t nb_elem);
+
+/**
+@brief Free the storage of a ring, no thread must be using it anymore
+@param ring pointer to the ring to release
+*/
+void lgw_ring_free(struct lgw_ring_s *ring);
+
+/**
+@brief Copy an element at the head of the ring (producer thread only)
+@param ring pointer to the ring
+@param elem pointer to the element to copy
+@return LGW_RING_FULL if the element was dropped, LGW_RING_SUCCESS else
+*/
+int lgw_ring_push(struct lgw_ring_s *ring, const void *elem);
+
+/**
+@brief Copy the element at the tail of the ring and remove it (consumer thread only)
+@param ring pointer to the ring
+@param elem pointer to the buffer receiving the element
+@return LGW_RING_EMPTY if there was nothing to pop, LGW_RING_SUCCESS else
+*/
+int lgw_ring_pop(struct lgw_ring_s *ring, void *elem);
+
+/**
+@brief Number of elements waiting in the ring (approximate when called from a third thread)
+@param ring pointer to the ring
+@return number of elements pushed and not popped yet
+*/
+uint32_t lgw_ring_count(struct lgw_ring_s *ring);
+
+/**
+@brief Number of elements dropped since the ring was initialized
+@param ring pointer to the ring
+@return number of calls to lgw_ring_push that returned LGW_RING_FULL
+*/
+uint32_t lgw_ring_drops(struct lgw_ring_s *ring);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
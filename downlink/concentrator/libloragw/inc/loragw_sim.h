@@ -0,0 +1,201 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Control interface of the simulated LoRa concentrator (CFG_SPI=sim).
+	The simulated SPI layer answers lgw_spi_xxx calls from an in-process model
+	of the SX1301 register file, RX packet FIFO, TX data buffer and MCUs.
+	Test programs use the functions below to inject received packets and to
+	inspect the packets the HAL asked the concentrator to transmit.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_SIM_H
+#define _LORAGW_SIM_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+
+#include "config.h"	/* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_SIM_SUCCESS		 0
+#define LGW_SIM_ERROR		-1
+
+#define LGW_SIM_BOARD_NB	4		/* number of simulated concentrator boards */
+#define LGW_SIM_TX_LOG_NB	64		/* number of TX descriptors kept by each board */
+#define LGW_SIM_CAL_TIME	2100	/* default duration of the simulated calibration, in ms */
+#define LGW_SIM_RSSI_OFFSET	-166.0	/* RSSI offset assumed when encoding injected RSSI values */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_sim_rx_s
+@brief Packet to be injected in the RX path of a simulated board
+*/
+struct lgw_sim_rx_s {
+	uint8_t		if_chain;	/*!> by which IF chain the packet is received */
+	uint8_t		status;		/*!> status of the received packet (STAT_xxx) */
+	uint32_t	datarate;	/*!> LoRa: DR_LORA_SFx, ignored for FSK */
+	uint8_t		coderate;	/*!> LoRa: CR_LORA_4_x, ignored for FSK */
+	uint8_t		bandwidth;	/*!> LoRa: BW_xxx, must match the IF chain configuration */
+	float		rssi;		/*!> RSSI in dBm, as reported with rssi_offset = LGW_SIM_RSSI_OFFSET */
+	float		snr;		/*!> average packet SNR, in dB (LoRa only) */
+	float		snr_min;	/*!> minimum packet SNR, in dB (LoRa only) */
+	float		snr_max;	/*!> maximum packet SNR, in dB (LoRa only) */
+	uint32_t	count_us;	/*!> raw 'RX finished' timestamp, 0 to use the board counter */
+	uint16_t	crc;		/*!> CRC that was received in the payload */
+	uint16_t	size;		/*!> payload size in bytes */
+	uint8_t		payload[256];	/*!> buffer containing the payload */
+};
+
+/**
+@struct lgw_sim_tx_s
+@brief Descriptor of a packet the HAL triggered on a simulated board
+*/
+struct lgw_sim_tx_s {
+	uint32_t	trig_us;	/*!> board counter value when the TX was triggered */
+	uint8_t		tx_mode;	/*!> IMMEDIATE, TIMESTAMPED or ON_GPS */
+	uint32_t	count_us;	/*!> TIMESTAMPED: emission start, counter value (trigger + TX start delay) */
+	uint32_t	freq_hz;	/*!> center frequency decoded from the PLL words */
+	uint8_t		rf_chain;	/*!> through which RF chain the packet is sent */
+	uint8_t		pow_index;	/*!> index in the TX gain LUT selected by the HAL */
+	uint8_t		dig_gain;	/*!> digital gain register at trigger time */
+	int8_t		offset_i;	/*!> TX I offset register at trigger time */
+	int8_t		offset_q;	/*!> TX Q offset register at trigger time */
+	uint8_t		modulation;	/*!> MOD_LORA or MOD_FSK */
+	uint8_t		bandwidth;	/*!> LoRa: BW_xxx */
+	uint32_t	datarate;	/*!> LoRa: DR_LORA_SFx, FSK: bits per second */
+	uint8_t		coderate;	/*!> LoRa: CR_LORA_4_x */
+	uint8_t		f_dev;		/*!> FSK: frequency deviation, in kHz */
+	bool		invert_pol;	/*!> LoRa: polarity inversion */
+	bool		no_crc;		/*!> true if CRC generation is disabled */
+	bool		no_header;	/*!> LoRa: implicit header mode */
+	uint16_t	preamble;	/*!> preamble length, in symbols (LoRa) or bytes (FSK) */
+	uint32_t	airtime_us;	/*!> time on air computed by the model, in microseconds */
+	uint16_t	size;		/*!> payload size in bytes */
+	uint8_t		payload[256];	/*!> buffer containing the payload */
+};
+
+/**
+@struct lgw_sim_counters_s
+@brief SPI and packet counters of a simulated board
+*/
+struct lgw_sim_counters_s {
+	uint32_t	spi_w;		/*!> number of single-byte writes */
+	uint32_t	spi_r;		/*!> number of single-byte reads */
+	uint32_t	spi_wb;		/*!> number of burst writes */
+	uint32_t	spi_rb;		/*!> number of burst reads */
+	uint32_t	spi_chunks;	/*!> number of chunks the burst reads and writes were split into */
+	uint32_t	spi_wm;		/*!> number of multiple writes (one transaction each) */
+	uint32_t	wm_frames;	/*!> number of frames carried by the multiple writes */
+	uint32_t	bytes_w;	/*!> number of data bytes written */
+	uint32_t	bytes_r;	/*!> number of data bytes read */
+	uint32_t	rx_injected;	/*!> number of packets accepted in the RX FIFO */
+	uint32_t	rx_dropped;	/*!> number of packets rejected (FIFO or data buffer full) */
+	uint32_t	tx_triggered;	/*!> number of TX triggers */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Select which simulated board the next lgw_spi_open will connect to
+@param board board number, between 0 and LGW_SIM_BOARD_NB-1
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_select(int board);
+
+/**
+@brief Put a simulated board back in its power-on state (erases MCU program RAM)
+@param board board number
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_power_cycle(int board);
+
+/**
+@brief Connect or disconnect the interrupt line of a simulated board
+@param board board number
+@param enable false to simulate a board without interrupt line (lgw_spi_irq_wait then fails)
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_set_irq(int board, bool enable);
+
+/**
+@brief Set the time the simulated calibration firmware needs to complete
+@param board board number
+@param cal_time_ms calibration duration, in milliseconds
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_set_cal_time(int board, unsigned cal_time_ms);
+
+/**
+@brief Get the current value of the internal counter of a simulated board
+@param board board number
+@return counter value, in microseconds since the board was powered
+*/
+uint32_t lgw_sim_get_count(int board);
+
+/**
+@brief Put a packet in the RX FIFO of a simulated board
+@param board board number
+@param pkt pointer to the description of the packet to receive
+@return LGW_SIM_ERROR if the packet is invalid for the current modem configuration or does not fit in the FIFO, LGW_SIM_SUCCESS otherwise
+*/
+int lgw_sim_inject_rx(int board, const struct lgw_sim_rx_s *pkt);
+
+/**
+@brief Get the number of packets waiting in the RX FIFO of a simulated board
+@param board board number
+@return number of packets, LGW_SIM_ERROR on invalid board
+*/
+int lgw_sim_rx_pending(int board);
+
+/**
+@brief Get the number of TX triggers recorded by a simulated board
+@param board board number
+@return number of TX triggers since power-on, LGW_SIM_ERROR on invalid board
+*/
+int lgw_sim_tx_count(int board);
+
+/**
+@brief Get a recorded TX descriptor
+@param board board number
+@param index index of the TX, between lgw_sim_tx_count()-LGW_SIM_TX_LOG_NB and lgw_sim_tx_count()-1
+@param tx pointer to a structure that will be filled with the descriptor
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_get_tx(int board, int index, struct lgw_sim_tx_s *tx);
+
+/**
+@brief Get the SPI and packet counters of a simulated board
+@param board board number
+@param cnt pointer to a structure that will be filled with the counters
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_get_counters(int board, struct lgw_sim_counters_s *cnt);
+
+/**
+@brief Reset the SPI and packet counters of a simulated board
+@param board board number
+@return status of operation (LGW_SIM_SUCCESS/LGW_SIM_ERROR)
+*/
+int lgw_sim_reset_counters(int board);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,132 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	SPI trace: record every transaction between loragw_reg and the SPI backend
+	to a compact binary file, and replay a recorded trace in place of the
+	backend to run the HAL without a concentrator.
+	The lgw_trace_* link functions have the signature of their lgw_spi_*
+	counterpart and are the only ones loragw_reg calls; when no trace is
+	active they are a direct call to the backend.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_TRACE_H
+#define _LORAGW_TRACE_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* FILE */
+
+#include "config.h"	/* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_TRACE_SUCCESS	 0
+#define LGW_TRACE_ERROR		-1
+
+#define LGW_TRACE_OFF		0	/* transactions go to the SPI backend, nothing recorded */
+#define LGW_TRACE_RECORD	1	/* transactions go to the SPI backend and are written to the trace file */
+#define LGW_TRACE_REPLAY	2	/* transactions are answered from the trace file, no SPI backend access */
+
+#define LGW_TRACE_STREAM_NB	8	/* number of calling threads told apart in a trace */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_trace_stat_s
+@brief State of the current or last trace
+*/
+struct lgw_trace_stat_s {
+	int			mode;		/*!> LGW_TRACE_OFF, LGW_TRACE_RECORD or LGW_TRACE_REPLAY */
+	uint32_t	nb_record;	/*!> number of transactions recorded, or replayed */
+	uint32_t	nb_total;	/*!> number of transactions in the replayed trace */
+	uint32_t	nb_mismatch;	/*!> number of replayed calls that did not match the trace, answered with LGW_SPI_ERROR */
+	int32_t		first_mismatch;	/*!> index in the trace of the transaction expected at the first mismatch, -1 if none */
+	uint64_t	nb_byte;	/*!> size of the trace file written, or read */
+	uint64_t	time_us;	/*!> time of the last recorded or replayed transaction, since the start of the trace */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Record all the following SPI transactions to a file
+@param path trace file, created or truncated
+@return LGW_TRACE_ERROR if the file cannot be created or a trace is active, LGW_TRACE_SUCCESS else
+
+Can be called while the concentrator is connected, the trace then starts with
+the next transaction.
+*/
+int lgw_trace_record(const char *path);
+
+/**
+@brief Answer all the following SPI transactions from a recorded trace
+@param path trace file, written by lgw_trace_record
+@return LGW_TRACE_ERROR if the file is not a valid trace, a trace is active or the concentrator is connected, LGW_TRACE_SUCCESS else
+
+Must be called before lgw_start (or lgw_connect), with the configuration used
+for the recording. Each calling thread follows the transactions of one
+recorded thread, bound at its first call: a multi-threaded application
+replays its own traces even though the threads are not scheduled the same way.
+Reads return the recorded data and status, writes are compared with the
+recorded ones; a call that does not match the trace returns LGW_SPI_ERROR,
+is counted in nb_mismatch and does not consume the trace. Interrupt waits
+return at once with the recorded status (LGW_SPI_TIMEOUT when the recorded
+program did not wait at that point), so the trace runs at full speed.
+*/
+int lgw_trace_replay(const char *path);
+
+/**
+@brief Close the trace file and go back to LGW_TRACE_OFF
+@return LGW_TRACE_ERROR if a replay is connected (lgw_stop first), LGW_TRACE_SUCCESS else
+
+lgw_trace_stat keeps reporting the counters of the stopped trace.
+*/
+int lgw_trace_stop(void);
+
+/**
+@brief Get the counters of the current or last trace
+@param stat pointer to a structure that will be filled with the counters
+@return LGW_TRACE_ERROR if stat is NULL, LGW_TRACE_SUCCESS else
+*/
+int lgw_trace_stat(struct lgw_trace_stat_s *stat);
+
+/**
+@brief Convert a trace file to text, one line per transaction
+@param path trace file, written by lgw_trace_record
+@param out stream that receives the text
+@return LGW_TRACE_ERROR if the file is not a valid trace, LGW_TRACE_SUCCESS else
+
+Line format: time in seconds, thread, operation, register address, size, data
+bytes in hexadecimal and 'ERR' if the backend returned an error. Multiple
+write frames are printed one per line.
+*/
+int lgw_trace_dump(const char *path, FILE *out);
+
+/* SPI link, same signatures and return values as the lgw_spi_* functions */
+int lgw_trace_open_dev(void **spi_target_ptr, const char *dev);
+int lgw_trace_close(void *spi_target);
+int lgw_trace_w(void *spi_target, uint8_t address, uint8_t data);
+int lgw_trace_r(void *spi_target, uint8_t address, uint8_t *data);
+int lgw_trace_wb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size);
+int lgw_trace_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size);
+int lgw_trace_wm(void *spi_target, uint8_t *address, uint16_t *size, uint8_t *data, uint16_t nb);
+int lgw_trace_irq_wait(void *spi_target, uint32_t timeout_ms);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
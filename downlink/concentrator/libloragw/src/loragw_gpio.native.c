@@ -23,6 +23,7 @@ Maintainer: Miguel Luis
 #include <unistd.h>		/* lseek, close */
 #include <fcntl.h>		/* open */
 #include <string.h>		/* memset */
+#include <poll.h>		/* poll */
 
 #include "loragw_aux.h"
 #include "loragw_gpio.h"
@@ -163,5 +164,72 @@ int lgw_gpio_write(int pin, int value) {
     return(LGW_GPIO_SUCCESS);
 }
 
+/* GPIO edge */
+int lgw_gpio_edge(int pin, int edge) {
+    static const char *s_edges_str[] = {"none", "rising", "falling", "both"};
+
+    char path[BUFFER_MAX];
+    int fd;
+
+    if ((edge < LGW_GPIO_EDGE_NONE) || (edge > LGW_GPIO_EDGE_BOTH)) {
+        DEBUG_MSG("Invalid gpio edge!\n");
+        return(LGW_GPIO_ERROR);
+    }
+
+    snprintf(path, BUFFER_MAX, "/sys/class/gpio/gpio%d/edge", pin);
+    fd = open(path, O_WRONLY);
+    if (fd == LGW_GPIO_ERROR) {
+        DEBUG_MSG("Failed to open gpio edge for writing!\n");
+        return(LGW_GPIO_ERROR);
+    }
+
+    if (write(fd, s_edges_str[edge], strlen(s_edges_str[edge])) == LGW_GPIO_ERROR) {
+        DEBUG_MSG("Failed to set edge!\n");
+        close(fd);
+        return(LGW_GPIO_ERROR);
+    }
+
+    close(fd);
+    return(LGW_GPIO_SUCCESS);
+}
+
+/* GPIO wait */
+int lgw_gpio_wait(int pin, int timeout_ms) {
+    char path[BUFFER_MAX];
+    char value_str[3];
+    struct pollfd pfd;
+    int fd;
+    int i;
+
+    snprintf(path, BUFFER_MAX, "/sys/class/gpio/gpio%d/value", pin);
+    fd = open(path, O_RDONLY);
+    if (fd == LGW_GPIO_ERROR) {
+        DEBUG_MSG("Failed to open gpio value for reading!\n");
+        return(LGW_GPIO_ERROR);
+    }
+
+    /* reading the value acknowledges the pending event, an edge after that read wakes poll up */
+    if (read(fd, value_str, 3) == LGW_GPIO_ERROR) {
+        DEBUG_MSG("Failed to read value!\n");
+        close(fd);
+        return(LGW_GPIO_ERROR);
+    }
+    if (atoi(value_str) == LGW_GPIO_HIGH) {
+        close(fd);
+        return(LGW_GPIO_HIGH);
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLPRI | POLLERR;
+    pfd.revents = 0;
+    i = poll(&pfd, 1, timeout_ms);
+    close(fd);
+    if (i < 0) {
+        DEBUG_MSG("Failed to poll value!\n");
+        return(LGW_GPIO_ERROR);
+    }
+    return((i > 0) ? LGW_GPIO_HIGH : LGW_GPIO_LOW);
+}
+
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -34,7 +34,7 @@ Maintainer: Sylvain Miermont
 #include <time.h>		/* struct timespec */
 #include <fcntl.h>		/* open */
 #include <termios.h>	/* tcflush */
-#include <math.h>       /* modf */
+#include <math.h>       /* modf sqrt fabs llround */
 
 #include <stdlib.h> // DEBUG
 
@@ -62,6 +62,65 @@ Maintainer: Sylvain Miermont
 #define		PLUS_10PPM			1.00001
 #define		MINUS_10PPM			0.99999
 #define		DEFAULT_BAUDRATE	B9600
+#define		NMEA_LEN_MAX		120 /* longer sentences are dropped by the stream parser (NMEA limit is 82) */
+#define		NMEA_FRAC_MAX		1000000000 /* 10^(number of fraction digits kept by the stream parser) */
+#define		FIT_RES_MIN			0.29 /* floor of the deviation of the fit residuals (quantization of the 1 MHz counter), in us */
+#define		FIT_OUT_NB			4.0 /* points further than FIT_OUT_NB deviations from the fit are left out of it */
+#define		FIT_GATE_MIN		10.0 /* a new sync point closer than this to the prediction of the fit is always accepted, in us */
+#define		FIT_GATE_NB			6.0 /* a new sync point further than FIT_GATE_NB uncertainties from the prediction is rejected */
+#define		FIT_WANDER			1E-9 /* assumed drift of the crystal error per second, for the holdover uncertainty */
+#define		FIT_ABER_MAX		3 /* number of successive rejected sync points that restarts the window */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* position of the stream parser in a sentence */
+enum nmea_step_e {
+	NMEA_WAIT,		/* waiting for the '$' that starts a sentence */
+	NMEA_FIELD,		/* in the address field (index 0) or a data field */
+	NMEA_CS_HI,		/* waiting for the first checksum digit, after '*' */
+	NMEA_CS_LO		/* waiting for the second checksum digit */
+};
+
+/* current field, parsed as a number while its characters arrive */
+struct nmea_field_s {
+	uint32_t	ival;	/* integer part */
+	uint8_t		idig;	/* number of digits of the integer part */
+	uint32_t	fval;	/* fractional part */
+	uint32_t	fdiv;	/* 0 if no '.', else 10^(number of digits of fval) */
+	bool		neg;	/* leading '-' */
+	bool		num;	/* only digits, one '.' and a leading '-' so far */
+	uint8_t		nchar;	/* number of characters */
+	char		c0;		/* first character */
+};
+
+/* values of the sentence being parsed, applied once its checksum is verified */
+struct nmea_pending_s {
+	short		yea, mon, day, hou, min, sec;
+	float		fra;
+	bool		time_ok;	/* time field present */
+	uint8_t		date_nb;	/* number of date items present (day, month, year) */
+	char		mod;
+	short		dla, dlo, alt, sat;
+	double		mla, mlo;
+	char		ola, olo;
+	bool		lat_ok, lon_ok, alt_ok, sat_ok;
+	uint8_t		dim;
+	float		pdop, hdop, vdop;
+};
+
+/* state of the stream parser, kept between calls */
+struct nmea_stream_s {
+	enum nmea_step_e		step;
+	enum gps_msg			type;	/* sentence type, known at the end of the address field */
+	char					addr[5];	/* address field: talker and sentence formatter */
+	int						len;	/* number of characters since '$' */
+	int						idx;	/* index of the current field, 0 is the address */
+	uint8_t					cs;		/* checksum of the characters between '$' and '*' */
+	uint8_t					cs_rx;	/* checksum read after '*' */
+	struct nmea_field_s		f;
+	struct nmea_pending_s	p;
+};
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
@@ -88,6 +147,12 @@ static bool gps_pos_ok = false;
 
 static char gps_mod = 'N'; /* GPS mode (N no fix, A autonomous, D differential) */
 static short gps_sat = 0; /* number of satellites used for fix */
+static uint8_t gps_dim = 0; /* GSA navigation mode (1 no fix, 2 2D, 3 3D) */
+static float gps_pdop = 0.0; /* dilutions of precision */
+static float gps_hdop = 0.0;
+static float gps_vdop = 0.0;
+
+static struct nmea_stream_s nmea_st = { .step = NMEA_WAIT }; /* state of lgw_parse_nmea_stream */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
@@ -102,6 +167,16 @@ bool match_label(char *s, char *label, int size, char wildcard);
 
 int str_chop(char *s, int buff_size, char separator, int *idx_ary, int max_idx);
 
+void nmea_field_start(void);
+
+void nmea_field_char(char c);
+
+void nmea_field_end(void);
+
+enum gps_msg nmea_sentence_end(void);
+
+int fit_solve(struct tref_fit *fit, struct tref *ref);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -247,6 +322,351 @@ int str_chop(char *s, int buff_size, char separator, int *idx_ary, int max_idx)
 	return j;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* clear the field accumulator of the stream parser */
+void nmea_field_start(void) {
+	memset(&nmea_st.f, 0, sizeof nmea_st.f);
+	nmea_st.f.num = true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* add a character to the current field, digits are accumulated as they arrive */
+void nmea_field_char(char c) {
+	struct nmea_field_s *f = &nmea_st.f;
+
+	f->nchar += 1;
+	if (f->nchar == 1) {
+		f->c0 = c;
+	}
+	if ((nmea_st.idx == 0) && (f->nchar <= sizeof nmea_st.addr)) {
+		nmea_st.addr[f->nchar - 1] = c;
+	}
+	if ((c >= '0') && (c <= '9')) {
+		if (f->fdiv == 0) {
+			if (f->idig >= 9) {
+				f->num = false; /* does not fit, no field of interest is that long */
+			}
+			f->ival = (f->ival * 10) + (c - '0');
+			f->idig += 1;
+		} else if (f->fdiv < NMEA_FRAC_MAX) {
+			f->fval = (f->fval * 10) + (c - '0');
+			f->fdiv *= 10;
+		} /* else, digits beyond the resolution are ignored */
+	} else if ((c == '.') && (f->fdiv == 0)) {
+		f->fdiv = 1;
+	} else if ((c == '-') && (f->nchar == 1)) {
+		f->neg = true;
+	} else {
+		f->num = false;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* interpret the field that just ended, according to the sentence type and its index */
+void nmea_field_end(void) {
+	struct nmea_field_s *f = &nmea_st.f;
+	struct nmea_pending_s *p = &nmea_st.p;
+	bool num = (f->num == true) && (f->idig > 0);
+	double frac = (f->fdiv > 1) ? ((double)f->fval / (double)f->fdiv) : 0.0;
+	enum gps_msg type = nmea_st.type;
+	int idx = nmea_st.idx;
+
+	if (idx == 0) {
+		/* address field: $G?xxx for the sentences of interest, any GNSS talker */
+		nmea_st.type = IGNORED;
+		if ((f->nchar == 5) && (nmea_st.addr[0] == 'G')) {
+			if (memcmp(nmea_st.addr + 2, "RMC", 3) == 0) {
+				nmea_st.type = NMEA_RMC;
+			} else if (memcmp(nmea_st.addr + 2, "GGA", 3) == 0) {
+				nmea_st.type = NMEA_GGA;
+			} else if (memcmp(nmea_st.addr + 2, "ZDA", 3) == 0) {
+				nmea_st.type = NMEA_ZDA;
+			} else if (memcmp(nmea_st.addr + 2, "GSA", 3) == 0) {
+				nmea_st.type = NMEA_GSA;
+			}
+		}
+	} else if ((idx == 1) && ((type == NMEA_RMC) || (type == NMEA_ZDA))) {
+		/* hhmmss.sss */
+		if (num && (f->idig == 6) && !f->neg) {
+			p->hou = f->ival / 10000;
+			p->min = (f->ival / 100) % 100;
+			p->sec = f->ival % 100;
+			p->fra = (float)frac;
+			p->time_ok = true;
+		}
+	} else if (type == NMEA_RMC) {
+		/* $xxRMC,time,status,lat,NS,long,EW,spd,cog,date,mv,mvEW,posMode*cs */
+		if ((idx == 9) && num && (f->idig == 6) && (f->fdiv == 0)) {
+			p->day = f->ival / 10000;
+			p->mon = (f->ival / 100) % 100;
+			p->yea = f->ival % 100;
+			p->date_nb = 3;
+		} else if (idx == 12) {
+			p->mod = f->c0;
+		}
+	} else if (type == NMEA_GGA) {
+		/* $xxGGA,time,lat,NS,long,EW,quality,numSV,HDOP,alt,M,sep,M,diffAge,diffStation*cs */
+		switch (idx) {
+			case 2: /* ddmm.mmmmm */
+				if (num && (f->idig >= 3) && !f->neg) {
+					p->dla = f->ival / 100;
+					p->mla = (double)(f->ival % 100) + frac;
+					p->lat_ok = true;
+				}
+				break;
+			case 3: p->ola = f->c0; break;
+			case 4: /* dddmm.mmmmm */
+				if (num && (f->idig >= 3) && !f->neg) {
+					p->dlo = f->ival / 100;
+					p->mlo = (double)(f->ival % 100) + frac;
+					p->lon_ok = true;
+				}
+				break;
+			case 5: p->olo = f->c0; break;
+			case 7:
+				if (num) {
+					p->sat = f->ival;
+					p->sat_ok = true;
+				}
+				break;
+			case 9: /* integer part, in meters */
+				if (num) {
+					p->alt = f->neg ? -(short)f->ival : (short)f->ival;
+					p->alt_ok = true;
+				}
+				break;
+			default: break;
+		}
+	} else if (type == NMEA_ZDA) {
+		/* $xxZDA,time,day,month,year,ltzh,ltzn*cs */
+		if (num && (f->fdiv == 0) && !f->neg) {
+			switch (idx) {
+				case 2: p->day = f->ival; p->date_nb += 1; break;
+				case 3: p->mon = f->ival; p->date_nb += 1; break;
+				case 4: p->yea = f->ival; p->date_nb += (f->idig == 4) ? 1 : 0; break;
+				default: break;
+			}
+		}
+	} else if (type == NMEA_GSA) {
+		/* $xxGSA,opMode,navMode{,sv},PDOP,HDOP,VDOP[,systemId]*cs, 12 satellite fields */
+		switch (idx) {
+			case 2: p->dim = num ? f->ival : 0; break;
+			case 15: p->pdop = num ? (float)(f->ival + frac) : 0.0; break;
+			case 16: p->hdop = num ? (float)(f->ival + frac) : 0.0; break;
+			case 17: p->vdop = num ? (float)(f->ival + frac) : 0.0; break;
+			default: break;
+		}
+	}
+
+	nmea_st.idx += 1;
+	nmea_field_start();
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* checksum received: check the sentence and apply it to the GPS solution */
+enum gps_msg nmea_sentence_end(void) {
+	struct nmea_pending_s *p = &nmea_st.p;
+	int nb_fields = nmea_st.idx;
+
+	if (nmea_st.cs != nmea_st.cs_rx) {
+		DEBUG_MSG("Warning: invalid NMEA sentence (bad checksum)\n");
+		return INVALID;
+	}
+
+	switch (nmea_st.type) {
+		case NMEA_RMC:
+			if (nb_fields != 13) {
+				DEBUG_MSG("Warning: invalid RMC sentence (number of fields)\n");
+				return INVALID;
+			}
+			gps_mod = ((p->mod == 'A') || (p->mod == 'D')) ? p->mod : 'N';
+			break;
+		case NMEA_GGA:
+			if (nb_fields != 15) {
+				DEBUG_MSG("Warning: invalid GGA sentence (number of fields)\n");
+				return INVALID;
+			}
+			if (p->sat_ok) {
+				gps_sat = p->sat;
+			}
+			if (p->lat_ok && p->lon_ok && p->alt_ok && ((p->ola == 'N') || (p->ola == 'S')) && ((p->olo == 'E') || (p->olo == 'W'))) {
+				gps_dla = p->dla;
+				gps_mla = p->mla;
+				gps_ola = p->ola;
+				gps_dlo = p->dlo;
+				gps_mlo = p->mlo;
+				gps_olo = p->olo;
+				gps_alt = p->alt;
+				gps_pos_ok = true;
+			} else {
+				gps_pos_ok = false;
+			}
+			return NMEA_GGA;
+		case NMEA_ZDA:
+			if (nb_fields != 7) {
+				DEBUG_MSG("Warning: invalid ZDA sentence (number of fields)\n");
+				return INVALID;
+			}
+			break;
+		case NMEA_GSA:
+			if ((nb_fields != 18) && (nb_fields != 19)) { /* NMEA 4.1 adds the system ID */
+				DEBUG_MSG("Warning: invalid GSA sentence (number of fields)\n");
+				return INVALID;
+			}
+			gps_dim = p->dim;
+			gps_pdop = p->pdop;
+			gps_hdop = p->hdop;
+			gps_vdop = p->vdop;
+			return NMEA_GSA;
+		default:
+			return IGNORED;
+	}
+
+	/* RMC and ZDA: date and time, only valid with a fix */
+	if (p->time_ok && (p->date_nb == 3)) {
+		gps_yea = p->yea;
+		gps_mon = p->mon;
+		gps_day = p->day;
+		gps_hou = p->hou;
+		gps_min = p->min;
+		gps_sec = p->sec;
+		gps_fra = p->fra;
+		gps_time_ok = (gps_mod == 'A') || (gps_mod == 'D');
+	} else {
+		gps_time_ok = false;
+	}
+	return nmea_st.type;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/*
+Least squares fit of the timestamps of the sync points against their UTC time,
+both relative to the latest sync point, done twice: the second pass leaves out
+the points further than FIT_OUT_NB deviations (estimated from the median
+residual) from the first fit.
+Updates the fit results and the time reference, returns an error (and changes
+nothing) if there are not enough points or the clock error is out of range.
+*/
+int fit_solve(struct tref_fit *fit, struct tref *ref) {
+	double x[LGW_GPS_FIT_WIN]; /* timestamp of the points, in s */
+	double y[LGW_GPS_FIT_WIN]; /* UTC time of the points, in s */
+	double r[LGW_GPS_FIT_WIN]; /* absolute residuals */
+	double m[LGW_GPS_FIT_WIN]; /* sorted absolute residuals */
+	bool used[LGW_GPS_FIT_WIN];
+	double mx, my, sxy, syy, a, b, s, thr;
+	int i, j, n, pass, nb_out;
+	uint32_t cnt0 = fit->count_us[fit->last];
+	struct timespec utc0 = fit->utc[fit->last];
+	int64_t ns;
+
+	for (i = 0; i < fit->nb; ++i) {
+		x[i] = (double)(int32_t)(fit->count_us[i] - cnt0) / TS_CPS;
+		y[i] = (double)(fit->utc[i].tv_sec - utc0.tv_sec) + 1E-9 * (double)(fit->utc[i].tv_nsec - utc0.tv_nsec);
+		used[i] = true;
+	}
+
+	for (pass = 0; pass < 2; ++pass) {
+		/* least squares */
+		n = 0;
+		mx = 0.0;
+		my = 0.0;
+		for (i = 0; i < fit->nb; ++i) {
+			if (used[i]) {
+				mx += x[i];
+				my += y[i];
+				n += 1;
+			}
+		}
+		if (n < 2) {
+			return LGW_GPS_ERROR;
+		}
+		mx /= n;
+		my /= n;
+		sxy = 0.0;
+		syy = 0.0;
+		for (i = 0; i < fit->nb; ++i) {
+			if (used[i]) {
+				sxy += (y[i] - my) * (x[i] - mx);
+				syy += (y[i] - my) * (y[i] - my);
+			}
+		}
+		if (syy <= 0.0) {
+			return LGW_GPS_ERROR;
+		}
+		b = sxy / syy;
+		a = mx - b * my;
+
+		/* residuals */
+		s = 0.0;
+		for (i = 0; i < fit->nb; ++i) {
+			r[i] = fabs(x[i] - a - b * y[i]);
+			if (used[i]) {
+				s += r[i] * r[i];
+			}
+		}
+		s = (n > 2) ? sqrt(s / (n - 2)) : 0.0;
+		if (s < (FIT_RES_MIN * 1E-6)) {
+			s = FIT_RES_MIN * 1E-6;
+		}
+		if ((pass == 1) || (n < 4)) {
+			break;
+		}
+
+		/* outliers, from the median of the absolute residuals (insertion sort, few points) */
+		for (i = 0; i < fit->nb; ++i) {
+			for (j = i; (j > 0) && (m[j - 1] > r[i]); --j) {
+				m[j] = m[j - 1];
+			}
+			m[j] = r[i];
+		}
+		thr = FIT_OUT_NB * 1.4826 * m[fit->nb / 2];
+		if (thr < (FIT_OUT_NB * FIT_RES_MIN * 1E-6)) {
+			thr = FIT_OUT_NB * FIT_RES_MIN * 1E-6;
+		}
+		nb_out = 0;
+		for (i = 0; i < fit->nb; ++i) {
+			if (r[i] > thr) {
+				used[i] = false;
+				nb_out += 1;
+			}
+		}
+		if (nb_out == 0) {
+			break;
+		}
+	}
+
+	if ((b > PLUS_10PPM) || (b < MINUS_10PPM)) {
+		DEBUG_MSG("Warning: correction range exceeded\n");
+		return LGW_GPS_ERROR;
+	}
+
+	fit->nb_used = n;
+	fit->xtal_err = b;
+	fit->xtal_sd = s / sqrt(syy);
+	fit->res_us = s * 1E6;
+	fit->off_us = a * 1E6;
+	fit->mean_s = my;
+	fit->var_s = syy;
+
+	/* reference: timestamp of the latest point, at the UTC time given by the fit */
+	ns = (int64_t)utc0.tv_nsec - llround(a / b * 1E9);
+	ref->systime = time(NULL);
+	ref->count_us = cnt0;
+	ref->utc.tv_sec = utc0.tv_sec + (time_t)(ns / 1000000000);
+	ref->utc.tv_nsec = (long)(ns % 1000000000);
+	if (ref->utc.tv_nsec < 0) {
+		ref->utc.tv_sec -= 1;
+		ref->utc.tv_nsec += 1000000000;
+	}
+	ref->xtal_err = b;
+	return LGW_GPS_SUCCESS;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
@@ -314,6 +734,8 @@ int lgw_gps_enable(char *tty_path, char *gps_familly, speed_t target_brate, int
 	gps_time_ok = false;
 	gps_pos_ok = false;
 	gps_mod = 'N';
+	gps_dim = 0;
+	nmea_st.step = NMEA_WAIT;
 	
 	return LGW_GPS_SUCCESS;
 }
@@ -413,6 +835,107 @@ enum gps_msg lgw_parse_nmea(char *serial_buff, int buff_size) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+enum gps_msg lgw_parse_nmea_stream(const char *data, int size, int *used) {
+	struct nmea_stream_s *st = &nmea_st;
+	enum gps_msg msg = UNKNOWN;
+	int i;
+	int len;
+	char c;
+	uint8_t v;
+	uint8_t cs;
+
+	/* check input parameters */
+	if ((data == NULL) || (size < 0)) {
+		size = 0;
+	}
+
+	for (i = 0; (i < size) && (msg == UNKNOWN); ++i) {
+		c = data[i];
+
+		/* a '$' always starts a new sentence, an unfinished one is dropped */
+		if (c == '$') {
+			if (st->step != NMEA_WAIT) {
+				DEBUG_MSG("Warning: unfinished NMEA sentence dropped\n");
+			}
+			memset(st, 0, sizeof *st);
+			st->step = NMEA_FIELD;
+			nmea_field_start();
+			continue;
+		}
+
+		switch (st->step) {
+			case NMEA_FIELD:
+				st->len += 1;
+				if ((c < 0x20) || (c > 0x7E) || (st->len > NMEA_LEN_MAX)) {
+					DEBUG_MSG("Warning: invalid NMEA sentence (truncated)\n");
+					st->step = NMEA_WAIT;
+					msg = INVALID;
+				} else if (c == '*') {
+					if (st->type != IGNORED) {
+						nmea_field_end();
+					}
+					st->step = NMEA_CS_HI;
+				} else if (st->type == IGNORED) {
+					/* only the checksum of the other sentences is needed, run to the '*' */
+					cs = st->cs ^ (uint8_t)c;
+					len = st->len;
+					while ((i + 1 < size) && (len < NMEA_LEN_MAX)) {
+						c = data[i + 1];
+						if ((c == '*') || (c == '$') || (c < 0x20) || (c > 0x7E)) {
+							break;
+						}
+						cs ^= (uint8_t)c;
+						len += 1;
+						i += 1;
+					}
+					st->cs = cs;
+					st->len = len;
+				} else {
+					st->cs ^= (uint8_t)c;
+					if (c == ',') {
+						nmea_field_end();
+					} else {
+						nmea_field_char(c);
+					}
+				}
+				break;
+
+			case NMEA_CS_HI:
+			case NMEA_CS_LO:
+				if ((c >= '0') && (c <= '9')) {
+					v = c - '0';
+				} else if ((c >= 'A') && (c <= 'F')) {
+					v = c - 'A' + 10;
+				} else if ((c >= 'a') && (c <= 'f')) {
+					v = c - 'a' + 10;
+				} else {
+					DEBUG_MSG("Warning: invalid NMEA sentence (checksum format)\n");
+					st->step = NMEA_WAIT;
+					msg = INVALID;
+					break;
+				}
+				st->cs_rx = (st->cs_rx << 4) | v;
+				if (st->step == NMEA_CS_HI) {
+					st->step = NMEA_CS_LO;
+				} else {
+					st->step = NMEA_WAIT;
+					msg = nmea_sentence_end();
+				}
+				break;
+
+			default: /* NMEA_WAIT, line ends and noise between sentences */
+				break;
+		}
+	}
+
+	if (used != NULL) {
+		*used = i;
+	}
+	return msg;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_gps_get(struct timespec *utc, struct coord_s *loc, struct coord_s *err) {
 	struct tm x;
 	time_t y;
@@ -462,6 +985,19 @@ int lgw_gps_get(struct timespec *utc, struct coord_s *loc, struct coord_s *err)
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_gps_get_fix(struct lgw_gps_fix_s *fix) {
+	CHECK_NULL(fix);
+	fix->mode = gps_mod;
+	fix->nb_sat = gps_sat;
+	fix->dim = gps_dim;
+	fix->pdop = gps_pdop;
+	fix->hdop = gps_hdop;
+	fix->vdop = gps_vdop;
+	return LGW_GPS_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc) {
 	double cnt_diff; /* internal concentrator time difference (in seconds) */
 	double utc_diff; /* UTC time difference (in seconds) */
@@ -526,6 +1062,116 @@ int lgw_gps_sync(struct tref *ref, uint32_t count_us, struct timespec utc) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_gps_fit_init(struct tref_fit *fit) {
+	CHECK_NULL(fit);
+	memset(fit, 0, sizeof *fit);
+	fit->last = LGW_GPS_FIT_WIN - 1;
+	fit->xtal_err = 1.0;
+	return LGW_GPS_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_gps_sync_fit(struct tref_fit *fit, struct tref *ref, uint32_t count_us, struct timespec utc) {
+	double cnt_diff; /* time since the latest sync point, from the concentrator counter (in seconds) */
+	double utc_diff; /* time since the latest sync point, from UTC (in seconds) */
+	double err_us; /* uncertainty of the prediction of the fit */
+	double dev_us; /* distance to the prediction of the fit */
+	bool aber = false;
+	int last, nb;
+	uint32_t old_cnt; /* oldest sync point, replaced by the new one */
+	struct timespec old_utc;
+
+	CHECK_NULL(fit);
+	CHECK_NULL(ref);
+
+	/* compare with the latest sync point, or the prediction of the fit */
+	if (fit->nb > 0) {
+		cnt_diff = (double)(int32_t)(count_us - fit->count_us[fit->last]) / TS_CPS;
+		utc_diff = (double)(utc.tv_sec - fit->utc[fit->last].tv_sec) + 1E-9 * (double)(utc.tv_nsec - fit->utc[fit->last].tv_nsec);
+		if (utc_diff <= 0) {
+			DEBUG_MSG("Warning: aberrant UTC value for synchronization\n");
+			aber = true;
+		} else if ((fit->nb_used >= 4) && (lgw_gps_fit_err(fit, count_us, &err_us) == LGW_GPS_SUCCESS)) {
+			dev_us = fabs(cnt_diff * 1E6 - fit->off_us - utc_diff * fit->xtal_err * 1E6);
+			aber = (dev_us > FIT_GATE_MIN) && (dev_us > (FIT_GATE_NB * err_us));
+		} else {
+			aber = (cnt_diff / utc_diff > PLUS_10PPM) || (cnt_diff / utc_diff < MINUS_10PPM);
+		}
+	}
+	if (aber) {
+		fit->nb_aber += 1;
+		if (fit->nb_aber < FIT_ABER_MAX) {
+			DEBUG_MSG("Warning: aberrant sync point, reference kept\n");
+			fit->nb_reject += 1;
+			return LGW_GPS_ERROR;
+		}
+		/* GPS or concentrator restarted: new window from this point (keep xtal_err) */
+		DEBUG_MSG("Warning: %d successive aberrant sync points, sync reset\n", FIT_ABER_MAX);
+		fit->nb = 0;
+		fit->last = LGW_GPS_FIT_WIN - 1;
+		fit->nb_used = 0;
+	}
+	fit->nb_aber = 0;
+
+	/* add the point to the window, the oldest one goes */
+	last = fit->last;
+	nb = fit->nb;
+	fit->last = (fit->last + 1) % LGW_GPS_FIT_WIN;
+	old_cnt = fit->count_us[fit->last];
+	old_utc = fit->utc[fit->last];
+	fit->count_us[fit->last] = count_us;
+	fit->utc[fit->last] = utc;
+	if (fit->nb < LGW_GPS_FIT_WIN) {
+		fit->nb += 1;
+	}
+
+	if (fit->nb == 1) {
+		/* first point, nothing to fit yet */
+		ref->systime = time(NULL);
+		ref->count_us = count_us;
+		ref->utc = utc;
+		if ((ref->xtal_err > PLUS_10PPM) || (ref->xtal_err < MINUS_10PPM)) {
+			ref->xtal_err = 1.0;
+		}
+		fit->xtal_err = ref->xtal_err;
+		fit->off_us = 0.0;
+		return LGW_GPS_SUCCESS;
+	}
+	if (fit_solve(fit, ref) != LGW_GPS_SUCCESS) {
+		/* the point goes back out of the window */
+		fit->count_us[fit->last] = old_cnt;
+		fit->utc[fit->last] = old_utc;
+		fit->last = last;
+		fit->nb = nb;
+		fit->nb_reject += 1;
+		return LGW_GPS_ERROR;
+	}
+	return LGW_GPS_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_gps_fit_err(const struct tref_fit *fit, uint32_t count_us, double *err_us) {
+	double t; /* UTC time since the latest sync point (in seconds) */
+
+	CHECK_NULL(fit);
+	CHECK_NULL(err_us);
+	if ((fit->nb_used < 2) || (fit->var_s <= 0.0)) {
+		DEBUG_MSG("ERROR: NO FIT TO ESTIMATE THE UNCERTAINTY\n");
+		return LGW_GPS_ERROR;
+	}
+
+	t = (double)(int32_t)(count_us - fit->count_us[fit->last]) / (TS_CPS * fit->xtal_err);
+	*err_us = fit->res_us * sqrt((1.0 / fit->nb_used) + ((t - fit->mean_s) * (t - fit->mean_s) / fit->var_s));
+	if (t > 0) { /* holdover */
+		*err_us += 0.5 * FIT_WANDER * t * t * 1E6;
+	}
+	return LGW_GPS_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_cnt2utc(struct tref ref, uint32_t count_us, struct timespec *utc) {
 	double delta_sec;
 	double intpart, fractpart;
@@ -575,4 +1221,51 @@ int lgw_utc2cnt(struct tref ref, struct timespec utc, uint32_t *count_us) {
 	return LGW_GPS_SUCCESS;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_cnt2utc_n(struct tref ref, const uint32_t *count_us, struct timespec *utc, int nb) {
+	double ns_per_cnt;
+	int64_t ns;
+	int i;
+
+	CHECK_NULL(count_us);
+	CHECK_NULL(utc);
+	if ((ref.systime == 0) || (ref.xtal_err > PLUS_10PPM) || (ref.xtal_err < MINUS_10PPM)) {
+		DEBUG_MSG("ERROR: INVALID REFERENCE FOR CNT -> UTC CONVERSION\n");
+		return LGW_GPS_ERROR;
+	}
+
+	/* one division for all the timestamps, integer nanoseconds instead of modf */
+	ns_per_cnt = 1E9 / (TS_CPS * ref.xtal_err);
+	for (i = 0; i < nb; ++i) {
+		ns = (int64_t)ref.utc.tv_nsec + (int64_t)((double)(count_us[i] - ref.count_us) * ns_per_cnt);
+		utc[i].tv_sec = ref.utc.tv_sec + (time_t)(ns / 1000000000);
+		utc[i].tv_nsec = (long)(ns % 1000000000);
+	}
+
+	return LGW_GPS_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_utc2cnt_n(struct tref ref, const struct timespec *utc, uint32_t *count_us, int nb) {
+	double delta_sec;
+	int i;
+
+	CHECK_NULL(utc);
+	CHECK_NULL(count_us);
+	if ((ref.systime == 0) || (ref.xtal_err > PLUS_10PPM) || (ref.xtal_err < MINUS_10PPM)) {
+		DEBUG_MSG("ERROR: INVALID REFERENCE FOR UTC -> CNT CONVERSION\n");
+		return LGW_GPS_ERROR;
+	}
+
+	for (i = 0; i < nb; ++i) {
+		delta_sec = (double)(utc[i].tv_sec - ref.utc.tv_sec);
+		delta_sec += 1E-9 * (double)(utc[i].tv_nsec - ref.utc.tv_nsec);
+		count_us[i] = ref.count_us + (uint32_t)(int64_t)(delta_sec * TS_CPS * ref.xtal_err);
+	}
+
+	return LGW_GPS_SUCCESS;
+}
+
 /* --- EOF ------------------------------------------------------------------ */
@@ -17,14 +17,25 @@ Maintainer: Sylvain Miermont
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
 #include <stdint.h>		/* C99 types */
 #include <stdbool.h>	/* bool type */
 #include <stdio.h>		/* printf fprintf */
+#include <stdlib.h>		/* malloc free */
 #include <string.h>		/* memcpy */
+#include <time.h>		/* clock_gettime */
 
 #include "loragw_reg.h"
+#include "loragw_reg_acc.h"
 #include "loragw_hal.h"
 #include "loragw_aux.h"
+#include "loragw_lut.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -46,6 +57,14 @@ Maintainer: Sylvain Miermont
 #define	SET_PPM_ON(bw,dr)	(((bw == BW_125KHZ) && ((dr == DR_LORA_SF11) || (dr == DR_LORA_SF12))) || ((bw == BW_250KHZ) && (dr == DR_LORA_SF12)))
 #define TRACE()				fprintf(stderr, "@ %s %d\n", __FUNCTION__, __LINE__);
 
+/* return the result of a HAL call made on a given context */
+#define CTX_RETURN(c, call)	do { struct lgw_ctx_s *prev = lgw_ctx_select(c); int ret = (call); lgw_ctx_select(prev); return ret; } while (0)
+
+/* statistics counters, updated and read by any thread without lock */
+#define STAT_ADD(x, n)	__atomic_fetch_add(&(x), (n), __ATOMIC_RELAXED)
+#define STAT_GET(x)		__atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STAT_CLR(x)		__atomic_store_n(&(x), 0, __ATOMIC_RELAXED)
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
 
@@ -57,6 +76,7 @@ Maintainer: Sylvain Miermont
 #define		FW_VERSION_CAL		2 /* Expected version of calibration firmware */
 #define		FW_VERSION_AGC		4 /* Expected version of AGC firmware */
 #define		FW_VERSION_ARB		1 /* Expected version of arbiter firmware */
+#define		FW_CRC_POLY			0xEDB88320 /* CRC-32 (IEEE 802.3), reflected */
 
 #define		TX_METADATA_NB		16
 #define		RX_METADATA_NB		16
@@ -72,6 +92,16 @@ Maintainer: Sylvain Miermont
 
 #define		TX_START_DELAY		1500
 
+#define		CFG_REG_NB			80 /* size of the list of configuration registers written by lgw_start */
+
+#define		RX_WAIT_BACKOFF_MIN	250 /* first sleep of lgw_receive_wait without interrupt line, in us */
+#define		RX_WAIT_BACKOFF_MAX	3000 /* longest sleep of lgw_receive_wait without interrupt line, in us */
+
+#define		CAL_TIMEOUT_MS		5000 /* deadline of the calibration firmware, measured between 2.1 and 2.2 sec */
+#define		CAL_POLL_MS			10 /* period of the calibration status polling */
+#define		CAL_IQ_NB			5 /* number of RX I/Q mismatch registers set by the calibration */
+#define		CAL_CACHE_VERSION	1 /* format of the calibration cache file */
+
 /*
 SX1257 frequency setting :
 F_register(24bit) = F_rf (Hz) / F_step(Hz)
@@ -109,6 +139,92 @@ F_register(24bit) = F_rf (Hz) / F_step(Hz)
 #define		RSSI_FSK_REF			-70.0	/* linearize FSK RSSI curve around -70 dBm */
 #define		RSSI_FSK_SLOPE			0.8
 
+/*
+State of one concentrator: the configuration set that the user can modify
+using rxrf_setconf, rxif_setconf and txgain_setconf functions, and what the
+functions _start and _send compute from it.
+
+Parameters validity and coherency is verified by the _setconf functions and
+the _start and _send functions assume they are valid.
+*/
+struct lgw_ctx_s {
+	struct lgw_reg_ctx_s *reg; /* connection to the concentrator, NULL for the default one */
+
+	bool lgw_is_started;
+
+	bool rf_enable[LGW_RF_CHAIN_NB];
+	uint32_t rf_rx_freq[LGW_RF_CHAIN_NB]; /* absolute, in Hz */
+	float rf_rssi_offset[LGW_RF_CHAIN_NB];
+	bool rf_tx_enable[LGW_RF_CHAIN_NB];
+	enum lgw_radio_type_e rf_radio_type[LGW_RF_CHAIN_NB];
+
+	bool if_enable[LGW_IF_CHAIN_NB];
+	bool if_rf_chain[LGW_IF_CHAIN_NB]; /* for each IF, 0 -> radio A, 1 -> radio B */
+	int32_t if_freq[LGW_IF_CHAIN_NB]; /* relative to radio frequency, +/- in Hz */
+
+	uint8_t lora_multi_sfmask[LGW_MULTI_NB]; /* enables SF for LoRa 'multi' modems */
+
+	uint8_t lora_rx_bw; /* bandwidth setting for LoRa standalone modem */
+	uint8_t lora_rx_sf; /* spreading factor setting for LoRa standalone modem */
+	bool lora_rx_ppm_offset;
+
+	uint8_t fsk_rx_bw; /* bandwidth setting of FSK modem */
+	uint32_t fsk_rx_dr; /* FSK modem datarate in bauds */
+	uint8_t fsk_sync_word_size; /* number of bytes for FSK sync word */
+	uint64_t fsk_sync_word; /* FSK sync word (ALIGNED RIGHT, MSbit first) */
+
+	bool lorawan_public;
+	uint8_t rf_clkout;
+
+	struct lgw_tx_gain_lut_s txgain_lut;
+
+	uint8_t rx_fetch_mode; /* how lgw_receive reads the RX FIFO */
+	struct lgw_rx_fetch_stat_s rx_fetch_stat; /* SPI cost of lgw_receive since lgw_start */
+	bool rx_wait_irq; /* false once the SPI link reported that it has no interrupt line */
+	uint32_t rx_wait_backoff; /* next sleep of lgw_receive_wait without interrupt line, in us */
+	uint32_t gps_toggle_nb; /* GPS event capture suspensions by lgw_get_instcnt since lgw_start */
+	uint32_t gps_toggle_cnt; /* internal counter value read during the last one */
+
+	/* configuration registers written by lgw_start, grouped by page by lgw_reg_wl */
+	uint16_t cfg_reg_id[CFG_REG_NB];
+	int32_t cfg_reg_val[CFG_REG_NB];
+	uint16_t cfg_reg_nb;
+
+	/* TX I/Q imbalance coefficients for mixer gain = 8 to 15 */
+	int8_t cal_offset_a_i[8]; /* TX I offset for radio A */
+	int8_t cal_offset_a_q[8]; /* TX Q offset for radio A */
+	int8_t cal_offset_b_i[8]; /* TX I offset for radio B */
+	int8_t cal_offset_b_q[8]; /* TX Q offset for radio B */
+
+	/* RX I/Q mismatch compensation, written by the calibration firmware or restored from the cache */
+	int32_t cal_iq_val[CAL_IQ_NB];
+
+	struct lgw_conf_cal_s cal_conf; /* calibration cache, disabled by default */
+
+	/* what was last loaded in each MCU program RAM, kept across lgw_stop/lgw_start */
+	struct lgw_fw_stat_s fw_stat;
+
+	/* TX descriptors are recomputed when the calibration or the TX gain LUT change */
+	uint32_t tx_desc_gen;
+	struct lgw_tx_desc_s tx_desc_last; /* parameters of the last packet sent by lgw_send_ptr */
+};
+
+/* default values of a context */
+#define CTX_INIT { \
+	.fsk_sync_word_size = 3, \
+	.fsk_sync_word = 0xC194C1, \
+	.lorawan_public = false, \
+	.rf_clkout = 0, \
+	.txgain_lut = { \
+		.size = 2, \
+		.lut[0] = { .dig_gain = 0, .pa_gain = 2, .dac_gain = 3, .mix_gain = 10, .rf_power = 14 }, \
+		.lut[1] = { .dig_gain = 0, .pa_gain = 3, .dac_gain = 3, .mix_gain = 14, .rf_power = 27 } }, \
+	.rx_fetch_mode = RX_FETCH_SINGLE, \
+	.rx_wait_irq = true, \
+	.rx_wait_backoff = RX_WAIT_BACKOFF_MIN, \
+	.cfg_reg_nb = 0, \
+	.tx_desc_gen = 1 }
+
 /* constant arrays defining hardware capability */
 
 const uint8_t ifmod_config[LGW_IF_CHAIN_NB] = LGW_IFMODEM_CONFIG;
@@ -120,6 +236,8 @@ const uint32_t rf_rx_bandwidth[LGW_RF_CHAIN_NB] = LGW_RF_RX_BANDWIDTH;
 	#define		CFG_SPI_STR		"native"
 #elif (CFG_SPI_FTDI == 1)
 	#define		CFG_SPI_STR		"ftdi"
+#elif (CFG_SPI_SIM == 1)
+	#define		CFG_SPI_STR		"sim"
 #else
 	#define		CFG_SPI_STR		"spi?"
 #endif
@@ -145,67 +263,28 @@ const char lgw_version_string[] = "Version: " LIBLORAGW_VERSION "; Options: " CF
 #include "agc_fw.var" /* external definition of the variable */
 #include "cal_fw.var" /* external definition of the variable */
 
-/*
-The following static variables are the configuration set that the user can
-modify using rxrf_setconf, rxif_setconf and txgain_setconf functions.
-The functions _start and _send then use that set to configure the hardware.
+/* context used by the functions that have no context parameter, see lgw_ctx_select */
+static struct lgw_ctx_s ctx_dflt = CTX_INIT;
 
-Parameters validity and coherency is verified by the _setconf functions and
-the _start and _send functions assume they are valid.
-*/
+/* context the calling thread acts on */
+static __thread struct lgw_ctx_s *cur = &ctx_dflt;
+
+/* last generation number given to a context, unique across contexts */
+static uint32_t tx_desc_gen_last = 1;
+
+/* RX I/Q mismatch compensation, written by the calibration firmware or restored from the cache */
+static const uint16_t cal_iq_reg[CAL_IQ_NB] = {LGW_IQ_MISMATCH_A_AMP_COEFF, LGW_IQ_MISMATCH_A_PHI_COEFF, LGW_IQ_MISMATCH_B_AMP_COEFF, LGW_IQ_MISMATCH_B_SEL_I, LGW_IQ_MISMATCH_B_PHI_COEFF};
 
-static bool lgw_is_started;
-
-static bool rf_enable[LGW_RF_CHAIN_NB];
-static uint32_t rf_rx_freq[LGW_RF_CHAIN_NB]; /* absolute, in Hz */
-static float rf_rssi_offset[LGW_RF_CHAIN_NB];
-static bool rf_tx_enable[LGW_RF_CHAIN_NB];
-static enum lgw_radio_type_e rf_radio_type[LGW_RF_CHAIN_NB];
-
-static bool if_enable[LGW_IF_CHAIN_NB];
-static bool if_rf_chain[LGW_IF_CHAIN_NB]; /* for each IF, 0 -> radio A, 1 -> radio B */
-static int32_t if_freq[LGW_IF_CHAIN_NB]; /* relative to radio frequency, +/- in Hz */
-
-static uint8_t lora_multi_sfmask[LGW_MULTI_NB]; /* enables SF for LoRa 'multi' modems */
-
-static uint8_t lora_rx_bw; /* bandwidth setting for LoRa standalone modem */
-static uint8_t lora_rx_sf; /* spreading factor setting for LoRa standalone modem */
-static bool lora_rx_ppm_offset;
-
-static uint8_t fsk_rx_bw; /* bandwidth setting of FSK modem */
-static uint32_t fsk_rx_dr; /* FSK modem datarate in bauds */
-static uint8_t fsk_sync_word_size = 3; /* default number of bytes for FSK sync word */
-static uint64_t fsk_sync_word= 0xC194C1; /* default FSK sync word (ALIGNED RIGHT, MSbit first) */
-
-static bool lorawan_public = false;
-static uint8_t rf_clkout = 0;
-
-static struct lgw_tx_gain_lut_s txgain_lut = {
-	.size = 2,
-	.lut[0] = {
-		.dig_gain = 0,
-		.pa_gain = 2,
-		.dac_gain = 3,
-		.mix_gain = 10,
-		.rf_power = 14
-	},
-	.lut[1] = {
-		.dig_gain = 0,
-		.pa_gain = 3,
-		.dac_gain = 3,
-		.mix_gain = 14,
-		.rf_power = 27
-	}};
-
-/* TX I/Q imbalance coefficients for mixer gain = 8 to 15 */
-static int8_t cal_offset_a_i[8]; /* TX I offset for radio A */
-static int8_t cal_offset_a_q[8]; /* TX Q offset for radio A */
-static int8_t cal_offset_b_i[8]; /* TX I offset for radio B */
-static int8_t cal_offset_b_q[8]; /* TX Q offset for radio B */
+/* performance counters of all the contexts, SPI traffic excepted (kept by loragw_reg) */
+static struct lgw_stats_s stats;
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
+uint32_t fw_crc(const uint8_t *data, uint16_t size);
+
+uint32_t fw_readback_crc(uint16_t size, uint32_t *duration_us);
+
 int load_firmware(uint8_t target, uint8_t *firmware, uint16_t size);
 
 void sx125x_write(uint8_t channel, uint8_t addr, uint8_t data);
@@ -216,13 +295,78 @@ int setup_sx125x(uint8_t rf_chain, uint32_t freq_hz);
 
 void lgw_constant_adjust(void);
 
+void cfg_reg_add(uint16_t register_id, int32_t reg_value);
+
+int tx_desc_compute(struct lgw_tx_desc_s *desc);
+
+bool tx_desc_match(const struct lgw_tx_desc_s *desc, const struct lgw_pkt_tx_s *pkt_data);
+
+void tx_desc_invalidate(void);
+
+bool rx_wait_sleep(uint32_t timeout_us);
+
+void stats_hist_add(struct lgw_stats_hist_s *h, uint32_t duration_us);
+
+void stats_hist_get(struct lgw_stats_hist_s *dst, struct lgw_stats_hist_s *h);
+
+void stats_hist_clr(struct lgw_stats_hist_s *h);
+
+int receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data);
+
+int send_prepared(struct lgw_tx_desc_s *desc, uint8_t tx_mode, uint32_t count_us, const uint8_t *payload, uint16_t size);
+
+int calibrate(uint8_t cal_cmd);
+
+int cal_cache_load(uint8_t cal_cmd);
+
+int cal_cache_save(uint8_t cal_cmd);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
+uint32_t fw_crc(const uint8_t *data, uint16_t size) {
+	uint32_t crc = 0xFFFFFFFF;
+	int i, j;
+
+	for (i = 0; i < size; ++i) {
+		crc ^= data[i];
+		for (j = 0; j < 8; ++j) {
+			crc = (crc >> 1) ^ (FW_CRC_POLY & (-(crc & 1)));
+		}
+	}
+	return ~crc;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* CRC of the program RAM content, the mux must give the host access to it */
+uint32_t fw_readback_crc(uint16_t size, uint32_t *duration_us) {
+	uint8_t fw_check[MCU_AGC_FW_BYTE];
+	int32_t dummy;
+	uint32_t crc;
+	struct timespec t0, t;
+	int spi_stat;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	spi_stat = lgw_reg_w(LGW_MCU_PROM_ADDR, 0);
+	spi_stat |= lgw_reg_r(LGW_MCU_PROM_DATA, &dummy); /* the first read after setting the address is a dummy */
+	spi_stat |= lgw_reg_rb(LGW_MCU_PROM_DATA, fw_check, size);
+	crc = (spi_stat == LGW_REG_SUCCESS) ? fw_crc(fw_check, size) : 0;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	*duration_us = (uint32_t)((t.tv_sec - t0.tv_sec) * 1000000 + (t.tv_nsec - t0.tv_nsec) / 1000);
+	return crc;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /* size is the firmware size in bytes (not 14b words) */
 int load_firmware(uint8_t target, uint8_t *firmware, uint16_t size) {
 	int reg_rst;
 	int reg_sel;
+	struct lgw_fw_mcu_stat_s *st;
+	uint32_t crc, crc_check;
+	bool resident = false;
+	struct timespec t0, t;
 
 	/* check parameters */
 	CHECK_NULL(firmware);
@@ -233,6 +377,7 @@ int load_firmware(uint8_t target, uint8_t *firmware, uint16_t size) {
 		}
 		reg_rst = LGW_MCU_RST_0;
 		reg_sel = LGW_MCU_SELECT_MUX_0;
+		st = &cur->fw_stat.arb;
 	}else if (target == MCU_AGC) {
 		if (size != MCU_AGC_FW_BYTE) {
 			DEBUG_MSG("ERROR: NOT A VALID SIZE FOR MCU AGC FIRMWARE\n");
@@ -240,20 +385,49 @@ int load_firmware(uint8_t target, uint8_t *firmware, uint16_t size) {
 		}
 		reg_rst = LGW_MCU_RST_1;
 		reg_sel = LGW_MCU_SELECT_MUX_1;
+		st = &cur->fw_stat.agc;
 	} else {
 		DEBUG_MSG("ERROR: NOT A VALID TARGET FOR LOADING FIRMWARE\n");
 		return -1;
 	}
+	crc = fw_crc(firmware, size);
 
 	/* reset the targeted MCU */
 	lgw_reg_w(reg_rst, 1);
 
-	/* set mux to access MCU program RAM and set address to 0 */
+	/* set mux to access MCU program RAM */
 	lgw_reg_w(reg_sel, 0);
-	lgw_reg_w(LGW_MCU_PROM_ADDR, 0);
 
-	/* write the program in one burst */
-	lgw_reg_wb(LGW_MCU_PROM_DATA, firmware, size);
+	/* the program RAM is only checked if it may hold that image (same as last time, or unknown) */
+	if ((st->crc == 0) || (st->crc == crc)) {
+		crc_check = fw_readback_crc(size, &st->verify_us);
+		resident = (crc_check == crc);
+	}
+
+	if (resident) {
+		st->nb_skip += 1;
+		DEBUG_PRINTF("Note: MCU %u firmware already loaded (CRC 0x%08X), checked in %u us\n", target, crc, st->verify_us);
+	} else {
+		/* write the program in one burst, from address 0 */
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		lgw_reg_w(LGW_MCU_PROM_ADDR, 0);
+		lgw_reg_wb(LGW_MCU_PROM_DATA, firmware, size);
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		st->load_us = (uint32_t)((t.tv_sec - t0.tv_sec) * 1000000 + (t.tv_nsec - t0.tv_nsec) / 1000);
+		st->nb_load += 1;
+
+		/* read it back */
+		crc_check = fw_readback_crc(size, &st->verify_us);
+		if (crc_check != crc) {
+			DEBUG_PRINTF("ERROR: MCU %u FIRMWARE READBACK FAILED (CRC 0x%08X, EXPECTED 0x%08X)\n", target, crc_check, crc);
+			st->crc = 0;
+			st->nb_fail += 1;
+			lgw_reg_w(reg_sel, 1);
+			return -1;
+		}
+		DEBUG_PRINTF("Note: MCU %u firmware loaded (CRC 0x%08X) in %u us, verified in %u us\n", target, crc, st->load_us, st->verify_us);
+	}
+	st->crc = crc;
 
 	/* give back control of the MCU program ram to the MCU */
 	lgw_reg_w(reg_sel, 1);
@@ -295,12 +469,14 @@ void sx125x_write(uint8_t channel, uint8_t addr, uint8_t data) {
 			return;
 	}
 
-	/* SPI master data write procedure */
+	/* SPI master data write procedure, sent in one SPI transaction */
+	lgw_reg_batch_begin();
 	lgw_reg_w(reg_cs, 0);
 	lgw_reg_w(reg_add, 0x80 | addr); /* MSB at 1 for write operation */
 	lgw_reg_w(reg_dat, data);
 	lgw_reg_w(reg_cs, 1);
 	lgw_reg_w(reg_cs, 0);
+	lgw_reg_batch_commit();
 
 	return;
 }
@@ -369,7 +545,7 @@ int setup_sx125x(uint8_t rf_chain, uint32_t freq_hz) {
 	DEBUG_PRINTF("Note: SX125x #%d version register returned 0x%02x\n", rf_chain, sx125x_read(rf_chain, 0x07));
 
 	/* General radio setup */
-	if (rf_clkout == rf_chain) {
+	if (cur->rf_clkout == rf_chain) {
 		sx125x_write(rf_chain, 0x10, SX125x_TX_DAC_CLK_SEL + 2);
 		DEBUG_PRINTF("Note: SX125x #%d clock output enabled\n", rf_chain);
 	} else {
@@ -377,7 +553,7 @@ int setup_sx125x(uint8_t rf_chain, uint32_t freq_hz) {
 		DEBUG_PRINTF("Note: SX125x #%d clock output disabled\n", rf_chain);
 	}
 
-	switch (rf_radio_type[rf_chain]) {
+	switch (cur->rf_radio_type[rf_chain]) {
 		case LGW_RADIO_TYPE_SX1255:
 			sx125x_write(rf_chain, 0x28, SX125x_XOSC_GM_STARTUP + SX125x_XOSC_DISABLE*16);
 			break;
@@ -385,11 +561,11 @@ int setup_sx125x(uint8_t rf_chain, uint32_t freq_hz) {
 			sx125x_write(rf_chain, 0x26, SX125x_XOSC_GM_STARTUP + SX125x_XOSC_DISABLE*16);
 			break;
 		default:
-			DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", rf_radio_type[rf_chain]);
+			DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", cur->rf_radio_type[rf_chain]);
 			break;
 	}
 
-	if (rf_enable[rf_chain] == true) {
+	if (cur->rf_enable[rf_chain] == true) {
 		/* Tx gain and trim */
 		sx125x_write(rf_chain, 0x08, SX125x_TX_MIX_GAIN + SX125x_TX_DAC_GAIN*16);
 		sx125x_write(rf_chain, 0x0A, SX125x_TX_ANA_BW + SX125x_TX_PLL_BW*32);
@@ -401,7 +577,7 @@ int setup_sx125x(uint8_t rf_chain, uint32_t freq_hz) {
 		sx125x_write(rf_chain, 0x0E, SX125x_ADC_TEMP + SX125x_RX_PLL_BW*2);
 
 		/* set RX PLL frequency */
-		switch (rf_radio_type[rf_chain]) {
+		switch (cur->rf_radio_type[rf_chain]) {
 			case LGW_RADIO_TYPE_SX1255:
 				part_int = freq_hz / (SX125x_32MHz_FRAC << 7); /* integer part, gives the MSB */
 				part_frac = ((freq_hz % (SX125x_32MHz_FRAC << 7)) << 9) / SX125x_32MHz_FRAC; /* fractional part, gives middle part and LSB */
@@ -411,7 +587,7 @@ int setup_sx125x(uint8_t rf_chain, uint32_t freq_hz) {
 				part_frac = ((freq_hz % (SX125x_32MHz_FRAC << 8)) << 8) / SX125x_32MHz_FRAC; /* fractional part, gives middle part and LSB */
 				break;
 			default:
-				DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", rf_radio_type[rf_chain]);
+				DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", cur->rf_radio_type[rf_chain]);
 				break;
 		}
 
@@ -449,14 +625,14 @@ void lgw_constant_adjust(void) {
 	// lgw_reg_w(LGW_RX_EDGE_SELECT,0); /* default 0 */
 	// lgw_reg_w(LGW_MBWSSF_MODEM_INVERT_IQ,0); /* default 0 */
 	// lgw_reg_w(LGW_DC_NOTCH_EN,1); /* default 1 */
-	lgw_reg_w(LGW_RSSI_BB_FILTER_ALPHA,6); /* default 7 */
-	lgw_reg_w(LGW_RSSI_DEC_FILTER_ALPHA,7); /* default 5 */
-	lgw_reg_w(LGW_RSSI_CHANN_FILTER_ALPHA,7); /* default 8 */
-	lgw_reg_w(LGW_RSSI_BB_DEFAULT_VALUE,23); /* default 32 */
-	lgw_reg_w(LGW_RSSI_CHANN_DEFAULT_VALUE,85); /* default 100 */
-	lgw_reg_w(LGW_RSSI_DEC_DEFAULT_VALUE,66); /* default 100 */
-	lgw_reg_w(LGW_DEC_GAIN_OFFSET,7); /* default 8 */
-	lgw_reg_w(LGW_CHAN_GAIN_OFFSET,6); /* default 7 */
+	cfg_reg_add(LGW_RSSI_BB_FILTER_ALPHA,6); /* default 7 */
+	cfg_reg_add(LGW_RSSI_DEC_FILTER_ALPHA,7); /* default 5 */
+	cfg_reg_add(LGW_RSSI_CHANN_FILTER_ALPHA,7); /* default 8 */
+	cfg_reg_add(LGW_RSSI_BB_DEFAULT_VALUE,23); /* default 32 */
+	cfg_reg_add(LGW_RSSI_CHANN_DEFAULT_VALUE,85); /* default 100 */
+	cfg_reg_add(LGW_RSSI_DEC_DEFAULT_VALUE,66); /* default 100 */
+	cfg_reg_add(LGW_DEC_GAIN_OFFSET,7); /* default 8 */
+	cfg_reg_add(LGW_CHAN_GAIN_OFFSET,6); /* default 7 */
 
 	/* Correlator setup */
 	// lgw_reg_w(LGW_CORR_DETECT_EN,126); /* default 126 */
@@ -483,13 +659,13 @@ void lgw_constant_adjust(void) {
 	// lgw_reg_w(LGW_FRAME_SYNCH_GAIN,1); /* default 1 */
 	// lgw_reg_w(LGW_SYNCH_DETECT_TH,1); /* default 1 */
 	// lgw_reg_w(LGW_ZERO_PAD,0); /* default 0 */
-	lgw_reg_w(LGW_SNR_AVG_CST,3); /* default 2 */
-	if (lorawan_public) { /* LoRa network */
-		lgw_reg_w(LGW_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
-		lgw_reg_w(LGW_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
+	cfg_reg_add(LGW_SNR_AVG_CST,3); /* default 2 */
+	if (cur->lorawan_public) { /* LoRa network */
+		cfg_reg_add(LGW_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
+		cfg_reg_add(LGW_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
 	} else { /* private network */
-		lgw_reg_w(LGW_FRAME_SYNCH_PEAK1_POS,1); /* default 1 */
-		lgw_reg_w(LGW_FRAME_SYNCH_PEAK2_POS,2); /* default 2 */
+		cfg_reg_add(LGW_FRAME_SYNCH_PEAK1_POS,1); /* default 1 */
+		cfg_reg_add(LGW_FRAME_SYNCH_PEAK2_POS,2); /* default 2 */
 	}
 
 	// lgw_reg_w(LGW_PREAMBLE_FINE_TIMING_GAIN,1); /* default 1 */
@@ -506,12 +682,12 @@ void lgw_constant_adjust(void) {
 	// lgw_reg_w(LGW_MBWSSF_FRAME_SYNCH_GAIN,1); /* default 1 */
 	// lgw_reg_w(LGW_MBWSSF_SYNCH_DETECT_TH,1); /* default 1 */
 	// lgw_reg_w(LGW_MBWSSF_ZERO_PAD,0); /* default 0 */
-	if (lorawan_public) { /* LoRa network */
-		lgw_reg_w(LGW_MBWSSF_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
-		lgw_reg_w(LGW_MBWSSF_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
+	if (cur->lorawan_public) { /* LoRa network */
+		cfg_reg_add(LGW_MBWSSF_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
+		cfg_reg_add(LGW_MBWSSF_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
 	} else {
-		lgw_reg_w(LGW_MBWSSF_FRAME_SYNCH_PEAK1_POS,1); /* default 1 */
-		lgw_reg_w(LGW_MBWSSF_FRAME_SYNCH_PEAK2_POS,2); /* default 2 */
+		cfg_reg_add(LGW_MBWSSF_FRAME_SYNCH_PEAK1_POS,1); /* default 1 */
+		cfg_reg_add(LGW_MBWSSF_FRAME_SYNCH_PEAK2_POS,2); /* default 2 */
 	}
 	// lgw_reg_w(LGW_MBWSSF_ONLY_CRC_EN,1); /* default 1 */
 	// lgw_reg_w(LGW_MBWSSF_PAYLOAD_FINE_TIMING_GAIN,2); /* default 2 */
@@ -520,179 +696,810 @@ void lgw_constant_adjust(void) {
 	// lgw_reg_w(LGW_MBWSSF_AGC_FREEZE_ON_DETECT,1); /* default 1 */
 
 	/* FSK datapath setup */
-	lgw_reg_w(LGW_FSK_RX_INVERT,1); /* default 0 */
-	lgw_reg_w(LGW_FSK_MODEM_INVERT_IQ,1); /* default 0 */
+	cfg_reg_add(LGW_FSK_RX_INVERT,1); /* default 0 */
+	cfg_reg_add(LGW_FSK_MODEM_INVERT_IQ,1); /* default 0 */
 
 	/* FSK demodulator setup */
-	lgw_reg_w(LGW_FSK_RSSI_LENGTH,4); /* default 0 */
-	lgw_reg_w(LGW_FSK_PKT_MODE,1); /* variable length, default 0 */
-	lgw_reg_w(LGW_FSK_CRC_EN,1); /* default 0 */
-	lgw_reg_w(LGW_FSK_DCFREE_ENC,2); /* default 0 */
+	cfg_reg_add(LGW_FSK_RSSI_LENGTH,4); /* default 0 */
+	cfg_reg_add(LGW_FSK_PKT_MODE,1); /* variable length, default 0 */
+	cfg_reg_add(LGW_FSK_CRC_EN,1); /* default 0 */
+	cfg_reg_add(LGW_FSK_DCFREE_ENC,2); /* default 0 */
 	// lgw_reg_w(LGW_FSK_CRC_IBM,0); /* default 0 */
-	lgw_reg_w(LGW_FSK_ERROR_OSR_TOL,10); /* default 0 */
-	lgw_reg_w(LGW_FSK_PKT_LENGTH,255); /* max packet length in variable length mode */
+	cfg_reg_add(LGW_FSK_ERROR_OSR_TOL,10); /* default 0 */
+	cfg_reg_add(LGW_FSK_PKT_LENGTH,255); /* max packet length in variable length mode */
 	// lgw_reg_w(LGW_FSK_NODE_ADRS,0); /* default 0 */
 	// lgw_reg_w(LGW_FSK_BROADCAST,0); /* default 0 */
 	// lgw_reg_w(LGW_FSK_AUTO_AFC_ON,0); /* default 0 */
-	lgw_reg_w(LGW_FSK_PATTERN_TIMEOUT_CFG,128); /* sync timeout (allow 8 bytes preamble + 8 bytes sync word, default 0 */
+	cfg_reg_add(LGW_FSK_PATTERN_TIMEOUT_CFG,128); /* sync timeout (allow 8 bytes preamble + 8 bytes sync word, default 0 */
 
 	/* TX general parameters */
-	lgw_reg_w(LGW_TX_START_DELAY, TX_START_DELAY); /* default 0 */
+	cfg_reg_add(LGW_TX_START_DELAY, TX_START_DELAY); /* default 0 */
 
 	/* TX LoRa */
 	// lgw_reg_w(LGW_TX_MODE,0); /* default 0 */
-	lgw_reg_w(LGW_TX_SWAP_IQ,1); /* "normal" polarity; default 0 */
-	if (lorawan_public) { /* LoRa network */
-		lgw_reg_w(LGW_TX_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
-		lgw_reg_w(LGW_TX_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
+	cfg_reg_add(LGW_TX_SWAP_IQ,1); /* "normal" polarity; default 0 */
+	if (cur->lorawan_public) { /* LoRa network */
+		cfg_reg_add(LGW_TX_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
+		cfg_reg_add(LGW_TX_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
 	} else { /* Private network */
-		lgw_reg_w(LGW_TX_FRAME_SYNCH_PEAK1_POS,1); /* default 1 */
-		lgw_reg_w(LGW_TX_FRAME_SYNCH_PEAK2_POS,2); /* default 2 */
+		cfg_reg_add(LGW_TX_FRAME_SYNCH_PEAK1_POS,1); /* default 1 */
+		cfg_reg_add(LGW_TX_FRAME_SYNCH_PEAK2_POS,2); /* default 2 */
 	}
 
 	/* TX FSK */
 	// lgw_reg_w(LGW_FSK_TX_GAUSSIAN_EN,1); /* default 1 */
-	lgw_reg_w(LGW_FSK_TX_GAUSSIAN_SELECT_BT,2); /* Gaussian filter always on TX, default 0 */
+	cfg_reg_add(LGW_FSK_TX_GAUSSIAN_SELECT_BT,2); /* Gaussian filter always on TX, default 0 */
 	// lgw_reg_w(LGW_FSK_TX_PATTERN_EN,1); /* default 1 */
 	// lgw_reg_w(LGW_FSK_TX_PREAMBLE_SEQ,0); /* default 0 */
 
 	return;
 }
 
-/* -------------------------------------------------------------------------- */
-/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_board_setconf(struct lgw_conf_board_s conf) {
+/* append a register write to the configuration list */
+void cfg_reg_add(uint16_t register_id, int32_t reg_value) {
+	if (cur->cfg_reg_nb >= CFG_REG_NB) {
+		DEBUG_MSG("ERROR: CONFIGURATION REGISTER LIST FULL\n");
+		return;
+	}
+	cur->cfg_reg_id[cur->cfg_reg_nb] = register_id;
+	cur->cfg_reg_val[cur->cfg_reg_nb] = reg_value;
+	++cur->cfg_reg_nb;
+}
 
-	/* check if the concentrator is running */
-	if (lgw_is_started == true) {
-		DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* run the calibration firmware and read its results */
+int calibrate(uint8_t cal_cmd) {
+	int i;
+	int32_t read_val;
+	uint8_t fw_version;
+	uint8_t cal_status;
+	struct timespec t0, t;
+	long elapsed_ms;
+
+	/* Load the calibration firmware  */
+	if (load_firmware(MCU_AGC, cal_firmware, MCU_AGC_FW_BYTE) != 0) {
+		DEBUG_MSG("ERROR: FAILED TO LOAD CALIBRATION FIRMWARE\n");
+		return -1;
+	}
+	lgw_reg_w(LGW_FORCE_HOST_RADIO_CTRL,0); /* gives to AGC MCU the control of the radios */
+	lgw_reg_w(LGW_RADIO_SELECT,cal_cmd); /* send calibration configuration word */
+	lgw_reg_w(LGW_MCU_RST_1,0);
+
+	/* Check firmware version */
+	lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, FW_VERSION_ADDR);
+	lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
+	fw_version = (uint8_t)read_val;
+	if (fw_version != FW_VERSION_CAL) {
+		printf("ERROR: Version of calibration firmware not expected, actual:%d expected:%d\n", fw_version, FW_VERSION_CAL);
+		return -1;
+	}
+
+	lgw_reg_w(LGW_PAGE_REG,3); /* Calibration will start on this condition as soon as MCU can talk to concentrator registers */
+	lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL,0); /* Give control of concentrator registers to MCU */
+
+	/* Wait for calibration to end, the status register is out of the pages so polling does not disturb the MCU */
+	DEBUG_PRINTF("Note: calibration started (timeout: %u ms)\n", CAL_TIMEOUT_MS);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	do {
+		wait_ms(CAL_POLL_MS);
+		lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		elapsed_ms = (t.tv_sec - t0.tv_sec) * 1000 + (t.tv_nsec - t0.tv_nsec) / 1000000;
+	} while (((read_val & 0x80) == 0) && (elapsed_ms < CAL_TIMEOUT_MS));
+	lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL,1); /* Take back control */
+
+	/* Get calibration status */
+	lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
+	cal_status = (uint8_t)read_val;
+	/*
+		bit 7: calibration finished
+		bit 0: could access SX1301 registers
+		bit 1: could access radio A registers
+		bit 2: could access radio B registers
+		bit 3: radio A RX image rejection successful
+		bit 4: radio B RX image rejection successful
+		bit 5: radio A TX imbalance correction successful
+		bit 6: radio B TX imbalance correction successful
+	*/
+	if ((cal_status & 0x81) != 0x81) {
+		DEBUG_PRINTF("ERROR: CALIBRATION FAILURE (STATUS = %u)\n", cal_status);
 		return LGW_HAL_ERROR;
+	} else {
+		DEBUG_PRINTF("Note: calibration finished in %ld ms (status = %u)\n", elapsed_ms, cal_status);
+	}
+	if (cur->rf_enable[0] && ((cal_status & 0x02) == 0)) {
+		DEBUG_MSG("WARNING: calibration could not access radio A\n");
+	}
+	if (cur->rf_enable[1] && ((cal_status & 0x04) == 0)) {
+		DEBUG_MSG("WARNING: calibration could not access radio B\n");
+	}
+	if (cur->rf_enable[0] && ((cal_status & 0x08) == 0)) {
+		DEBUG_MSG("WARNING: problem in calibration of radio A for image rejection\n");
+	}
+	if (cur->rf_enable[1] && ((cal_status & 0x10) == 0)) {
+		DEBUG_MSG("WARNING: problem in calibration of radio B for image rejection\n");
+	}
+	if (cur->rf_enable[0] && cur->rf_tx_enable[0] && ((cal_status & 0x20) == 0)) {
+		DEBUG_MSG("WARNING: problem in calibration of radio A for TX imbalance\n");
+	}
+	if (cur->rf_enable[1] && cur->rf_tx_enable[1] && ((cal_status & 0x40) == 0)) {
+		DEBUG_MSG("WARNING: problem in calibration of radio B for TX imbalance\n");
 	}
 
-	/* set internal config according to parameters */
-	lorawan_public = conf.lorawan_public;
-	rf_clkout = conf.clksrc;
+	/* Get TX DC offset values */
+	for(i=0; i<=7; ++i) {
+		lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA0+i);
+		lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
+		cur->cal_offset_a_i[i] = (int8_t)read_val;
+		lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA8+i);
+		lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
+		cur->cal_offset_a_q[i] = (int8_t)read_val;
+		lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB0+i);
+		lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
+		cur->cal_offset_b_i[i] = (int8_t)read_val;
+		lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB8+i);
+		lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
+		cur->cal_offset_b_q[i] = (int8_t)read_val;
+	}
 
-	DEBUG_PRINTF("Note: board configuration; lorawan_public:%d, clksrc:%d\n", lorawan_public, rf_clkout);
+	/* Get RX image rejection coefficients, only needed to fill the cache */
+	for (i=0; i<CAL_IQ_NB; ++i) {
+		lgw_reg_r(cal_iq_reg[i], &cur->cal_iq_val[i]);
+	}
 
 	return LGW_HAL_SUCCESS;
 }
 
-int lgw_rxrf_setconf(uint8_t rf_chain, struct lgw_conf_rxrf_s conf) {
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-	/* check if the concentrator is running */
-	if (lgw_is_started == true) {
-		DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
+/* restore the calibration results from the cache file if they match the current configuration */
+int cal_cache_load(uint8_t cal_cmd) {
+	FILE *f;
+	unsigned version, radio_type, cmd;
+	unsigned long long board_id;
+	unsigned long freq_a, freq_b;
+	int8_t offset[4][8];
+	int32_t iq[CAL_IQ_NB];
+	int i, j, v, n;
+
+	f = fopen(cur->cal_conf.cache_file, "r");
+	if (f == NULL) {
+		DEBUG_PRINTF("Note: no calibration cache file %s\n", cur->cal_conf.cache_file);
 		return LGW_HAL_ERROR;
 	}
 
-	/* check input range (segfault prevention) */
-	if (rf_chain >= LGW_RF_CHAIN_NB) {
-		DEBUG_MSG("ERROR: NOT A VALID RF_CHAIN NUMBER\n");
+	/* key */
+	n = fscanf(f, "lgwcal %u %llx %u %lu %lu %x", &version, &board_id, &radio_type, &freq_a, &freq_b, &cmd);
+	if ((n != 6) || (version != CAL_CACHE_VERSION)) {
+		DEBUG_PRINTF("WARNING: %s is not a calibration cache file, ignored\n", cur->cal_conf.cache_file);
+		fclose(f);
 		return LGW_HAL_ERROR;
 	}
-
-	/* check if radio type is supported */
-	if ((conf.type != LGW_RADIO_TYPE_SX1255) && (conf.type != LGW_RADIO_TYPE_SX1257)) {
-		DEBUG_MSG("ERROR: NOT A VALID RADIO TYPE\n");
+	if ((board_id != cur->cal_conf.board_id) || (radio_type != (unsigned)cur->rf_radio_type[0]) || (freq_a != cur->rf_rx_freq[0]) || (freq_b != cur->rf_rx_freq[1]) || (cmd != cal_cmd)) {
+		DEBUG_MSG("Note: calibration cache does not match the board configuration\n");
+		fclose(f);
 		return LGW_HAL_ERROR;
 	}
 
-	/* set internal config according to parameters */
-	rf_enable[rf_chain] = conf.enable;
-	rf_rx_freq[rf_chain] = conf.freq_hz;
-	rf_rssi_offset[rf_chain] = conf.rssi_offset;
-	rf_radio_type[rf_chain] = conf.type;
-	rf_tx_enable[rf_chain] = conf.tx_enable;
+	/* TX offsets of radio A I/Q then radio B I/Q, RX I/Q mismatch */
+	for (i=0; i<4; ++i) {
+		for (j=0; j<8; ++j) {
+			if ((fscanf(f, "%d", &v) != 1) || (v < -128) || (v > 127)) {
+				DEBUG_PRINTF("WARNING: calibration cache file %s is truncated, ignored\n", cur->cal_conf.cache_file);
+				fclose(f);
+				return LGW_HAL_ERROR;
+			}
+			offset[i][j] = (int8_t)v;
+		}
+	}
+	for (i=0; i<CAL_IQ_NB; ++i) {
+		if ((fscanf(f, "%d", &v) != 1) || (v < 0) || (v > 63)) {
+			DEBUG_PRINTF("WARNING: calibration cache file %s is truncated, ignored\n", cur->cal_conf.cache_file);
+			fclose(f);
+			return LGW_HAL_ERROR;
+		}
+		iq[i] = v;
+	}
+	fclose(f);
+
+	memcpy(cur->cal_offset_a_i, offset[0], sizeof cur->cal_offset_a_i);
+	memcpy(cur->cal_offset_a_q, offset[1], sizeof cur->cal_offset_a_q);
+	memcpy(cur->cal_offset_b_i, offset[2], sizeof cur->cal_offset_b_i);
+	memcpy(cur->cal_offset_b_q, offset[3], sizeof cur->cal_offset_b_q);
+	memcpy(cur->cal_iq_val, iq, sizeof cur->cal_iq_val);
+	return LGW_HAL_SUCCESS;
+}
 
-	DEBUG_PRINTF("Note: rf_chain %d configuration; en:%d freq:%d rssi_offset:%f radio_type:%d tx_enable:%d\n", rf_chain, rf_enable[rf_chain], rf_rx_freq[rf_chain], rf_rssi_offset[rf_chain], rf_radio_type[rf_chain], rf_tx_enable[rf_chain]);
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+/* write the calibration results, through a temporary file so that a crash never leaves a partial cache */
+int cal_cache_save(uint8_t cal_cmd) {
+	char tmp_file[LGW_CAL_PATH_SIZE + 4];
+	const int8_t *offset[4] = {cur->cal_offset_a_i, cur->cal_offset_a_q, cur->cal_offset_b_i, cur->cal_offset_b_q};
+	FILE *f;
+	int i, j;
+	int err = 0;
+
+	snprintf(tmp_file, sizeof tmp_file, "%s.tmp", cur->cal_conf.cache_file);
+	f = fopen(tmp_file, "w");
+	if (f == NULL) {
+		DEBUG_PRINTF("ERROR: FAILED TO CREATE CALIBRATION CACHE FILE %s\n", tmp_file);
+		return LGW_HAL_ERROR;
+	}
+	fprintf(f, "lgwcal %u %016llX %u %lu %lu %02X\n", CAL_CACHE_VERSION, (unsigned long long)cur->cal_conf.board_id, (unsigned)cur->rf_radio_type[0], (unsigned long)cur->rf_rx_freq[0], (unsigned long)cur->rf_rx_freq[1], cal_cmd);
+	for (i=0; i<4; ++i) {
+		for (j=0; j<8; ++j) {
+			fprintf(f, "%d%c", offset[i][j], (j < 7) ? ' ' : '\n');
+		}
+	}
+	for (i=0; i<CAL_IQ_NB; ++i) {
+		fprintf(f, "%d%c", (int)cur->cal_iq_val[i], (i < CAL_IQ_NB-1) ? ' ' : '\n');
+	}
+	err |= ferror(f);
+	err |= fclose(f);
+	if ((err != 0) || (rename(tmp_file, cur->cal_conf.cache_file) != 0)) {
+		DEBUG_PRINTF("ERROR: FAILED TO WRITE CALIBRATION CACHE FILE %s\n", cur->cal_conf.cache_file);
+		remove(tmp_file);
+		return LGW_HAL_ERROR;
+	}
 	return LGW_HAL_SUCCESS;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
+/* check the TX parameters of a descriptor and compute its registers and metadata */
+int tx_desc_compute(struct lgw_tx_desc_s *desc) {
+	uint8_t *buff = desc->meta;
+	uint32_t part_int = 0; /* integer part for PLL register value calculation */
+	uint32_t part_frac = 0; /* fractional part for PLL register value calculation */
+	uint16_t fsk_dr_div; /* divider to configure for target datarate */
+	uint16_t preamble;
+	uint8_t pow_index = 0; /* 4-bit value to set the firmware TX power */
+	uint8_t target_mix_gain = 0; /* used to select the proper I/Q offset correction */
+
+	desc->gen = 0;
 
 	/* check if the concentrator is running */
-	if (lgw_is_started == true) {
-		DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
+	if (cur->lgw_is_started == false) {
+		DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE SENDING\n");
 		return LGW_HAL_ERROR;
 	}
 
 	/* check input range (segfault prevention) */
-	if (if_chain >= LGW_IF_CHAIN_NB) {
-		DEBUG_PRINTF("ERROR: %d NOT A VALID IF_CHAIN NUMBER\n", if_chain);
+	if (desc->rf_chain >= LGW_RF_CHAIN_NB) {
+		DEBUG_MSG("ERROR: INVALID RF_CHAIN TO SEND PACKETS\n");
 		return LGW_HAL_ERROR;
 	}
 
-	/* if chain is disabled, don't care about most parameters */
-	if (conf.enable == false) {
-		if_enable[if_chain] = false;
-		if_freq[if_chain] = 0;
-		DEBUG_PRINTF("Note: if_chain %d disabled\n", if_chain);
-		return LGW_HAL_SUCCESS;
-	}
-
-	/* check 'general' parameters */
-	if (ifmod_config[if_chain] == IF_UNDEFINED) {
-		DEBUG_PRINTF("ERROR: IF CHAIN %d NOT CONFIGURABLE\n", if_chain);
-	}
-	if (conf.rf_chain >= LGW_RF_CHAIN_NB) {
-		DEBUG_MSG("ERROR: INVALID RF_CHAIN TO ASSOCIATE WITH A LORA_STD IF CHAIN\n");
+	/* check input variables */
+	if (cur->rf_tx_enable[desc->rf_chain] == false) {
+		DEBUG_MSG("ERROR: SELECTED RF_CHAIN IS DISABLED FOR TX ON SELECTED BOARD\n");
 		return LGW_HAL_ERROR;
 	}
-	if ((conf.freq_hz + LGW_REF_BW/2) > ((int32_t)rf_rx_bandwidth[conf.rf_chain] / 2)) {
-		DEBUG_PRINTF("ERROR: IF FREQUENCY %d TOO HIGH\n", conf.freq_hz);
+	if (cur->rf_enable[desc->rf_chain] == false) {
+		DEBUG_MSG("ERROR: SELECTED RF_CHAIN IS DISABLED\n");
 		return LGW_HAL_ERROR;
-	} else if ((conf.freq_hz - LGW_REF_BW/2) < -((int32_t)rf_rx_bandwidth[conf.rf_chain] / 2)) {
-		DEBUG_PRINTF("ERROR: IF FREQUENCY %d TOO LOW\n", conf.freq_hz);
+	}
+	if (desc->modulation == MOD_LORA) {
+		if (!IS_LORA_BW(desc->bandwidth)) {
+			DEBUG_MSG("ERROR: BANDWIDTH NOT SUPPORTED BY LORA TX\n");
+			return LGW_HAL_ERROR;
+		}
+		if (!IS_LORA_STD_DR(desc->datarate)) {
+			DEBUG_MSG("ERROR: DATARATE NOT SUPPORTED BY LORA TX\n");
+			return LGW_HAL_ERROR;
+		}
+		if (!IS_LORA_CR(desc->coderate)) {
+			DEBUG_MSG("ERROR: CODERATE NOT SUPPORTED BY LORA TX\n");
+			return LGW_HAL_ERROR;
+		}
+	} else if (desc->modulation == MOD_FSK) {
+		if((desc->f_dev < 1) || (desc->f_dev > 200)) {
+			DEBUG_MSG("ERROR: TX FREQUENCY DEVIATION OUT OF ACCEPTABLE RANGE\n");
+			return LGW_HAL_ERROR;
+		}
+		if(!IS_FSK_DR(desc->datarate)) {
+			DEBUG_MSG("ERROR: DATARATE NOT SUPPORTED BY FSK IF CHAIN\n");
+			return LGW_HAL_ERROR;
+		}
+	} else {
+		DEBUG_MSG("ERROR: INVALID TX MODULATION\n");
 		return LGW_HAL_ERROR;
 	}
-	/* WARNING: if the channel is 250 or 500kHz wide, that check is insufficient */
 
-	/* check parameters according to the type of IF chain + modem,
-	fill default if necessary, and commit configuration if everything is OK */
-	switch (ifmod_config[if_chain]) {
-		case IF_LORA_STD:
-			/* fill default parameters if needed */
-			if (conf.bandwidth == BW_UNDEFINED) {
-				conf.bandwidth = BW_250KHZ;
-			}
-			if (conf.datarate == DR_UNDEFINED) {
-				conf.datarate = DR_LORA_SF9;
-			}
-			/* check BW & DR */
-			if (!IS_LORA_BW(conf.bandwidth)) {
-				DEBUG_MSG("ERROR: BANDWIDTH NOT SUPPORTED BY LORA_STD IF CHAIN\n");
-				return LGW_HAL_ERROR;
-			}
-			if (!IS_LORA_STD_DR(conf.datarate)) {
-				DEBUG_MSG("ERROR: DATARATE NOT SUPPORTED BY LORA_STD IF CHAIN\n");
-				return LGW_HAL_ERROR;
-			}
-			/* set internal configuration  */
-			if_enable[if_chain] = conf.enable;
-			if_rf_chain[if_chain] = conf.rf_chain;
-			if_freq[if_chain] = conf.freq_hz;
-			lora_rx_bw = conf.bandwidth;
-			lora_rx_sf = (uint8_t)(DR_LORA_MULTI & conf.datarate); /* filter SF out of the 7-12 range */
-			if (SET_PPM_ON(conf.bandwidth, conf.datarate)) {
-				lora_rx_ppm_offset = true;
-			} else {
-				lora_rx_ppm_offset = false;
-			}
+	/* interpretation of TX power */
+	for (pow_index = cur->txgain_lut.size-1; pow_index > 0; pow_index--) {
+		if (cur->txgain_lut.lut[pow_index].rf_power <= desc->rf_power) {
+			break;
+		}
+	}
+	desc->pow_index = pow_index;
+
+	/* TX imbalance correction and digital gain */
+	target_mix_gain = cur->txgain_lut.lut[pow_index].mix_gain;
+	if (desc->rf_chain == 0) { /* use radio A calibration table */
+		desc->offset_i = cur->cal_offset_a_i[target_mix_gain - 8];
+		desc->offset_q = cur->cal_offset_a_q[target_mix_gain - 8];
+	} else { /* use radio B calibration table */
+		desc->offset_i = cur->cal_offset_b_i[target_mix_gain - 8];
+		desc->offset_q = cur->cal_offset_b_q[target_mix_gain - 8];
+	}
+	desc->dig_gain = cur->txgain_lut.lut[pow_index].dig_gain;
 
-			DEBUG_PRINTF("Note: LoRa 'std' if_chain %d configuration; en:%d freq:%d bw:%d dr:%d\n", if_chain, if_enable[if_chain], if_freq[if_chain], lora_rx_bw, lora_rx_sf);
+	memset(buff, 0, LGW_TX_METADATA_MAX);
+	desc->meta_size = TX_METADATA_NB; /* the payload starts just after the metadata */
+
+	/* metadata 0 to 2, TX PLL frequency */
+	switch (cur->rf_radio_type[0]) { /* we assume that there is only one radio type on the board */
+		case LGW_RADIO_TYPE_SX1255:
+			part_int = desc->freq_hz / (SX125x_32MHz_FRAC << 7); /* integer part, gives the MSB */
+			part_frac = ((desc->freq_hz % (SX125x_32MHz_FRAC << 7)) << 9) / SX125x_32MHz_FRAC; /* fractional part, gives middle part and LSB */
+			break;
+		case LGW_RADIO_TYPE_SX1257:
+			part_int = desc->freq_hz / (SX125x_32MHz_FRAC << 8); /* integer part, gives the MSB */
+			part_frac = ((desc->freq_hz % (SX125x_32MHz_FRAC << 8)) << 8) / SX125x_32MHz_FRAC; /* fractional part, gives middle part and LSB */
+			break;
+		default:
+			DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", cur->rf_radio_type[0]);
 			break;
+	}
 
-		case IF_LORA_MULTI:
-			/* fill default parameters if needed */
-			if (conf.bandwidth == BW_UNDEFINED) {
-				conf.bandwidth = BW_125KHZ;
-			}
-			if (conf.datarate == DR_UNDEFINED) {
+	buff[0] = 0xFF & part_int; /* Most Significant Byte */
+	buff[1] = 0xFF & (part_frac >> 8); /* middle byte */
+	buff[2] = 0xFF & part_frac; /* Least Significant Byte */
+
+	/* metadata 3 to 6 (timestamp trigger value) and 10 (payload size) are set for each packet */
+
+	/* parameters depending on modulation  */
+	if (desc->modulation == MOD_LORA) {
+		/* metadata 7, modulation type, radio chain selection and TX power */
+		buff[7] = (0x20 & (desc->rf_chain << 5)) | (0x0F & pow_index); /* bit 4 is 0 -> LoRa modulation */
+
+		buff[8] = 0; /* metadata 8, not used */
+
+		/* metadata 9, CRC, LoRa CR & SF */
+		switch (desc->datarate) {
+			case DR_LORA_SF7: buff[9] = 7; break;
+			case DR_LORA_SF8: buff[9] = 8; break;
+			case DR_LORA_SF9: buff[9] = 9; break;
+			case DR_LORA_SF10: buff[9] = 10; break;
+			case DR_LORA_SF11: buff[9] = 11; break;
+			case DR_LORA_SF12: buff[9] = 12; break;
+			default: DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", desc->datarate);
+		}
+		switch (desc->coderate) {
+			case CR_LORA_4_5: buff[9] |= 1 << 4; break;
+			case CR_LORA_4_6: buff[9] |= 2 << 4; break;
+			case CR_LORA_4_7: buff[9] |= 3 << 4; break;
+			case CR_LORA_4_8: buff[9] |= 4 << 4; break;
+			default: DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", desc->coderate);
+		}
+		if (desc->no_crc == false) {
+			buff[9] |= 0x80; /* set 'CRC enable' bit */
+		} else {
+			DEBUG_MSG("Info: packet will be sent without CRC\n");
+		}
+
+		/* metadata 11, implicit header, modulation bandwidth, PPM offset & polarity */
+		switch (desc->bandwidth) {
+			case BW_125KHZ: buff[11] = 0; break;
+			case BW_250KHZ: buff[11] = 1; break;
+			case BW_500KHZ: buff[11] = 2; break;
+			default: DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", desc->bandwidth);
+		}
+		if (desc->no_header == true) {
+			buff[11] |= 0x04; /* set 'implicit header' bit */
+		}
+		if (SET_PPM_ON(desc->bandwidth,desc->datarate)) {
+			buff[11] |= 0x08; /* set 'PPM offset' bit at 1 */
+		}
+		if (desc->invert_pol == true) {
+			buff[11] |= 0x10; /* set 'TX polarity' bit at 1 */
+		}
+
+		/* metadata 12 & 13, LoRa preamble size */
+		preamble = desc->preamble;
+		if (preamble == 0) { /* if not explicit, use recommended LoRa preamble size */
+			preamble = STD_LORA_PREAMBLE;
+		} else if (preamble < MIN_LORA_PREAMBLE) { /* enforce minimum preamble size */
+			preamble = MIN_LORA_PREAMBLE;
+			DEBUG_MSG("Note: preamble length adjusted to respect minimum LoRa preamble size\n");
+		}
+		buff[12] = 0xFF & (preamble >> 8);
+		buff[13] = 0xFF & preamble;
+
+		/* metadata 14 & 15, not used */
+		buff[14] = 0;
+		buff[15] = 0;
+
+		/* MSB of RF frequency is now used in AGC firmware to implement large/narrow filtering in SX1257/55 */
+		buff[0] &= 0x3F; /* Unset 2 MSBs of frequency code */
+		if (desc->bandwidth == BW_500KHZ) {
+			buff[0] |= 0x80; /* Set MSB bit to enlarge analog filter for 500kHz BW */
+		}
+		else if (desc->bandwidth == BW_125KHZ){
+			buff[0] |= 0x40; /* Set MSB-1 bit to enable digital filter for 125kHz BW */
+		}
+
+	} else {
+		/* metadata 7, modulation type, radio chain selection and TX power */
+		buff[7] = (0x20 & (desc->rf_chain << 5)) | 0x10 | (0x0F & pow_index); /* bit 4 is 1 -> FSK modulation */
+
+		buff[8] = 0; /* metadata 8, not used */
+
+		/* metadata 9, frequency deviation */
+		buff[9] = desc->f_dev;
+
+		/* metadata 11, packet mode, CRC, encoding */
+		buff[11] = 0x01 | (desc->no_crc?0:0x02) | (0x02 << 2); /* always in variable length packet mode, whitening, and CCITT CRC if CRC is not disabled  */
+
+		/* metadata 12 & 13, FSK preamble size */
+		preamble = desc->preamble;
+		if (preamble == 0) { /* if not explicit, use LoRa MAC preamble size */
+			preamble = STD_FSK_PREAMBLE;
+		} else if (preamble < MIN_FSK_PREAMBLE) { /* enforce minimum preamble size */
+			preamble = MIN_FSK_PREAMBLE;
+			DEBUG_MSG("Note: preamble length adjusted to respect minimum FSK preamble size\n");
+		}
+		buff[12] = 0xFF & (preamble >> 8);
+		buff[13] = 0xFF & preamble;
+
+		/* metadata 14 & 15, FSK baudrate */
+		fsk_dr_div = (uint16_t)((uint32_t)LGW_XTAL_FREQU / desc->datarate); /* Ok for datarate between 500bps and 250kbps */
+		buff[14] = 0xFF & (fsk_dr_div >> 8);
+		buff[15] = 0xFF & fsk_dr_div;
+
+		/* metadata 16, payload size for variable mode, set for each packet */
+		++desc->meta_size; /* one more byte to transfer to the TX modem */
+		/* TODO: how to handle 255 bytes packets ?!? */
+
+		/* MSB of RF frequency is now used in AGC firmware to implement large/narrow filtering in SX1257/55 */
+		buff[0] &= 0x7F; /* Always use narrow band for FSK (force MSB to 0) */
+	}
+
+	desc->gen = cur->tx_desc_gen;
+	return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* make the descriptors computed so far for the current context out of date */
+void tx_desc_invalidate(void) {
+	cur->tx_desc_gen = __atomic_add_fetch(&tx_desc_gen_last, 1, __ATOMIC_RELAXED);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* check if a packet has the TX parameters of an up-to-date descriptor */
+bool tx_desc_match(const struct lgw_tx_desc_s *desc, const struct lgw_pkt_tx_s *pkt_data) {
+	return (desc->gen == cur->tx_desc_gen) &&
+		(desc->freq_hz == pkt_data->freq_hz) &&
+		(desc->rf_chain == pkt_data->rf_chain) &&
+		(desc->rf_power == pkt_data->rf_power) &&
+		(desc->modulation == pkt_data->modulation) &&
+		(desc->bandwidth == pkt_data->bandwidth) &&
+		(desc->datarate == pkt_data->datarate) &&
+		(desc->coderate == pkt_data->coderate) &&
+		(desc->invert_pol == pkt_data->invert_pol) &&
+		(desc->f_dev == pkt_data->f_dev) &&
+		(desc->preamble == pkt_data->preamble) &&
+		(desc->no_crc == pkt_data->no_crc) &&
+		(desc->no_header == pkt_data->no_header);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* sleep until the RX FIFO may hold packets, without any register access;
+return false if the interrupt line stayed low for the whole timeout */
+bool rx_wait_sleep(uint32_t timeout_us) {
+	int i;
+
+	/* sleep until the interrupt line is raised */
+	if (cur->rx_wait_irq == true) {
+		i = lgw_reg_irq_wait((timeout_us + 999) / 1000);
+		if (i == LGW_REG_SUCCESS) {
+			cur->rx_fetch_stat.nb_wakeup_irq += 1;
+			return true;
+		} else if (i == LGW_REG_TIMEOUT) {
+			return false;
+		}
+		DEBUG_MSG("Note: no concentrator interrupt line, lgw_receive_wait polls the FIFO\n");
+		cur->rx_wait_irq = false;
+	}
+
+	/* no interrupt line, poll the FIFO less and less often while it is empty */
+	wait_us((timeout_us < cur->rx_wait_backoff) ? timeout_us : cur->rx_wait_backoff);
+	cur->rx_fetch_stat.nb_wakeup_poll += 1;
+	cur->rx_wait_backoff *= 2;
+	if (cur->rx_wait_backoff > RX_WAIT_BACKOFF_MAX) {
+		cur->rx_wait_backoff = RX_WAIT_BACKOFF_MAX;
+	}
+	return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* add a duration to a latency histogram */
+void stats_hist_add(struct lgw_stats_hist_s *h, uint32_t duration_us) {
+	int i;
+	uint32_t max;
+
+	i = (duration_us == 0) ? 0 : 31 - __builtin_clz(duration_us); /* floor(log2) */
+	if (i >= LGW_STATS_HIST_NB) {
+		i = LGW_STATS_HIST_NB - 1;
+	}
+	STAT_ADD(h->hist[i], 1);
+	STAT_ADD(h->nb, 1);
+	STAT_ADD(h->total_us, duration_us);
+	max = STAT_GET(h->max_us);
+	while ((duration_us > max) && !__atomic_compare_exchange_n(&h->max_us, &max, duration_us, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		/* max was updated with the current value, try again */
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void stats_hist_get(struct lgw_stats_hist_s *dst, struct lgw_stats_hist_s *h) {
+	int i;
+
+	dst->nb = STAT_GET(h->nb);
+	dst->total_us = STAT_GET(h->total_us);
+	dst->max_us = STAT_GET(h->max_us);
+	for (i = 0; i < LGW_STATS_HIST_NB; ++i) {
+		dst->hist[i] = STAT_GET(h->hist[i]);
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void stats_hist_clr(struct lgw_stats_hist_s *h) {
+	int i;
+
+	STAT_CLR(h->nb);
+	STAT_CLR(h->total_us);
+	STAT_CLR(h->max_us);
+	for (i = 0; i < LGW_STATS_HIST_NB; ++i) {
+		STAT_CLR(h->hist[i]);
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+struct lgw_ctx_s *lgw_ctx_new(const char *spi_dev) {
+	static const struct lgw_ctx_s init = CTX_INIT;
+	struct lgw_ctx_s *c;
+
+	c = malloc(sizeof *c);
+	if (c == NULL) {
+		DEBUG_MSG("ERROR: MALLOC FAIL\n");
+		return NULL;
+	}
+	*c = init;
+	c->reg = lgw_reg_ctx_new(spi_dev);
+	if (c->reg == NULL) {
+		free(c);
+		return NULL;
+	}
+	c->tx_desc_gen = __atomic_add_fetch(&tx_desc_gen_last, 1, __ATOMIC_RELAXED);
+	return c;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_free(struct lgw_ctx_s *ctx) {
+	CHECK_NULL(ctx);
+	if ((ctx == cur) || (ctx->lgw_is_started == true)) {
+		DEBUG_MSG("ERROR: CONTEXT IN USE, STOP IT OR SELECT ANOTHER ONE FIRST\n");
+		return LGW_HAL_ERROR;
+	}
+	if (lgw_reg_ctx_free(ctx->reg) != LGW_REG_SUCCESS) {
+		return LGW_HAL_ERROR;
+	}
+	free(ctx);
+	return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+struct lgw_ctx_s *lgw_ctx_select(struct lgw_ctx_s *ctx) {
+	struct lgw_ctx_s *prev = cur;
+
+	cur = (ctx == NULL) ? &ctx_dflt : ctx;
+	lgw_reg_ctx_select(cur->reg);
+	return (prev == &ctx_dflt) ? NULL : prev;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_board_setconf(struct lgw_ctx_s *ctx, struct lgw_conf_board_s conf) {
+	CTX_RETURN(ctx, lgw_board_setconf(conf));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_rxrf_setconf(struct lgw_ctx_s *ctx, uint8_t rf_chain, struct lgw_conf_rxrf_s conf) {
+	CTX_RETURN(ctx, lgw_rxrf_setconf(rf_chain, conf));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_rxif_setconf(struct lgw_ctx_s *ctx, uint8_t if_chain, struct lgw_conf_rxif_s conf) {
+	CTX_RETURN(ctx, lgw_rxif_setconf(if_chain, conf));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_txgain_setconf(struct lgw_ctx_s *ctx, struct lgw_tx_gain_lut_s *conf) {
+	CTX_RETURN(ctx, lgw_txgain_setconf(conf));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_start(struct lgw_ctx_s *ctx) {
+	CTX_RETURN(ctx, lgw_start());
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_stop(struct lgw_ctx_s *ctx) {
+	CTX_RETURN(ctx, lgw_stop());
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_receive(struct lgw_ctx_s *ctx, uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
+	CTX_RETURN(ctx, lgw_receive(max_pkt, pkt_data));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_send(struct lgw_ctx_s *ctx, const struct lgw_pkt_tx_s *pkt_data) {
+	CTX_RETURN(ctx, lgw_send_ptr(pkt_data));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_status(struct lgw_ctx_s *ctx, uint8_t select, uint8_t *code) {
+	CTX_RETURN(ctx, lgw_status(select, code));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_board_setconf(struct lgw_conf_board_s conf) {
+
+	/* check if the concentrator is running */
+	if (cur->lgw_is_started == true) {
+		DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
+		return LGW_HAL_ERROR;
+	}
+
+	/* set internal config according to parameters */
+	cur->lorawan_public = conf.lorawan_public;
+	cur->rf_clkout = conf.clksrc;
+
+	DEBUG_PRINTF("Note: board configuration; cur->lorawan_public:%d, clksrc:%d\n", cur->lorawan_public, cur->rf_clkout);
+
+	return LGW_HAL_SUCCESS;
+}
+
+int lgw_rxrf_setconf(uint8_t rf_chain, struct lgw_conf_rxrf_s conf) {
+
+	/* check if the concentrator is running */
+	if (cur->lgw_is_started == true) {
+		DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
+		return LGW_HAL_ERROR;
+	}
+
+	/* check input range (segfault prevention) */
+	if (rf_chain >= LGW_RF_CHAIN_NB) {
+		DEBUG_MSG("ERROR: NOT A VALID RF_CHAIN NUMBER\n");
+		return LGW_HAL_ERROR;
+	}
+
+	/* check if radio type is supported */
+	if ((conf.type != LGW_RADIO_TYPE_SX1255) && (conf.type != LGW_RADIO_TYPE_SX1257)) {
+		DEBUG_MSG("ERROR: NOT A VALID RADIO TYPE\n");
+		return LGW_HAL_ERROR;
+	}
+
+	/* set internal config according to parameters */
+	cur->rf_enable[rf_chain] = conf.enable;
+	cur->rf_rx_freq[rf_chain] = conf.freq_hz;
+	cur->rf_rssi_offset[rf_chain] = conf.rssi_offset;
+	cur->rf_radio_type[rf_chain] = conf.type;
+	cur->rf_tx_enable[rf_chain] = conf.tx_enable;
+
+	DEBUG_PRINTF("Note: rf_chain %d configuration; en:%d freq:%d rssi_offset:%f radio_type:%d tx_enable:%d\n", rf_chain, cur->rf_enable[rf_chain], cur->rf_rx_freq[rf_chain], cur->rf_rssi_offset[rf_chain], cur->rf_radio_type[rf_chain], cur->rf_tx_enable[rf_chain]);
+
+	return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
+
+	/* check if the concentrator is running */
+	if (cur->lgw_is_started == true) {
+		DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
+		return LGW_HAL_ERROR;
+	}
+
+	/* check input range (segfault prevention) */
+	if (if_chain >= LGW_IF_CHAIN_NB) {
+		DEBUG_PRINTF("ERROR: %d NOT A VALID IF_CHAIN NUMBER\n", if_chain);
+		return LGW_HAL_ERROR;
+	}
+
+	/* if chain is disabled, don't care about most parameters */
+	if (conf.enable == false) {
+		cur->if_enable[if_chain] = false;
+		cur->if_freq[if_chain] = 0;
+		DEBUG_PRINTF("Note: if_chain %d disabled\n", if_chain);
+		return LGW_HAL_SUCCESS;
+	}
+
+	/* check 'general' parameters */
+	if (ifmod_config[if_chain] == IF_UNDEFINED) {
+		DEBUG_PRINTF("ERROR: IF CHAIN %d NOT CONFIGURABLE\n", if_chain);
+	}
+	if (conf.rf_chain >= LGW_RF_CHAIN_NB) {
+		DEBUG_MSG("ERROR: INVALID RF_CHAIN TO ASSOCIATE WITH A LORA_STD IF CHAIN\n");
+		return LGW_HAL_ERROR;
+	}
+	if ((conf.freq_hz + LGW_REF_BW/2) > ((int32_t)rf_rx_bandwidth[conf.rf_chain] / 2)) {
+		DEBUG_PRINTF("ERROR: IF FREQUENCY %d TOO HIGH\n", conf.freq_hz);
+		return LGW_HAL_ERROR;
+	} else if ((conf.freq_hz - LGW_REF_BW/2) < -((int32_t)rf_rx_bandwidth[conf.rf_chain] / 2)) {
+		DEBUG_PRINTF("ERROR: IF FREQUENCY %d TOO LOW\n", conf.freq_hz);
+		return LGW_HAL_ERROR;
+	}
+	/* WARNING: if the channel is 250 or 500kHz wide, that check is insufficient */
+
+	/* check parameters according to the type of IF chain + modem,
+	fill default if necessary, and commit configuration if everything is OK */
+	switch (ifmod_config[if_chain]) {
+		case IF_LORA_STD:
+			/* fill default parameters if needed */
+			if (conf.bandwidth == BW_UNDEFINED) {
+				conf.bandwidth = BW_250KHZ;
+			}
+			if (conf.datarate == DR_UNDEFINED) {
+				conf.datarate = DR_LORA_SF9;
+			}
+			/* check BW & DR */
+			if (!IS_LORA_BW(conf.bandwidth)) {
+				DEBUG_MSG("ERROR: BANDWIDTH NOT SUPPORTED BY LORA_STD IF CHAIN\n");
+				return LGW_HAL_ERROR;
+			}
+			if (!IS_LORA_STD_DR(conf.datarate)) {
+				DEBUG_MSG("ERROR: DATARATE NOT SUPPORTED BY LORA_STD IF CHAIN\n");
+				return LGW_HAL_ERROR;
+			}
+			/* set internal configuration  */
+			cur->if_enable[if_chain] = conf.enable;
+			cur->if_rf_chain[if_chain] = conf.rf_chain;
+			cur->if_freq[if_chain] = conf.freq_hz;
+			cur->lora_rx_bw = conf.bandwidth;
+			cur->lora_rx_sf = (uint8_t)(DR_LORA_MULTI & conf.datarate); /* filter SF out of the 7-12 range */
+			if (SET_PPM_ON(conf.bandwidth, conf.datarate)) {
+				cur->lora_rx_ppm_offset = true;
+			} else {
+				cur->lora_rx_ppm_offset = false;
+			}
+
+			DEBUG_PRINTF("Note: LoRa 'std' if_chain %d configuration; en:%d freq:%d bw:%d dr:%d\n", if_chain, cur->if_enable[if_chain], cur->if_freq[if_chain], cur->lora_rx_bw, cur->lora_rx_sf);
+			break;
+
+		case IF_LORA_MULTI:
+			/* fill default parameters if needed */
+			if (conf.bandwidth == BW_UNDEFINED) {
+				conf.bandwidth = BW_125KHZ;
+			}
+			if (conf.datarate == DR_UNDEFINED) {
 				conf.datarate = DR_LORA_MULTI;
 			}
 			/* check BW & DR */
@@ -705,12 +1512,12 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
 				return LGW_HAL_ERROR;
 			}
 			/* set internal configuration  */
-			if_enable[if_chain] = conf.enable;
-			if_rf_chain[if_chain] = conf.rf_chain;
-			if_freq[if_chain] = conf.freq_hz;
-			lora_multi_sfmask[if_chain] = (uint8_t)(DR_LORA_MULTI & conf.datarate); /* filter SF out of the 7-12 range */
+			cur->if_enable[if_chain] = conf.enable;
+			cur->if_rf_chain[if_chain] = conf.rf_chain;
+			cur->if_freq[if_chain] = conf.freq_hz;
+			cur->lora_multi_sfmask[if_chain] = (uint8_t)(DR_LORA_MULTI & conf.datarate); /* filter SF out of the 7-12 range */
 
-			DEBUG_PRINTF("Note: LoRa 'multi' if_chain %d configuration; en:%d freq:%d SF_mask:0x%02x\n", if_chain, if_enable[if_chain], if_freq[if_chain], lora_multi_sfmask[if_chain]);
+			DEBUG_PRINTF("Note: LoRa 'multi' if_chain %d configuration; en:%d freq:%d SF_mask:0x%02x\n", if_chain, cur->if_enable[if_chain], cur->if_freq[if_chain], cur->lora_multi_sfmask[if_chain]);
 			break;
 
 		case IF_FSK_STD:
@@ -731,16 +1538,16 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
 				return LGW_HAL_ERROR;
 			}
 			/* set internal configuration  */
-			if_enable[if_chain] = conf.enable;
-			if_rf_chain[if_chain] = conf.rf_chain;
-			if_freq[if_chain] = conf.freq_hz;
-			fsk_rx_bw = conf.bandwidth;
-			fsk_rx_dr = conf.datarate;
+			cur->if_enable[if_chain] = conf.enable;
+			cur->if_rf_chain[if_chain] = conf.rf_chain;
+			cur->if_freq[if_chain] = conf.freq_hz;
+			cur->fsk_rx_bw = conf.bandwidth;
+			cur->fsk_rx_dr = conf.datarate;
 			if (conf.sync_word > 0) {
-				fsk_sync_word_size = conf.sync_word_size;
-				fsk_sync_word = conf.sync_word;
+				cur->fsk_sync_word_size = conf.sync_word_size;
+				cur->fsk_sync_word = conf.sync_word;
 			}
-			DEBUG_PRINTF("Note: FSK if_chain %d configuration; en:%d freq:%d bw:%d dr:%d (%d real dr) sync:0x%0*llX\n", if_chain, if_enable[if_chain], if_freq[if_chain], fsk_rx_bw, fsk_rx_dr, LGW_XTAL_FREQU/(LGW_XTAL_FREQU/fsk_rx_dr), 2*fsk_sync_word_size, fsk_sync_word);
+			DEBUG_PRINTF("Note: FSK if_chain %d configuration; en:%d freq:%d bw:%d dr:%d (%d real dr) sync:0x%0*llX\n", if_chain, cur->if_enable[if_chain], cur->if_freq[if_chain], cur->fsk_rx_bw, cur->fsk_rx_dr, LGW_XTAL_FREQU/(LGW_XTAL_FREQU/cur->fsk_rx_dr), 2*cur->fsk_sync_word_size, cur->fsk_sync_word);
 			break;
 
 		default:
@@ -762,9 +1569,9 @@ int lgw_txgain_setconf(struct lgw_tx_gain_lut_s *conf) {
 		return LGW_HAL_ERROR;
 	}
 
-	txgain_lut.size = conf->size;
+	cur->txgain_lut.size = conf->size;
 
-	for (i = 0; i < txgain_lut.size; i++) {
+	for (i = 0; i < cur->txgain_lut.size; i++) {
 		/* Check gain range */
 		if (conf->lut[i].dig_gain > 3) {
 			DEBUG_MSG("ERROR: TX gain LUT: SX1301 digital gain must be between 0 and 3\n");
@@ -787,13 +1594,34 @@ int lgw_txgain_setconf(struct lgw_tx_gain_lut_s *conf) {
 		}
 
 		/* Set internal LUT */
-		txgain_lut.lut[i].dig_gain = conf->lut[i].dig_gain;
-		txgain_lut.lut[i].dac_gain = conf->lut[i].dac_gain;
-		txgain_lut.lut[i].mix_gain = conf->lut[i].mix_gain;
-		txgain_lut.lut[i].pa_gain  = conf->lut[i].pa_gain;
-		txgain_lut.lut[i].rf_power = conf->lut[i].rf_power;
+		cur->txgain_lut.lut[i].dig_gain = conf->lut[i].dig_gain;
+		cur->txgain_lut.lut[i].dac_gain = conf->lut[i].dac_gain;
+		cur->txgain_lut.lut[i].mix_gain = conf->lut[i].mix_gain;
+		cur->txgain_lut.lut[i].pa_gain  = conf->lut[i].pa_gain;
+		cur->txgain_lut.lut[i].rf_power = conf->lut[i].rf_power;
+	}
+	tx_desc_invalidate();
+
+	return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_cal_setconf(struct lgw_conf_cal_s conf) {
+
+	/* check if the concentrator is running */
+	if (cur->lgw_is_started == true) {
+		DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
+		return LGW_HAL_ERROR;
 	}
 
+	if (conf.cache_enable && ((conf.cache_file[0] == '\0') || (memchr(conf.cache_file, '\0', sizeof conf.cache_file) == NULL))) {
+		DEBUG_MSG("ERROR: INVALID CALIBRATION CACHE FILE PATH\n");
+		return LGW_HAL_ERROR;
+	}
+
+	cur->cal_conf = conf;
+	DEBUG_PRINTF("Note: calibration cache %s; board_id:%016llX, file:%s\n", conf.cache_enable ? "enabled" : "disabled", (unsigned long long)conf.board_id, conf.cache_enable ? conf.cache_file : "-");
 	return LGW_HAL_SUCCESS;
 }
 
@@ -808,12 +1636,12 @@ int lgw_start(void) {
 	uint8_t load_val;
 	uint8_t fw_version;
 	uint8_t cal_cmd;
-	uint16_t cal_time;
-	uint8_t cal_status;
+	bool cal_cached;
 
 	uint64_t fsk_sync_word_reg;
+	uint16_t nb_page_switch;
 
-	if (lgw_is_started == true) {
+	if (cur->lgw_is_started == true) {
 		DEBUG_MSG("Note: LoRa concentrator already started, restarting it now\n");
 	}
 
@@ -838,8 +1666,8 @@ int lgw_start(void) {
 	lgw_reg_w(LGW_RADIO_RST,0);
 
 	/* setup the radios */
-	setup_sx125x(0, rf_rx_freq[0]);
-	setup_sx125x(1, rf_rx_freq[1]);
+	setup_sx125x(0, cur->rf_rx_freq[0]);
+	setup_sx125x(1, cur->rf_rx_freq[1]);
 
 	/* gives AGC control of GPIOs to enable Tx external digital filter */
 	lgw_reg_w(LGW_GPIO_MODE,31); /* Set all GPIOs as output */
@@ -855,13 +1683,13 @@ int lgw_start(void) {
 
 	/* select calibration command */
 	cal_cmd = 0;
-	cal_cmd |= rf_enable[0] ? 0x01 : 0x00; /* Bit 0: Calibrate Rx IQ mismatch compensation on radio A */
-	cal_cmd |= rf_enable[1] ? 0x02 : 0x00; /* Bit 1: Calibrate Rx IQ mismatch compensation on radio B */
-	cal_cmd |= (rf_enable[0] && rf_tx_enable[0]) ? 0x04 : 0x00; /* Bit 2: Calibrate Tx DC offset on radio A */
-	cal_cmd |= (rf_enable[1] && rf_tx_enable[1]) ? 0x08 : 0x00; /* Bit 3: Calibrate Tx DC offset on radio B */
+	cal_cmd |= cur->rf_enable[0] ? 0x01 : 0x00; /* Bit 0: Calibrate Rx IQ mismatch compensation on radio A */
+	cal_cmd |= cur->rf_enable[1] ? 0x02 : 0x00; /* Bit 1: Calibrate Rx IQ mismatch compensation on radio B */
+	cal_cmd |= (cur->rf_enable[0] && cur->rf_tx_enable[0]) ? 0x04 : 0x00; /* Bit 2: Calibrate Tx DC offset on radio A */
+	cal_cmd |= (cur->rf_enable[1] && cur->rf_tx_enable[1]) ? 0x08 : 0x00; /* Bit 3: Calibrate Tx DC offset on radio B */
 	cal_cmd |= 0x10; /* Bit 4: 0: calibrate with DAC gain=2, 1: with DAC gain=3 (use 3) */
 
-	switch (rf_radio_type[0]) { /* we assume that there is only one radio type on the board */
+	switch (cur->rf_radio_type[0]) { /* we assume that there is only one radio type on the board */
 		case LGW_RADIO_TYPE_SX1255:
 			cal_cmd |= 0x20; /* Bit 5: 0: SX1257, 1: SX1255 */
 			break;
@@ -869,106 +1697,51 @@ int lgw_start(void) {
 			cal_cmd |= 0x00; /* Bit 5: 0: SX1257, 1: SX1255 */
 			break;
 		default:
-			DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", rf_radio_type[0]);
+			DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", cur->rf_radio_type[0]);
 			break;
 	}
 
 	cal_cmd |= 0x00; /* Bit 6-7: Board type 0: ref, 1: FPGA, 3: board X */
-	cal_time = 2300; /* measured between 2.1 and 2.2 sec, because 1 TX only */
-
-	/* Load the calibration firmware  */
-	load_firmware(MCU_AGC, cal_firmware, MCU_AGC_FW_BYTE);
-	lgw_reg_w(LGW_FORCE_HOST_RADIO_CTRL,0); /* gives to AGC MCU the control of the radios */
-	lgw_reg_w(LGW_RADIO_SELECT,cal_cmd); /* send calibration configuration word */
-	lgw_reg_w(LGW_MCU_RST_1,0);
-
-	/* Check firmware version */
-	lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, FW_VERSION_ADDR);
-	lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-	fw_version = (uint8_t)read_val;
-	if (fw_version != FW_VERSION_CAL) {
-		printf("ERROR: Version of calibration firmware not expected, actual:%d expected:%d\n", fw_version, FW_VERSION_CAL);
-		return -1;
-	}
-
-	lgw_reg_w(LGW_PAGE_REG,3); /* Calibration will start on this condition as soon as MCU can talk to concentrator registers */
-	lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL,0); /* Give control of concentrator registers to MCU */
-
-	/* Wait for calibration to end */
-	DEBUG_PRINTF("Note: calibration started (time: %u ms)\n", cal_time);
-	wait_ms(cal_time); /* Wait for end of calibration */
-	lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL,1); /* Take back control */
 
-	/* Get calibration status */
-	lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
-	cal_status = (uint8_t)read_val;
-	/*
-		bit 7: calibration finished
-		bit 0: could access SX1301 registers
-		bit 1: could access radio A registers
-		bit 2: could access radio B registers
-		bit 3: radio A RX image rejection successful
-		bit 4: radio B RX image rejection successful
-		bit 5: radio A TX imbalance correction successful
-		bit 6: radio B TX imbalance correction successful
-	*/
-	if ((cal_status & 0x81) != 0x81) {
-		DEBUG_PRINTF("ERROR: CALIBRATION FAILURE (STATUS = %u)\n", cal_status);
-		return LGW_HAL_ERROR;
+	/* warm start with the results of a previous calibration of the same board, or calibrate */
+	cal_cached = false;
+	if (cur->cal_conf.cache_enable && (cal_cache_load(cal_cmd) == LGW_HAL_SUCCESS)) {
+		DEBUG_PRINTF("Note: calibration results restored from %s, calibration skipped\n", cur->cal_conf.cache_file);
+		cal_cached = true;
 	} else {
-		DEBUG_PRINTF("Note: calibration finished (status = %u)\n", cal_status);
-	}
-	if (rf_enable[0] && ((cal_status & 0x02) == 0)) {
-		DEBUG_MSG("WARNING: calibration could not access radio A\n");
-	}
-	if (rf_enable[1] && ((cal_status & 0x04) == 0)) {
-		DEBUG_MSG("WARNING: calibration could not access radio B\n");
-	}
-	if (rf_enable[0] && ((cal_status & 0x08) == 0)) {
-		DEBUG_MSG("WARNING: problem in calibration of radio A for image rejection\n");
-	}
-	if (rf_enable[1] && ((cal_status & 0x10) == 0)) {
-		DEBUG_MSG("WARNING: problem in calibration of radio B for image rejection\n");
-	}
-	if (rf_enable[0] && rf_tx_enable[0] && ((cal_status & 0x20) == 0)) {
-		DEBUG_MSG("WARNING: problem in calibration of radio A for TX imbalance\n");
-	}
-	if (rf_enable[1] && rf_tx_enable[1] && ((cal_status & 0x40) == 0)) {
-		DEBUG_MSG("WARNING: problem in calibration of radio B for TX imbalance\n");
-	}
-
-	/* Get TX DC offset values */
-	for(i=0; i<=7; ++i) {
-		lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA0+i);
-		lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-		cal_offset_a_i[i] = (int8_t)read_val;
-		lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA8+i);
-		lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-		cal_offset_a_q[i] = (int8_t)read_val;
-		lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB0+i);
-		lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-		cal_offset_b_i[i] = (int8_t)read_val;
-		lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB8+i);
-		lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-		cal_offset_b_q[i] = (int8_t)read_val;
+		i = calibrate(cal_cmd);
+		if (i != LGW_HAL_SUCCESS) {
+			return i;
+		}
+		if (cur->cal_conf.cache_enable) {
+			cal_cache_save(cal_cmd);
+		}
 	}
 
-	/* load adjusted parameters */
+	/* load adjusted parameters and modem configuration, grouped by page and sent in one SPI transaction */
+	cur->cfg_reg_nb = 0;
 	lgw_constant_adjust();
 
+	/* RX image rejection, the calibration firmware already set these registers if it ran */
+	if (cal_cached) {
+		for (i=0; i<CAL_IQ_NB; ++i) {
+			cfg_reg_add(cal_iq_reg[i], cur->cal_iq_val[i]);
+		}
+	}
+
 	/* Freq-to-time-drift calculation */
-	x = 4096000000 / (rf_rx_freq[0] >> 1); /* dividend: (4*2048*1000000) >> 1, rescaled to avoid 32b overflow */
+	x = 4096000000 / (cur->rf_rx_freq[0] >> 1); /* dividend: (4*2048*1000000) >> 1, rescaled to avoid 32b overflow */
 	x = ( x > 63 ) ? 63 : x; /* saturation */
-	lgw_reg_w(LGW_FREQ_TO_TIME_DRIFT, x); /* default 9 */
+	cfg_reg_add(LGW_FREQ_TO_TIME_DRIFT, x); /* default 9 */
 
-	x = 4096000000 / (rf_rx_freq[0] >> 3); /* dividend: (16*2048*1000000) >> 3, rescaled to avoid 32b overflow */
+	x = 4096000000 / (cur->rf_rx_freq[0] >> 3); /* dividend: (16*2048*1000000) >> 3, rescaled to avoid 32b overflow */
 	x = ( x > 63 ) ? 63 : x; /* saturation */
-	lgw_reg_w(LGW_MBWSSF_FREQ_TO_TIME_DRIFT, x); /* default 36 */
+	cfg_reg_add(LGW_MBWSSF_FREQ_TO_TIME_DRIFT, x); /* default 36 */
 
 	/* configure LoRa 'multi' demodulators aka. LoRa 'sensor' channels (IF0-3) */
 	radio_select = 0; /* IF mapping to radio A/B (per bit, 0=A, 1=B) */
 	for(i=0; i<LGW_MULTI_NB; ++i) {
-		radio_select += (if_rf_chain[i] == 1 ? 1 << i : 0); /* transform bool array into binary word */
+		radio_select += (cur->if_rf_chain[i] == 1 ? 1 << i : 0); /* transform bool array into binary word */
 	}
 	/*
 	lgw_reg_w(LGW_RADIO_SELECT, radio_select);
@@ -977,76 +1750,82 @@ int lgw_start(void) {
 	will be loaded in LGW_RADIO_SELECT at the end of start procedure.
 	*/
 
-	lgw_reg_w(LGW_IF_FREQ_0, IF_HZ_TO_REG(if_freq[0])); /* default -384 */
-	lgw_reg_w(LGW_IF_FREQ_1, IF_HZ_TO_REG(if_freq[1])); /* default -128 */
-	lgw_reg_w(LGW_IF_FREQ_2, IF_HZ_TO_REG(if_freq[2])); /* default 128 */
-	lgw_reg_w(LGW_IF_FREQ_3, IF_HZ_TO_REG(if_freq[3])); /* default 384 */
-	lgw_reg_w(LGW_IF_FREQ_4, IF_HZ_TO_REG(if_freq[4])); /* default -384 */
-	lgw_reg_w(LGW_IF_FREQ_5, IF_HZ_TO_REG(if_freq[5])); /* default -128 */
-	lgw_reg_w(LGW_IF_FREQ_6, IF_HZ_TO_REG(if_freq[6])); /* default 128 */
-	lgw_reg_w(LGW_IF_FREQ_7, IF_HZ_TO_REG(if_freq[7])); /* default 384 */
+	cfg_reg_add(LGW_IF_FREQ_0, IF_HZ_TO_REG(cur->if_freq[0])); /* default -384 */
+	cfg_reg_add(LGW_IF_FREQ_1, IF_HZ_TO_REG(cur->if_freq[1])); /* default -128 */
+	cfg_reg_add(LGW_IF_FREQ_2, IF_HZ_TO_REG(cur->if_freq[2])); /* default 128 */
+	cfg_reg_add(LGW_IF_FREQ_3, IF_HZ_TO_REG(cur->if_freq[3])); /* default 384 */
+	cfg_reg_add(LGW_IF_FREQ_4, IF_HZ_TO_REG(cur->if_freq[4])); /* default -384 */
+	cfg_reg_add(LGW_IF_FREQ_5, IF_HZ_TO_REG(cur->if_freq[5])); /* default -128 */
+	cfg_reg_add(LGW_IF_FREQ_6, IF_HZ_TO_REG(cur->if_freq[6])); /* default 128 */
+	cfg_reg_add(LGW_IF_FREQ_7, IF_HZ_TO_REG(cur->if_freq[7])); /* default 384 */
 
-	lgw_reg_w(LGW_CORR0_DETECT_EN, (if_enable[0] == true) ? lora_multi_sfmask[0] : 0); /* default 0 */
-	lgw_reg_w(LGW_CORR1_DETECT_EN, (if_enable[1] == true) ? lora_multi_sfmask[1] : 0); /* default 0 */
-	lgw_reg_w(LGW_CORR2_DETECT_EN, (if_enable[2] == true) ? lora_multi_sfmask[2] : 0); /* default 0 */
-	lgw_reg_w(LGW_CORR3_DETECT_EN, (if_enable[3] == true) ? lora_multi_sfmask[3] : 0); /* default 0 */
-	lgw_reg_w(LGW_CORR4_DETECT_EN, (if_enable[4] == true) ? lora_multi_sfmask[4] : 0); /* default 0 */
-	lgw_reg_w(LGW_CORR5_DETECT_EN, (if_enable[5] == true) ? lora_multi_sfmask[5] : 0); /* default 0 */
-	lgw_reg_w(LGW_CORR6_DETECT_EN, (if_enable[6] == true) ? lora_multi_sfmask[6] : 0); /* default 0 */
-	lgw_reg_w(LGW_CORR7_DETECT_EN, (if_enable[7] == true) ? lora_multi_sfmask[7] : 0); /* default 0 */
+	cfg_reg_add(LGW_CORR0_DETECT_EN, (cur->if_enable[0] == true) ? cur->lora_multi_sfmask[0] : 0); /* default 0 */
+	cfg_reg_add(LGW_CORR1_DETECT_EN, (cur->if_enable[1] == true) ? cur->lora_multi_sfmask[1] : 0); /* default 0 */
+	cfg_reg_add(LGW_CORR2_DETECT_EN, (cur->if_enable[2] == true) ? cur->lora_multi_sfmask[2] : 0); /* default 0 */
+	cfg_reg_add(LGW_CORR3_DETECT_EN, (cur->if_enable[3] == true) ? cur->lora_multi_sfmask[3] : 0); /* default 0 */
+	cfg_reg_add(LGW_CORR4_DETECT_EN, (cur->if_enable[4] == true) ? cur->lora_multi_sfmask[4] : 0); /* default 0 */
+	cfg_reg_add(LGW_CORR5_DETECT_EN, (cur->if_enable[5] == true) ? cur->lora_multi_sfmask[5] : 0); /* default 0 */
+	cfg_reg_add(LGW_CORR6_DETECT_EN, (cur->if_enable[6] == true) ? cur->lora_multi_sfmask[6] : 0); /* default 0 */
+	cfg_reg_add(LGW_CORR7_DETECT_EN, (cur->if_enable[7] == true) ? cur->lora_multi_sfmask[7] : 0); /* default 0 */
 
-	lgw_reg_w(LGW_PPM_OFFSET, 0x60); /* as the threshold is 16ms, use 0x60 to enable ppm_offset for SF12 and SF11 @125kHz*/
+	cfg_reg_add(LGW_PPM_OFFSET, 0x60); /* as the threshold is 16ms, use 0x60 to enable ppm_offset for SF12 and SF11 @125kHz*/
 
-	lgw_reg_w(LGW_CONCENTRATOR_MODEM_ENABLE,1); /* default 0 */
+	cfg_reg_add(LGW_CONCENTRATOR_MODEM_ENABLE,1); /* default 0 */
 
 	/* configure LoRa 'stand-alone' modem (IF8) */
-	lgw_reg_w(LGW_IF_FREQ_8, IF_HZ_TO_REG(if_freq[8])); /* MBWSSF modem (default 0) */
-	if (if_enable[8] == true) {
-		lgw_reg_w(LGW_MBWSSF_RADIO_SELECT, if_rf_chain[8]);
-		switch(lora_rx_bw) {
-			case BW_125KHZ: lgw_reg_w(LGW_MBWSSF_MODEM_BW,0); break;
-			case BW_250KHZ: lgw_reg_w(LGW_MBWSSF_MODEM_BW,1); break;
-			case BW_500KHZ: lgw_reg_w(LGW_MBWSSF_MODEM_BW,2); break;
+	cfg_reg_add(LGW_IF_FREQ_8, IF_HZ_TO_REG(cur->if_freq[8])); /* MBWSSF modem (default 0) */
+	if (cur->if_enable[8] == true) {
+		cfg_reg_add(LGW_MBWSSF_RADIO_SELECT, cur->if_rf_chain[8]);
+		switch(cur->lora_rx_bw) {
+			case BW_125KHZ: cfg_reg_add(LGW_MBWSSF_MODEM_BW,0); break;
+			case BW_250KHZ: cfg_reg_add(LGW_MBWSSF_MODEM_BW,1); break;
+			case BW_500KHZ: cfg_reg_add(LGW_MBWSSF_MODEM_BW,2); break;
 			default:
-				DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", lora_rx_bw);
+				DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", cur->lora_rx_bw);
 				return LGW_HAL_ERROR;
 		}
-		switch(lora_rx_sf) {
-			case DR_LORA_SF7: lgw_reg_w(LGW_MBWSSF_RATE_SF,7); break;
-			case DR_LORA_SF8: lgw_reg_w(LGW_MBWSSF_RATE_SF,8); break;
-			case DR_LORA_SF9: lgw_reg_w(LGW_MBWSSF_RATE_SF,9); break;
-			case DR_LORA_SF10: lgw_reg_w(LGW_MBWSSF_RATE_SF,10); break;
-			case DR_LORA_SF11: lgw_reg_w(LGW_MBWSSF_RATE_SF,11); break;
-			case DR_LORA_SF12: lgw_reg_w(LGW_MBWSSF_RATE_SF,12); break;
+		switch(cur->lora_rx_sf) {
+			case DR_LORA_SF7: cfg_reg_add(LGW_MBWSSF_RATE_SF,7); break;
+			case DR_LORA_SF8: cfg_reg_add(LGW_MBWSSF_RATE_SF,8); break;
+			case DR_LORA_SF9: cfg_reg_add(LGW_MBWSSF_RATE_SF,9); break;
+			case DR_LORA_SF10: cfg_reg_add(LGW_MBWSSF_RATE_SF,10); break;
+			case DR_LORA_SF11: cfg_reg_add(LGW_MBWSSF_RATE_SF,11); break;
+			case DR_LORA_SF12: cfg_reg_add(LGW_MBWSSF_RATE_SF,12); break;
 			default:
-				DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", lora_rx_sf);
+				DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", cur->lora_rx_sf);
 				return LGW_HAL_ERROR;
 		}
-		lgw_reg_w(LGW_MBWSSF_PPM_OFFSET, lora_rx_ppm_offset); /* default 0 */
-		lgw_reg_w(LGW_MBWSSF_MODEM_ENABLE, 1); /* default 0 */
+		cfg_reg_add(LGW_MBWSSF_PPM_OFFSET, cur->lora_rx_ppm_offset); /* default 0 */
+		cfg_reg_add(LGW_MBWSSF_MODEM_ENABLE, 1); /* default 0 */
 	} else {
-		lgw_reg_w(LGW_MBWSSF_MODEM_ENABLE, 0);
+		cfg_reg_add(LGW_MBWSSF_MODEM_ENABLE, 0);
 	}
 
 	/* configure FSK modem (IF9) */
-	lgw_reg_w(LGW_IF_FREQ_9, IF_HZ_TO_REG(if_freq[9])); /* FSK modem, default 0 */
-	lgw_reg_w(LGW_FSK_PSIZE, fsk_sync_word_size-1);
-	lgw_reg_w(LGW_FSK_TX_PSIZE, fsk_sync_word_size-1);
-	fsk_sync_word_reg = fsk_sync_word << (8 * (8 - fsk_sync_word_size));
-	lgw_reg_w(LGW_FSK_REF_PATTERN_LSB, (uint32_t)(0xFFFFFFFF & fsk_sync_word_reg));
-	lgw_reg_w(LGW_FSK_REF_PATTERN_MSB, (uint32_t)(0xFFFFFFFF & (fsk_sync_word_reg >> 32)));
-	if (if_enable[9] == true) {
-		lgw_reg_w(LGW_FSK_RADIO_SELECT, if_rf_chain[9]);
-		lgw_reg_w(LGW_FSK_BR_RATIO,LGW_XTAL_FREQU/fsk_rx_dr); /* setting the dividing ratio for datarate */
-		lgw_reg_w(LGW_FSK_CH_BW_EXPO,fsk_rx_bw);
-		lgw_reg_w(LGW_FSK_MODEM_ENABLE,1); /* default 0 */
+	cfg_reg_add(LGW_IF_FREQ_9, IF_HZ_TO_REG(cur->if_freq[9])); /* FSK modem, default 0 */
+	cfg_reg_add(LGW_FSK_PSIZE, cur->fsk_sync_word_size-1);
+	cfg_reg_add(LGW_FSK_TX_PSIZE, cur->fsk_sync_word_size-1);
+	fsk_sync_word_reg = cur->fsk_sync_word << (8 * (8 - cur->fsk_sync_word_size));
+	cfg_reg_add(LGW_FSK_REF_PATTERN_LSB, (uint32_t)(0xFFFFFFFF & fsk_sync_word_reg));
+	cfg_reg_add(LGW_FSK_REF_PATTERN_MSB, (uint32_t)(0xFFFFFFFF & (fsk_sync_word_reg >> 32)));
+	if (cur->if_enable[9] == true) {
+		cfg_reg_add(LGW_FSK_RADIO_SELECT, cur->if_rf_chain[9]);
+		cfg_reg_add(LGW_FSK_BR_RATIO,LGW_XTAL_FREQU/cur->fsk_rx_dr); /* setting the dividing ratio for datarate */
+		cfg_reg_add(LGW_FSK_CH_BW_EXPO,cur->fsk_rx_bw);
+		cfg_reg_add(LGW_FSK_MODEM_ENABLE,1); /* default 0 */
 	} else {
-		lgw_reg_w(LGW_FSK_MODEM_ENABLE,0);
+		cfg_reg_add(LGW_FSK_MODEM_ENABLE,0);
 	}
+	lgw_reg_batch_begin();
+	lgw_reg_wl(cur->cfg_reg_id, cur->cfg_reg_val, cur->cfg_reg_nb, &nb_page_switch);
+	lgw_reg_batch_commit();
+	DEBUG_PRINTF("Note: %u configuration registers written with %u page switches\n", cur->cfg_reg_nb, nb_page_switch);
 
 	/* Load firmware */
-	load_firmware(MCU_ARB, arb_firmware, MCU_ARB_FW_BYTE);
-	load_firmware(MCU_AGC, agc_firmware, MCU_AGC_FW_BYTE);
+	if ((load_firmware(MCU_ARB, arb_firmware, MCU_ARB_FW_BYTE) != 0) || (load_firmware(MCU_AGC, agc_firmware, MCU_AGC_FW_BYTE) != 0)) {
+		DEBUG_MSG("ERROR: FAILED TO LOAD MCU FIRMWARE\n");
+		return LGW_HAL_ERROR;
+	}
 
 	/* gives the AGC MCU control over radio, RF front-end and filter gain */
 	lgw_reg_w(LGW_FORCE_HOST_RADIO_CTRL,0);
@@ -1084,10 +1863,10 @@ int lgw_start(void) {
 	}
 
 	/* Update Tx gain LUT and start AGC */
-	for (i = 0; i < txgain_lut.size; ++i) {
+	for (i = 0; i < cur->txgain_lut.size; ++i) {
 		lgw_reg_w(LGW_RADIO_SELECT, AGC_CMD_WAIT); /* start a transaction */
 		wait_ms(1);
-		load_val = txgain_lut.lut[i].mix_gain + (16 * txgain_lut.lut[i].dac_gain) + (64 * txgain_lut.lut[i].pa_gain);
+		load_val = cur->txgain_lut.lut[i].mix_gain + (16 * cur->txgain_lut.lut[i].dac_gain) + (64 * cur->txgain_lut.lut[i].pa_gain);
 		lgw_reg_w(LGW_RADIO_SELECT, load_val);
 		wait_ms(1);
 		lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
@@ -1097,7 +1876,7 @@ int lgw_start(void) {
 		}
 	}
 	/* As the AGC fw is waiting for 16 entries, we need to abort the transaction if we get less entries */
-	if (txgain_lut.size < TX_GAIN_LUT_SIZE_MAX) {
+	if (cur->txgain_lut.size < TX_GAIN_LUT_SIZE_MAX) {
 		lgw_reg_w(LGW_RADIO_SELECT, AGC_CMD_WAIT);
 		wait_ms(1);
 		load_val = AGC_CMD_ABORT;
@@ -1147,7 +1926,12 @@ int lgw_start(void) {
 	/* enable GPS event capture */
 	lgw_reg_w(LGW_GPS_EN,1);
 
-	lgw_is_started = true;
+	memset(&cur->rx_fetch_stat, 0, sizeof cur->rx_fetch_stat);
+	cur->rx_wait_irq = true;
+	cur->rx_wait_backoff = RX_WAIT_BACKOFF_MIN;
+	cur->gps_toggle_nb = 0;
+	tx_desc_invalidate();
+	cur->lgw_is_started = true;
 	return LGW_HAL_SUCCESS;
 }
 
@@ -1157,13 +1941,15 @@ int lgw_stop(void) {
 	lgw_soft_reset();
 	lgw_disconnect();
 
-	lgw_is_started = false;
+	cur->lgw_is_started = false;
+	tx_desc_invalidate();
 	return LGW_HAL_SUCCESS;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
+/* body of lgw_receive, without the statistics */
+int receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
 	int nb_pkt_fetch; /* loop variable and return value */
 	struct lgw_pkt_rx_s *p; /* pointer to the current structure in the struct array */
 	uint8_t buff[255+RX_METADATA_NB]; /* buffer to store the result of SPI read bursts */
@@ -1171,12 +1957,20 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
 	int ifmod; /* type of if_chain/modem a packet was received by */
 	int stat_fifo; /* the packet status as indicated in the FIFO */
 	uint32_t raw_timestamp; /* timestamp when internal 'RX finished' was triggered */
-	uint32_t delay_x, delay_y, delay_z; /* temporary variable for timestamp offset calculation */
 	uint32_t timestamp_correction; /* correction to account for processing delay */
-	uint32_t sf, cr, bw_pow, crc_en, ppm; /* used to calculate timestamp correction */
+	uint8_t sf, cr; /* used to calculate timestamp correction */
+	bool crc_en; /* used to calculate timestamp correction */
+	uint8_t burst_buff[LGW_DATABUFF_SIZE]; /* data of several packets, read in one SPI burst (RX_FETCH_BURST) */
+	unsigned burst_size = 0; /* number of valid bytes in burst_buff */
+	unsigned burst_addr = 0; /* address in the concentrator data buffer of the first byte of burst_buff */
+	unsigned burst_next = 0; /* offset in burst_buff where the next packet is expected */
+	unsigned burst_nb = 0; /* number of packets that were complete when burst_buff was read, not fetched yet */
+	unsigned pkt_addr; /* address in the concentrator data buffer of the packet at the head of the FIFO */
+	unsigned offset; /* offset of that packet in burst_buff */
+	unsigned nb_queued = 0; /* number of packets the FIFO reported, not fetched yet */
 
 	/* check if the concentrator is running */
-	if (lgw_is_started == false) {
+	if (cur->lgw_is_started == false) {
 		DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE RECEIVING\n");
 		return LGW_HAL_ERROR;
 	}
@@ -1188,14 +1982,29 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
 	}
 	CHECK_NULL(pkt_data);
 
+	cur->rx_fetch_stat.nb_fetch += 1;
+
 	/* iterate max_pkt times at most */
 	for (nb_pkt_fetch = 0; nb_pkt_fetch < max_pkt; ++nb_pkt_fetch) {
 
 		/* point to the proper struct in the struct array */
 		p = &pkt_data[nb_pkt_fetch];
 
+		/* in burst mode, do not poll the FIFO again when it was emptied */
+		if ((cur->rx_fetch_mode == RX_FETCH_BURST) && (nb_pkt_fetch > 0) && (nb_queued == 0)) {
+			break;
+		}
+
 		/* fetch all the RX FIFO data */
-		lgw_reg_rb(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, buff, 5);
+		if (lgw_reg_rb_rx_packet_data_fifo_num_stored(buff, 5) != LGW_REG_SUCCESS) {
+			DEBUG_MSG("ERROR: FAILED TO READ THE RX FIFO STATUS\n");
+			if (nb_pkt_fetch == 0) {
+				return LGW_HAL_ERROR;
+			}
+			break; /* return the packets already fetched, the error will be seen by the next call */
+		}
+		cur->rx_fetch_stat.nb_spi += 1;
+		cur->rx_fetch_stat.nb_spi_bytes += 5;
 
 		/* how many packets are in the RX buffer ? Break if zero */
 		if (buff[0] == 0) {
@@ -1204,44 +2013,70 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
 
 		DEBUG_PRINTF("FIFO content: %x %x %x %x %x\n",buff[0],buff[1],buff[2],buff[3],buff[4]);
 
+		nb_queued = buff[0] - 1;
+		pkt_addr = (unsigned)buff[1] + ((unsigned)buff[2] << 8);
 		p->size = buff[4];
 		sz = p->size;
 		stat_fifo = buff[3]; /* will be used later, need to save it before overwriting buff */
 
 		/* get payload + metadata */
-		lgw_reg_rb(LGW_RX_DATA_BUF_DATA, buff, sz+RX_METADATA_NB);
+		if (cur->rx_fetch_mode == RX_FETCH_BURST) {
+			/* only use data already read if the packet was queued at that time and the FIFO confirms it is where it is expected */
+			offset = (pkt_addr + LGW_DATABUFF_SIZE - burst_addr) % LGW_DATABUFF_SIZE;
+			if ((burst_nb == 0) || (offset != burst_next) || ((offset + sz + RX_METADATA_NB) > burst_size)) {
+				/* read that packet and the following ones, assuming they all have the same size */
+				burst_size = (sz + RX_METADATA_NB) * (1 + ((nb_queued < (unsigned)(max_pkt - nb_pkt_fetch - 1)) ? nb_queued : (unsigned)(max_pkt - nb_pkt_fetch - 1)));
+				if (burst_size > LGW_DATABUFF_SIZE) {
+					burst_size = LGW_DATABUFF_SIZE;
+				}
+				lgw_reg_rb_rx_data_buf_data(burst_buff, burst_size);
+				cur->rx_fetch_stat.nb_spi += 1;
+				cur->rx_fetch_stat.nb_spi_bytes += burst_size;
+				burst_addr = pkt_addr;
+				burst_nb = 1 + nb_queued;
+				offset = 0;
+			}
+			burst_nb -= 1;
+			memcpy((void *)buff, (void *)(burst_buff + offset), sz+RX_METADATA_NB);
+			burst_next = offset + sz + RX_METADATA_NB;
+		} else {
+			lgw_reg_rb_rx_data_buf_data(buff, sz+RX_METADATA_NB);
+			cur->rx_fetch_stat.nb_spi += 1;
+			cur->rx_fetch_stat.nb_spi_bytes += sz+RX_METADATA_NB;
+		}
 
 		/* copy payload to result struct */
 		memcpy((void *)p->payload, (void *)buff, sz);
 
-		/* get back info from configuration so that application doesn't have to keep track of it */
-		p->rf_chain = (uint8_t)if_rf_chain[p->if_chain];
-		p->freq_hz = (uint32_t)((int32_t)rf_rx_freq[p->rf_chain] + if_freq[p->if_chain]);
-
 		/* process metadata */
 		p->if_chain = buff[sz+0];
+
+		/* get back info from configuration so that application doesn't have to keep track of it */
+		p->rf_chain = (uint8_t)cur->if_rf_chain[p->if_chain];
+		p->freq_hz = (uint32_t)((int32_t)cur->rf_rx_freq[p->rf_chain] + cur->if_freq[p->if_chain]);
+
 		ifmod = ifmod_config[p->if_chain];
 		DEBUG_PRINTF("[%d %d]\n", p->if_chain, ifmod);
-		p->rssi = (float)buff[sz+5] + rf_rssi_offset[p->rf_chain];
+		p->rssi = (float)buff[sz+5] + cur->rf_rssi_offset[p->rf_chain];
 
 		if ((ifmod == IF_LORA_MULTI) || (ifmod == IF_LORA_STD)) {
 			DEBUG_MSG("Note: LoRa packet\n");
 			switch(stat_fifo & 0x07) {
 				case 5:
 					p->status = STAT_CRC_OK;
-					crc_en = 1;
+					crc_en = true;
 					break;
 				case 7:
 					p->status = STAT_CRC_BAD;
-					crc_en = 1;
+					crc_en = true;
 					break;
 				case 1:
 					p->status = STAT_NO_CRC;
-					crc_en = 0;
+					crc_en = false;
 					break;
 				default:
 					p->status = STAT_UNDEFINED;
-					crc_en = 0;
+					crc_en = false;
 			}
 			p->modulation = MOD_LORA;
 			p->snr = ((float)((int8_t)buff[sz+2]))/4;
@@ -1250,7 +2085,7 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
 			if (ifmod == IF_LORA_MULTI) {
 				p->bandwidth = BW_125KHZ; /* fixed in hardware */
 			} else {
-				p->bandwidth = lora_rx_bw; /* get the parameter from the config variable */
+				p->bandwidth = cur->lora_rx_bw; /* get the parameter from the config variable */
 			}
 			sf = (buff[sz+1] >> 4) & 0x0F;
 			switch (sf) {
@@ -1266,55 +2101,14 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
 			switch (cr) {
 				case 1: p->coderate = CR_LORA_4_5; break;
 				case 2: p->coderate = CR_LORA_4_6; break;
-				case 3: p->coderate = CR_LORA_4_7; break;
-				case 4: p->coderate = CR_LORA_4_8; break;
-				default: p->coderate = CR_UNDEFINED;
-			}
-
-			/* determine if 'PPM mode' is on, needed for timestamp correction */
-			if (SET_PPM_ON(p->bandwidth,p->datarate)) {
-				ppm = 1;
-			} else {
-				ppm = 0;
-			}
-
-			/* timestamp correction code, base delay */
-			if (ifmod == IF_LORA_STD) { /* if packet was received on the stand-alone LoRa modem */
-				switch (lora_rx_bw) {
-					case BW_125KHZ:
-						delay_x = 64;
-						bw_pow = 1;
-						break;
-					case BW_250KHZ:
-						delay_x = 32;
-						bw_pow = 2;
-						break;
-					case BW_500KHZ:
-						delay_x = 16;
-						bw_pow = 4;
-						break;
-					default:
-						DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", p->bandwidth);
-						delay_x = 0;
-						bw_pow = 0;
-				}
-			} else { /* packet was received on one of the sensor channels = 125kHz */
-				delay_x = 114;
-				bw_pow = 1;
+				case 3: p->coderate = CR_LORA_4_7; break;
+				case 4: p->coderate = CR_LORA_4_8; break;
+				default: p->coderate = CR_UNDEFINED;
 			}
 
-			/* timestamp correction code, variable delay */
-			if ((sf >= 6) && (sf <= 12) && (bw_pow > 0)) {
-				if ((2*(sz + 2*crc_en) - (sf-7)) <= 0) { /* payload fits entirely in first 8 symbols */
-					delay_y = ( ((1<<(sf-1)) * (sf+1)) + (3 * (1<<(sf-4))) ) / bw_pow;
-					delay_z = 32 * (2*(sz+2*crc_en) + 5) / bw_pow;
-				} else {
-					delay_y = ( ((1<<(sf-1)) * (sf+1)) + ((4 - ppm) * (1<<(sf-4))) ) / bw_pow;
-					delay_z = (16 + 4*cr) * (((2*(sz+2*crc_en)-sf+6) % (sf - 2*ppm)) + 1) / bw_pow;
-				}
-				timestamp_correction = delay_x + delay_y + delay_z;
-			} else {
-				timestamp_correction = 0;
+			/* timestamp correction, processing delay of the modem (see loragw_lut) */
+			timestamp_correction = lgw_lut_rx_delay(ifmod, p->bandwidth, sf, cr, crc_en, sz);
+			if (timestamp_correction == 0) {
 				DEBUG_MSG("WARNING: invalid packet, no timestamp correction\n");
 			}
 
@@ -1335,10 +2129,10 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
 			p->snr = -128.0;
 			p->snr_min = -128.0;
 			p->snr_max = -128.0;
-			p->bandwidth = fsk_rx_bw;
-			p->datarate = fsk_rx_dr;
+			p->bandwidth = cur->fsk_rx_bw;
+			p->datarate = cur->fsk_rx_dr;
 			p->coderate = CR_UNDEFINED;
-			timestamp_correction = ((uint32_t)680000 / fsk_rx_dr) - 20;
+			timestamp_correction = ((uint32_t)680000 / cur->fsk_rx_dr) - 20;
 
 			/* RSSI correction */
 			p->rssi -= RSSI_FSK_BIAS;
@@ -1362,301 +2156,338 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
 		p->crc = (uint16_t)buff[sz+10] + ((uint16_t)buff[sz+11] << 8);
 
 		/* advance packet FIFO */
-		lgw_reg_w(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, 0);
+		lgw_reg_w_rx_packet_data_fifo_num_stored(0);
+		cur->rx_fetch_stat.nb_spi += 1;
+		cur->rx_fetch_stat.nb_spi_bytes += 1;
 	}
 
+	cur->rx_fetch_stat.nb_pkt += nb_pkt_fetch;
+	if (nb_pkt_fetch > 0) {
+		cur->rx_wait_backoff = RX_WAIT_BACKOFF_MIN; /* traffic, poll faster */
+	}
 	return nb_pkt_fetch;
 }
 
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_send(struct lgw_pkt_tx_s pkt_data) {
+int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
+	struct timespec t0, t;
+	int nb_pkt;
 	int i;
-	uint8_t buff[256+TX_METADATA_NB]; /* buffer to prepare the packet to send + metadata before SPI write burst */
-	uint32_t part_int = 0; /* integer part for PLL register value calculation */
-	uint32_t part_frac = 0; /* fractional part for PLL register value calculation */
-	uint16_t fsk_dr_div; /* divider to configure for target datarate */
-	int transfer_size = 0; /* data to transfer from host to TX databuffer */
-	int payload_offset = 0; /* start of the payload content in the databuffer */
-	uint8_t pow_index = 0; /* 4-bit value to set the firmware TX power */
-	uint8_t target_mix_gain = 0; /* used to select the proper I/Q offset correction */
-	uint32_t count_trig; /* timestamp value in trigger mode corrected for TX start delay */
 
-	/* check if the concentrator is running */
-	if (lgw_is_started == false) {
-		DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE SENDING\n");
-		return LGW_HAL_ERROR;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	nb_pkt = receive(max_pkt, pkt_data);
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	stats_hist_add(&stats.rx_time, (uint32_t)((t.tv_sec - t0.tv_sec) * 1000000 + (t.tv_nsec - t0.tv_nsec) / 1000));
+	STAT_ADD(stats.rx_fetch, 1);
+	if (nb_pkt == LGW_HAL_ERROR) {
+		STAT_ADD(stats.rx_error, 1);
+		return nb_pkt;
+	}
+	STAT_ADD(stats.rx_pkt, nb_pkt);
+	for (i = 0; i < nb_pkt; ++i) {
+		switch (pkt_data[i].status) {
+			case STAT_CRC_OK:
+				STAT_ADD(stats.rx_crc_ok, 1);
+				break;
+			case STAT_CRC_BAD:
+				STAT_ADD(stats.rx_crc_bad, 1);
+				break;
+			case STAT_NO_CRC:
+				STAT_ADD(stats.rx_no_crc, 1);
+				break;
+			default:
+				break;
+		}
 	}
+	return nb_pkt;
+}
 
-	/* check input range (segfault prevention) */
-	if (pkt_data.rf_chain >= LGW_RF_CHAIN_NB) {
-		DEBUG_MSG("ERROR: INVALID RF_CHAIN TO SEND PACKETS\n");
-		return LGW_HAL_ERROR;
-	}
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-	/* check input variables */
-	if (rf_tx_enable[pkt_data.rf_chain] == false) {
-		DEBUG_MSG("ERROR: SELECTED RF_CHAIN IS DISABLED FOR TX ON SELECTED BOARD\n");
+int lgw_rx_fetch_mode(uint8_t mode) {
+	if ((mode != RX_FETCH_SINGLE) && (mode != RX_FETCH_BURST)) {
+		DEBUG_MSG("ERROR: INVALID RX FETCH MODE\n");
 		return LGW_HAL_ERROR;
 	}
-	if (rf_enable[pkt_data.rf_chain] == false) {
-		DEBUG_MSG("ERROR: SELECTED RF_CHAIN IS DISABLED\n");
-		return LGW_HAL_ERROR;
-	}
-	if (!IS_TX_MODE(pkt_data.tx_mode)) {
-		DEBUG_MSG("ERROR: TX_MODE NOT SUPPORTED\n");
-		return LGW_HAL_ERROR;
-	}
-	if (pkt_data.modulation == MOD_LORA) {
-		if (!IS_LORA_BW(pkt_data.bandwidth)) {
-			DEBUG_MSG("ERROR: BANDWIDTH NOT SUPPORTED BY LORA TX\n");
-			return LGW_HAL_ERROR;
-		}
-		if (!IS_LORA_STD_DR(pkt_data.datarate)) {
-			DEBUG_MSG("ERROR: DATARATE NOT SUPPORTED BY LORA TX\n");
-			return LGW_HAL_ERROR;
-		}
-		if (!IS_LORA_CR(pkt_data.coderate)) {
-			DEBUG_MSG("ERROR: CODERATE NOT SUPPORTED BY LORA TX\n");
-			return LGW_HAL_ERROR;
-		}
-		if (pkt_data.size > 255) {
-			DEBUG_MSG("ERROR: PAYLOAD LENGTH TOO BIG FOR LORA TX\n");
-			return LGW_HAL_ERROR;
-		}
-	} else if (pkt_data.modulation == MOD_FSK) {
-		if((pkt_data.f_dev < 1) || (pkt_data.f_dev > 200)) {
-			DEBUG_MSG("ERROR: TX FREQUENCY DEVIATION OUT OF ACCEPTABLE RANGE\n");
-			return LGW_HAL_ERROR;
-		}
-		if(!IS_FSK_DR(pkt_data.datarate)) {
-			DEBUG_MSG("ERROR: DATARATE NOT SUPPORTED BY FSK IF CHAIN\n");
-			return LGW_HAL_ERROR;
+	cur->rx_fetch_mode = mode;
+	return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_receive_wait(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data, uint32_t timeout_ms) {
+	struct timespec t0, t;
+	uint32_t elapsed_us;
+	uint32_t timeout_us = timeout_ms * 1000;
+	int nb_pkt;
+
+	cur->rx_fetch_stat.nb_wait += 1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (;;) {
+		nb_pkt = lgw_receive(max_pkt, pkt_data);
+		if (nb_pkt != 0) {
+			return nb_pkt;
 		}
-		if (pkt_data.size > 255) {
-			DEBUG_MSG("ERROR: PAYLOAD LENGTH TOO BIG FOR FSK TX\n");
-			return LGW_HAL_ERROR;
+
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		elapsed_us = (uint32_t)((t.tv_sec - t0.tv_sec) * 1000000 + (t.tv_nsec - t0.tv_nsec) / 1000);
+		if (elapsed_us >= timeout_us) {
+			return 0;
 		}
-	} else {
-		DEBUG_MSG("ERROR: INVALID TX MODULATION\n");
-		return LGW_HAL_ERROR;
-	}
 
-	/* interpretation of TX power */
-	for (pow_index = txgain_lut.size-1; pow_index > 0; pow_index--) {
-		if (txgain_lut.lut[pow_index].rf_power <= pkt_data.rf_power) {
-			break;
+		if (rx_wait_sleep(timeout_us - elapsed_us) == false) {
+			return 0;
 		}
 	}
+}
 
-	/* loading TX imbalance correction */
-	target_mix_gain = txgain_lut.lut[pow_index].mix_gain;
-	if (pkt_data.rf_chain == 0) { /* use radio A calibration table */
-		lgw_reg_w(LGW_TX_OFFSET_I, cal_offset_a_i[target_mix_gain - 8]);
-		lgw_reg_w(LGW_TX_OFFSET_Q, cal_offset_a_q[target_mix_gain - 8]);
-	} else { /* use radio B calibration table */
-		lgw_reg_w(LGW_TX_OFFSET_I, cal_offset_b_i[target_mix_gain - 8]);
-		lgw_reg_w(LGW_TX_OFFSET_Q, cal_offset_b_q[target_mix_gain - 8]);
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rx_wait(uint32_t timeout_ms) {
+	/* check if the concentrator is running */
+	if (cur->lgw_is_started == false) {
+		DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE WAITING FOR PACKETS\n");
+		return LGW_HAL_ERROR;
 	}
 
-	/* Set digital gain from LUT */
-	lgw_reg_w(LGW_TX_GAIN, txgain_lut.lut[pow_index].dig_gain);
+	cur->rx_fetch_stat.nb_wait += 1;
+	rx_wait_sleep(timeout_ms * 1000);
+	return LGW_HAL_SUCCESS;
+}
 
-	/* fixed metadata, useful payload and misc metadata compositing */
-	transfer_size = TX_METADATA_NB + pkt_data.size; /*  */
-	payload_offset = TX_METADATA_NB; /* start the payload just after the metadata */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-	/* metadata 0 to 2, TX PLL frequency */
-	switch (rf_radio_type[0]) { /* we assume that there is only one radio type on the board */
-		case LGW_RADIO_TYPE_SX1255:
-			part_int = pkt_data.freq_hz / (SX125x_32MHz_FRAC << 7); /* integer part, gives the MSB */
-			part_frac = ((pkt_data.freq_hz % (SX125x_32MHz_FRAC << 7)) << 9) / SX125x_32MHz_FRAC; /* fractional part, gives middle part and LSB */
-			break;
-		case LGW_RADIO_TYPE_SX1257:
-			part_int = pkt_data.freq_hz / (SX125x_32MHz_FRAC << 8); /* integer part, gives the MSB */
-			part_frac = ((pkt_data.freq_hz % (SX125x_32MHz_FRAC << 8)) << 8) / SX125x_32MHz_FRAC; /* fractional part, gives middle part and LSB */
-			break;
-		default:
-			DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", rf_radio_type[0]);
-			break;
-	}
+int lgw_rx_fetch_stat(struct lgw_rx_fetch_stat_s *stat) {
+	CHECK_NULL(stat);
+	*stat = cur->rx_fetch_stat;
+	return LGW_HAL_SUCCESS;
+}
 
-	buff[0] = 0xFF & part_int; /* Most Significant Byte */
-	buff[1] = 0xFF & (part_frac >> 8); /* middle byte */
-	buff[2] = 0xFF & part_frac; /* Least Significant Byte */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-	/* metadata 3 to 6, timestamp trigger value */
-	/* TX state machine must be triggered at T0 - TX_START_DELAY for packet to start being emitted at T0 */
-	if (pkt_data.tx_mode == TIMESTAMPED)
-	{
-		count_trig = pkt_data.count_us - TX_START_DELAY;
-		buff[3] = 0xFF & (count_trig >> 24);
-		buff[4] = 0xFF & (count_trig >> 16);
-		buff[5] = 0xFF & (count_trig >> 8);
-		buff[6] = 0xFF &  count_trig;
-	}
+int lgw_fw_stat(struct lgw_fw_stat_s *stat) {
+	CHECK_NULL(stat);
+	*stat = cur->fw_stat;
+	return LGW_HAL_SUCCESS;
+}
 
-	/* parameters depending on modulation  */
-	if (pkt_data.modulation == MOD_LORA) {
-		/* metadata 7, modulation type, radio chain selection and TX power */
-		buff[7] = (0x20 & (pkt_data.rf_chain << 5)) | (0x0F & pow_index); /* bit 4 is 0 -> LoRa modulation */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-		buff[8] = 0; /* metadata 8, not used */
+int lgw_get_stats(struct lgw_stats_s *stats_out) {
+	struct lgw_reg_stats_s reg;
+
+	CHECK_NULL(stats_out);
+	lgw_reg_stats(&reg);
+	stats_out->spi_nb = reg.nb_spi;
+	stats_out->spi_bytes_w = reg.nb_byte_w;
+	stats_out->spi_bytes_r = reg.nb_byte_r;
+	stats_out->page_switch = reg.nb_page_switch;
+	stats_out->rx_fetch = STAT_GET(stats.rx_fetch);
+	stats_out->rx_pkt = STAT_GET(stats.rx_pkt);
+	stats_out->rx_crc_ok = STAT_GET(stats.rx_crc_ok);
+	stats_out->rx_crc_bad = STAT_GET(stats.rx_crc_bad);
+	stats_out->rx_no_crc = STAT_GET(stats.rx_no_crc);
+	stats_out->rx_error = STAT_GET(stats.rx_error);
+	stats_out->tx_pkt = STAT_GET(stats.tx_pkt);
+	stats_out->tx_error = STAT_GET(stats.tx_error);
+	stats_hist_get(&stats_out->rx_time, &stats.rx_time);
+	stats_hist_get(&stats_out->tx_time, &stats.tx_time);
+	return LGW_HAL_SUCCESS;
+}
 
-		/* metadata 9, CRC, LoRa CR & SF */
-		switch (pkt_data.datarate) {
-			case DR_LORA_SF7: buff[9] = 7; break;
-			case DR_LORA_SF8: buff[9] = 8; break;
-			case DR_LORA_SF9: buff[9] = 9; break;
-			case DR_LORA_SF10: buff[9] = 10; break;
-			case DR_LORA_SF11: buff[9] = 11; break;
-			case DR_LORA_SF12: buff[9] = 12; break;
-			default: DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", pkt_data.datarate);
-		}
-		switch (pkt_data.coderate) {
-			case CR_LORA_4_5: buff[9] |= 1 << 4; break;
-			case CR_LORA_4_6: buff[9] |= 2 << 4; break;
-			case CR_LORA_4_7: buff[9] |= 3 << 4; break;
-			case CR_LORA_4_8: buff[9] |= 4 << 4; break;
-			default: DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", pkt_data.coderate);
-		}
-		if (pkt_data.no_crc == false) {
-			buff[9] |= 0x80; /* set 'CRC enable' bit */
-		} else {
-			DEBUG_MSG("Info: packet will be sent without CRC\n");
-		}
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-		/* metadata 10, payload size */
-		buff[10] = pkt_data.size;
+void lgw_reset_stats(void) {
+	lgw_reg_reset_stats();
+	STAT_CLR(stats.rx_fetch);
+	STAT_CLR(stats.rx_pkt);
+	STAT_CLR(stats.rx_crc_ok);
+	STAT_CLR(stats.rx_crc_bad);
+	STAT_CLR(stats.rx_no_crc);
+	STAT_CLR(stats.rx_error);
+	STAT_CLR(stats.tx_pkt);
+	STAT_CLR(stats.tx_error);
+	stats_hist_clr(&stats.rx_time);
+	stats_hist_clr(&stats.tx_time);
+}
 
-		/* metadata 11, implicit header, modulation bandwidth, PPM offset & polarity */
-		switch (pkt_data.bandwidth) {
-			case BW_125KHZ: buff[11] = 0; break;
-			case BW_250KHZ: buff[11] = 1; break;
-			case BW_500KHZ: buff[11] = 2; break;
-			default: DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", pkt_data.bandwidth);
-		}
-		if (pkt_data.no_header == true) {
-			buff[11] |= 0x04; /* set 'implicit header' bit */
-		}
-		if (SET_PPM_ON(pkt_data.bandwidth,pkt_data.datarate)) {
-			buff[11] |= 0x08; /* set 'PPM offset' bit at 1 */
-		}
-		if (pkt_data.invert_pol == true) {
-			buff[11] |= 0x10; /* set 'TX polarity' bit at 1 */
-		}
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-		/* metadata 12 & 13, LoRa preamble size */
-		if (pkt_data.preamble == 0) { /* if not explicit, use recommended LoRa preamble size */
-			pkt_data.preamble = STD_LORA_PREAMBLE;
-		} else if (pkt_data.preamble < MIN_LORA_PREAMBLE) { /* enforce minimum preamble size */
-			pkt_data.preamble = MIN_LORA_PREAMBLE;
-			DEBUG_MSG("Note: preamble length adjusted to respect minimum LoRa preamble size\n");
-		}
-		buff[12] = 0xFF & (pkt_data.preamble >> 8);
-		buff[13] = 0xFF & pkt_data.preamble;
+int lgw_send(struct lgw_pkt_tx_s pkt_data) {
+	return lgw_send_ptr(&pkt_data);
+}
 
-		/* metadata 14 & 15, not used */
-		buff[14] = 0;
-		buff[15] = 0;
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-		/* MSB of RF frequency is now used in AGC firmware to implement large/narrow filtering in SX1257/55 */
-		buff[0] &= 0x3F; /* Unset 2 MSBs of frequency code */
-		if (pkt_data.bandwidth == BW_500KHZ) {
-			buff[0] |= 0x80; /* Set MSB bit to enlarge analog filter for 500kHz BW */
-		}
-        else if (pkt_data.bandwidth == BW_125KHZ){
-			buff[0] |= 0x40; /* Set MSB-1 bit to enable digital filter for 125kHz BW */
+int lgw_send_ptr(const struct lgw_pkt_tx_s *pkt_data) {
+	CHECK_NULL(pkt_data);
+
+	/* only compute the metadata when the TX parameters change */
+	if (tx_desc_match(&cur->tx_desc_last, pkt_data) == false) {
+		if (lgw_tx_prepare(pkt_data, &cur->tx_desc_last) != LGW_HAL_SUCCESS) {
+			cur->tx_desc_last.gen = 0;
+			STAT_ADD(stats.tx_error, 1);
+			return LGW_HAL_ERROR;
 		}
+	}
 
-	} else if (pkt_data.modulation == MOD_FSK) {
-		/* metadata 7, modulation type, radio chain selection and TX power */
-		buff[7] = (0x20 & (pkt_data.rf_chain << 5)) | 0x10 | (0x0F & pow_index); /* bit 4 is 1 -> FSK modulation */
+	return lgw_send_prepared(&cur->tx_desc_last, pkt_data->tx_mode, pkt_data->count_us, pkt_data->payload, pkt_data->size);
+}
 
-		buff[8] = 0; /* metadata 8, not used */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-		/* metadata 9, frequency deviation */
-		buff[9] = pkt_data.f_dev;
+int lgw_tx_prepare(const struct lgw_pkt_tx_s *pkt_data, struct lgw_tx_desc_s *desc) {
+	/* check input variables */
+	CHECK_NULL(pkt_data);
+	CHECK_NULL(desc);
+
+	memset(desc, 0, sizeof *desc);
+	desc->freq_hz = pkt_data->freq_hz;
+	desc->rf_chain = pkt_data->rf_chain;
+	desc->rf_power = pkt_data->rf_power;
+	desc->modulation = pkt_data->modulation;
+	desc->bandwidth = pkt_data->bandwidth;
+	desc->datarate = pkt_data->datarate;
+	desc->coderate = pkt_data->coderate;
+	desc->invert_pol = pkt_data->invert_pol;
+	desc->f_dev = pkt_data->f_dev;
+	desc->preamble = pkt_data->preamble;
+	desc->no_crc = pkt_data->no_crc;
+	desc->no_header = pkt_data->no_header;
+
+	return tx_desc_compute(desc);
+}
 
-		/* metadata 10, payload size */
-		buff[10] = pkt_data.size;
-		/* TODO: how to handle 255 bytes packets ?!? */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-		/* metadata 11, packet mode, CRC, encoding */
-		buff[11] = 0x01 | (pkt_data.no_crc?0:0x02) | (0x02 << 2); /* always in variable length packet mode, whitening, and CCITT CRC if CRC is not disabled  */
+/* body of lgw_send_prepared, without the statistics */
+int send_prepared(struct lgw_tx_desc_s *desc, uint8_t tx_mode, uint32_t count_us, const uint8_t *payload, uint16_t size) {
+	int i;
+	uint8_t buff[256+LGW_TX_METADATA_MAX]; /* buffer to prepare the packet to send + metadata before SPI write burst */
+	uint32_t count_trig; /* timestamp value in trigger mode corrected for TX start delay */
 
-		/* metadata 12 & 13, FSK preamble size */
-		if (pkt_data.preamble == 0) { /* if not explicit, use LoRa MAC preamble size */
-			pkt_data.preamble = STD_FSK_PREAMBLE;
-		} else if (pkt_data.preamble < MIN_FSK_PREAMBLE) { /* enforce minimum preamble size */
-			pkt_data.preamble = MIN_FSK_PREAMBLE;
-			DEBUG_MSG("Note: preamble length adjusted to respect minimum FSK preamble size\n");
+	/* check input variables */
+	CHECK_NULL(desc);
+	CHECK_NULL(payload);
+	if (cur->lgw_is_started == false) {
+		DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE SENDING\n");
+		return LGW_HAL_ERROR;
+	}
+	if (!IS_TX_MODE(tx_mode)) {
+		DEBUG_MSG("ERROR: TX_MODE NOT SUPPORTED\n");
+		return LGW_HAL_ERROR;
+	}
+	if (size > 255) {
+		DEBUG_MSG("ERROR: PAYLOAD LENGTH TOO BIG FOR TX\n");
+		return LGW_HAL_ERROR;
+	}
+
+	/* descriptor computed before a restart or a TX gain LUT change */
+	if (desc->gen != cur->tx_desc_gen) {
+		if (tx_desc_compute(desc) != LGW_HAL_SUCCESS) {
+			return LGW_HAL_ERROR;
 		}
-		buff[12] = 0xFF & (pkt_data.preamble >> 8);
-		buff[13] = 0xFF & pkt_data.preamble;
+	}
 
-		/* metadata 14 & 15, FSK baudrate */
-		fsk_dr_div = (uint16_t)((uint32_t)LGW_XTAL_FREQU / pkt_data.datarate); /* Ok for datarate between 500bps and 250kbps */
-		buff[14] = 0xFF & (fsk_dr_div >> 8);
-		buff[15] = 0xFF & fsk_dr_div;
+	/* fixed metadata, useful payload and misc metadata compositing */
+	memcpy(buff, desc->meta, desc->meta_size);
+
+	/* metadata 3 to 6, timestamp trigger value */
+	/* TX state machine must be triggered at T0 - TX_START_DELAY for packet to start being emitted at T0 */
+	if (tx_mode == TIMESTAMPED) {
+		count_trig = count_us - TX_START_DELAY;
+		buff[3] = 0xFF & (count_trig >> 24);
+		buff[4] = 0xFF & (count_trig >> 16);
+		buff[5] = 0xFF & (count_trig >> 8);
+		buff[6] = 0xFF &  count_trig;
+	}
 
+	/* metadata 10, payload size */
+	buff[10] = size;
+	if (desc->modulation == MOD_FSK) {
 		/* insert payload size in the packet for variable mode */
-		buff[16] = pkt_data.size;
-		++transfer_size; /* one more byte to transfer to the TX modem */
-		++payload_offset; /* start the payload with one more byte of offset */
+		buff[16] = size;
+	}
 
-		/* MSB of RF frequency is now used in AGC firmware to implement large/narrow filtering in SX1257/55 */
-		buff[0] &= 0x7F; /* Always use narrow band for FSK (force MSB to 0) */
+	/* copy payload from user buffer to buffer containing metadata */
+	memcpy((void *)(buff + desc->meta_size), (void *)payload, size);
 
-	} else {
-		DEBUG_MSG("ERROR: INVALID TX MODULATION..\n");
-		return LGW_HAL_ERROR;
-	}
+	/* register writes, TX data and trigger are sent in one SPI transaction */
+	lgw_reg_batch_begin();
 
-	/* copy payload from user struct to buffer containing metadata */
-	memcpy((void *)(buff + payload_offset), (void *)(pkt_data.payload), pkt_data.size);
+	/* loading TX imbalance correction */
+	lgw_reg_w_tx_offset_i(desc->offset_i);
+	lgw_reg_w_tx_offset_q(desc->offset_q);
+
+	/* Set digital gain from LUT */
+	lgw_reg_w_tx_gain(desc->dig_gain);
 
 	/* reset TX command flags */
 	lgw_abort_tx();
 
 	/* put metadata + payload in the TX data buffer */
-	lgw_reg_w(LGW_TX_DATA_BUF_ADDR, 0);
-	lgw_reg_wb(LGW_TX_DATA_BUF_DATA, buff, transfer_size);
-	DEBUG_ARRAY(i, transfer_size, buff);
+	lgw_reg_w_tx_data_buf_addr(0);
+	lgw_reg_wb_tx_data_buf_data(buff, desc->meta_size + size);
+	DEBUG_ARRAY(i, desc->meta_size + size, buff);
 
 	/* send data */
-	switch(pkt_data.tx_mode) {
+	switch(tx_mode) {
 		case IMMEDIATE:
-			lgw_reg_w(LGW_TX_TRIG_IMMEDIATE, 1);
+			lgw_reg_w_tx_trig_immediate(1);
 			break;
 
 		case TIMESTAMPED:
-			lgw_reg_w(LGW_TX_TRIG_DELAYED, 1);
+			lgw_reg_w_tx_trig_delayed(1);
 			break;
 
 		case ON_GPS:
-			lgw_reg_w(LGW_TX_TRIG_GPS, 1);
+			lgw_reg_w_tx_trig_gps(1);
 			break;
 
 		default:
-			DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", pkt_data.tx_mode);
+			DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", tx_mode);
+			lgw_reg_batch_commit();
 			return LGW_HAL_ERROR;
 	}
 
+	if (lgw_reg_batch_commit() != LGW_REG_SUCCESS) {
+		DEBUG_MSG("ERROR: FAILED TO SEND TX PACKET\n");
+		return LGW_HAL_ERROR;
+	}
 	return LGW_HAL_SUCCESS;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_send_prepared(struct lgw_tx_desc_s *desc, uint8_t tx_mode, uint32_t count_us, const uint8_t *payload, uint16_t size) {
+	struct timespec t0, t;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	i = send_prepared(desc, tx_mode, count_us, payload, size);
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	stats_hist_add(&stats.tx_time, (uint32_t)((t.tv_sec - t0.tv_sec) * 1000000 + (t.tv_nsec - t0.tv_nsec) / 1000));
+	if (i == LGW_HAL_SUCCESS) {
+		STAT_ADD(stats.tx_pkt, 1);
+	} else {
+		STAT_ADD(stats.tx_error, 1);
+	}
+	return i;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_status(uint8_t select, uint8_t *code) {
-	int32_t read_value;
+	int32_t read_value = 0;
 
 	/* check input variables */
 	CHECK_NULL(code);
 
 	if (select == TX_STATUS) {
-		lgw_reg_r(LGW_TX_STATUS, &read_value);
-		if (lgw_is_started == false) {
+		lgw_reg_r_tx_status(&read_value);
+		if (cur->lgw_is_started == false) {
 			*code = TX_OFF;
 		} else if ((read_value & 0x10) == 0) { /* bit 4 @1: TX programmed */
 			*code = TX_FREE;
@@ -1683,7 +2514,7 @@ int lgw_status(uint8_t select, uint8_t *code) {
 int lgw_abort_tx(void) {
 	int i;
 
-	i = lgw_reg_w(LGW_TX_TRIG_ALL, 0);
+	i = lgw_reg_w_tx_trig_all(0);
 
 	if (i == LGW_REG_SUCCESS) return LGW_HAL_SUCCESS;
 	else return LGW_HAL_ERROR;
@@ -1695,7 +2526,7 @@ int lgw_get_trigcnt(uint32_t* trig_cnt_us) {
 	int i;
 	int32_t val;
 
-	i = lgw_reg_r(LGW_TIMESTAMP, &val);
+	i = lgw_reg_r_timestamp(&val);
 	if (i == LGW_REG_SUCCESS) {
 		*trig_cnt_us = (uint32_t)val;
 		return LGW_HAL_SUCCESS;
@@ -1706,6 +2537,89 @@ int lgw_get_trigcnt(uint32_t* trig_cnt_us) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_get_instcnt(uint32_t* inst_cnt_us) {
+	int i;
+	int32_t val;
+
+	CHECK_NULL(inst_cnt_us);
+
+	/* with GPS event capture disabled, the timestamp register follows the counter */
+	lgw_reg_batch_begin();
+	lgw_reg_w_gps_en(0);
+	i = lgw_reg_r_timestamp(&val);
+	lgw_reg_w_gps_en(1);
+	lgw_reg_batch_commit();
+	cur->gps_toggle_nb += 1;
+	if (i == LGW_REG_SUCCESS) {
+		cur->gps_toggle_cnt = (uint32_t)val;
+		*inst_cnt_us = (uint32_t)val;
+		return LGW_HAL_SUCCESS;
+	} else {
+		return LGW_HAL_ERROR;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_get_gps_toggle(uint32_t *nb_toggle, uint32_t *toggle_cnt_us) {
+	CHECK_NULL(nb_toggle);
+	CHECK_NULL(toggle_cnt_us);
+
+	*nb_toggle = cur->gps_toggle_nb;
+	*toggle_cnt_us = cur->gps_toggle_cnt;
+	return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t lgw_time_on_air(const struct lgw_pkt_tx_s *pkt_data) {
+	uint8_t sf;
+	uint16_t preamble;
+
+	if (pkt_data == NULL) {
+		return 0;
+	}
+
+	/* preamble as adjusted by lgw_send */
+	preamble = pkt_data->preamble;
+	if (pkt_data->modulation == MOD_FSK) {
+		if (preamble == 0) {
+			preamble = STD_FSK_PREAMBLE;
+		} else if (preamble < MIN_FSK_PREAMBLE) {
+			preamble = MIN_FSK_PREAMBLE;
+		}
+	} else {
+		if (preamble == 0) {
+			preamble = STD_LORA_PREAMBLE;
+		} else if (preamble < MIN_LORA_PREAMBLE) {
+			preamble = MIN_LORA_PREAMBLE;
+		}
+	}
+
+	if (pkt_data->modulation == MOD_FSK) {
+		if (pkt_data->datarate == 0) {
+			return 0;
+		}
+		/* preamble + sync word + length byte + payload + CRC */
+		return (uint32_t)((8000000ULL * (preamble + 3 + 1 + pkt_data->size + (pkt_data->no_crc ? 0 : 2))) / pkt_data->datarate);
+	} else if (pkt_data->modulation != MOD_LORA) {
+		return 0;
+	}
+
+	switch (pkt_data->datarate) {
+		case DR_LORA_SF7: sf = 7; break;
+		case DR_LORA_SF8: sf = 8; break;
+		case DR_LORA_SF9: sf = 9; break;
+		case DR_LORA_SF10: sf = 10; break;
+		case DR_LORA_SF11: sf = 11; break;
+		case DR_LORA_SF12: sf = 12; break;
+		default: return 0;
+	}
+	return lgw_lut_lora_toa(pkt_data->bandwidth, sf, pkt_data->coderate, !pkt_data->no_crc, pkt_data->no_header, pkt_data->size, preamble);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 const char* lgw_version_info() {
 	return lgw_version_string;
 }
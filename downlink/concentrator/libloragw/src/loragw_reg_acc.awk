@@ -0,0 +1,144 @@
+# / _____)             _              | |
+#( (____  _____ ____ _| |_ _____  ____| |__
+# \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+# _____) ) ____| | | || |_| ____( (___| | | |
+#(______/|_____)_|_|_| \__)_____)\____)_| |_|
+#  (C)2013 Semtech-Cycleo
+#
+# Description:
+#	Generate inc/loragw_reg_acc.h from the loregs table of src/loragw_reg.c:
+#	one static inline accessor per register, with its page, address, masks,
+#	shifts and number of bytes as constants.
+#	usage: awk -f src/loragw_reg_acc.awk src/loragw_reg.c > inc/loragw_reg_acc.h
+#
+# License: Revised BSD License, see LICENSE.TXT file include in the project
+# Maintainer: Sylvain Miermont
+
+# writes that have a side effect handled by lgw_reg_w
+function special(name) {
+	return (name == "PAGE_REG") || (name == "SOFT_RESET") || (name == "EMERGENCY_FORCE_HOST_CTRL")
+}
+
+BEGIN {
+	nb = 0
+	intable = 0
+}
+
+/loregs\[LGW_TOTALREGS\] = \{/ {
+	intable = 1
+	next
+}
+
+intable && /^\};/ {
+	intable = 0
+}
+
+intable && /\{ *-?[0-9]+ *,/ {
+	line = $0
+	match(line, /\{[^}]*\}/)
+	split(substr(line, RSTART + 1, RLENGTH - 2), f, ",")
+	match(line, /\/\* *[A-Z0-9_]+/)
+	name = substr(line, RSTART, RLENGTH)
+	sub(/\/\* */, "", name)
+	page[nb] = f[1] + 0
+	addr[nb] = f[2] + 0
+	offs[nb] = f[3] + 0
+	sign[nb] = f[4] + 0
+	leng[nb] = f[5] + 0
+	rdon[nb] = f[6] + 0
+	reg[nb] = name
+	nb += 1
+}
+
+END {
+	if (nb == 0) {
+		print "loragw_reg_acc.awk: loregs table not found" > "/dev/stderr"
+		exit 1
+	}
+
+	print "/* generated by src/loragw_reg_acc.awk from the loregs table of src/loragw_reg.c, do not edit */"
+	print ""
+	print "#ifndef _LORAGW_REG_ACC_H"
+	print "#define _LORAGW_REG_ACC_H"
+	print ""
+	print "#include <stdint.h>\t\t/* C99 types */"
+	print ""
+	print "#include \"loragw_reg.h\""
+	print ""
+	printf "/* %d registers */\n", nb
+
+	for (i = 0; i < nb; ++i) {
+		n = tolower(reg[i])
+		p = page[i]
+		a = addr[i]
+		o = offs[i]
+		l = leng[i]
+		print ""
+
+		# read
+		if (o + l <= 8) {
+			printf "static inline int lgw_reg_r_%s(int32_t *reg_value) {\n", n
+			print "\tuint8_t u;"
+			print "\tint i;"
+			print ""
+			printf "\ti = lgw_reg_rbyte(%d, %d, &u);\n", p, a
+			if ((o == 0) && (l == 8)) {
+				expr = sign[i] ? "(int32_t)(int8_t)u" : "(int32_t)u"
+			} else if (sign[i]) {
+				expr = sprintf("(int32_t)((int8_t)(u << %d) >> %d)", 8 - l - o, 8 - l)
+			} else {
+				expr = sprintf("(int32_t)((u >> %d) & 0x%02X)", o, 2^l - 1)
+			}
+		} else {
+			printf "static inline int lgw_reg_r_%s(int32_t *reg_value) {\n", n
+			print "\tuint32_t u;"
+			print "\tint i;"
+			print ""
+			printf "\ti = lgw_reg_rmulti(%d, %d, %d, &u);\n", p, a, int((l + 7) / 8)
+			if (sign[i] && (l < 32)) {
+				expr = sprintf("(int32_t)(u << %d) >> %d", 32 - l, 32 - l)
+			} else {
+				expr = "(int32_t)u"
+			}
+		}
+		print "\tif (i == LGW_REG_SUCCESS) {"
+		printf "\t\t*reg_value = %s;\n", expr
+		print "\t}"
+		print "\treturn i;"
+		print "}"
+
+		# write
+		if (rdon[i] == 0) {
+			printf "static inline int lgw_reg_w_%s(int32_t reg_value) {\n", n
+			if (special(reg[i])) {
+				printf "\treturn lgw_reg_w(LGW_%s, reg_value);\n", reg[i]
+			} else if ((o == 0) && (l == 8)) {
+				printf "\treturn lgw_reg_wbyte(%d, %d, (uint8_t)reg_value);\n", p, a
+			} else if ((o == 0) && (l < 8)) {
+				printf "\treturn lgw_reg_wbits(%d, %d, 0x%02X, (uint8_t)reg_value & 0x%02X);\n", p, a, 2^l - 1, 2^l - 1
+			} else if (o + l <= 8) {
+				printf "\treturn lgw_reg_wbits(%d, %d, 0x%02X, (uint8_t)((uint8_t)reg_value << %d) & 0x%02X);\n", p, a, (2^l - 1) * 2^o, o, (2^l - 1) * 2^o
+			} else {
+				printf "\treturn lgw_reg_wmulti(%d, %d, %d, reg_value);\n", p, a, int((l + 7) / 8)
+			}
+			print "}"
+		}
+
+		# bursts, from the first byte of the register
+		if ((o == 0) && (l % 8 == 0)) {
+			printf "static inline int lgw_reg_rb_%s(uint8_t *data, uint16_t size) {\n", n
+			printf "\treturn lgw_reg_rburst(%d, %d, data, size);\n", p, a
+			print "}"
+			if (rdon[i] == 0) {
+				printf "static inline int lgw_reg_wb_%s(uint8_t *data, uint16_t size) {\n", n
+				printf "\treturn lgw_reg_wburst(%d, %d, data, size);\n", p, a
+				print "}"
+			}
+		}
+	}
+
+	print ""
+	print "#endif"
+	print ""
+	print "/* --- EOF ------------------------------------------------------------------ */"
+}
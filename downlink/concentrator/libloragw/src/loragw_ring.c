@@ -0,0 +1,124 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Bounded single-producer single-consumer ring buffer
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdio.h>		/* printf fprintf */
+#include <stdlib.h>		/* malloc free */
+#include <string.h>		/* memcpy */
+
+#include "loragw_ring.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_AUX == 1
+	#define DEBUG_MSG(str)				fprintf(stderr, str)
+	#define DEBUG_PRINTF(fmt, args...)	fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+	#define CHECK_NULL(a)				if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_RING_ERROR;}
+#else
+	#define DEBUG_MSG(str)
+	#define DEBUG_PRINTF(fmt, args...)
+	#define CHECK_NULL(a)				if(a==NULL){return LGW_RING_ERROR;}
+#endif
+
+/* the other side of the ring is only read through these, so that the element
+copy cannot be reordered after the index update that publishes it */
+#define LOAD_ACQUIRE(a)		__atomic_load_n(&(a), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(a,v)	__atomic_store_n(&(a), (v), __ATOMIC_RELEASE)
+#define LOAD_RELAXED(a)		__atomic_load_n(&(a), __ATOMIC_RELAXED)
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_ring_init(struct lgw_ring_s *ring, size_t elem_size, uint32_t nb_elem) {
+	CHECK_NULL(ring);
+	if ((elem_size == 0) || (nb_elem < 2) || (nb_elem > LGW_RING_NB_MAX) || ((nb_elem & (nb_elem - 1)) != 0)) {
+		DEBUG_MSG("ERROR: RING SIZE MUST BE A POWER OF 2\n");
+		return LGW_RING_ERROR;
+	}
+
+	memset(ring, 0, sizeof *ring);
+	ring->buf = malloc(elem_size * nb_elem);
+	if (ring->buf == NULL) {
+		DEBUG_MSG("ERROR: FAILED TO ALLOCATE RING\n");
+		return LGW_RING_ERROR;
+	}
+	ring->elem_size = elem_size;
+	ring->mask = nb_elem - 1;
+	DEBUG_PRINTF("Note: ring of %u elements of %u bytes\n", nb_elem, (unsigned)elem_size);
+	return LGW_RING_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_ring_free(struct lgw_ring_s *ring) {
+	if (ring == NULL) {
+		return;
+	}
+	free(ring->buf);
+	ring->buf = NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ring_push(struct lgw_ring_s *ring, const void *elem) {
+	uint32_t head = ring->head; /* only written by this thread */
+
+	if ((head - LOAD_ACQUIRE(ring->tail)) > ring->mask) {
+		STORE_RELEASE(ring->nb_drop, ring->nb_drop + 1);
+		return LGW_RING_FULL;
+	}
+	memcpy(ring->buf + (head & ring->mask) * ring->elem_size, elem, ring->elem_size);
+	STORE_RELEASE(ring->head, head + 1);
+	return LGW_RING_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ring_pop(struct lgw_ring_s *ring, void *elem) {
+	uint32_t tail = ring->tail; /* only written by this thread */
+	uint32_t nb;
+
+	nb = LOAD_ACQUIRE(ring->head) - tail;
+	if (nb == 0) {
+		return LGW_RING_EMPTY;
+	}
+	if (nb > ring->nb_max) {
+		ring->nb_max = nb;
+	}
+	memcpy(elem, ring->buf + (tail & ring->mask) * ring->elem_size, ring->elem_size);
+	STORE_RELEASE(ring->tail, tail + 1);
+	return LGW_RING_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t lgw_ring_count(struct lgw_ring_s *ring) {
+	uint32_t tail = LOAD_ACQUIRE(ring->tail); /* read first, so that it can never be ahead of head */
+
+	return LOAD_ACQUIRE(ring->head) - tail;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t lgw_ring_drops(struct lgw_ring_s *ring) {
+	return LOAD_RELAXED(ring->nb_drop);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,1321 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Simulated LoRa concentrator, used in place of the SPI link to run the HAL
+	without hardware.
+	Single-byte, burst and multiple-frame SPI transactions are answered by an
+	in-process model of the SX1301: register pages, RX packet FIFO and data
+	buffer, TX data buffer and trigger logic, MCU program RAM and the behaviour
+	of the calibration/AGC/arbiter firmwares that lgw_start relies on.
+	An interrupt line, raised while the RX FIFO is not empty, wakes up the
+	threads waiting in lgw_spi_irq_wait.
+	Several boards can be simulated in parallel (see loragw_sim.h).
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* printf fprintf */
+#include <string.h>		/* memset memcpy memcmp */
+#include <stdlib.h>		/* strtol */
+#include <math.h>		/* ceil lround */
+#include <time.h>		/* clock_gettime */
+#include <pthread.h>	/* pthread_mutex pthread_cond */
+
+#include "loragw_spi.h"
+#include "loragw_reg.h"
+#include "loragw_hal.h"
+#include "loragw_sim.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#if DEBUG_SPI == 1
+	#define DEBUG_MSG(str)				fprintf(stderr, str)
+	#define DEBUG_PRINTF(fmt, args...)	fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+	#define CHECK_NULL(a)				if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_SPI_ERROR;}
+#else
+	#define DEBUG_MSG(str)
+	#define DEBUG_PRINTF(fmt, args...)
+	#define CHECK_NULL(a)				if(a==NULL){return LGW_SPI_ERROR;}
+#endif
+
+#define CHECK_BOARD(b)				if((b<0)||(b>=LGW_SIM_BOARD_NB)){return LGW_SIM_ERROR;}
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define		MCU_ARB		0
+#define		MCU_AGC		1
+#define		MCU_ARB_FW_BYTE		8192 /* size of the firmware IN BYTES (= twice the number of 14b words) */
+#define		MCU_AGC_FW_BYTE		8192 /* size of the firmware IN BYTES (= twice the number of 14b words) */
+#define		FW_VERSION_ADDR		0x20 /* Address of firmware version in data memory */
+
+#define		SIM_PAGE_NB			4
+#define		SIM_TX_BUF_SIZE		512
+#define		SIM_MCU_RAM_SIZE	256
+#define		RX_METADATA_NB		16
+#define		TX_METADATA_NB		16
+
+/* register addresses that have a side effect in the model */
+#define		ADDR_PAGE			0	/* page select & soft reset */
+#define		ADDR_RX_BUF_ADDR	2	/* 16 bits, LSB first */
+#define		ADDR_RX_BUF_DATA	4
+#define		ADDR_TX_BUF_ADDR	5
+#define		ADDR_TX_BUF_DATA	6
+#define		ADDR_CAPTURE_DATA	8
+#define		ADDR_PROM_ADDR		9
+#define		ADDR_PROM_DATA		10
+#define		ADDR_FIFO_NUM		11	/* followed by address pointer (2), status, size */
+#define		ADDR_AGC_STATUS		32
+#define		ADDR_EMERGENCY		127
+#define		ADDR_RADIO_SELECT	35	/* page 0 */
+#define		ADDR_MCU_CTRL		106	/* page 0, RST_0 RST_1 MUX_0 MUX_1 in bits 0 to 3 */
+#define		ADDR_TX_TRIG		33	/* page 1 */
+#define		ADDR_TX_STATUS		62	/* page 1 */
+#define		ADDR_RADIO_A_DATA	33	/* page 2, followed by readback, address, -, CS */
+#define		ADDR_RADIO_B_DATA	38	/* page 2, same layout as radio A */
+#define		ADDR_ARB_RAM_DATA	64	/* page 2 */
+#define		ADDR_AGC_RAM_DATA	65	/* page 2 */
+#define		ADDR_TIMESTAMP		70	/* page 2, 32 bits, LSB first */
+#define		ADDR_ARB_RAM_ADDR	80	/* page 2 */
+#define		ADDR_AGC_RAM_ADDR	81	/* page 2 */
+
+#define		AGC_CMD_WAIT		16
+#define		AGC_CMD_ABORT		17
+
+#define		SX1257_VERSION		0x21
+
+/* identification of the firmware running in the AGC MCU */
+enum sim_fw_e {
+	FW_NONE = 0,
+	FW_CAL,
+	FW_AGC,
+	FW_ARB
+};
+
+/* steps of the AGC firmware initialisation handshake */
+enum sim_agc_step_e {
+	AGC_STEP_LUT = 0,
+	AGC_STEP_FREQ,
+	AGC_STEP_CHAN,
+	AGC_STEP_END,
+	AGC_STEP_RUN
+};
+
+/* state of the TX state machine */
+enum sim_tx_state_e {
+	TX_STATE_FREE = 0,
+	TX_STATE_DELAYED,
+	TX_STATE_ON_GPS,
+	TX_STATE_EMITTING
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct sim_fifo_s {
+	uint16_t	addr;	/* start of the packet in the RX data buffer */
+	uint8_t		status;
+	uint8_t		size;
+};
+
+struct sim_board_s {
+	pthread_mutex_t	mx;
+	pthread_cond_t	irq_cv;	/* signaled when a packet enters the RX FIFO */
+	bool		irq_line;	/* false to simulate a board without interrupt line */
+	bool		powered;
+	unsigned	cal_time_ms;
+	struct timespec	t0;	/* power-on time, origin of the internal counter */
+
+	/* register file */
+	uint8_t		page;
+	uint8_t		common[128];	/* registers shared by all pages */
+	uint8_t		paged[SIM_PAGE_NB][128];
+	uint32_t	timestamp_latch;
+	uint32_t	gps_en_cnt;	/* counter when the GPS event capture was last enabled */
+
+	/* RX path */
+	uint8_t		rx_buf[LGW_DATABUFF_SIZE];
+	struct sim_fifo_s	rx_fifo[LGW_PKT_FIFO_SIZE];
+	int			rx_head;
+	int			rx_nb;
+	uint16_t	rx_wr;	/* next free byte of the data buffer */
+	uint16_t	rx_rd;	/* data port read pointer */
+
+	/* TX path */
+	uint8_t		tx_buf[SIM_TX_BUF_SIZE];
+	uint16_t	tx_ptr;
+	enum sim_tx_state_e	tx_state;
+	uint32_t	tx_start;	/* counter value when emission starts */
+	uint32_t	tx_end;		/* counter value when emission ends */
+	struct lgw_sim_tx_s	tx_log[LGW_SIM_TX_LOG_NB];
+	int			tx_nb;
+
+	/* MCUs */
+	uint8_t		prom[2][MCU_AGC_FW_BYTE];	/* program RAM of each MCU */
+	uint16_t	prom_ptr;
+	bool		prom_primed;	/* first PROM read after setting the address is a dummy */
+	uint8_t		ram[2][SIM_MCU_RAM_SIZE];
+	enum sim_fw_e	agc_fw;	/* firmware running in AGC MCU, FW_NONE if held in reset */
+	bool		arb_run;
+	uint8_t		cal_cmd;
+	bool		cal_started;
+	struct timespec	cal_t0;
+	enum sim_agc_step_e	agc_step;
+	bool		agc_wait;
+	int			agc_lut_nb;
+	uint8_t		agc_status;
+	uint8_t		agc_freq_msb;
+
+	/* radios */
+	uint8_t		radio[LGW_RF_CHAIN_NB][128];
+
+	struct lgw_sim_counters_s	cnt;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+#include "arb_fw.var" /* reference images, used to identify what is loaded in the MCUs */
+#include "agc_fw.var"
+#include "cal_fw.var"
+
+static struct sim_board_s sim_boards[LGW_SIM_BOARD_NB];
+static pthread_mutex_t sim_init_mx = PTHREAD_MUTEX_INITIALIZER;
+static bool sim_init_done = false;
+static int sim_board_sel = 0; /* board opened by the next lgw_spi_open */
+static uint32_t sim_spi_speed = 8000000; /* only reported, the model does not depend on the clock */
+static uint16_t sim_spi_chunk = LGW_BURST_CHUNK; /* bursts are counted in chunks of that size */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void sim_init(void);
+
+static void sim_power_on(struct sim_board_s *b);
+
+static void sim_soft_reset(struct sim_board_s *b);
+
+static uint32_t sim_count(struct sim_board_s *b);
+
+static uint32_t sim_field(struct sim_board_s *b, uint16_t register_id);
+
+static uint32_t sim_airtime(const struct lgw_sim_tx_s *tx);
+
+static void sim_tx_trigger(struct sim_board_s *b, uint8_t trig);
+
+static void sim_tx_update(struct sim_board_s *b);
+
+static void sim_mcu_ctrl(struct sim_board_s *b, uint8_t old, uint8_t val);
+
+static void sim_agc_command(struct sim_board_s *b, uint8_t val);
+
+static uint8_t sim_agc_status(struct sim_board_s *b);
+
+static void sim_radio_spi(struct sim_board_s *b, int rf_chain);
+
+static void sim_write(struct sim_board_s *b, uint8_t addr, uint8_t data);
+
+static uint8_t sim_read(struct sim_board_s *b, uint8_t addr);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void sim_init(void) {
+	pthread_condattr_t ca;
+	int i;
+
+	pthread_mutex_lock(&sim_init_mx);
+	if (sim_init_done == false) {
+		pthread_condattr_init(&ca);
+		pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+		for (i=0; i<LGW_SIM_BOARD_NB; ++i) {
+			memset(&sim_boards[i], 0, sizeof(sim_boards[i]));
+			pthread_mutex_init(&sim_boards[i].mx, NULL);
+			pthread_cond_init(&sim_boards[i].irq_cv, &ca);
+			sim_boards[i].irq_line = true;
+			sim_boards[i].cal_time_ms = LGW_SIM_CAL_TIME;
+		}
+		pthread_condattr_destroy(&ca);
+		sim_init_done = true;
+	}
+	pthread_mutex_unlock(&sim_init_mx);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void sim_power_on(struct sim_board_s *b) {
+	memset(b->prom, 0, sizeof(b->prom));
+	memset(b->radio, 0, sizeof(b->radio));
+	memset(b->tx_log, 0, sizeof(b->tx_log));
+	memset(&b->cnt, 0, sizeof(b->cnt));
+	b->tx_nb = 0;
+	clock_gettime(CLOCK_MONOTONIC, &b->t0);
+	sim_soft_reset(b);
+	b->powered = true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* reset the register file to the default values of the register map */
+static void sim_soft_reset(struct sim_board_s *b) {
+	int i, j, k;
+	int size_byte;
+	uint8_t mask;
+	uint8_t *p;
+	struct lgw_reg_s r;
+
+	memset(b->common, 0, sizeof(b->common));
+	memset(b->paged, 0, sizeof(b->paged));
+	for (i=0; i<LGW_TOTALREGS; ++i) {
+		r = loregs[i];
+		for (j=0; j<SIM_PAGE_NB; ++j) {
+			if ((r.page != -1) && (r.page != j)) {
+				continue;
+			}
+			p = (r.page == -1) ? &b->common[r.addr] : &b->paged[j][r.addr];
+			if ((r.offs + r.leng) <= 8) {
+				mask = ((1 << r.leng) - 1) << r.offs;
+				*p = (*p & ~mask) | (((uint8_t)r.dflt << r.offs) & mask);
+			} else {
+				size_byte = (r.leng + 7) / 8;
+				for (k=0; k<size_byte; ++k) {
+					p[k] = (uint8_t)(r.dflt >> (8*k));
+				}
+				break;
+			}
+			if (r.page == -1) {
+				break;
+			}
+		}
+	}
+	b->page = 0;
+
+	/* the RX FIFO is flushed and the MCUs go back in reset, program RAM is kept */
+	b->rx_head = 0;
+	b->rx_nb = 0;
+	b->rx_wr = 0;
+	b->rx_rd = 0;
+	b->tx_ptr = 0;
+	b->tx_state = TX_STATE_FREE;
+	b->prom_ptr = 0;
+	b->prom_primed = false;
+	memset(b->ram, 0, sizeof(b->ram));
+	b->agc_fw = FW_NONE;
+	b->arb_run = false;
+	b->cal_started = false;
+	b->agc_status = 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* internal 1 MHz counter, starts at power-on */
+static uint32_t sim_count(struct sim_board_s *b) {
+	struct timespec t;
+	uint64_t us;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	us = (uint64_t)(t.tv_sec - b->t0.tv_sec) * 1000000;
+	us += (int64_t)(t.tv_nsec - b->t0.tv_nsec) / 1000;
+	return (uint32_t)us;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* get the value of a register field from the model, as lgw_reg_r would */
+static uint32_t sim_field(struct sim_board_s *b, uint16_t register_id) {
+	struct lgw_reg_s r;
+	uint8_t *p;
+	uint32_t u = 0;
+	int i;
+
+	r = loregs[register_id];
+	p = (r.page == -1) ? &b->common[r.addr] : &b->paged[r.page][r.addr];
+	if ((r.offs + r.leng) <= 8) {
+		return (*p >> r.offs) & ((1 << r.leng) - 1);
+	}
+	for (i=(r.leng+7)/8-1; i>=0; --i) {
+		u = (u << 8) + p[i];
+	}
+	return u;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* time on air of a TX descriptor, in microseconds */
+static uint32_t sim_airtime(const struct lgw_sim_tx_s *tx) {
+	double t_sym, n_payload;
+	int sf, bw_khz, de;
+
+	if (tx->modulation == MOD_FSK) {
+		/* preamble + sync word + length byte + payload + CRC */
+		return (uint32_t)(8.0e6 * (tx->preamble + 3 + 1 + tx->size + (tx->no_crc ? 0 : 2)) / tx->datarate);
+	}
+	switch (tx->datarate) {
+		case DR_LORA_SF7: sf = 7; break;
+		case DR_LORA_SF8: sf = 8; break;
+		case DR_LORA_SF9: sf = 9; break;
+		case DR_LORA_SF10: sf = 10; break;
+		case DR_LORA_SF11: sf = 11; break;
+		case DR_LORA_SF12: sf = 12; break;
+		default: return 0;
+	}
+	switch (tx->bandwidth) {
+		case BW_125KHZ: bw_khz = 125; break;
+		case BW_250KHZ: bw_khz = 250; break;
+		case BW_500KHZ: bw_khz = 500; break;
+		default: return 0;
+	}
+	de = ((bw_khz == 125) && (sf >= 11)) || ((bw_khz == 250) && (sf == 12));
+	t_sym = (double)(1 << sf) * 1000.0 / bw_khz; /* in us */
+	n_payload = ceil((8.0*tx->size - 4*sf + 28 + (tx->no_crc ? 0 : 16) - (tx->no_header ? 20 : 0)) / (4.0 * (sf - 2*de)));
+	n_payload = 8 + ((n_payload > 0) ? n_payload * (tx->coderate + 4) : 0);
+	return (uint32_t)((tx->preamble + 4.25 + n_payload) * t_sym);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* decode the TX data buffer and record the descriptor */
+static void sim_tx_trigger(struct sim_board_s *b, uint8_t trig) {
+	struct lgw_sim_tx_s *tx;
+	const uint8_t *m = b->tx_buf;
+	uint32_t freq_reg;
+	uint32_t count_trig;
+	uint32_t start_delay;
+	int payload_offset = TX_METADATA_NB;
+
+	tx = &b->tx_log[b->tx_nb % LGW_SIM_TX_LOG_NB];
+	memset(tx, 0, sizeof(*tx));
+	tx->trig_us = sim_count(b);
+	tx->rf_chain = (m[7] >> 5) & 0x01;
+	tx->pow_index = m[7] & 0x0F;
+	tx->dig_gain = (uint8_t)sim_field(b, LGW_TX_GAIN);
+	tx->offset_i = (int8_t)b->paged[1][loregs[LGW_TX_OFFSET_I].addr];
+	tx->offset_q = (int8_t)b->paged[1][loregs[LGW_TX_OFFSET_Q].addr];
+	tx->preamble = ((uint16_t)m[12] << 8) | m[13];
+	tx->size = m[10];
+
+	/* the 2 MSBs of the frequency code are replaced by the AGC firmware with the value loaded at init */
+	if ((m[7] & 0x10) == 0) {
+		tx->modulation = MOD_LORA;
+		freq_reg = ((uint32_t)((m[0] & 0x3F) | (b->agc_freq_msb << 6)) << 16);
+		switch (m[9] & 0x0F) {
+			case 7: tx->datarate = DR_LORA_SF7; break;
+			case 8: tx->datarate = DR_LORA_SF8; break;
+			case 9: tx->datarate = DR_LORA_SF9; break;
+			case 10: tx->datarate = DR_LORA_SF10; break;
+			case 11: tx->datarate = DR_LORA_SF11; break;
+			case 12: tx->datarate = DR_LORA_SF12; break;
+			default: tx->datarate = DR_UNDEFINED;
+		}
+		tx->coderate = (m[9] >> 4) & 0x07; /* same coding as CR_LORA_4_x */
+		tx->no_crc = ((m[9] & 0x80) == 0);
+		switch (m[11] & 0x03) {
+			case 0: tx->bandwidth = BW_125KHZ; break;
+			case 1: tx->bandwidth = BW_250KHZ; break;
+			case 2: tx->bandwidth = BW_500KHZ; break;
+			default: tx->bandwidth = BW_UNDEFINED;
+		}
+		tx->no_header = ((m[11] & 0x04) != 0);
+		tx->invert_pol = ((m[11] & 0x10) != 0);
+	} else {
+		tx->modulation = MOD_FSK;
+		freq_reg = ((uint32_t)((m[0] & 0x7F) | ((b->agc_freq_msb & 0x02) << 6)) << 16);
+		tx->f_dev = m[9];
+		tx->no_crc = ((m[11] & 0x02) == 0);
+		tx->datarate = LGW_XTAL_FREQU / (((uint16_t)m[14] << 8) | m[15]);
+		payload_offset += 1; /* length byte of variable length mode */
+	}
+	freq_reg |= ((uint32_t)m[1] << 8) | m[2];
+	if ((b->cal_cmd & 0x20) != 0) { /* SX1255 */
+		tx->freq_hz = (uint32_t)(((uint64_t)freq_reg * 15625) >> 9);
+	} else { /* SX1257 */
+		tx->freq_hz = (uint32_t)(((uint64_t)freq_reg * 15625) >> 8);
+	}
+	memcpy(tx->payload, m + payload_offset, tx->size);
+	tx->airtime_us = sim_airtime(tx);
+
+	/* TX state machine: the modem starts TX_START_DELAY after the trigger event */
+	start_delay = sim_field(b, LGW_TX_START_DELAY);
+	if (trig & 0x01) {
+		tx->tx_mode = IMMEDIATE;
+		tx->count_us = tx->trig_us + start_delay;
+		b->tx_state = TX_STATE_EMITTING;
+	} else if (trig & 0x02) {
+		tx->tx_mode = TIMESTAMPED;
+		count_trig = ((uint32_t)m[3] << 24) | ((uint32_t)m[4] << 16) | ((uint32_t)m[5] << 8) | m[6];
+		tx->count_us = count_trig + start_delay;
+		b->tx_state = TX_STATE_DELAYED;
+	} else {
+		tx->tx_mode = ON_GPS;
+		tx->count_us = (tx->trig_us - (tx->trig_us % 1000000)) + 1000000 + start_delay; /* next PPS */
+		b->tx_state = TX_STATE_ON_GPS;
+	}
+	b->tx_start = tx->count_us;
+	b->tx_end = tx->count_us + tx->airtime_us;
+
+	b->tx_nb += 1;
+	b->cnt.tx_triggered += 1;
+	DEBUG_PRINTF("Note: simulated TX triggered, mode %u, start %u, airtime %u us\n", tx->tx_mode, tx->count_us, tx->airtime_us);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void sim_tx_update(struct sim_board_s *b) {
+	uint32_t now;
+
+	if (b->tx_state == TX_STATE_FREE) {
+		return;
+	}
+	now = sim_count(b);
+	if ((int32_t)(now - b->tx_end) >= 0) {
+		b->tx_state = TX_STATE_FREE;
+	} else if ((int32_t)(now - b->tx_start) >= 0) {
+		b->tx_state = TX_STATE_EMITTING;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* MCU reset and program RAM mux control */
+static void sim_mcu_ctrl(struct sim_board_s *b, uint8_t old, uint8_t val) {
+	/* arbiter MCU */
+	if ((val & 0x01) != 0) {
+		b->arb_run = false;
+		b->ram[MCU_ARB][FW_VERSION_ADDR] = 0;
+	} else if ((old & 0x01) != 0) {
+		b->arb_run = true;
+		if (memcmp(b->prom[MCU_ARB], arb_firmware, MCU_ARB_FW_BYTE) == 0) {
+			b->ram[MCU_ARB][FW_VERSION_ADDR] = 1;
+		}
+	}
+
+	/* AGC MCU */
+	if ((val & 0x02) != 0) {
+		b->agc_fw = FW_NONE;
+		b->ram[MCU_AGC][FW_VERSION_ADDR] = 0;
+	} else if ((old & 0x02) != 0) {
+		b->agc_status = 0;
+		if (memcmp(b->prom[MCU_AGC], cal_firmware, MCU_AGC_FW_BYTE) == 0) {
+			b->agc_fw = FW_CAL;
+			b->ram[MCU_AGC][FW_VERSION_ADDR] = 2;
+			b->cal_cmd = b->paged[0][ADDR_RADIO_SELECT];
+			b->cal_started = false;
+		} else if (memcmp(b->prom[MCU_AGC], agc_firmware, MCU_AGC_FW_BYTE) == 0) {
+			b->agc_fw = FW_AGC;
+			b->ram[MCU_AGC][FW_VERSION_ADDR] = 4;
+			b->agc_step = AGC_STEP_LUT;
+			b->agc_wait = false;
+			b->agc_lut_nb = 0;
+			b->agc_status = 0x10;
+		} else {
+			b->agc_fw = FW_NONE; /* unknown image, the MCU does not answer */
+		}
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* AGC firmware initialisation protocol, through the RADIO_SELECT register */
+static void sim_agc_command(struct sim_board_s *b, uint8_t val) {
+	if ((b->agc_fw != FW_AGC) || (b->agc_step == AGC_STEP_RUN)) {
+		return;
+	}
+	if (b->agc_wait == false) {
+		if (val == AGC_CMD_WAIT) {
+			b->agc_wait = true;
+		}
+		return;
+	}
+	b->agc_wait = false;
+	switch (b->agc_step) {
+		case AGC_STEP_LUT:
+			if (val == AGC_CMD_ABORT) {
+				b->agc_status = 0x30;
+				b->agc_step = AGC_STEP_FREQ;
+			} else {
+				b->agc_status = 0x30 + b->agc_lut_nb;
+				b->agc_lut_nb += 1;
+				if (b->agc_lut_nb == TX_GAIN_LUT_SIZE_MAX) {
+					b->agc_step = AGC_STEP_FREQ;
+				}
+			}
+			break;
+		case AGC_STEP_FREQ:
+			b->agc_freq_msb = val & 0x03;
+			b->agc_status = 0x30 + val;
+			b->agc_step = AGC_STEP_CHAN;
+			break;
+		case AGC_STEP_CHAN:
+			b->agc_status = 0x30 + val;
+			b->agc_step = AGC_STEP_END;
+			break;
+		default:
+			b->agc_status = 0x40;
+			b->agc_step = AGC_STEP_RUN;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t sim_agc_status(struct sim_board_s *b) {
+	struct timespec t;
+	long elapsed_ms;
+	uint8_t status;
+	int i;
+
+	if (b->agc_fw != FW_CAL) {
+		return b->agc_status;
+	}
+	if (b->cal_started == false) {
+		return 0x00;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	elapsed_ms = (t.tv_sec - b->cal_t0.tv_sec) * 1000 + (t.tv_nsec - b->cal_t0.tv_nsec) / 1000000;
+	if (elapsed_ms < (long)b->cal_time_ms) {
+		return 0x01; /* registers accessible, calibration running */
+	}
+
+	/* calibration finished: every requested step succeeds */
+	status = 0x81;
+	status |= (b->cal_cmd & 0x01) ? 0x0A : 0x00;
+	status |= (b->cal_cmd & 0x02) ? 0x14 : 0x00;
+	status |= (b->cal_cmd & 0x04) ? 0x20 : 0x00;
+	status |= (b->cal_cmd & 0x08) ? 0x40 : 0x00;
+	if (b->agc_status != status) {
+		/* TX DC offsets for mixer gain 8 to 15, radio A I/Q then radio B I/Q */
+		for (i=0; i<8; ++i) {
+			b->ram[MCU_AGC][0xA0+i] = (uint8_t)(i + 1);
+			b->ram[MCU_AGC][0xA8+i] = (uint8_t)(-(i + 1));
+			b->ram[MCU_AGC][0xB0+i] = (uint8_t)(i + 9);
+			b->ram[MCU_AGC][0xB8+i] = (uint8_t)(-(i + 9));
+		}
+		/* RX image rejection coefficients */
+		if ((b->cal_cmd & 0x01) != 0) {
+			b->paged[0][loregs[LGW_IQ_MISMATCH_A_AMP_COEFF].addr] = 0x05;
+			b->paged[0][loregs[LGW_IQ_MISMATCH_A_PHI_COEFF].addr] = 0x3A;
+		}
+		if ((b->cal_cmd & 0x02) != 0) {
+			b->paged[0][loregs[LGW_IQ_MISMATCH_B_AMP_COEFF].addr] = 0x47; /* SEL_I in bit 6 */
+			b->paged[0][loregs[LGW_IQ_MISMATCH_B_PHI_COEFF].addr] = 0x03;
+		}
+		b->agc_status = status;
+	}
+	return status;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SX125x SPI master transaction, on rising edge of chip select */
+static void sim_radio_spi(struct sim_board_s *b, int rf_chain) {
+	uint8_t *regs = &b->paged[2][(rf_chain == 0) ? ADDR_RADIO_A_DATA : ADDR_RADIO_B_DATA];
+	uint8_t addr = regs[2];
+
+	if ((addr & 0x80) != 0) {
+		b->radio[rf_chain][addr & 0x7F] = regs[0];
+		return;
+	}
+	switch (addr) {
+		case 0x07: /* version */
+			regs[1] = SX1257_VERSION;
+			break;
+		case 0x11: /* status, PLL locks as soon as RX is enabled */
+			regs[1] = ((b->radio[rf_chain][0x00] & 0x03) == 0x03) ? 0x02 : 0x00;
+			break;
+		default:
+			regs[1] = b->radio[rf_chain][addr & 0x7F];
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void sim_write(struct sim_board_s *b, uint8_t addr, uint8_t data) {
+	uint8_t *p;
+	uint8_t old;
+
+	addr &= 0x7F;
+	if ((addr < 33) || (addr > 124)) {
+		p = &b->common[addr];
+	} else {
+		p = &b->paged[b->page][addr];
+	}
+	old = *p;
+
+	if ((addr < 33) || (addr > 124)) {
+		switch (addr) {
+			case ADDR_PAGE:
+				if ((data & 0x80) != 0) {
+					sim_soft_reset(b);
+				}
+				b->page = data & 0x03;
+				b->common[ADDR_PAGE] = b->page;
+				return;
+			case ADDR_RX_BUF_ADDR:
+			case ADDR_RX_BUF_ADDR+1:
+				*p = data;
+				b->rx_rd = (b->common[ADDR_RX_BUF_ADDR] | (b->common[ADDR_RX_BUF_ADDR+1] << 8)) % LGW_DATABUFF_SIZE;
+				return;
+			case ADDR_TX_BUF_ADDR:
+				b->tx_ptr = data;
+				break;
+			case ADDR_TX_BUF_DATA:
+				b->tx_buf[b->tx_ptr % SIM_TX_BUF_SIZE] = data;
+				b->tx_ptr += 1;
+				return;
+			case ADDR_PROM_ADDR:
+				b->prom_ptr = data;
+				b->prom_primed = false;
+				break;
+			case ADDR_PROM_DATA: /* to the program RAM of every MCU whose mux is switched to SPI, both after a reset */
+				if ((b->paged[0][ADDR_MCU_CTRL] & 0x04) == 0) {
+					b->prom[MCU_ARB][b->prom_ptr % MCU_ARB_FW_BYTE] = data;
+				}
+				if ((b->paged[0][ADDR_MCU_CTRL] & 0x08) == 0) {
+					b->prom[MCU_AGC][b->prom_ptr % MCU_AGC_FW_BYTE] = data;
+				}
+				b->prom_ptr += 1;
+				return;
+			case ADDR_FIFO_NUM: /* any write frees the packet at the head of the FIFO */
+				if (b->rx_nb > 0) {
+					b->rx_head = (b->rx_head + 1) % LGW_PKT_FIFO_SIZE;
+					b->rx_nb -= 1;
+					if (b->rx_nb > 0) {
+						b->rx_rd = b->rx_fifo[b->rx_head].addr;
+					}
+				}
+				return;
+			case ADDR_EMERGENCY:
+				if ((b->agc_fw == FW_CAL) && (b->cal_started == false) && ((data & 0x01) == 0) && (b->page == 3)) {
+					b->cal_started = true;
+					clock_gettime(CLOCK_MONOTONIC, &b->cal_t0);
+				}
+				break;
+			default:
+				break;
+		}
+		*p = data;
+		return;
+	}
+
+	*p = data;
+	switch (b->page) {
+		case 0:
+			if (addr == ADDR_MCU_CTRL) {
+				sim_mcu_ctrl(b, old, data);
+			} else if (addr == ADDR_RADIO_SELECT) {
+				sim_agc_command(b, data);
+			}
+			break;
+		case 1:
+			if (addr == ADDR_TX_TRIG) {
+				if (data == 0) {
+					b->tx_state = TX_STATE_FREE; /* abort */
+				} else if (((old & 0x07) == 0) && ((data & 0x07) != 0)) {
+					sim_tx_trigger(b, data);
+				}
+			}
+			break;
+		case 2:
+			if ((addr == loregs[LGW_GPS_EN].addr) && ((old & 0x01) == 0) && ((data & 0x01) != 0)) {
+				b->gps_en_cnt = sim_count(b); /* the timestamp stops following the counter */
+			} else if ((addr == ADDR_RADIO_A_DATA + 4) && ((old & 0x01) == 0) && ((data & 0x01) != 0)) {
+				sim_radio_spi(b, 0);
+			} else if ((addr == ADDR_RADIO_B_DATA + 4) && ((old & 0x01) == 0) && ((data & 0x01) != 0)) {
+				sim_radio_spi(b, 1);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t sim_read(struct sim_board_s *b, uint8_t addr) {
+	struct sim_fifo_s *f = &b->rx_fifo[b->rx_head];
+	uint8_t data;
+	uint32_t now;
+
+	addr &= 0x7F;
+	if ((addr < 33) || (addr > 124)) {
+		switch (addr) {
+			case ADDR_RX_BUF_DATA:
+				data = b->rx_buf[b->rx_rd];
+				b->rx_rd = (b->rx_rd + 1) % LGW_DATABUFF_SIZE;
+				return data;
+			case ADDR_CAPTURE_DATA:
+				return 0;
+			case ADDR_PROM_DATA:
+				if (b->prom_primed == false) {
+					b->prom_primed = true;
+					return 0;
+				}
+				/* the arbiter program RAM when both muxes are on SPI, where the HAL loads and checks it */
+				if ((b->paged[0][ADDR_MCU_CTRL] & 0x04) == 0) {
+					data = b->prom[MCU_ARB][b->prom_ptr % MCU_ARB_FW_BYTE];
+				} else if ((b->paged[0][ADDR_MCU_CTRL] & 0x08) == 0) {
+					data = b->prom[MCU_AGC][b->prom_ptr % MCU_AGC_FW_BYTE];
+				} else {
+					data = 0;
+				}
+				b->prom_ptr += 1;
+				return data;
+			case ADDR_FIFO_NUM:
+				return (uint8_t)b->rx_nb;
+			case ADDR_FIFO_NUM+1:
+				return (b->rx_nb > 0) ? (uint8_t)f->addr : 0;
+			case ADDR_FIFO_NUM+2:
+				return (b->rx_nb > 0) ? (uint8_t)(f->addr >> 8) : 0;
+			case ADDR_FIFO_NUM+3:
+				return (b->rx_nb > 0) ? f->status : 0;
+			case ADDR_FIFO_NUM+4:
+				return (b->rx_nb > 0) ? f->size : 0;
+			case ADDR_AGC_STATUS:
+				return sim_agc_status(b);
+			default:
+				return b->common[addr];
+		}
+	}
+
+	if ((b->page == 1) && (addr == ADDR_TX_STATUS)) {
+		sim_tx_update(b);
+		switch (b->tx_state) {
+			case TX_STATE_FREE: return 0x80;
+			case TX_STATE_EMITTING: return 0xB0;
+			default: return 0x90; /* programmed, waiting for trigger */
+		}
+	} else if ((b->page == 2) && (addr == ADDR_AGC_RAM_DATA)) {
+		return b->ram[MCU_AGC][b->paged[2][ADDR_AGC_RAM_ADDR]];
+	} else if ((b->page == 2) && (addr == ADDR_ARB_RAM_DATA)) {
+		return b->ram[MCU_ARB][b->paged[2][ADDR_ARB_RAM_ADDR]];
+	} else if ((b->page == 2) && (addr >= ADDR_TIMESTAMP) && (addr < ADDR_TIMESTAMP + 4)) {
+		if (addr == ADDR_TIMESTAMP) {
+			/* latched when the LSB is read, so that a burst read is coherent */
+			now = sim_count(b);
+			if ((b->paged[2][loregs[LGW_GPS_EN].addr] & 0x01) != 0) {
+				/* counter value at last PPS, or when the capture was enabled if later */
+				now = ((now - b->gps_en_cnt) < (now % 1000000)) ? b->gps_en_cnt : now - (now % 1000000);
+			}
+			b->timestamp_latch = now;
+		}
+		return (uint8_t)(b->timestamp_latch >> (8 * (addr - ADDR_TIMESTAMP)));
+	}
+	return b->paged[b->page][addr];
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+/* SPI initialization and configuration */
+int lgw_spi_open(void **spi_target_ptr) {
+	return lgw_spi_open_dev(spi_target_ptr, NULL);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_open_dev(void **spi_target_ptr, const char *dev) {
+	struct sim_board_s *b;
+	int board = sim_board_sel;
+	char *end;
+
+	/* check input variables */
+	CHECK_NULL(spi_target_ptr); /* cannot be null, must point on a void pointer (*spi_target_ptr can be null) */
+	if (dev != NULL) {
+		board = (int)strtol(dev, &end, 10);
+		if ((end == dev) || (*end != '\0') || (board < 0) || (board >= LGW_SIM_BOARD_NB)) {
+			DEBUG_PRINTF("ERROR: %s IS NOT A SIMULATED BOARD NUMBER\n", dev);
+			return LGW_SPI_ERROR;
+		}
+	}
+
+	sim_init();
+	b = &sim_boards[board];
+
+	/* the simulated board is powered on the first time it is opened, its state then survives close/open */
+	pthread_mutex_lock(&b->mx);
+	if (b->powered == false) {
+		sim_power_on(b);
+	}
+	pthread_mutex_unlock(&b->mx);
+
+	*spi_target_ptr = (void *)b;
+	DEBUG_PRINTF("Note: simulated concentrator #%d opened\n", board);
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI clock and burst chunk size */
+int lgw_spi_setconf(void *spi_target, struct lgw_spi_conf_s conf) {
+	/* check input variables */
+	if ((conf.speed_hz != 0) && ((conf.speed_hz < LGW_SPI_SPEED_MIN) || (conf.speed_hz > LGW_SPI_SPEED_MAX))) {
+		DEBUG_PRINTF("ERROR: SPI CLOCK %u HZ OUT OF RANGE\n", conf.speed_hz);
+		return LGW_SPI_ERROR;
+	}
+	if ((conf.chunk_size != 0) && ((conf.chunk_size < LGW_BURST_CHUNK_MIN) || (conf.chunk_size > LGW_BURST_CHUNK_MAX))) {
+		DEBUG_PRINTF("ERROR: CHUNK SIZE %u OUT OF RANGE\n", conf.chunk_size);
+		return LGW_SPI_ERROR;
+	}
+
+	(void)spi_target; /* same settings for all the simulated links */
+	if (conf.speed_hz != 0) {
+		sim_spi_speed = conf.speed_hz;
+	}
+	if (conf.chunk_size != 0) {
+		sim_spi_chunk = conf.chunk_size;
+	}
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_getconf(struct lgw_spi_conf_s *conf) {
+	CHECK_NULL(conf);
+	conf->speed_hz = sim_spi_speed;
+	conf->chunk_size = sim_spi_chunk;
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SPI release */
+int lgw_spi_close(void *spi_target) {
+	/* check input variables */
+	CHECK_NULL(spi_target);
+
+	DEBUG_MSG("Note: simulated concentrator closed\n");
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Simple write */
+int lgw_spi_w(void *spi_target, uint8_t address, uint8_t data) {
+	struct sim_board_s *b = (struct sim_board_s *)spi_target;
+
+	/* check input variables */
+	CHECK_NULL(spi_target);
+	if ((address & 0x80) != 0) {
+		DEBUG_MSG("WARNING: SPI address > 127\n");
+	}
+
+	pthread_mutex_lock(&b->mx);
+	sim_write(b, address, data);
+	b->cnt.spi_w += 1;
+	b->cnt.bytes_w += 1;
+	pthread_mutex_unlock(&b->mx);
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Simple read */
+int lgw_spi_r(void *spi_target, uint8_t address, uint8_t *data) {
+	struct sim_board_s *b = (struct sim_board_s *)spi_target;
+
+	/* check input variables */
+	CHECK_NULL(spi_target);
+	if ((address & 0x80) != 0) {
+		DEBUG_MSG("WARNING: SPI address > 127\n");
+	}
+	CHECK_NULL(data);
+
+	pthread_mutex_lock(&b->mx);
+	*data = sim_read(b, address);
+	b->cnt.spi_r += 1;
+	b->cnt.bytes_r += 1;
+	pthread_mutex_unlock(&b->mx);
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Burst (multiple-byte) write */
+int lgw_spi_wb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size) {
+	struct sim_board_s *b = (struct sim_board_s *)spi_target;
+	bool data_port;
+	int i;
+
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	if ((address & 0x80) != 0) {
+		DEBUG_MSG("WARNING: SPI address > 127\n");
+	}
+	CHECK_NULL(data);
+	if (size == 0) {
+		DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+		return LGW_SPI_ERROR;
+	}
+
+	/* data ports keep the same address, other registers auto-increment */
+	data_port = (address == ADDR_RX_BUF_DATA) || (address == ADDR_TX_BUF_DATA) || (address == ADDR_CAPTURE_DATA) || (address == ADDR_PROM_DATA);
+	pthread_mutex_lock(&b->mx);
+	for (i=0; i<size; ++i) {
+		sim_write(b, data_port ? address : (uint8_t)(address + i), data[i]);
+	}
+	b->cnt.spi_wb += 1;
+	b->cnt.spi_chunks += (size + sim_spi_chunk - 1) / sim_spi_chunk;
+	b->cnt.bytes_w += size;
+	pthread_mutex_unlock(&b->mx);
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Multiple write, frames are applied in order as one transaction */
+int lgw_spi_wm(void *spi_target, uint8_t *address, uint16_t *size, uint8_t *data, uint16_t nb) {
+	struct sim_board_s *b = (struct sim_board_s *)spi_target;
+	bool data_port;
+	int offset = 0;
+	int i, j;
+
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	CHECK_NULL(address);
+	CHECK_NULL(size);
+	CHECK_NULL(data);
+	if ((nb == 0) || (nb > LGW_SPI_WM_MAX)) {
+		DEBUG_MSG("ERROR: INVALID NUMBER OF FRAMES\n");
+		return LGW_SPI_ERROR;
+	}
+	for (i=0; i<nb; ++i) {
+		if ((size[i] == 0) || (size[i] > LGW_BURST_CHUNK)) {
+			DEBUG_MSG("ERROR: INVALID FRAME SIZE\n");
+			return LGW_SPI_ERROR;
+		}
+	}
+
+	pthread_mutex_lock(&b->mx);
+	for (i=0; i<nb; ++i) {
+		data_port = (address[i] == ADDR_RX_BUF_DATA) || (address[i] == ADDR_TX_BUF_DATA) || (address[i] == ADDR_CAPTURE_DATA) || (address[i] == ADDR_PROM_DATA);
+		for (j=0; j<size[i]; ++j) {
+			sim_write(b, data_port ? address[i] : (uint8_t)(address[i] + j), data[offset + j]);
+		}
+		offset += size[i];
+	}
+	b->cnt.spi_wm += 1;
+	b->cnt.wm_frames += nb;
+	b->cnt.bytes_w += offset;
+	pthread_mutex_unlock(&b->mx);
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Burst (multiple-byte) read */
+int lgw_spi_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size) {
+	struct sim_board_s *b = (struct sim_board_s *)spi_target;
+	bool data_port;
+	int i;
+
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	if ((address & 0x80) != 0) {
+		DEBUG_MSG("WARNING: SPI address > 127\n");
+	}
+	CHECK_NULL(data);
+	if (size == 0) {
+		DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+		return LGW_SPI_ERROR;
+	}
+
+	data_port = (address == ADDR_RX_BUF_DATA) || (address == ADDR_TX_BUF_DATA) || (address == ADDR_CAPTURE_DATA) || (address == ADDR_PROM_DATA);
+	pthread_mutex_lock(&b->mx);
+	for (i=0; i<size; ++i) {
+		data[i] = sim_read(b, data_port ? address : (uint8_t)(address + i));
+	}
+	b->cnt.spi_rb += 1;
+	b->cnt.spi_chunks += (size + sim_spi_chunk - 1) / sim_spi_chunk;
+	b->cnt.bytes_r += size;
+	pthread_mutex_unlock(&b->mx);
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Interrupt wait, the line is high while the RX FIFO is not empty */
+int lgw_spi_irq_wait(void *spi_target, uint32_t timeout_ms) {
+	struct sim_board_s *b = (struct sim_board_s *)spi_target;
+	struct timespec deadline;
+	int i = 0;
+
+	/* check input variables */
+	CHECK_NULL(spi_target);
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec += 1;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&b->mx);
+	if (b->irq_line == false) {
+		pthread_mutex_unlock(&b->mx);
+		return LGW_SPI_ERROR;
+	}
+	while ((b->rx_nb == 0) && (i == 0)) {
+		i = pthread_cond_timedwait(&b->irq_cv, &b->mx, &deadline);
+	}
+	i = (b->rx_nb > 0) ? LGW_SPI_SUCCESS : LGW_SPI_TIMEOUT;
+	pthread_mutex_unlock(&b->mx);
+	return i;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_select(int board) {
+	CHECK_BOARD(board);
+	sim_board_sel = board;
+	return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_power_cycle(int board) {
+	CHECK_BOARD(board);
+	sim_init();
+	pthread_mutex_lock(&sim_boards[board].mx);
+	sim_power_on(&sim_boards[board]);
+	pthread_mutex_unlock(&sim_boards[board].mx);
+	return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_set_irq(int board, bool enable) {
+	CHECK_BOARD(board);
+	sim_init();
+	pthread_mutex_lock(&sim_boards[board].mx);
+	sim_boards[board].irq_line = enable;
+	pthread_mutex_unlock(&sim_boards[board].mx);
+	return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_set_cal_time(int board, unsigned cal_time_ms) {
+	CHECK_BOARD(board);
+	sim_init();
+	pthread_mutex_lock(&sim_boards[board].mx);
+	sim_boards[board].cal_time_ms = cal_time_ms;
+	pthread_mutex_unlock(&sim_boards[board].mx);
+	return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t lgw_sim_get_count(int board) {
+	uint32_t now;
+
+	if ((board < 0) || (board >= LGW_SIM_BOARD_NB) || (sim_boards[board].powered == false)) {
+		return 0;
+	}
+	pthread_mutex_lock(&sim_boards[board].mx);
+	now = sim_count(&sim_boards[board]);
+	pthread_mutex_unlock(&sim_boards[board].mx);
+	return now;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_inject_rx(int board, const struct lgw_sim_rx_s *pkt) {
+	const uint8_t ifmod_config[LGW_IF_CHAIN_NB] = LGW_IFMODEM_CONFIG;
+	struct sim_board_s *b;
+	struct sim_fifo_s *f;
+	uint8_t meta[RX_METADATA_NB];
+	int sf, i;
+	int used;
+	float raw_rssi;
+	uint32_t ts;
+
+	CHECK_BOARD(board);
+	if ((pkt == NULL) || (pkt->if_chain >= LGW_IF_CHAIN_NB) || (pkt->size > 255)) {
+		return LGW_SIM_ERROR;
+	}
+	b = &sim_boards[board];
+	if (b->powered == false) {
+		return LGW_SIM_ERROR;
+	}
+
+	/* the demodulators only receive what they are configured for */
+	switch (pkt->datarate) {
+		case DR_LORA_SF7: sf = 7; break;
+		case DR_LORA_SF8: sf = 8; break;
+		case DR_LORA_SF9: sf = 9; break;
+		case DR_LORA_SF10: sf = 10; break;
+		case DR_LORA_SF11: sf = 11; break;
+		case DR_LORA_SF12: sf = 12; break;
+		default: sf = 0;
+	}
+	pthread_mutex_lock(&b->mx);
+	switch (ifmod_config[pkt->if_chain]) {
+		case IF_LORA_MULTI:
+			if ((pkt->bandwidth != BW_125KHZ) || ((sim_field(b, LGW_CORR0_DETECT_EN + pkt->if_chain) & pkt->datarate) == 0)) {
+				DEBUG_MSG("WARNING: simulated packet not matching LoRa multi-SF modem configuration\n");
+				pthread_mutex_unlock(&b->mx);
+				return LGW_SIM_ERROR;
+			}
+			raw_rssi = pkt->rssi - LGW_SIM_RSSI_OFFSET - 35.0; /* RSSI_MULTI_BIAS */
+			break;
+		case IF_LORA_STD:
+			if ((sim_field(b, LGW_MBWSSF_MODEM_ENABLE) == 0) || ((int)sim_field(b, LGW_MBWSSF_RATE_SF) != sf) || (sim_field(b, LGW_MBWSSF_MODEM_BW) != (uint32_t)((pkt->bandwidth == BW_125KHZ) ? 0 : ((pkt->bandwidth == BW_250KHZ) ? 1 : 2)))) {
+				DEBUG_MSG("WARNING: simulated packet not matching LoRa stand-alone modem configuration\n");
+				pthread_mutex_unlock(&b->mx);
+				return LGW_SIM_ERROR;
+			}
+			raw_rssi = pkt->rssi - LGW_SIM_RSSI_OFFSET;
+			break;
+		case IF_FSK_STD:
+			sf = 0;
+			raw_rssi = (pkt->rssi + 70.0) / 0.8 - 70.0 - LGW_SIM_RSSI_OFFSET - 37.0; /* inverse of FSK RSSI linearization */
+			break;
+		default:
+			pthread_mutex_unlock(&b->mx);
+			return LGW_SIM_ERROR;
+	}
+
+	/* check room in FIFO and data buffer */
+	used = 0;
+	if (b->rx_nb > 0) {
+		used = (b->rx_wr + LGW_DATABUFF_SIZE - b->rx_fifo[b->rx_head].addr) % LGW_DATABUFF_SIZE;
+	}
+	if ((b->rx_nb >= LGW_PKT_FIFO_SIZE) || ((used + pkt->size + RX_METADATA_NB) > LGW_DATABUFF_SIZE)) {
+		b->cnt.rx_dropped += 1;
+		pthread_mutex_unlock(&b->mx);
+		return LGW_SIM_ERROR;
+	}
+
+	/* metadata layout, as decoded by lgw_receive */
+	memset(meta, 0, sizeof(meta));
+	meta[0] = pkt->if_chain;
+	meta[1] = (uint8_t)((sf << 4) | ((pkt->coderate & 0x07) << 1));
+	meta[2] = (uint8_t)(int8_t)lroundf(pkt->snr * 4);
+	meta[3] = (uint8_t)(int8_t)lroundf(pkt->snr_min * 4);
+	meta[4] = (uint8_t)(int8_t)lroundf(pkt->snr_max * 4);
+	meta[5] = (uint8_t)((raw_rssi < 0) ? 0 : ((raw_rssi > 255) ? 255 : lroundf(raw_rssi)));
+	ts = (pkt->count_us != 0) ? pkt->count_us : sim_count(b);
+	meta[6] = (uint8_t)ts;
+	meta[7] = (uint8_t)(ts >> 8);
+	meta[8] = (uint8_t)(ts >> 16);
+	meta[9] = (uint8_t)(ts >> 24);
+	meta[10] = (uint8_t)pkt->crc;
+	meta[11] = (uint8_t)(pkt->crc >> 8);
+
+	f = &b->rx_fifo[(b->rx_head + b->rx_nb) % LGW_PKT_FIFO_SIZE];
+	f->addr = b->rx_wr;
+	f->size = (uint8_t)pkt->size;
+	switch (pkt->status) {
+		case STAT_CRC_OK: f->status = 5; break;
+		case STAT_CRC_BAD: f->status = 7; break;
+		case STAT_NO_CRC: f->status = 1; break;
+		default: f->status = 0;
+	}
+	for (i=0; i<pkt->size; ++i) {
+		b->rx_buf[b->rx_wr] = pkt->payload[i];
+		b->rx_wr = (b->rx_wr + 1) % LGW_DATABUFF_SIZE;
+	}
+	for (i=0; i<RX_METADATA_NB; ++i) {
+		b->rx_buf[b->rx_wr] = meta[i];
+		b->rx_wr = (b->rx_wr + 1) % LGW_DATABUFF_SIZE;
+	}
+	if (b->rx_nb == 0) {
+		b->rx_rd = f->addr; /* data port points to the head of the FIFO */
+	}
+	b->rx_nb += 1;
+	b->cnt.rx_injected += 1;
+	pthread_cond_broadcast(&b->irq_cv); /* raise the interrupt line */
+	pthread_mutex_unlock(&b->mx);
+	return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_rx_pending(int board) {
+	int n;
+
+	CHECK_BOARD(board);
+	pthread_mutex_lock(&sim_boards[board].mx);
+	n = sim_boards[board].rx_nb;
+	pthread_mutex_unlock(&sim_boards[board].mx);
+	return n;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_tx_count(int board) {
+	int n;
+
+	CHECK_BOARD(board);
+	pthread_mutex_lock(&sim_boards[board].mx);
+	n = sim_boards[board].tx_nb;
+	pthread_mutex_unlock(&sim_boards[board].mx);
+	return n;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_get_tx(int board, int index, struct lgw_sim_tx_s *tx) {
+	struct sim_board_s *b;
+
+	CHECK_BOARD(board);
+	if (tx == NULL) {
+		return LGW_SIM_ERROR;
+	}
+	b = &sim_boards[board];
+	pthread_mutex_lock(&b->mx);
+	if ((index < 0) || (index >= b->tx_nb) || (index < (b->tx_nb - LGW_SIM_TX_LOG_NB))) {
+		pthread_mutex_unlock(&b->mx);
+		return LGW_SIM_ERROR;
+	}
+	*tx = b->tx_log[index % LGW_SIM_TX_LOG_NB];
+	pthread_mutex_unlock(&b->mx);
+	return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_get_counters(int board, struct lgw_sim_counters_s *cnt) {
+	CHECK_BOARD(board);
+	if (cnt == NULL) {
+		return LGW_SIM_ERROR;
+	}
+	pthread_mutex_lock(&sim_boards[board].mx);
+	*cnt = sim_boards[board].cnt;
+	pthread_mutex_unlock(&sim_boards[board].mx);
+	return LGW_SIM_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sim_reset_counters(int board) {
+	CHECK_BOARD(board);
+	pthread_mutex_lock(&sim_boards[board].mx);
+	memset(&sim_boards[board].cnt, 0, sizeof(sim_boards[board].cnt));
+	pthread_mutex_unlock(&sim_boards[board].mx);
+	return LGW_SIM_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,223 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Streaming statistics, Welford mean and variance and P-square percentiles
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdio.h>		/* printf fprintf */
+#include <string.h>		/* memset */
+#include <math.h>		/* sqrt NAN */
+
+#include "loragw_stat.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_AUX == 1
+	#define DEBUG_MSG(str)				fprintf(stderr, str)
+	#define DEBUG_PRINTF(fmt, args...)	fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+	#define CHECK_NULL(a)				if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_STAT_ERROR;}
+#else
+	#define DEBUG_MSG(str)
+	#define DEBUG_PRINTF(fmt, args...)
+	#define CHECK_NULL(a)				if(a==NULL){return LGW_STAT_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+static const double stat_p[LGW_STAT_QUANT_NB] = {0.05, 0.5, 0.95};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+void p2_init(struct lgw_p2_s *p2, double p);
+
+void p2_add(struct lgw_p2_s *p2, uint32_t nb, double x);
+
+double p2_adjust(const struct lgw_p2_s *p2, int i, int d);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+void p2_init(struct lgw_p2_s *p2, double p) {
+	int i;
+
+	memset(p2, 0, sizeof *p2);
+	p2->p = p;
+	for (i = 0; i < 5; ++i) {
+		p2->n[i] = i;
+	}
+	p2->np[0] = 0.0;
+	p2->np[1] = 2.0 * p;
+	p2->np[2] = 4.0 * p;
+	p2->np[3] = 2.0 + 2.0 * p;
+	p2->np[4] = 4.0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* x is the value number nb (from 0) */
+void p2_add(struct lgw_p2_s *p2, uint32_t nb, double x) {
+	const double dn[5] = {0.0, p2->p / 2.0, p2->p, (1.0 + p2->p) / 2.0, 1.0};
+	double *q = p2->q;
+	uint32_t *n = p2->n;
+	double d, qp;
+	int i, k;
+
+	/* the first 5 values are the initial markers, kept sorted */
+	if (nb < 5) {
+		for (i = (int)nb; (i > 0) && (q[i - 1] > x); --i) {
+			q[i] = q[i - 1];
+		}
+		q[i] = x;
+		return;
+	}
+
+	/* cell of x, the extreme markers follow the min and max */
+	if (x < q[0]) {
+		q[0] = x;
+		k = 0;
+	} else if (x >= q[4]) {
+		q[4] = x;
+		k = 3;
+	} else {
+		for (k = 0; x >= q[k + 1]; ++k);
+	}
+	for (i = k + 1; i < 5; ++i) {
+		n[i] += 1;
+	}
+	for (i = 0; i < 5; ++i) {
+		p2->np[i] += dn[i];
+	}
+
+	/* move the middle markers that are one position off or more */
+	for (i = 1; i < 4; ++i) {
+		d = p2->np[i] - n[i];
+		if (((d >= 1.0) && (n[i + 1] - n[i] > 1)) || ((d <= -1.0) && (n[i] - n[i - 1] > 1))) {
+			k = (d > 0.0) ? 1 : -1;
+			qp = p2_adjust(p2, i, k);
+			if ((q[i - 1] < qp) && (qp < q[i + 1])) {
+				q[i] = qp; /* parabolic */
+			} else {
+				q[i] += k * (q[i + k] - q[i]) / ((double)n[i + k] - n[i]); /* linear */
+			}
+			n[i] += k;
+		}
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* piecewise-parabolic prediction of marker i moved by d (+1 or -1) */
+double p2_adjust(const struct lgw_p2_s *p2, int i, int d) {
+	const double *q = p2->q;
+	double n0 = p2->n[i - 1], n1 = p2->n[i], n2 = p2->n[i + 1];
+
+	return q[i] + d / (n2 - n0) * ((n1 - n0 + d) * (q[i + 1] - q[i]) / (n2 - n1) + (n2 - n1 - d) * (q[i] - q[i - 1]) / (n1 - n0));
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_stat_init(struct lgw_stat_s *stat) {
+	int i;
+
+	CHECK_NULL(stat);
+	stat->nb = 0;
+	stat->mean = 0.0;
+	stat->m2 = 0.0;
+	stat->min = NAN;
+	stat->max = NAN;
+	for (i = 0; i < LGW_STAT_QUANT_NB; ++i) {
+		p2_init(&stat->quant[i], stat_p[i]);
+	}
+	return LGW_STAT_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_stat_add(struct lgw_stat_s *stat, double x) {
+	double d;
+	int i;
+
+	CHECK_NULL(stat);
+	if (stat->nb == UINT32_MAX) {
+		DEBUG_MSG("ERROR: TOO MANY VALUES\n");
+		return LGW_STAT_ERROR;
+	}
+	for (i = 0; i < LGW_STAT_QUANT_NB; ++i) {
+		p2_add(&stat->quant[i], stat->nb, x);
+	}
+
+	/* Welford, no cancellation between two large sums */
+	stat->nb += 1;
+	d = x - stat->mean;
+	stat->mean += d / stat->nb;
+	stat->m2 += d * (x - stat->mean);
+	if ((stat->nb == 1) || (x < stat->min)) {
+		stat->min = x;
+	}
+	if ((stat->nb == 1) || (x > stat->max)) {
+		stat->max = x;
+	}
+	return LGW_STAT_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+double lgw_stat_mean(const struct lgw_stat_s *stat) {
+	if ((stat == NULL) || (stat->nb == 0)) {
+		return NAN;
+	}
+	return stat->mean;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+double lgw_stat_sd(const struct lgw_stat_s *stat) {
+	if ((stat == NULL) || (stat->nb == 0)) {
+		return NAN;
+	}
+	return sqrt(stat->m2 / stat->nb);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+double lgw_stat_quantile(const struct lgw_stat_s *stat, int i) {
+	const struct lgw_p2_s *p2;
+	double r;
+	int k;
+
+	if ((stat == NULL) || (stat->nb == 0) || (i < 0) || (i >= LGW_STAT_QUANT_NB)) {
+		return NAN;
+	}
+	p2 = &stat->quant[i];
+	if (stat->nb > 5) {
+		return p2->q[2];
+	}
+
+	/* few values, interpolate between them */
+	r = p2->p * (stat->nb - 1);
+	k = (int)r;
+	if (k >= (int)stat->nb - 1) {
+		return p2->q[stat->nb - 1];
+	}
+	return p2->q[k] + (r - k) * (p2->q[k + 1] - p2->q[k]);
+}
+
+/* --- EOF ------------------------------------------------------------------ */
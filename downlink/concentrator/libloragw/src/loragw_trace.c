@@ -0,0 +1,797 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	SPI trace record and replay
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* printf fprintf fopen fwrite */
+#include <stdlib.h>		/* malloc free */
+#include <string.h>		/* memcmp memcpy memset */
+#include <time.h>		/* clock_gettime time gmtime strftime */
+#include <pthread.h>	/* pthread_mutex pthread_self */
+#include <fcntl.h>		/* open */
+#include <unistd.h>		/* close */
+#include <sys/mman.h>	/* mmap munmap */
+#include <sys/stat.h>	/* fstat */
+
+#include "loragw_trace.h"
+#include "loragw_spi.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_SPI == 1
+	#define DEBUG_MSG(str)				fprintf(stderr, str)
+	#define DEBUG_PRINTF(fmt, args...)	fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+	#define CHECK_NULL(a)				if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_TRACE_ERROR;}
+#else
+	#define DEBUG_MSG(str)
+	#define DEBUG_PRINTF(fmt, args...)
+	#define CHECK_NULL(a)				if(a==NULL){return LGW_TRACE_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+/*
+File format, all integers little-endian:
+	header: "LGWT", version (1 byte), 3 reserved bytes, start time (8 bytes, seconds since the Epoch)
+	record: operation (bits 0-3), thread (bits 4-6), backend error (bit 7),
+		microseconds since the previous record (varint), then:
+	W, R	address, data byte
+	WB, RB	address, size (varint), data
+	WM		number of frames (varint), address and size (varint) of each frame, data of all frames
+	IRQ		timeout in ms (varint), result (0: interrupt, 1: timeout, 2: no interrupt line)
+	OPEN, CLOSE	nothing
+Varints are LEB128: 7 bits per byte, least significant first, bit 7 set if more bytes follow.
+*/
+#define TRACE_MAGIC		"LGWT"
+#define TRACE_VERSION	1
+#define TRACE_HDR_SIZE	16
+
+#define TRC_OPEN		1
+#define TRC_CLOSE		2
+#define TRC_W			3
+#define TRC_R			4
+#define TRC_WB			5
+#define TRC_RB			6
+#define TRC_WM			7
+#define TRC_IRQ			8
+
+#define TRC_OP_MASK		0x0F
+#define TRC_STREAM_SHIFT	4
+#define TRC_ERR			0x80
+
+#define TRC_HEAD_MAX	(16 + 4 * LGW_SPI_WM_MAX)	/* operation, time, frame table */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* one decoded record, pointing into the trace buffer */
+struct trace_rec_s {
+	uint8_t			op;
+	uint8_t			stream;
+	bool			err;
+	uint64_t		dt_us;
+	const uint8_t	*head;		/* everything but the data bytes */
+	uint32_t		head_len;
+	const uint8_t	*data;
+	uint32_t		data_len;
+	size_t			len;		/* size of the whole record */
+};
+
+/* position of a record in the replayed trace */
+struct trace_idx_s {
+	size_t		off;
+	uint64_t	t_us;
+	uint32_t	nb;		/* index of the record in the file */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
+
+static int trace_mode = LGW_TRACE_OFF;
+static pthread_mutex_t mx_trace = PTHREAD_MUTEX_INITIALIZER; /* records and replay cursors are shared by the threads using the HAL */
+static struct lgw_trace_stat_s trace_stat = {LGW_TRACE_OFF, 0, 0, 0, -1, 0, 0};
+static bool link_open = false;
+static uint8_t replay_link; /* its address is the SPI target handed to loragw_reg during a replay */
+
+/* recording */
+static FILE *rec_file = NULL;
+static struct timespec rec_start; /* time of the lgw_trace_record call */
+static uint64_t rec_last_us = 0; /* time of the previous record, since rec_start */
+static pthread_t rec_thread[LGW_TRACE_STREAM_NB];
+static int rec_thread_nb = 0;
+
+/* replay, one cursor per recorded thread */
+static uint8_t *rep_buf = NULL;
+static size_t rep_size = 0;
+static struct trace_idx_s *rep_idx[LGW_TRACE_STREAM_NB];
+static uint32_t rep_nb[LGW_TRACE_STREAM_NB];
+static uint32_t rep_cursor[LGW_TRACE_STREAM_NB];
+static bool rep_bound[LGW_TRACE_STREAM_NB];
+static pthread_t rep_thread[LGW_TRACE_STREAM_NB];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+int trace_put_varint(uint8_t *buf, uint64_t v);
+
+bool trace_get_varint(const uint8_t *buf, size_t size, size_t *pos, uint64_t *v);
+
+bool trace_parse(const uint8_t *buf, size_t size, size_t off, struct trace_rec_s *rec);
+
+int trace_load(const char *path, uint8_t **buf, size_t *size);
+
+int trace_stream(void);
+
+void record_xfer(uint8_t op, int spi_stat, const uint8_t *head, uint32_t head_len, const uint8_t *data, uint32_t data_len);
+
+int replay_xfer(uint8_t op, const uint8_t *head, uint32_t head_len, uint8_t *data, uint32_t data_len, bool is_read);
+
+int replay_irq(void);
+
+void replay_free(void);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+int trace_put_varint(uint8_t *buf, uint64_t v) {
+	int n = 0;
+
+	while (v >= 0x80) {
+		buf[n++] = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	buf[n++] = (uint8_t)v;
+	return n;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+bool trace_get_varint(const uint8_t *buf, size_t size, size_t *pos, uint64_t *v) {
+	int shift;
+
+	*v = 0;
+	for (shift = 0; (shift < 64) && (*pos < size); shift += 7) {
+		*v |= (uint64_t)(buf[*pos] & 0x7F) << shift;
+		if ((buf[(*pos)++] & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* decode the record at offset off, false if it is invalid or truncated */
+bool trace_parse(const uint8_t *buf, size_t size, size_t off, struct trace_rec_s *rec) {
+	size_t pos = off;
+	size_t start;
+	uint64_t v, nb, sum;
+
+	if (pos >= size) {
+		return false;
+	}
+	rec->op = buf[pos] & TRC_OP_MASK;
+	rec->stream = (buf[pos] >> TRC_STREAM_SHIFT) & 0x07;
+	rec->err = (buf[pos] & TRC_ERR) != 0;
+	pos += 1;
+	if (trace_get_varint(buf, size, &pos, &rec->dt_us) == false) {
+		return false;
+	}
+
+	start = pos;
+	rec->head = buf + start;
+	switch (rec->op) {
+		case TRC_OPEN:
+		case TRC_CLOSE:
+			sum = 0;
+			break;
+		case TRC_W:
+		case TRC_R:
+			pos += 1;
+			sum = 1;
+			break;
+		case TRC_WB:
+		case TRC_RB:
+			pos += 1;
+			if (trace_get_varint(buf, size, &pos, &sum) == false) {
+				return false;
+			}
+			break;
+		case TRC_WM:
+			if ((trace_get_varint(buf, size, &pos, &nb) == false) || (nb == 0) || (nb > LGW_SPI_WM_MAX)) {
+				return false;
+			}
+			for (sum = 0; nb > 0; --nb) {
+				pos += 1;
+				if (trace_get_varint(buf, size, &pos, &v) == false) {
+					return false;
+				}
+				sum += v;
+			}
+			break;
+		case TRC_IRQ:
+			if (trace_get_varint(buf, size, &pos, &v) == false) {
+				return false;
+			}
+			pos += 1;
+			sum = 0;
+			break;
+		default:
+			return false;
+	}
+	if ((pos > size) || (sum > size - pos)) {
+		return false;
+	}
+	rec->head_len = (uint32_t)(pos - start);
+	rec->data = buf + pos;
+	rec->data_len = (uint32_t)sum;
+	rec->len = pos + sum - off;
+	return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* map a trace file in memory and check its header */
+int trace_load(const char *path, uint8_t **buf, size_t *size) {
+	struct stat st;
+	void *p;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		DEBUG_PRINTF("ERROR: IMPOSSIBLE TO OPEN TRACE FILE %s\n", path);
+		return LGW_TRACE_ERROR;
+	}
+	if ((fstat(fd, &st) != 0) || (st.st_size < TRACE_HDR_SIZE)) {
+		DEBUG_PRINTF("ERROR: %s IS NOT A TRACE FILE\n", path);
+		close(fd);
+		return LGW_TRACE_ERROR;
+	}
+	p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		DEBUG_PRINTF("ERROR: IMPOSSIBLE TO MAP TRACE FILE %s\n", path);
+		return LGW_TRACE_ERROR;
+	}
+	if ((memcmp(p, TRACE_MAGIC, 4) != 0) || (((uint8_t *)p)[4] != TRACE_VERSION)) {
+		DEBUG_PRINTF("ERROR: %s IS NOT A TRACE FILE OR HAS AN UNSUPPORTED VERSION\n", path);
+		munmap(p, (size_t)st.st_size);
+		return LGW_TRACE_ERROR;
+	}
+	*buf = p;
+	*size = (size_t)st.st_size;
+	return LGW_TRACE_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* thread index of the caller while recording, the last one is shared if there are too many threads */
+int trace_stream(void) {
+	pthread_t self = pthread_self();
+	int i;
+
+	for (i = 0; i < rec_thread_nb; ++i) {
+		if (pthread_equal(rec_thread[i], self)) {
+			return i;
+		}
+	}
+	if (rec_thread_nb == LGW_TRACE_STREAM_NB) {
+		return LGW_TRACE_STREAM_NB - 1;
+	}
+	rec_thread[rec_thread_nb] = self;
+	return rec_thread_nb++;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void record_xfer(uint8_t op, int spi_stat, const uint8_t *head, uint32_t head_len, const uint8_t *data, uint32_t data_len) {
+	uint8_t hdr[1 + 10];
+	struct timespec now;
+	uint64_t t;
+	int n;
+
+	pthread_mutex_lock(&mx_trace);
+	if (rec_file == NULL) { /* stopped by another thread */
+		pthread_mutex_unlock(&mx_trace);
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	t = (uint64_t)(now.tv_sec - rec_start.tv_sec) * 1000000 + (now.tv_nsec - rec_start.tv_nsec) / 1000;
+	hdr[0] = op | (uint8_t)(trace_stream() << TRC_STREAM_SHIFT) | ((op != TRC_IRQ) && (spi_stat != LGW_SPI_SUCCESS) ? TRC_ERR : 0);
+	n = 1 + trace_put_varint(hdr + 1, t - rec_last_us);
+	fwrite(hdr, 1, n, rec_file);
+	if (head_len > 0) {
+		fwrite(head, 1, head_len, rec_file);
+	}
+	if (data_len > 0) {
+		fwrite(data, 1, data_len, rec_file);
+	}
+	if (op == TRC_CLOSE) {
+		fflush(rec_file); /* the trace of a session is complete even if the program is killed later */
+	}
+	rec_last_us = t;
+	trace_stat.nb_record += 1;
+	trace_stat.nb_byte += n + head_len + data_len;
+	trace_stat.time_us = t;
+	pthread_mutex_unlock(&mx_trace);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* answer a call with the next matching record of the threads bound to the caller, or of a thread not bound yet */
+int replay_xfer(uint8_t op, const uint8_t *head, uint32_t head_len, uint8_t *data, uint32_t data_len, bool is_read) {
+	pthread_t self = pthread_self();
+	struct trace_rec_s rec;
+	struct trace_idx_s *idx;
+	int pass, s;
+	uint32_t i;
+	int32_t expected = -1;
+
+	pthread_mutex_lock(&mx_trace);
+	for (pass = 0; pass < 2; ++pass) {
+		for (s = 0; s < LGW_TRACE_STREAM_NB; ++s) {
+			if ((pass == 0) != (rep_bound[s] && pthread_equal(rep_thread[s], self))) {
+				continue;
+			}
+			if ((pass == 1) && rep_bound[s]) {
+				continue;
+			}
+			/* interrupt waits the caller did not do are skipped */
+			for (i = rep_cursor[s]; i < rep_nb[s]; ++i) {
+				trace_parse(rep_buf, rep_size, rep_idx[s][i].off, &rec);
+				if ((rec.op != TRC_IRQ) || (op == TRC_IRQ)) {
+					break;
+				}
+			}
+			if (i == rep_nb[s]) {
+				continue;
+			}
+			if ((pass == 0) && (expected < 0)) {
+				expected = (int32_t)rep_idx[s][i].nb;
+			}
+			if ((rec.op != op) || (rec.data_len != data_len)) {
+				continue;
+			}
+			if ((op != TRC_IRQ) && ((rec.head_len != head_len) || (memcmp(rec.head, head, head_len) != 0))) {
+				continue;
+			}
+			if ((is_read == false) && (memcmp(rec.data, data, data_len) != 0)) {
+				continue;
+			}
+
+			/* match */
+			if (is_read) {
+				memcpy(data, rec.data, data_len);
+			}
+			idx = &rep_idx[s][i];
+			rep_cursor[s] = i + 1;
+			rep_bound[s] = true;
+			rep_thread[s] = self;
+			trace_stat.nb_record += 1;
+			if (idx->t_us > trace_stat.time_us) {
+				trace_stat.time_us = idx->t_us;
+			}
+			pthread_mutex_unlock(&mx_trace);
+			if (op == TRC_IRQ) {
+				return (rec.head[rec.head_len - 1] == 0) ? LGW_SPI_SUCCESS : ((rec.head[rec.head_len - 1] == 1) ? LGW_SPI_TIMEOUT : LGW_SPI_ERROR);
+			}
+			return rec.err ? LGW_SPI_ERROR : LGW_SPI_SUCCESS;
+		}
+	}
+
+	if (op == TRC_IRQ) {
+		pthread_mutex_unlock(&mx_trace);
+		return LGW_SPI_TIMEOUT;
+	}
+	DEBUG_PRINTF("WARNING: SPI operation %u at address 0x%02X does not match the trace (expected record %d)\n", op, (head_len > 0) ? head[0] : 0, expected);
+	trace_stat.nb_mismatch += 1;
+	if (trace_stat.first_mismatch < 0) {
+		trace_stat.first_mismatch = expected;
+	}
+	pthread_mutex_unlock(&mx_trace);
+	return LGW_SPI_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int replay_irq(void) {
+	return replay_xfer(TRC_IRQ, NULL, 0, NULL, 0, false);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void replay_free(void) {
+	int s;
+
+	for (s = 0; s < LGW_TRACE_STREAM_NB; ++s) {
+		free(rep_idx[s]);
+		rep_idx[s] = NULL;
+		rep_nb[s] = 0;
+	}
+	if (rep_buf != NULL) {
+		munmap(rep_buf, rep_size);
+		rep_buf = NULL;
+	}
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_trace_record(const char *path) {
+	uint8_t hdr[TRACE_HDR_SIZE];
+	uint64_t t;
+	int i;
+
+	CHECK_NULL(path);
+	if (trace_mode != LGW_TRACE_OFF) {
+		DEBUG_MSG("ERROR: A TRACE IS ALREADY ACTIVE\n");
+		return LGW_TRACE_ERROR;
+	}
+	rec_file = fopen(path, "wb");
+	if (rec_file == NULL) {
+		DEBUG_PRINTF("ERROR: IMPOSSIBLE TO CREATE TRACE FILE %s\n", path);
+		return LGW_TRACE_ERROR;
+	}
+
+	memset(hdr, 0, sizeof hdr);
+	memcpy(hdr, TRACE_MAGIC, 4);
+	hdr[4] = TRACE_VERSION;
+	t = (uint64_t)time(NULL);
+	for (i = 0; i < 8; ++i) {
+		hdr[8 + i] = (uint8_t)(t >> (8 * i));
+	}
+	if (fwrite(hdr, 1, sizeof hdr, rec_file) != sizeof hdr) {
+		DEBUG_PRINTF("ERROR: IMPOSSIBLE TO WRITE TRACE FILE %s\n", path);
+		fclose(rec_file);
+		rec_file = NULL;
+		return LGW_TRACE_ERROR;
+	}
+
+	memset(&trace_stat, 0, sizeof trace_stat);
+	trace_stat.mode = LGW_TRACE_RECORD;
+	trace_stat.first_mismatch = -1;
+	trace_stat.nb_byte = sizeof hdr;
+	rec_thread_nb = 0;
+	rec_last_us = 0;
+	clock_gettime(CLOCK_MONOTONIC, &rec_start);
+	trace_mode = LGW_TRACE_RECORD;
+	return LGW_TRACE_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_trace_replay(const char *path) {
+	struct trace_rec_s rec;
+	uint32_t count[LGW_TRACE_STREAM_NB];
+	uint32_t nb;
+	uint64_t t;
+	size_t off;
+	int s;
+
+	CHECK_NULL(path);
+	if ((trace_mode != LGW_TRACE_OFF) || link_open) {
+		DEBUG_MSG("ERROR: A TRACE IS ALREADY ACTIVE OR THE CONCENTRATOR IS CONNECTED\n");
+		return LGW_TRACE_ERROR;
+	}
+	if (trace_load(path, &rep_buf, &rep_size) != LGW_TRACE_SUCCESS) {
+		return LGW_TRACE_ERROR;
+	}
+
+	/* index the records of each thread, a truncated last record (recording program killed) is ignored */
+	memset(count, 0, sizeof count);
+	for (off = TRACE_HDR_SIZE; trace_parse(rep_buf, rep_size, off, &rec); off += rec.len) {
+		count[rec.stream] += 1;
+	}
+	for (s = 0; s < LGW_TRACE_STREAM_NB; ++s) {
+		rep_idx[s] = malloc((count[s] > 0 ? count[s] : 1) * sizeof(struct trace_idx_s));
+		if (rep_idx[s] == NULL) {
+			DEBUG_MSG("ERROR: NOT ENOUGH MEMORY TO INDEX THE TRACE\n");
+			replay_free();
+			return LGW_TRACE_ERROR;
+		}
+		rep_nb[s] = 0;
+		rep_cursor[s] = 0;
+		rep_bound[s] = false;
+	}
+	nb = 0;
+	t = 0;
+	for (off = TRACE_HDR_SIZE; trace_parse(rep_buf, rep_size, off, &rec); off += rec.len) {
+		t += rec.dt_us;
+		s = rec.stream;
+		rep_idx[s][rep_nb[s]].off = off;
+		rep_idx[s][rep_nb[s]].t_us = t;
+		rep_idx[s][rep_nb[s]].nb = nb++;
+		rep_nb[s] += 1;
+	}
+	if (off != rep_size) {
+		DEBUG_PRINTF("WARNING: %u trailing bytes of %s ignored\n", (unsigned)(rep_size - off), path);
+	}
+
+	memset(&trace_stat, 0, sizeof trace_stat);
+	trace_stat.mode = LGW_TRACE_REPLAY;
+	trace_stat.nb_total = nb;
+	trace_stat.first_mismatch = -1;
+	trace_stat.nb_byte = rep_size;
+	trace_mode = LGW_TRACE_REPLAY;
+	return LGW_TRACE_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_trace_stop(void) {
+	if (trace_mode == LGW_TRACE_RECORD) {
+		pthread_mutex_lock(&mx_trace);
+		fclose(rec_file);
+		rec_file = NULL;
+		pthread_mutex_unlock(&mx_trace);
+	} else if (trace_mode == LGW_TRACE_REPLAY) {
+		if (link_open) {
+			DEBUG_MSG("ERROR: STOP THE CONCENTRATOR BEFORE THE REPLAY\n");
+			return LGW_TRACE_ERROR;
+		}
+		replay_free();
+	}
+	trace_mode = LGW_TRACE_OFF;
+	trace_stat.mode = LGW_TRACE_OFF;
+	return LGW_TRACE_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_trace_stat(struct lgw_trace_stat_s *stat) {
+	CHECK_NULL(stat);
+	pthread_mutex_lock(&mx_trace);
+	*stat = trace_stat;
+	pthread_mutex_unlock(&mx_trace);
+	return LGW_TRACE_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_trace_dump(const char *path, FILE *out) {
+	static const char *op_name[] = {"?", "open", "close", "w", "r", "wb", "rb", "wm", "irq"};
+	static const char *irq_name[] = {"interrupt", "timeout", "no line"};
+	struct trace_rec_s rec;
+	uint8_t *buf;
+	size_t size, off, pos;
+	uint64_t t = 0, v, nb;
+	uint32_t n = 0, d, k;
+	time_t start = 0;
+	char date[32];
+	int i;
+
+	CHECK_NULL(path);
+	CHECK_NULL(out);
+	if (trace_load(path, &buf, &size) != LGW_TRACE_SUCCESS) {
+		return LGW_TRACE_ERROR;
+	}
+
+	for (i = 7; i >= 0; --i) {
+		start = (start << 8) | buf[8 + i];
+	}
+	strftime(date, sizeof date, "%Y-%m-%d %H:%M:%S UTC", gmtime(&start));
+	fprintf(out, "# SPI trace started %s\n", date);
+	fprintf(out, "# time_s thread op address size data\n");
+	for (off = TRACE_HDR_SIZE; trace_parse(buf, size, off, &rec); off += rec.len) {
+		t += rec.dt_us;
+		n += 1;
+		fprintf(out, "%llu.%06u %u %s", (unsigned long long)(t / 1000000), (unsigned)(t % 1000000), rec.stream, op_name[rec.op]);
+		switch (rec.op) {
+			case TRC_W:
+			case TRC_R:
+			case TRC_WB:
+			case TRC_RB:
+				fprintf(out, " 0x%02X %u", rec.head[0], rec.data_len);
+				for (k = 0; k < rec.data_len; ++k) {
+					fprintf(out, " %02X", rec.data[k]);
+				}
+				break;
+			case TRC_WM:
+				pos = 0;
+				trace_get_varint(rec.head, rec.head_len, &pos, &nb);
+				fprintf(out, " %u frames", (unsigned)nb);
+				for (d = 0; nb > 0; --nb) {
+					fprintf(out, "\n  0x%02X", rec.head[pos]);
+					pos += 1;
+					trace_get_varint(rec.head, rec.head_len, &pos, &v);
+					fprintf(out, " %u", (unsigned)v);
+					for (k = 0; k < v; ++k) {
+						fprintf(out, " %02X", rec.data[d++]);
+					}
+				}
+				break;
+			case TRC_IRQ:
+				pos = 0;
+				trace_get_varint(rec.head, rec.head_len, &pos, &v);
+				k = rec.head[pos];
+				fprintf(out, " %u ms %s", (unsigned)v, irq_name[(k < 3) ? k : 2]);
+				break;
+			default:
+				break;
+		}
+		fprintf(out, "%s\n", rec.err ? " ERR" : "");
+	}
+	fprintf(out, "# %u transactions, %llu.%06u s", n, (unsigned long long)(t / 1000000), (unsigned)(t % 1000000));
+	if (off != size) {
+		fprintf(out, ", %u trailing bytes not decoded", (unsigned)(size - off));
+	}
+	fprintf(out, "\n");
+	munmap(buf, size);
+	return LGW_TRACE_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_trace_open_dev(void **spi_target_ptr, const char *dev) {
+	int spi_stat;
+
+	if (trace_mode == LGW_TRACE_REPLAY) {
+		spi_stat = replay_xfer(TRC_OPEN, NULL, 0, NULL, 0, false);
+		if (spi_stat == LGW_SPI_SUCCESS) {
+			*spi_target_ptr = &replay_link;
+			link_open = true;
+		}
+		return spi_stat;
+	}
+	spi_stat = lgw_spi_open_dev(spi_target_ptr, dev);
+	if (spi_stat == LGW_SPI_SUCCESS) {
+		link_open = true;
+	}
+	if (trace_mode == LGW_TRACE_RECORD) {
+		record_xfer(TRC_OPEN, spi_stat, NULL, 0, NULL, 0);
+	}
+	return spi_stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_trace_close(void *spi_target) {
+	int spi_stat;
+
+	link_open = false;
+	if (spi_target == &replay_link) {
+		return replay_xfer(TRC_CLOSE, NULL, 0, NULL, 0, false);
+	}
+	spi_stat = lgw_spi_close(spi_target);
+	if (trace_mode == LGW_TRACE_RECORD) {
+		record_xfer(TRC_CLOSE, spi_stat, NULL, 0, NULL, 0);
+	}
+	return spi_stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_trace_w(void *spi_target, uint8_t address, uint8_t data) {
+	int spi_stat;
+
+	if (trace_mode == LGW_TRACE_OFF) {
+		return lgw_spi_w(spi_target, address, data);
+	} else if (trace_mode == LGW_TRACE_REPLAY) {
+		return replay_xfer(TRC_W, &address, 1, &data, 1, false);
+	}
+	spi_stat = lgw_spi_w(spi_target, address, data);
+	record_xfer(TRC_W, spi_stat, &address, 1, &data, 1);
+	return spi_stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_trace_r(void *spi_target, uint8_t address, uint8_t *data) {
+	int spi_stat;
+
+	if (trace_mode == LGW_TRACE_OFF) {
+		return lgw_spi_r(spi_target, address, data);
+	} else if (trace_mode == LGW_TRACE_REPLAY) {
+		return replay_xfer(TRC_R, &address, 1, data, 1, true);
+	}
+	spi_stat = lgw_spi_r(spi_target, address, data);
+	record_xfer(TRC_R, spi_stat, &address, 1, data, 1);
+	return spi_stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_trace_wb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size) {
+	uint8_t head[1 + 3];
+	int n, spi_stat;
+
+	if (trace_mode == LGW_TRACE_OFF) {
+		return lgw_spi_wb(spi_target, address, data, size);
+	}
+	head[0] = address;
+	n = 1 + trace_put_varint(head + 1, size);
+	if (trace_mode == LGW_TRACE_REPLAY) {
+		return replay_xfer(TRC_WB, head, n, data, size, false);
+	}
+	spi_stat = lgw_spi_wb(spi_target, address, data, size);
+	record_xfer(TRC_WB, spi_stat, head, n, data, size);
+	return spi_stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_trace_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size) {
+	uint8_t head[1 + 3];
+	int n, spi_stat;
+
+	if (trace_mode == LGW_TRACE_OFF) {
+		return lgw_spi_rb(spi_target, address, data, size);
+	}
+	head[0] = address;
+	n = 1 + trace_put_varint(head + 1, size);
+	if (trace_mode == LGW_TRACE_REPLAY) {
+		return replay_xfer(TRC_RB, head, n, data, size, true);
+	}
+	spi_stat = lgw_spi_rb(spi_target, address, data, size);
+	record_xfer(TRC_RB, spi_stat, head, n, data, size);
+	return spi_stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_trace_wm(void *spi_target, uint8_t *address, uint16_t *size, uint8_t *data, uint16_t nb) {
+	uint8_t head[TRC_HEAD_MAX];
+	uint32_t len = 0;
+	int i, n, spi_stat;
+
+	if ((trace_mode == LGW_TRACE_OFF) || (nb == 0) || (nb > LGW_SPI_WM_MAX)) {
+		return lgw_spi_wm(spi_target, address, size, data, nb); /* invalid frame numbers are rejected by the backend */
+	}
+	n = trace_put_varint(head, nb);
+	for (i = 0; i < nb; ++i) {
+		head[n++] = address[i];
+		n += trace_put_varint(head + n, size[i]);
+		len += size[i];
+	}
+	if (trace_mode == LGW_TRACE_REPLAY) {
+		return replay_xfer(TRC_WM, head, n, data, len, false);
+	}
+	spi_stat = lgw_spi_wm(spi_target, address, size, data, nb);
+	record_xfer(TRC_WM, spi_stat, head, n, data, len);
+	return spi_stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_trace_irq_wait(void *spi_target, uint32_t timeout_ms) {
+	uint8_t head[5 + 1];
+	int n, spi_stat;
+
+	if (trace_mode == LGW_TRACE_OFF) {
+		return lgw_spi_irq_wait(spi_target, timeout_ms);
+	} else if (trace_mode == LGW_TRACE_REPLAY) {
+		return replay_irq();
+	}
+	spi_stat = lgw_spi_irq_wait(spi_target, timeout_ms);
+	n = trace_put_varint(head, timeout_ms);
+	head[n++] = (spi_stat == LGW_SPI_SUCCESS) ? 0 : ((spi_stat == LGW_SPI_TIMEOUT) ? 1 : 2);
+	record_xfer(TRC_IRQ, spi_stat, head, n, NULL, 0);
+	return spi_stat;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -30,6 +30,7 @@ Maintainer: Sylvain Miermont
 #include <string.h>		/* memset */
 #include <signal.h>		/* sigaction */
 #include <unistd.h>		/* getopt access */
+#include <time.h>		/* clock_gettime */
 
 #include "loragw_hal.h"
 #include "loragw_reg.h"
@@ -56,6 +57,8 @@ static int quit_sig = 0; /* 1 -> application terminates without shutting down th
 
 static void sig_handler(int sigio);
 
+static double elapsed_ms(struct timespec *t0);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -67,6 +70,14 @@ static void sig_handler(int sigio) {
 	}
 }
 
+/* milliseconds elapsed since t0 (monotonic clock) */
+static double elapsed_ms(struct timespec *t0) {
+	struct timespec t1;
+	
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (double)(t1.tv_sec - t0->tv_sec) * 1E3 + (double)(t1.tv_nsec - t0->tv_nsec) / 1E6;
+}
+
 /* describe command line options */
 void usage(void) {
 	printf("Library version information: %s\n", lgw_version_info());
@@ -103,6 +114,7 @@ int main(int argc, char **argv)
 	uint32_t tx_cnt = 0;
 	unsigned long loop_cnt = 0;
 	uint8_t status_var = 0;
+	struct timespec t0; /* for lgw_start and lgw_send latency measurement */
 	double xd = 0.0;
 	int xi = 0;
 
@@ -301,9 +313,10 @@ int main(int argc, char **argv)
 */	
 	
 	/* connect, configure and start the LoRa concentrator */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
 	i = lgw_start();
 	if (i == LGW_HAL_SUCCESS) {
-		printf("*** Concentrator started ***\n");
+		printf("*** Concentrator started (%.1f ms) ***\n", elapsed_ms(&t0));
 	} else {
 		printf("*** Impossible to start concentrator ***\n");
 		return -1;
@@ -388,9 +401,11 @@ int main(int argc, char **argv)
 			txpkt.payload[17] = 0xff & (tx_cnt >> 16);
 			txpkt.payload[18] = 0xff & (tx_cnt >> 8);
 			txpkt.payload[19] = 0xff & tx_cnt;
+			clock_gettime(CLOCK_MONOTONIC, &t0);
 			i = lgw_send(txpkt); /* non-blocking scheduling of TX packet */
+			xd = elapsed_ms(&t0);
 			j = 0;
-			printf("+++\nSending packet #%d, rf path %d, return %d\nstatus -> ", tx_cnt, txpkt.rf_chain, i);
+			printf("+++\nSending packet #%d, rf path %d, return %d (%.3f ms)\nstatus -> ", tx_cnt, txpkt.rf_chain, i, xd);
 			do {
 				++j;
 				wait_ms(100);
@@ -0,0 +1,2488 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Regression test of the loragw_hal 'library' against the simulated
+	concentrator (CFG_SPI=sim), no hardware needed.
+	Starts the concentrator, injects packets in the simulated RX FIFO and
+	checks what lgw_receive returns, sends packets and checks what the
+	simulated TX modem decoded, then compares the register file obtained with
+	and without the register shadow and checks that batched register writes
+	reach the concentrator in order, and that prepared TX descriptors send the
+	same packets as lgw_send, and that lgw_receive_wait is woken up by the
+	simulated interrupt line or falls back to polling without it, and that the
+	TX queue sends packets in order, at their timestamp, without overlaps.
+	Compares the timing lookup tables with the reference formulas for every
+	combination of packet parameters. Finally, checks that lgw_start detects
+	the end of the calibration and that the calibration cache restores the
+	same TX and RX corrections without calibrating, and that the MCU
+	firmwares are only written when the program RAM does not already hold them,
+	and that bursts are split according to the SPI settings. Records the SPI
+	traffic of a session with two threads and replays it without the
+	simulated concentrator, and that the HAL performance counters agree
+	with the SPI traffic and packets seen by the simulated concentrator.
+	Runs two more simulated boards from two threads at the same time, each
+	with its own HAL context, next to the default one. Checks that the
+	generated register accessors read and write the same bits, with the same
+	SPI traffic, as lgw_reg_r and lgw_reg_w, and that the NMEA stream parser
+	finds the same sentences however the GPS output is split across reads.
+	Synchronizes on the PPS of a simulated drifting clock, with glitches and
+	an outage, and checks the accuracy and uncertainty of the fitted time
+	reference and that converting arrays of timestamps gives the same times,
+	and that a trigger timestamp left by a counter read is not taken for a PPS.
+	Compares the streaming statistics with the exact mean, standard deviation
+	and percentiles of the same values, up to a million values. Sends
+	commands to a control socket from a client, split and grouped in any way,
+	and checks the commands received and the replies, also when the client
+	disconnects before a reply.
+	Returns a non-zero value on failure.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* printf */
+#include <stdlib.h>		/* abs */
+#include <string.h>		/* memset */
+#include <math.h>		/* fabs */
+#include <time.h>		/* clock_gettime */
+#include <pthread.h>	/* pthread_create */
+#include <unistd.h>		/* close unlink */
+#include <poll.h>		/* poll */
+#include <sys/socket.h>	/* socket connect send recv */
+#include <sys/un.h>		/* struct sockaddr_un */
+
+#include "loragw_hal.h"
+#include "loragw_reg.h"
+#include "loragw_reg_acc.h"
+#include "loragw_aux.h"
+#include "loragw_sim.h"
+#include "loragw_spi.h"
+#include "loragw_txq.h"
+#include "loragw_lut.h"
+#include "loragw_trace.h"
+#include "loragw_gps.h"
+#include "loragw_stat.h"
+#include "loragw_ctl.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define CHECK(cond)		check((cond), #cond, __LINE__)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define		SIM_BOARD		0
+#define		F_RX_A			867500000
+#define		F_RX_B			868500000
+#define		F_TX			868100000
+#define		TX_START_DELAY	1500 /* same value as in loragw_hal.c */
+#define		MCU_FW_BYTE		8192 /* size of the MCU firmwares */
+#define		CTX_PKT_NB		40 /* packets received by each board of the context test */
+#define		NMEA_MSG_NB		8 /* sentences recorded by nmea_feed */
+#define		FIT_PPS_NB		400 /* PPS of the GPS sync test */
+#define		FIT_CNT0		0xFEC78000 /* counter at the first PPS, wraps after 20 s */
+#define		FIT_UTC0		1039422959 /* UTC time of the first PPS */
+#define		FIT_XTAL_ERR	3E-6 /* clock error at the first PPS */
+#define		FIT_DRIFT		1E-9 /* drift of the clock error, per second */
+#define		FIT_CONV_NB		4096 /* timestamps converted at once */
+#define		STAT_SORT_NB	100000 /* values of the statistics test compared with their sorted copy */
+#define		STAT_LONG_NB	1000000 /* values of the long series of the statistics test */
+#define		CTL_PATH		"test_loragw_sim.sock" /* control socket of the control test, in the current directory */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* what the RX thread of the trace test received */
+struct trace_rx_s {
+	struct lgw_pkt_rx_s	pkt[LGW_PKT_FIFO_SIZE];
+	int					nb_pkt;
+	int					nb_wait;
+};
+
+/* a register of the accessor test, with its generated accessors */
+struct reg_acc_s {
+	uint16_t	id;
+	int			(*r)(int32_t *reg_value);
+	int			(*w)(int32_t reg_value);
+	int32_t		val[3];		/* values written, in the register range */
+};
+
+/* one board of the context test, and what its thread did */
+struct ctx_board_s {
+	struct lgw_ctx_s	*ctx;
+	int					board;		/* simulated board number */
+	uint8_t				rf_chain;	/* TX radio, different on each board */
+	uint32_t			f_tx;		/* TX frequency, different on each board */
+	int					start;		/* lgw_ctx_start result */
+	int					nb_pkt;		/* packets received */
+	int					nb_bad;		/* packets received with an unexpected payload */
+	int					send;		/* lgw_ctx_send result */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static int nb_check = 0;
+static int nb_fail = 0;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void check(bool cond, const char *str, int line);
+
+static void configure(void);
+
+static void test_rx(void);
+
+static void test_rx_burst(void);
+
+static void test_tx(void);
+
+static void test_shadow(void);
+
+static void test_batch(void);
+
+static void test_reg_list(void);
+
+static void test_tx_desc(void);
+
+static void *inject_later(void *arg);
+
+static uint32_t elapsed_us(const struct timespec *t0, const struct timespec *t1);
+
+static void test_rx_wait(void);
+
+static void test_txq(void);
+
+static uint32_t ref_rx_delay(int ifmod, uint8_t bw, uint32_t sf, uint32_t cr, uint32_t crc_en, unsigned sz);
+
+static uint32_t ref_lora_toa(uint8_t bw, uint32_t datarate, uint8_t coderate, bool no_crc, bool no_header, uint16_t size, uint16_t preamble);
+
+static void test_lut(void);
+
+static uint32_t start_ms(int *ret);
+
+static void test_cal(void);
+
+static void test_fw(void);
+
+static void test_spi_conf(void);
+
+static void *trace_rx(void *arg);
+
+static void test_trace(void);
+
+static void test_stats(void);
+
+static void *ctx_run(void *arg);
+
+static void test_ctx(void);
+
+static void test_reg_acc(void);
+
+static int nmea_feed(const char *data, int size, int chunk, enum gps_msg *msg);
+
+static void test_nmea(void);
+
+static uint32_t fit_count(double t, uint32_t *seed);
+
+static double fit_error_us(struct tref ref, uint32_t count_us, double t);
+
+static void test_gps_fit(void);
+
+static double stat_value(uint32_t *seed);
+
+static int stat_cmp(const void *a, const void *b);
+
+static void test_stat(void);
+
+static int ctl_connect(void);
+
+static int ctl_read(int fd, char *line, size_t size);
+
+static void test_ctl(void);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void check(bool cond, const char *str, int line) {
+	++nb_check;
+	if (!cond) {
+		++nb_fail;
+		printf("FAIL (line %d): %s\n", line, str);
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void configure(void) {
+	struct lgw_conf_board_s boardconf;
+	struct lgw_conf_rxrf_s rfconf;
+	struct lgw_conf_rxif_s ifconf;
+	int i;
+
+	memset(&boardconf, 0, sizeof(boardconf));
+	boardconf.lorawan_public = true;
+	boardconf.clksrc = 1;
+	lgw_board_setconf(boardconf);
+
+	memset(&rfconf, 0, sizeof(rfconf));
+	rfconf.enable = true;
+	rfconf.freq_hz = F_RX_A;
+	rfconf.rssi_offset = LGW_SIM_RSSI_OFFSET;
+	rfconf.type = LGW_RADIO_TYPE_SX1257;
+	rfconf.tx_enable = true;
+	lgw_rxrf_setconf(0, rfconf); /* radio A, f0 */
+	rfconf.freq_hz = F_RX_B;
+	rfconf.tx_enable = false;
+	lgw_rxrf_setconf(1, rfconf); /* radio B, f1 */
+
+	/* LoRa multi-SF channels, 4 on each radio */
+	memset(&ifconf, 0, sizeof(ifconf));
+	for (i=0; i<8; ++i) {
+		ifconf.enable = true;
+		ifconf.rf_chain = i / 4;
+		ifconf.freq_hz = -300000 + 200000 * (i % 4);
+		ifconf.datarate = DR_LORA_MULTI;
+		lgw_rxif_setconf(i, ifconf);
+	}
+
+	/* LoRa 'stand alone' channel */
+	memset(&ifconf, 0, sizeof(ifconf));
+	ifconf.enable = true;
+	ifconf.rf_chain = 0;
+	ifconf.freq_hz = 0;
+	ifconf.bandwidth = BW_250KHZ;
+	ifconf.datarate = DR_LORA_SF10;
+	lgw_rxif_setconf(8, ifconf);
+
+	/* FSK channel */
+	memset(&ifconf, 0, sizeof(ifconf));
+	ifconf.enable = true;
+	ifconf.rf_chain = 1;
+	ifconf.freq_hz = 0;
+	ifconf.bandwidth = BW_250KHZ;
+	ifconf.datarate = 64000;
+	lgw_rxif_setconf(9, ifconf);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_rx(void) {
+	const uint32_t sf_tab[] = {DR_LORA_SF7, DR_LORA_SF8, DR_LORA_SF9, DR_LORA_SF10, DR_LORA_SF11, DR_LORA_SF12};
+	const uint8_t cr_tab[] = {CR_LORA_4_5, CR_LORA_4_6, CR_LORA_4_7, CR_LORA_4_8};
+	struct lgw_sim_rx_s in[LGW_PKT_FIFO_SIZE];
+	struct lgw_pkt_rx_s out[LGW_PKT_FIFO_SIZE + 4];
+	struct lgw_sim_rx_s bad;
+	struct lgw_sim_counters_s cnt;
+	uint32_t t0;
+	int i, j, nb_pkt;
+
+	printf("--- RX path ---\n");
+
+	/* one packet per multi-SF chain, with different SF/CR/size/quality */
+	t0 = lgw_sim_get_count(SIM_BOARD);
+	memset(in, 0, sizeof(in));
+	for (i=0; i<6; ++i) {
+		in[i].if_chain = i;
+		in[i].status = (i == 4) ? STAT_CRC_BAD : STAT_CRC_OK;
+		in[i].datarate = sf_tab[i];
+		in[i].coderate = cr_tab[i % 4];
+		in[i].bandwidth = BW_125KHZ;
+		in[i].rssi = -120.0 + 10 * i;
+		in[i].snr = -7.5 + 3.25 * i;
+		in[i].snr_min = in[i].snr - 2.0;
+		in[i].snr_max = in[i].snr + 1.5;
+		in[i].count_us = t0 + 1000 * i + 100000;
+		in[i].size = 1 + 30 * i;
+		for (j=0; j<in[i].size; ++j) {
+			in[i].payload[j] = (uint8_t)(i * 16 + j);
+		}
+	}
+	/* LoRa stand-alone modem */
+	in[6] = in[3];
+	in[6].if_chain = 8;
+	in[6].bandwidth = BW_250KHZ;
+	in[6].datarate = DR_LORA_SF10;
+	in[6].rssi = -55.0;
+	/* FSK modem */
+	in[7] = in[1];
+	in[7].if_chain = 9;
+	in[7].datarate = 0;
+	in[7].coderate = 0;
+	in[7].rssi = -74.0;
+	in[7].size = 255;
+	for (i=0; i<LGW_PKT_FIFO_SIZE; ++i) {
+		CHECK(lgw_sim_inject_rx(SIM_BOARD, &in[i]) == LGW_SIM_SUCCESS);
+	}
+	CHECK(lgw_sim_rx_pending(SIM_BOARD) == LGW_PKT_FIFO_SIZE);
+
+	/* the FIFO is full, next packet is dropped */
+	CHECK(lgw_sim_inject_rx(SIM_BOARD, &in[0]) == LGW_SIM_ERROR);
+	lgw_sim_get_counters(SIM_BOARD, &cnt);
+	CHECK(cnt.rx_dropped == 1);
+
+	/* fetch everything, in two calls */
+	nb_pkt = lgw_receive(3, out);
+	CHECK(nb_pkt == 3);
+	nb_pkt = lgw_receive(ARRAY_SIZE(out) - 3, &out[3]);
+	CHECK(nb_pkt == LGW_PKT_FIFO_SIZE - 3);
+	CHECK(lgw_sim_rx_pending(SIM_BOARD) == 0);
+	CHECK(lgw_receive(ARRAY_SIZE(out), out + LGW_PKT_FIFO_SIZE) == 0);
+
+	for (i=0; i<LGW_PKT_FIFO_SIZE; ++i) {
+		CHECK(out[i].if_chain == in[i].if_chain);
+		CHECK(out[i].size == in[i].size);
+		CHECK(memcmp(out[i].payload, in[i].payload, in[i].size) == 0);
+		CHECK(abs((int32_t)(in[i].count_us - out[i].count_us)) < 40000); /* timestamp correction only, about 28 ms at SF12 */
+		if (in[i].if_chain == 9) {
+			CHECK(out[i].modulation == MOD_FSK);
+			CHECK(fabs(out[i].rssi - in[i].rssi) <= 1.0);
+			continue;
+		}
+		CHECK(out[i].modulation == MOD_LORA);
+		CHECK(out[i].status == in[i].status);
+		CHECK(out[i].datarate == in[i].datarate);
+		CHECK(out[i].coderate == in[i].coderate);
+		CHECK(out[i].bandwidth == in[i].bandwidth);
+		CHECK(fabs(out[i].rssi - in[i].rssi) <= 0.5);
+		CHECK(out[i].snr == in[i].snr);
+		CHECK(out[i].snr_min == in[i].snr_min);
+		CHECK(out[i].snr_max == in[i].snr_max);
+	}
+
+	/* packets the modems are not configured for are not received */
+	bad = in[6];
+	bad.datarate = DR_LORA_SF7; /* stand-alone modem set for SF10 */
+	CHECK(lgw_sim_inject_rx(SIM_BOARD, &bad) == LGW_SIM_ERROR);
+	bad = in[0];
+	bad.bandwidth = BW_500KHZ; /* multi-SF modems are 125 kHz only */
+	CHECK(lgw_sim_inject_rx(SIM_BOARD, &bad) == LGW_SIM_ERROR);
+	CHECK(lgw_sim_rx_pending(SIM_BOARD) == 0);
+
+	/* data buffer wraps around */
+	for (j=0; j<10; ++j) {
+		for (i=0; i<4; ++i) {
+			in[i].size = 250;
+			in[i].payload[0] = (uint8_t)(j + i);
+			CHECK(lgw_sim_inject_rx(SIM_BOARD, &in[i]) == ((i < 3) ? LGW_SIM_SUCCESS : LGW_SIM_ERROR));
+		}
+		nb_pkt = lgw_receive(ARRAY_SIZE(out), out);
+		CHECK(nb_pkt == 3);
+		for (i=0; i<nb_pkt; ++i) {
+			CHECK((out[i].size == 250) && (out[i].payload[0] == (uint8_t)(j + i)) && (out[i].datarate == in[i].datarate));
+		}
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* fetch the same packets in single and burst mode, compare results and SPI cost */
+static void test_rx_burst(void) {
+	const uint8_t mode_tab[] = {RX_FETCH_SINGLE, RX_FETCH_BURST};
+	const uint16_t size_tab[] = {20, 20, 20, 20, 20, 20, 20, 20, 10, 50, 10, 10, 90, 30, 10, 50};
+	struct lgw_sim_rx_s in;
+	struct lgw_pkt_rx_s out[2][2*LGW_PKT_FIFO_SIZE];
+	struct lgw_rx_fetch_stat_s st0, st1;
+	struct lgw_sim_counters_s cnt;
+	uint32_t nb_spi[2];
+	int nb_pkt[2];
+	int i, k, m;
+
+	printf("--- RX path, burst fetch ---\n");
+
+	memset(out, 0, sizeof(out));
+	for (m=0; m<2; ++m) {
+		CHECK(lgw_rx_fetch_mode(mode_tab[m]) == LGW_HAL_SUCCESS);
+		lgw_rx_fetch_stat(&st0);
+		lgw_sim_reset_counters(SIM_BOARD);
+		nb_pkt[m] = 0;
+		/* same size packets, then different sizes */
+		for (k=0; k<2; ++k) {
+			for (i=0; i<LGW_PKT_FIFO_SIZE; ++i) {
+				memset(&in, 0, sizeof(in));
+				in.if_chain = i;
+				in.status = STAT_CRC_OK;
+				in.datarate = DR_LORA_SF7 << (i % 6);
+				in.coderate = CR_LORA_4_5;
+				in.bandwidth = BW_125KHZ;
+				in.rssi = -100.0 + i;
+				in.snr = 5.0;
+				in.count_us = 1000000 * (k + 1) + 1000 * i;
+				in.size = size_tab[k*LGW_PKT_FIFO_SIZE + i];
+				memset(in.payload, k*LGW_PKT_FIFO_SIZE + i, in.size);
+				CHECK(lgw_sim_inject_rx(SIM_BOARD, &in) == LGW_SIM_SUCCESS);
+			}
+			nb_pkt[m] += lgw_receive(LGW_PKT_FIFO_SIZE, &out[m][k*LGW_PKT_FIFO_SIZE]);
+		}
+		CHECK(lgw_receive(LGW_PKT_FIFO_SIZE, out[m]) == 0);
+		lgw_rx_fetch_stat(&st1);
+		lgw_sim_get_counters(SIM_BOARD, &cnt);
+		nb_spi[m] = st1.nb_spi - st0.nb_spi;
+		CHECK(nb_spi[m] == cnt.spi_r + cnt.spi_w + cnt.spi_rb + cnt.spi_wb);
+		CHECK(st1.nb_pkt - st0.nb_pkt == (uint32_t)nb_pkt[m]);
+		printf("mode %u: %d packets, %u SPI transactions (%.2f per packet), %u bytes\n", mode_tab[m], nb_pkt[m], nb_spi[m], (float)nb_spi[m] / nb_pkt[m], st1.nb_spi_bytes - st0.nb_spi_bytes);
+	}
+	CHECK(nb_pkt[0] == 2*LGW_PKT_FIFO_SIZE);
+	CHECK(nb_pkt[1] == 2*LGW_PKT_FIFO_SIZE);
+	CHECK(memcmp(out[0], out[1], sizeof(out[0])) == 0);
+	for (i=0; i<2*LGW_PKT_FIFO_SIZE; ++i) {
+		CHECK((out[1][i].size == size_tab[i]) && (out[1][i].payload[0] == i) && (out[1][i].payload[size_tab[i]-1] == i));
+	}
+	/* 3 per packet + final FIFO poll, against FIFO read + advance per packet + few data bursts */
+	CHECK(nb_spi[0] == 3 * 2*LGW_PKT_FIFO_SIZE + 1);
+	CHECK(nb_spi[1] < 2 * 2*LGW_PKT_FIFO_SIZE + 8);
+
+	/* packets arriving while fetching are picked on next call */
+	memset(&in, 0, sizeof(in));
+	in.if_chain = 0;
+	in.status = STAT_CRC_OK;
+	in.datarate = DR_LORA_SF7;
+	in.coderate = CR_LORA_4_5;
+	in.bandwidth = BW_125KHZ;
+	in.size = 40;
+	CHECK(lgw_sim_inject_rx(SIM_BOARD, &in) == LGW_SIM_SUCCESS);
+	CHECK(lgw_sim_inject_rx(SIM_BOARD, &in) == LGW_SIM_SUCCESS);
+	CHECK(lgw_receive(1, out[0]) == 1);
+	CHECK(lgw_sim_inject_rx(SIM_BOARD, &in) == LGW_SIM_SUCCESS);
+	CHECK(lgw_receive(LGW_PKT_FIFO_SIZE, out[0]) == 2);
+	CHECK(lgw_receive(LGW_PKT_FIFO_SIZE, out[0]) == 0);
+
+	lgw_rx_fetch_mode(RX_FETCH_SINGLE);
+	CHECK(lgw_rx_fetch_mode(2) == LGW_HAL_ERROR);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_tx(void) {
+	struct lgw_pkt_tx_s txpkt;
+	struct lgw_sim_tx_s tx;
+	uint8_t status_var;
+	int nb_tx;
+	int i;
+
+	printf("--- TX path ---\n");
+
+	/* immediate LoRa packet */
+	memset(&txpkt, 0, sizeof(txpkt));
+	txpkt.freq_hz = F_TX;
+	txpkt.tx_mode = IMMEDIATE;
+	txpkt.rf_power = 14;
+	txpkt.modulation = MOD_LORA;
+	txpkt.bandwidth = BW_125KHZ;
+	txpkt.datarate = DR_LORA_SF9;
+	txpkt.coderate = CR_LORA_4_6;
+	txpkt.invert_pol = true;
+	txpkt.preamble = 8;
+	txpkt.size = 20;
+	strcpy((char *)txpkt.payload, "TX.TEST.LORA.GW.SIM!");
+	txpkt.rf_chain = 0;
+
+	nb_tx = lgw_sim_tx_count(SIM_BOARD);
+	CHECK(lgw_send(txpkt) == LGW_HAL_SUCCESS);
+	CHECK(lgw_sim_tx_count(SIM_BOARD) == nb_tx + 1);
+	CHECK(lgw_status(TX_STATUS, &status_var) == LGW_HAL_SUCCESS);
+	CHECK(status_var == TX_EMITTING);
+	CHECK(lgw_sim_get_tx(SIM_BOARD, nb_tx, &tx) == LGW_SIM_SUCCESS);
+	CHECK(tx.tx_mode == IMMEDIATE);
+	CHECK(tx.modulation == MOD_LORA);
+	CHECK(abs((int)tx.freq_hz - F_TX) < 62); /* PLL step is 61 Hz */
+	CHECK(tx.rf_chain == 0);
+	CHECK(tx.pow_index == 0);
+	CHECK(tx.bandwidth == BW_125KHZ);
+	CHECK(tx.datarate == DR_LORA_SF9);
+	CHECK(tx.coderate == CR_LORA_4_6);
+	CHECK(tx.invert_pol == true);
+	CHECK(tx.no_crc == false);
+	CHECK(tx.no_header == false);
+	CHECK(tx.preamble == 8);
+	CHECK(tx.size == 20);
+	CHECK(memcmp(tx.payload, txpkt.payload, 20) == 0);
+	CHECK((tx.offset_i == 3) && (tx.offset_q == -3)); /* simulated calibration, mix_gain 10 */
+	CHECK(tx.count_us - tx.trig_us == TX_START_DELAY);
+	CHECK((tx.airtime_us > 200000) && (tx.airtime_us < 210000)); /* 206 ms for SF9/125k, 20 bytes, CR 4/6 */
+
+	/* wait for the end of the emission */
+	i = 0;
+	do {
+		wait_ms(20);
+		lgw_status(TX_STATUS, &status_var);
+	} while ((status_var != TX_FREE) && (++i < 50));
+	CHECK(status_var == TX_FREE);
+	CHECK((i >= 8) && (i <= 12));
+
+	/* timestamped packet, cancelled before it starts */
+	txpkt.tx_mode = TIMESTAMPED;
+	txpkt.count_us = lgw_sim_get_count(SIM_BOARD) + 500000;
+	txpkt.rf_power = 27;
+	txpkt.invert_pol = false;
+	txpkt.no_crc = true;
+	CHECK(lgw_send(txpkt) == LGW_HAL_SUCCESS);
+	CHECK(lgw_sim_get_tx(SIM_BOARD, nb_tx + 1, &tx) == LGW_SIM_SUCCESS);
+	CHECK(tx.tx_mode == TIMESTAMPED);
+	CHECK(tx.count_us == txpkt.count_us);
+	CHECK(tx.pow_index == 1);
+	CHECK((tx.offset_i == 7) && (tx.offset_q == -7)); /* simulated calibration, mix_gain 14 */
+	CHECK(tx.no_crc == true);
+	lgw_status(TX_STATUS, &status_var);
+	CHECK(status_var == TX_SCHEDULED);
+	CHECK(lgw_abort_tx() == LGW_HAL_SUCCESS);
+	lgw_status(TX_STATUS, &status_var);
+	CHECK(status_var == TX_FREE);
+
+	/* FSK packet */
+	memset(&txpkt, 0, sizeof(txpkt));
+	txpkt.freq_hz = F_TX;
+	txpkt.tx_mode = IMMEDIATE;
+	txpkt.rf_power = 14;
+	txpkt.modulation = MOD_FSK;
+	txpkt.f_dev = 25;
+	txpkt.datarate = 50000;
+	txpkt.size = 64;
+	txpkt.rf_chain = 0;
+	CHECK(lgw_send(txpkt) == LGW_HAL_SUCCESS);
+	CHECK(lgw_sim_get_tx(SIM_BOARD, nb_tx + 2, &tx) == LGW_SIM_SUCCESS);
+	CHECK(tx.modulation == MOD_FSK);
+	CHECK(abs((int)tx.freq_hz - F_TX) < 62);
+	CHECK(tx.f_dev == 25);
+	CHECK(tx.datarate == 50000);
+	CHECK(tx.size == 64);
+	CHECK(tx.preamble == 5);
+
+	/* TX on radio B is not enabled in the configuration */
+	txpkt.rf_chain = 1;
+	CHECK(lgw_send(txpkt) == LGW_HAL_ERROR);
+	CHECK(lgw_sim_tx_count(SIM_BOARD) == nb_tx + 3);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_shadow(void) {
+	static int32_t regs[2][LGW_TOTALREGS];
+	struct lgw_reg_shadow_stat_s st0, st1;
+	struct lgw_sim_counters_s cnt;
+	struct lgw_pkt_tx_s txpkt;
+	struct lgw_sim_tx_s tx[2];
+	uint32_t nb_start[2], nb_send[2];
+	int nb_tx;
+	int i, m;
+
+	printf("--- register shadow ---\n");
+
+	memset(&txpkt, 0, sizeof(txpkt));
+	txpkt.freq_hz = F_TX;
+	txpkt.tx_mode = TIMESTAMPED;
+	txpkt.rf_power = 14;
+	txpkt.modulation = MOD_LORA;
+	txpkt.bandwidth = BW_125KHZ;
+	txpkt.datarate = DR_LORA_SF7;
+	txpkt.coderate = CR_LORA_4_5;
+	txpkt.preamble = 8;
+	txpkt.size = 16;
+	txpkt.rf_chain = 0;
+
+	/* m = 0: shadow disabled, m = 1: shadow enabled */
+	for (m=0; m<2; ++m) {
+		lgw_stop();
+		lgw_sim_power_cycle(SIM_BOARD);
+		CHECK(lgw_reg_shadow(m == 1) == LGW_REG_SUCCESS);
+		lgw_sim_reset_counters(SIM_BOARD);
+		CHECK(lgw_start() == LGW_HAL_SUCCESS);
+		lgw_sim_get_counters(SIM_BOARD, &cnt);
+		nb_start[m] = cnt.spi_w + cnt.spi_r + cnt.spi_wb + cnt.spi_rb + cnt.spi_wm;
+
+		/* second packet of a series with the same parameters, only the timestamp changes */
+		nb_tx = lgw_sim_tx_count(SIM_BOARD);
+		txpkt.count_us = lgw_sim_get_count(SIM_BOARD) + 500000;
+		CHECK(lgw_send(txpkt) == LGW_HAL_SUCCESS);
+		lgw_abort_tx();
+		lgw_reg_shadow_stat(&st0);
+		lgw_sim_reset_counters(SIM_BOARD);
+		txpkt.count_us += 100000;
+		CHECK(lgw_send(txpkt) == LGW_HAL_SUCCESS);
+		lgw_sim_get_counters(SIM_BOARD, &cnt);
+		lgw_reg_shadow_stat(&st1);
+		nb_send[m] = cnt.spi_w + cnt.spi_r + cnt.spi_wb + cnt.spi_rb + cnt.spi_wm;
+		CHECK(lgw_sim_get_tx(SIM_BOARD, nb_tx + 1, &tx[m]) == LGW_SIM_SUCCESS);
+		CHECK(tx[m].count_us == txpkt.count_us);
+		lgw_abort_tx();
+		if (m == 0) {
+			CHECK((st1.nb_read_saved == 0) && (st1.nb_write_saved == 0));
+		} else {
+			CHECK((st1.nb_read_saved > st0.nb_read_saved) && (st1.nb_write_saved > st0.nb_write_saved));
+		}
+
+		/* snapshot of the writable registers, data ports excluded */
+		for (i=0; i<LGW_TOTALREGS; ++i) {
+			if ((loregs[i].rdon == 1) || (i == LGW_RX_DATA_BUF_DATA) || (i == LGW_TX_DATA_BUF_DATA) || (i == LGW_MCU_PROM_DATA)) {
+				regs[m][i] = 0;
+			} else {
+				lgw_reg_r(i, &regs[m][i]);
+			}
+		}
+	}
+
+	printf("lgw_start: %u SPI transactions without shadow, %u with shadow\n", nb_start[0], nb_start[1]);
+	printf("lgw_send: %u SPI transactions without shadow, %u with shadow\n", nb_send[0], nb_send[1]);
+	CHECK(nb_start[1] < nb_start[0]);
+	CHECK(nb_send[1] < nb_send[0]);
+	CHECK(memcmp(regs[0], regs[1], sizeof(regs[0])) == 0);
+	CHECK((tx[0].freq_hz == tx[1].freq_hz) && (tx[0].pow_index == tx[1].pow_index) && (tx[0].dig_gain == tx[1].dig_gain));
+	CHECK((tx[0].offset_i == tx[1].offset_i) && (tx[0].offset_q == tx[1].offset_q));
+	CHECK((tx[1].datarate == DR_LORA_SF7) && (tx[1].coderate == CR_LORA_4_5) && (tx[1].preamble == 8) && (tx[1].size == 16));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_batch(void) {
+	struct lgw_sim_counters_s cnt;
+	struct lgw_pkt_tx_s txpkt;
+	struct lgw_sim_tx_s tx;
+	uint8_t buff[300];
+	int32_t val;
+	int nb_tx;
+	int i;
+
+	printf("--- register write batch ---\n");
+
+	/* writes on several pages, with a read in the middle */
+	lgw_reg_shadow(false);
+	lgw_sim_reset_counters(SIM_BOARD);
+	CHECK(lgw_reg_batch_begin() == LGW_REG_SUCCESS);
+	lgw_reg_w(LGW_IF_FREQ_0, -100); /* page 0, 13 bits */
+	lgw_reg_w(LGW_TX_OFFSET_I, -5); /* page 1 */
+	lgw_reg_w(LGW_FSK_PSIZE, 1); /* page 1, 3 bits (read-modify-write) */
+	lgw_reg_w(LGW_GPS_POL, 0); /* page 2, 1 bit (read-modify-write) */
+	lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0x42); /* page 2 */
+	CHECK(lgw_reg_batch_begin() == LGW_REG_SUCCESS); /* nested */
+	lgw_reg_w(LGW_TX_OFFSET_Q, 5);
+	CHECK(lgw_reg_batch_commit() == LGW_REG_SUCCESS);
+	lgw_sim_get_counters(SIM_BOARD, &cnt);
+	CHECK(cnt.spi_w + cnt.spi_wb == 0); /* nothing written before the read or the commit */
+	lgw_reg_r(LGW_IF_FREQ_0, &val);
+	CHECK(val == -100);
+	lgw_reg_w(LGW_IF_FREQ_1, 200);
+	CHECK(lgw_reg_batch_commit() == LGW_REG_SUCCESS);
+	CHECK(lgw_reg_batch_commit() == LGW_REG_ERROR);
+	lgw_sim_get_counters(SIM_BOARD, &cnt);
+	printf("%u register writes in %u SPI transactions\n", cnt.wm_frames, cnt.spi_wm + cnt.spi_w + cnt.spi_wb);
+	CHECK(cnt.spi_w + cnt.spi_wb == 0);
+	lgw_reg_r(LGW_TX_OFFSET_I, &val);
+	CHECK(val == -5);
+	lgw_reg_r(LGW_TX_OFFSET_Q, &val);
+	CHECK(val == 5);
+	lgw_reg_r(LGW_FSK_PSIZE, &val);
+	CHECK(val == 1);
+	lgw_reg_r(LGW_GPS_POL, &val);
+	CHECK(val == 0);
+	lgw_reg_r(LGW_IF_FREQ_1, &val);
+	CHECK(val == 200);
+	lgw_reg_shadow(true);
+
+	/* bursts bigger than the queue are sent directly, after the queued frames */
+	for (i=0; i<(int)sizeof(buff); ++i) {
+		buff[i] = (uint8_t)i;
+	}
+	CHECK(lgw_reg_batch_begin() == LGW_REG_SUCCESS);
+	lgw_reg_w(LGW_TX_DATA_BUF_ADDR, 0);
+	lgw_reg_wb(LGW_TX_DATA_BUF_DATA, buff, sizeof(buff));
+	lgw_reg_w(LGW_TX_DATA_BUF_ADDR, 0);
+	lgw_reg_wb(LGW_TX_DATA_BUF_DATA, buff + 100, 16);
+	CHECK(lgw_reg_batch_commit() == LGW_REG_SUCCESS);
+
+	/* a packet sent in one SPI transaction, once the shadow knows the TX gain register */
+	memset(&txpkt, 0, sizeof(txpkt));
+	txpkt.freq_hz = F_TX;
+	txpkt.tx_mode = IMMEDIATE;
+	txpkt.rf_power = 27;
+	txpkt.modulation = MOD_LORA;
+	txpkt.bandwidth = BW_125KHZ;
+	txpkt.datarate = DR_LORA_SF12;
+	txpkt.coderate = CR_LORA_4_5;
+	txpkt.size = 255;
+	memset(txpkt.payload, 0xA5, 255);
+	txpkt.rf_chain = 0;
+	CHECK(lgw_send(txpkt) == LGW_HAL_SUCCESS);
+	lgw_abort_tx();
+	nb_tx = lgw_sim_tx_count(SIM_BOARD);
+	lgw_sim_reset_counters(SIM_BOARD);
+	CHECK(lgw_send(txpkt) == LGW_HAL_SUCCESS);
+	lgw_sim_get_counters(SIM_BOARD, &cnt);
+	printf("lgw_send: %u SPI transactions, %u frames\n", cnt.spi_w + cnt.spi_r + cnt.spi_wb + cnt.spi_rb + cnt.spi_wm, cnt.wm_frames);
+	CHECK((cnt.spi_wm == 1) && (cnt.spi_w + cnt.spi_r + cnt.spi_wb + cnt.spi_rb == 0));
+	CHECK(lgw_sim_get_tx(SIM_BOARD, nb_tx, &tx) == LGW_SIM_SUCCESS);
+	CHECK((tx.size == 255) && (tx.payload[0] == 0xA5) && (tx.payload[254] == 0xA5));
+	CHECK((tx.pow_index == 1) && (tx.offset_i == 7) && (tx.offset_q == -7));
+	lgw_abort_tx();
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_reg_list(void) {
+	/* registers alternating between page 0, 1 and 2 */
+	uint16_t id[8] = {LGW_IF_FREQ_0, LGW_TX_OFFSET_I, LGW_IF_FREQ_1, LGW_TX_OFFSET_Q, LGW_IF_FREQ_2, LGW_DBG_AGC_MCU_RAM_ADDR, LGW_IF_FREQ_3, LGW_FSK_PSIZE};
+	int32_t val[8] = {-100, -5, 200, 5, -300, 0x42, 400, 1};
+	int32_t rd[8];
+	uint16_t bar_id[4] = {LGW_TX_OFFSET_I, LGW_RX_DATA_BUF_ADDR, LGW_IF_FREQ_0, LGW_TX_OFFSET_Q};
+	int32_t bar_val[4] = {3, 0x10, -50, -3};
+	struct lgw_sim_counters_s cnt;
+	uint16_t nb_sw_single, nb_sw_list, nb_sw;
+	uint32_t nb_spi_single, nb_spi_list;
+	int i;
+
+	printf("--- register list access ---\n");
+
+	lgw_reg_shadow(false);
+
+	/* register by register, in list order */
+	lgw_reg_w(LGW_PAGE_REG, 0);
+	lgw_sim_reset_counters(SIM_BOARD);
+	for (i=0; i<8; ++i) {
+		lgw_reg_w(id[i], val[i]);
+	}
+	lgw_sim_get_counters(SIM_BOARD, &cnt);
+	nb_spi_single = cnt.spi_w + cnt.spi_r;
+
+	/* same list, grouped by page */
+	lgw_reg_w(LGW_PAGE_REG, 0);
+	lgw_sim_reset_counters(SIM_BOARD);
+	CHECK(lgw_reg_wl(id, val, 8, &nb_sw_list) == LGW_REG_SUCCESS);
+	lgw_sim_get_counters(SIM_BOARD, &cnt);
+	nb_spi_list = cnt.spi_w + cnt.spi_r;
+	nb_sw_single = nb_sw_list + nb_spi_single - nb_spi_list; /* only the page switches differ */
+	printf("%u page switches register by register, %u grouped by page\n", nb_sw_single, nb_sw_list);
+	CHECK(nb_sw_single == 7);
+	CHECK(nb_sw_list == 2);
+
+	/* read back, starting from another page: the current page is done first */
+	CHECK(lgw_reg_rl(id, rd, 8, &nb_sw) == LGW_REG_SUCCESS);
+	CHECK(nb_sw == 2);
+	CHECK(memcmp(rd, val, sizeof(val)) == 0);
+	CHECK(lgw_reg_rl(id, rd, 8, NULL) == LGW_REG_SUCCESS);
+
+	/* a pointer register is a barrier: the write of IF_FREQ_0 can not move before it */
+	CHECK(lgw_reg_wl(bar_id, bar_val, 4, NULL) == LGW_REG_SUCCESS);
+	lgw_reg_r(LGW_TX_OFFSET_I, &rd[0]);
+	lgw_reg_r(LGW_RX_DATA_BUF_ADDR, &rd[1]);
+	lgw_reg_r(LGW_IF_FREQ_0, &rd[2]);
+	lgw_reg_r(LGW_TX_OFFSET_Q, &rd[3]);
+	CHECK((rd[0] == 3) && (rd[2] == -50) && (rd[3] == -3));
+
+	/* invalid lists */
+	bar_id[1] = LGW_TOTALREGS;
+	CHECK(lgw_reg_wl(bar_id, bar_val, 4, NULL) == LGW_REG_ERROR);
+	CHECK(lgw_reg_rl(NULL, rd, 4, NULL) == LGW_REG_ERROR);
+
+	lgw_reg_shadow(true);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_tx_desc(void) {
+	struct lgw_pkt_tx_s txpkt;
+	struct lgw_tx_desc_s desc;
+	struct lgw_tx_gain_lut_s lut;
+	struct lgw_sim_tx_s ref, tx;
+	uint32_t count_us;
+	int nb_tx;
+
+	printf("--- prepared TX descriptor ---\n");
+
+	memset(&txpkt, 0, sizeof(txpkt));
+	txpkt.freq_hz = F_TX;
+	txpkt.tx_mode = TIMESTAMPED;
+	txpkt.rf_power = 14;
+	txpkt.modulation = MOD_LORA;
+	txpkt.bandwidth = BW_250KHZ;
+	txpkt.datarate = DR_LORA_SF10;
+	txpkt.coderate = CR_LORA_4_8;
+	txpkt.invert_pol = true;
+	txpkt.no_header = true;
+	txpkt.size = 40;
+	memset(txpkt.payload, 0x5A, 40);
+	txpkt.rf_chain = 0;
+
+	/* reference packet sent by value */
+	nb_tx = lgw_sim_tx_count(SIM_BOARD);
+	count_us = lgw_sim_get_count(SIM_BOARD) + 500000;
+	txpkt.count_us = count_us;
+	CHECK(lgw_send(txpkt) == LGW_HAL_SUCCESS);
+	CHECK(lgw_sim_get_tx(SIM_BOARD, nb_tx, &ref) == LGW_SIM_SUCCESS);
+	lgw_abort_tx();
+
+	/* same packet from a prepared descriptor */
+	CHECK(lgw_tx_prepare(&txpkt, &desc) == LGW_HAL_SUCCESS);
+	CHECK(lgw_send_prepared(&desc, TIMESTAMPED, count_us, txpkt.payload, 40) == LGW_HAL_SUCCESS);
+	CHECK(lgw_sim_get_tx(SIM_BOARD, nb_tx + 1, &tx) == LGW_SIM_SUCCESS);
+	lgw_abort_tx();
+	CHECK((tx.tx_mode == ref.tx_mode) && (tx.count_us == ref.count_us) && (tx.freq_hz == ref.freq_hz));
+	CHECK((tx.pow_index == ref.pow_index) && (tx.dig_gain == ref.dig_gain) && (tx.offset_i == ref.offset_i) && (tx.offset_q == ref.offset_q));
+	CHECK((tx.bandwidth == BW_250KHZ) && (tx.datarate == DR_LORA_SF10) && (tx.coderate == CR_LORA_4_8));
+	CHECK((tx.invert_pol == true) && (tx.no_header == true) && (tx.preamble == ref.preamble));
+	CHECK((tx.size == 40) && (memcmp(tx.payload, ref.payload, 40) == 0));
+
+	/* only the payload, size and timestamp change between packets */
+	txpkt.payload[0] = 0x11;
+	CHECK(lgw_send_prepared(&desc, IMMEDIATE, 0, txpkt.payload, 10) == LGW_HAL_SUCCESS);
+	CHECK(lgw_sim_get_tx(SIM_BOARD, nb_tx + 2, &tx) == LGW_SIM_SUCCESS);
+	lgw_abort_tx();
+	CHECK((tx.tx_mode == IMMEDIATE) && (tx.size == 10) && (tx.payload[0] == 0x11) && (tx.datarate == DR_LORA_SF10));
+
+	/* FSK packets by pointer, the second one reuses the parameters of the first one */
+	memset(&txpkt, 0, sizeof(txpkt));
+	txpkt.freq_hz = F_TX;
+	txpkt.tx_mode = IMMEDIATE;
+	txpkt.rf_power = 27;
+	txpkt.modulation = MOD_FSK;
+	txpkt.f_dev = 50;
+	txpkt.datarate = 100000;
+	txpkt.size = 30;
+	memset(txpkt.payload, 0xC3, 30);
+	CHECK(lgw_send_ptr(&txpkt) == LGW_HAL_SUCCESS);
+	lgw_abort_tx();
+	txpkt.size = 200;
+	memset(txpkt.payload, 0x3C, 200);
+	CHECK(lgw_send_ptr(&txpkt) == LGW_HAL_SUCCESS);
+	CHECK(lgw_sim_get_tx(SIM_BOARD, nb_tx + 4, &tx) == LGW_SIM_SUCCESS);
+	lgw_abort_tx();
+	CHECK((tx.modulation == MOD_FSK) && (tx.f_dev == 50) && (tx.datarate == 100000) && (tx.pow_index == 1));
+	CHECK((tx.size == 200) && (tx.payload[0] == 0x3C) && (tx.payload[199] == 0x3C));
+
+	/* a change of the TX gain LUT is applied to prepared descriptors */
+	memset(&lut, 0, sizeof(lut));
+	lut.size = 1;
+	lut.lut[0].pa_gain = 2;
+	lut.lut[0].dac_gain = 3;
+	lut.lut[0].mix_gain = 14;
+	lut.lut[0].rf_power = 20;
+	CHECK(lgw_txgain_setconf(&lut) == LGW_HAL_SUCCESS);
+	CHECK(lgw_send_prepared(&desc, IMMEDIATE, 0, txpkt.payload, 10) == LGW_HAL_SUCCESS);
+	CHECK(lgw_sim_get_tx(SIM_BOARD, nb_tx + 5, &tx) == LGW_SIM_SUCCESS);
+	lgw_abort_tx();
+	CHECK((tx.pow_index == 0) && (tx.offset_i == 7) && (tx.offset_q == -7));
+	lut.size = 2;
+	lut.lut[0].mix_gain = 10;
+	lut.lut[0].rf_power = 14;
+	lut.lut[1].pa_gain = 3;
+	lut.lut[1].dac_gain = 3;
+	lut.lut[1].mix_gain = 14;
+	lut.lut[1].rf_power = 27;
+	CHECK(lgw_txgain_setconf(&lut) == LGW_HAL_SUCCESS);
+
+	/* invalid parameters */
+	CHECK(lgw_send_prepared(&desc, IMMEDIATE, 0, txpkt.payload, 256) == LGW_HAL_ERROR);
+	CHECK(lgw_send_prepared(&desc, 7, 0, txpkt.payload, 10) == LGW_HAL_ERROR);
+	txpkt.rf_chain = 1;
+	CHECK(lgw_tx_prepare(&txpkt, &desc) == LGW_HAL_ERROR);
+	CHECK(lgw_send_prepared(&desc, IMMEDIATE, 0, txpkt.payload, 10) == LGW_HAL_ERROR);
+	CHECK(lgw_send_ptr(&txpkt) == LGW_HAL_ERROR);
+	CHECK(lgw_sim_tx_count(SIM_BOARD) == nb_tx + 6);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* inject a packet 30 ms after being started, and record when */
+static void *inject_later(void *arg) {
+	struct timespec *t_inject = (struct timespec *)arg;
+	struct lgw_sim_rx_s in;
+
+	memset(&in, 0, sizeof(in));
+	in.if_chain = 0;
+	in.status = STAT_CRC_OK;
+	in.datarate = DR_LORA_SF7;
+	in.coderate = CR_LORA_4_5;
+	in.bandwidth = BW_125KHZ;
+	in.rssi = -80.0;
+	in.size = 12;
+	memset(in.payload, 0x77, in.size);
+	wait_ms(30);
+	clock_gettime(CLOCK_MONOTONIC, t_inject);
+	lgw_sim_inject_rx(SIM_BOARD, &in);
+	return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t elapsed_us(const struct timespec *t0, const struct timespec *t1) {
+	return (uint32_t)((t1->tv_sec - t0->tv_sec) * 1000000 + (t1->tv_nsec - t0->tv_nsec) / 1000);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_rx_wait(void) {
+	struct lgw_pkt_rx_s out[LGW_PKT_FIFO_SIZE];
+	struct lgw_rx_fetch_stat_s st0, st1;
+	struct timespec t0, t1, t_inject;
+	pthread_t thrid;
+	uint32_t latency[2];
+	int nb_pkt;
+	int m;
+
+	printf("--- RX wait ---\n");
+
+	/* nothing received, the call returns at the timeout */
+	CHECK(lgw_receive(LGW_PKT_FIFO_SIZE, out) == 0);
+	lgw_rx_fetch_stat(&st0);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	CHECK(lgw_receive_wait(LGW_PKT_FIFO_SIZE, out, 50) == 0);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	lgw_rx_fetch_stat(&st1);
+	CHECK((elapsed_us(&t0, &t1) >= 50000) && (elapsed_us(&t0, &t1) < 80000));
+	CHECK((st1.nb_wait - st0.nb_wait == 1) && (st1.nb_wakeup_poll == st0.nb_wakeup_poll));
+	CHECK(st1.nb_fetch - st0.nb_fetch <= 2);
+
+	/* packet received while waiting, with then without interrupt line */
+	for (m=0; m<2; ++m) {
+		lgw_sim_set_irq(SIM_BOARD, (m == 0));
+		lgw_rx_fetch_stat(&st0);
+		CHECK(pthread_create(&thrid, NULL, inject_later, &t_inject) == 0);
+		nb_pkt = lgw_receive_wait(LGW_PKT_FIFO_SIZE, out, 1000);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		pthread_join(thrid, NULL);
+		lgw_rx_fetch_stat(&st1);
+		latency[m] = elapsed_us(&t_inject, &t1);
+		CHECK((nb_pkt == 1) && (out[0].size == 12) && (out[0].payload[0] == 0x77));
+		if (m == 0) {
+			CHECK((st1.nb_wakeup_irq - st0.nb_wakeup_irq == 1) && (st1.nb_wakeup_poll == st0.nb_wakeup_poll));
+			CHECK(st1.nb_fetch - st0.nb_fetch == 2);
+		} else {
+			CHECK(st1.nb_wakeup_poll - st0.nb_wakeup_poll > 5);
+			CHECK(st1.nb_fetch - st0.nb_fetch < 30); /* 3 ms between polls once the backoff saturates */
+		}
+		printf("%s interrupt line: packet returned %u us after reception, %u FIFO polls\n", (m == 0) ? "with" : "without", latency[m], st1.nb_fetch - st0.nb_fetch);
+	}
+	CHECK(latency[0] < 10000);
+	CHECK(latency[1] < 15000);
+	lgw_sim_set_irq(SIM_BOARD, true);
+}
+
+static void test_txq(void) {
+	struct lgw_txq_s txq;
+	struct lgw_pkt_tx_s txpkt;
+	struct lgw_sim_tx_s tx;
+	uint32_t now, next_us, toa, t;
+	uint32_t start[4];
+	int nb_tx;
+	int i;
+
+	printf("--- TX queue ---\n");
+
+	memset(&txpkt, 0, sizeof(txpkt));
+	txpkt.freq_hz = F_TX;
+	txpkt.rf_power = 14;
+	txpkt.modulation = MOD_LORA;
+	txpkt.bandwidth = BW_125KHZ;
+	txpkt.datarate = DR_LORA_SF7;
+	txpkt.coderate = CR_LORA_4_5;
+	txpkt.invert_pol = true;
+	txpkt.preamble = 8;
+	txpkt.size = 20;
+	txpkt.rf_chain = 0;
+
+	/* time on air: 55.25 symbols of 1.024 ms, and 25.25 symbols of 32.768 ms (low datarate optimization) */
+	CHECK(lgw_time_on_air(&txpkt) == 56576);
+	txpkt.datarate = DR_LORA_SF12;
+	txpkt.size = 3;
+	CHECK(lgw_time_on_air(&txpkt) == 827392);
+	txpkt.datarate = DR_LORA_SF7;
+	txpkt.size = 20;
+	toa = lgw_time_on_air(&txpkt);
+
+	/* the simulated modem agrees */
+	txpkt.tx_mode = IMMEDIATE;
+	nb_tx = lgw_sim_tx_count(SIM_BOARD);
+	CHECK(lgw_send_ptr(&txpkt) == LGW_HAL_SUCCESS);
+	CHECK(lgw_sim_get_tx(SIM_BOARD, nb_tx, &tx) == LGW_SIM_SUCCESS);
+	CHECK(abs((int)tx.airtime_us - (int)toa) <= 1);
+	wait_ms(toa / 1000 + 10);
+
+	/* current counter, not the last PPS */
+	CHECK(lgw_get_instcnt(&now) == LGW_HAL_SUCCESS);
+	CHECK(abs((int)(now - lgw_sim_get_count(SIM_BOARD))) < 1000);
+
+	/* three back-to-back packets, queued out of order */
+	lgw_txq_init(&txq);
+	txq.guard_us = 2 * LGW_TXQ_LEAD_US; /* each packet can be loaded as soon as its lead time starts */
+	lgw_get_instcnt(&now);
+	txpkt.tx_mode = TIMESTAMPED;
+	for (i = 0; i < 3; ++i) {
+		start[i] = now + 100000 + i * (toa + txq.guard_us);
+	}
+	for (i = 2; i >= 0; --i) {
+		txpkt.count_us = start[i];
+		txpkt.payload[0] = i;
+		CHECK(lgw_txq_enqueue(&txq, &txpkt, now) == LGW_TXQ_SUCCESS);
+	}
+	CHECK(lgw_txq_count(&txq) == 3);
+
+	/* overlaps, slot in the past or too close */
+	txpkt.count_us = start[1] + toa / 2;
+	CHECK(lgw_txq_enqueue(&txq, &txpkt, now) == LGW_TXQ_COLLISION);
+	txpkt.count_us = start[0] - toa;
+	CHECK(lgw_txq_enqueue(&txq, &txpkt, now) == LGW_TXQ_COLLISION);
+	txpkt.count_us = now + 1000;
+	CHECK(lgw_txq_enqueue(&txq, &txpkt, now) == LGW_TXQ_TOO_LATE);
+	txpkt.count_us = now - 1000;
+	CHECK(lgw_txq_enqueue(&txq, &txpkt, now) == LGW_TXQ_TOO_LATE);
+	CHECK(txq.nb_collision == 2);
+	CHECK(txq.nb_late == 2);
+
+	/* an immediate packet goes after the last one */
+	txpkt.tx_mode = IMMEDIATE;
+	txpkt.payload[0] = 3;
+	CHECK(lgw_txq_enqueue(&txq, &txpkt, now) == LGW_TXQ_SUCCESS);
+	start[3] = start[2] + toa + txq.guard_us;
+	CHECK(txq.pkt[3].tx_mode == TIMESTAMPED);
+	CHECK(txq.pkt[3].count_us == start[3]);
+
+	/* nothing is sent before its slot */
+	CHECK(lgw_txq_run(&txq, &next_us) == LGW_TXQ_SUCCESS);
+	CHECK(lgw_sim_tx_count(SIM_BOARD) == nb_tx + 1);
+	CHECK((next_us > 100000 - LGW_TXQ_LEAD_US - 5000) && (next_us <= 100000 - LGW_TXQ_LEAD_US));
+
+	/* run the queue like an application would */
+	i = 0;
+	while ((lgw_txq_count(&txq) > 0) && (++i < 1000)) {
+		CHECK(lgw_txq_run(&txq, &next_us) == LGW_TXQ_SUCCESS);
+		wait_us(next_us);
+	}
+	wait_ms(toa / 1000 + 10);
+	CHECK(lgw_txq_count(&txq) == 0);
+	CHECK(txq.nb_sent == 4);
+	CHECK(txq.nb_late == 2);
+	CHECK(lgw_sim_tx_count(SIM_BOARD) == nb_tx + 5);
+	for (i = 0; i < 4; ++i) {
+		lgw_sim_get_tx(SIM_BOARD, nb_tx + 1 + i, &tx);
+		CHECK(tx.payload[0] == i);
+		CHECK(tx.tx_mode == TIMESTAMPED);
+		CHECK(tx.count_us == start[i]);
+		CHECK(tx.trig_us < tx.count_us - TX_START_DELAY); /* loaded before the slot */
+		t = tx.count_us - tx.trig_us;
+		CHECK(t <= LGW_TXQ_LEAD_US + TX_START_DELAY);
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* timestamp correction as computed by lgw_receive before the lookup tables */
+static uint32_t ref_rx_delay(int ifmod, uint8_t bw, uint32_t sf, uint32_t cr, uint32_t crc_en, unsigned sz) {
+	uint32_t delay_x, delay_y, delay_z, bw_pow, ppm;
+	uint32_t dr;
+
+	switch (sf) {
+		case 7: dr = DR_LORA_SF7; break;
+		case 8: dr = DR_LORA_SF8; break;
+		case 9: dr = DR_LORA_SF9; break;
+		case 10: dr = DR_LORA_SF10; break;
+		case 11: dr = DR_LORA_SF11; break;
+		case 12: dr = DR_LORA_SF12; break;
+		default: dr = DR_UNDEFINED;
+	}
+	ppm = (((bw == BW_125KHZ) && ((dr == DR_LORA_SF11) || (dr == DR_LORA_SF12))) || ((bw == BW_250KHZ) && (dr == DR_LORA_SF12))) ? 1 : 0;
+	if (ifmod == IF_LORA_STD) {
+		switch (bw) {
+			case BW_125KHZ: delay_x = 64; bw_pow = 1; break;
+			case BW_250KHZ: delay_x = 32; bw_pow = 2; break;
+			case BW_500KHZ: delay_x = 16; bw_pow = 4; break;
+			default: delay_x = 0; bw_pow = 0;
+		}
+	} else {
+		delay_x = 114;
+		bw_pow = 1;
+	}
+	if ((sf >= 6) && (sf <= 12) && (bw_pow > 0)) {
+		if ((2*(sz + 2*crc_en) - (sf-7)) <= 0) {
+			delay_y = ( ((1<<(sf-1)) * (sf+1)) + (3 * (1<<(sf-4))) ) / bw_pow;
+			delay_z = 32 * (2*(sz+2*crc_en) + 5) / bw_pow;
+		} else {
+			delay_y = ( ((1<<(sf-1)) * (sf+1)) + ((4 - ppm) * (1<<(sf-4))) ) / bw_pow;
+			delay_z = (16 + 4*cr) * (((2*(sz+2*crc_en)-sf+6) % (sf - 2*ppm)) + 1) / bw_pow;
+		}
+		return delay_x + delay_y + delay_z;
+	}
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* LoRa time on air from the datasheet formula */
+static uint32_t ref_lora_toa(uint8_t bw, uint32_t datarate, uint8_t coderate, bool no_crc, bool no_header, uint16_t size, uint16_t preamble) {
+	int sf, bw_khz, de;
+	int32_t nb_bits;
+	uint32_t nb_sym_payload;
+
+	switch (datarate) {
+		case DR_LORA_SF7: sf = 7; break;
+		case DR_LORA_SF8: sf = 8; break;
+		case DR_LORA_SF9: sf = 9; break;
+		case DR_LORA_SF10: sf = 10; break;
+		case DR_LORA_SF11: sf = 11; break;
+		case DR_LORA_SF12: sf = 12; break;
+		default: return 0;
+	}
+	switch (bw) {
+		case BW_125KHZ: bw_khz = 125; break;
+		case BW_250KHZ: bw_khz = 250; break;
+		case BW_500KHZ: bw_khz = 500; break;
+		default: return 0;
+	}
+	if (!IS_LORA_CR(coderate)) {
+		return 0;
+	}
+	de = ((bw_khz == 125) && (sf >= 11)) || ((bw_khz == 250) && (sf == 12));
+	nb_bits = 8*size - 4*sf + 28 + (no_crc ? 0 : 16) - (no_header ? 20 : 0);
+	nb_sym_payload = 8;
+	if (nb_bits > 0) {
+		nb_sym_payload += ((nb_bits + 4*(sf - 2*de) - 1) / (4*(sf - 2*de))) * (coderate + 4);
+	}
+	return (uint32_t)(((uint64_t)(4*(preamble + nb_sym_payload) + 17) * ((uint64_t)1000 << sf)) / (4 * bw_khz));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_lut(void) {
+	const uint8_t bw_tab[] = {BW_UNDEFINED, BW_500KHZ, BW_250KHZ, BW_125KHZ, BW_62K5HZ};
+	const uint32_t dr_tab[] = {DR_UNDEFINED, DR_LORA_SF7, DR_LORA_SF8, DR_LORA_SF9, DR_LORA_SF10, DR_LORA_SF11, DR_LORA_SF12};
+	const uint16_t pre_tab[] = {0, 2, 4, 8, 12, 65535};
+	struct lgw_pkt_tx_s txpkt;
+	struct lgw_sim_rx_s in;
+	struct lgw_pkt_rx_s out;
+	uint32_t ref, lut;
+	int nb_test, nb_diff;
+	int ifmod, b, sf, cr, crc, sz, d, hdr, p;
+
+	printf("--- timing lookup tables ---\n");
+
+	/* every packet the modems can report, including invalid metadata */
+	nb_test = 0;
+	nb_diff = 0;
+	for (ifmod = IF_LORA_STD; ifmod <= IF_LORA_MULTI; ++ifmod) {
+		for (b = 0; b < (int)ARRAY_SIZE(bw_tab); ++b) {
+			if ((ifmod == IF_LORA_MULTI) && (bw_tab[b] != BW_125KHZ)) {
+				continue; /* fixed in hardware */
+			}
+			for (sf = 0; sf < 16; ++sf) {
+				for (cr = 0; cr < 8; ++cr) {
+					for (crc = 0; crc < 2; ++crc) {
+						for (sz = 0; sz < 256; ++sz) {
+							ref = ref_rx_delay(ifmod, bw_tab[b], sf, cr, crc, sz);
+							lut = lgw_lut_rx_delay(ifmod, bw_tab[b], sf, cr, crc, sz);
+							++nb_test;
+							if (lut != ref) {
+								if (nb_diff++ == 0) {
+									printf("RX delay mismatch: modem 0x%02X, BW 0x%02X, SF%d, CR %d, CRC %d, %d bytes: %u instead of %u\n", ifmod, bw_tab[b], sf, cr, crc, sz, lut, ref);
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	printf("%d RX delays compared\n", nb_test);
+	CHECK(nb_test == (5 + 1) * 16 * 8 * 2 * 256);
+	CHECK(nb_diff == 0);
+
+	/* every LoRa packet lgw_send accepts, and invalid parameters */
+	nb_test = 0;
+	nb_diff = 0;
+	memset(&txpkt, 0, sizeof(txpkt));
+	txpkt.modulation = MOD_LORA;
+	for (b = 0; b < (int)ARRAY_SIZE(bw_tab); ++b) {
+		for (d = 0; d < (int)ARRAY_SIZE(dr_tab); ++d) {
+			for (cr = 0; cr < 6; ++cr) {
+				for (crc = 0; crc < 2; ++crc) {
+					for (hdr = 0; hdr < 2; ++hdr) {
+						for (p = 0; p < (int)ARRAY_SIZE(pre_tab); ++p) {
+							for (sz = 0; sz < 256; ++sz) {
+								txpkt.bandwidth = bw_tab[b];
+								txpkt.datarate = dr_tab[d];
+								txpkt.coderate = cr;
+								txpkt.no_crc = (crc == 0);
+								txpkt.no_header = (hdr == 1);
+								txpkt.preamble = pre_tab[p];
+								txpkt.size = sz;
+								/* preamble as adjusted by lgw_send */
+								ref = ref_lora_toa(bw_tab[b], dr_tab[d], cr, txpkt.no_crc, txpkt.no_header, sz, (pre_tab[p] == 0) ? 6 : ((pre_tab[p] < 4) ? 4 : pre_tab[p]));
+								lut = lgw_time_on_air(&txpkt);
+								++nb_test;
+								if (lut != ref) {
+									if (nb_diff++ == 0) {
+										printf("time on air mismatch: BW 0x%02X, DR 0x%02X, CR %d, CRC %d, header %d, preamble %u, %d bytes: %u instead of %u\n", bw_tab[b], dr_tab[d], cr, crc, hdr, pre_tab[p], sz, lut, ref);
+									}
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	printf("%d times on air compared\n", nb_test);
+	CHECK(nb_diff == 0);
+
+	/* lgw_receive applies the table to the raw timestamp */
+	memset(&in, 0, sizeof(in));
+	in.status = STAT_CRC_OK;
+	in.bandwidth = BW_125KHZ;
+	in.coderate = CR_LORA_4_6;
+	in.rssi = -80.0;
+	in.snr = 5.0;
+	for (d = 1; d < (int)ARRAY_SIZE(dr_tab); ++d) {
+		in.if_chain = 0;
+		in.datarate = dr_tab[d];
+		in.count_us = lgw_sim_get_count(SIM_BOARD) + 1000000;
+		in.size = 2 * d;
+		CHECK(lgw_sim_inject_rx(SIM_BOARD, &in) == LGW_SIM_SUCCESS);
+		CHECK(lgw_receive(1, &out) == 1);
+		CHECK(in.count_us - out.count_us == ref_rx_delay(IF_LORA_MULTI, BW_125KHZ, d + 6, 2, 1, in.size));
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* restart the concentrator, return the duration of lgw_start */
+static uint32_t start_ms(int *ret) {
+	struct timespec t0, t1;
+
+	lgw_stop();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	*ret = lgw_start();
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return elapsed_us(&t0, &t1) / 1000;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_cal(void) {
+	const char cal_file[] = "/tmp/test_loragw_sim.cal";
+	const uint16_t iq_reg[] = {LGW_IQ_MISMATCH_A_AMP_COEFF, LGW_IQ_MISMATCH_A_PHI_COEFF, LGW_IQ_MISMATCH_B_AMP_COEFF, LGW_IQ_MISMATCH_B_SEL_I, LGW_IQ_MISMATCH_B_PHI_COEFF};
+	const int32_t iq_val[] = {0x05, 0x3A, 0x07, 1, 0x03}; /* set by the simulated calibration */
+	struct lgw_conf_cal_s calconf;
+	struct lgw_pkt_tx_s txpkt;
+	struct lgw_sim_tx_s tx[2];
+	int32_t val;
+	uint32_t t;
+	char line[16];
+	FILE *f;
+	int i, ret;
+
+	printf("--- calibration ---\n");
+	remove(cal_file);
+
+	/* lgw_start returns as soon as the calibration is done */
+	lgw_sim_set_cal_time(SIM_BOARD, 300);
+	t = start_ms(&ret);
+	printf("lgw_start with a 300 ms calibration: %u ms\n", t);
+	CHECK(ret == LGW_HAL_SUCCESS);
+	CHECK((t >= 300) && (t < 1300));
+	for (i = 0; i < (int)ARRAY_SIZE(iq_reg); ++i) {
+		lgw_reg_r(iq_reg[i], &val);
+		CHECK(val == iq_val[i]);
+	}
+
+	/* or gives up at the deadline */
+	lgw_sim_set_cal_time(SIM_BOARD, 60000);
+	t = start_ms(&ret);
+	printf("lgw_start with a calibration that does not end: %u ms\n", t);
+	CHECK(ret == LGW_HAL_ERROR);
+	CHECK((t >= 5000) && (t < 7000));
+
+	/* invalid configurations */
+	memset(&calconf, 0, sizeof(calconf));
+	calconf.cache_enable = true;
+	CHECK(lgw_cal_setconf(calconf) == LGW_HAL_ERROR);
+	memset(calconf.cache_file, 'a', sizeof(calconf.cache_file));
+	CHECK(lgw_cal_setconf(calconf) == LGW_HAL_ERROR);
+
+	/* cold start, fills the cache */
+	calconf.board_id = 0x0123456789ABCDEFULL;
+	strcpy(calconf.cache_file, cal_file);
+	CHECK(lgw_cal_setconf(calconf) == LGW_HAL_SUCCESS);
+	lgw_sim_set_cal_time(SIM_BOARD, 1500);
+	t = start_ms(&ret);
+	printf("cold start: %u ms\n", t);
+	CHECK(ret == LGW_HAL_SUCCESS);
+	CHECK(t >= 1500);
+	CHECK(lgw_cal_setconf(calconf) == LGW_HAL_ERROR); /* running */
+	f = fopen(cal_file, "r");
+	CHECK(f != NULL);
+	if (f != NULL) {
+		CHECK(fgets(line, sizeof line, f) != NULL);
+		CHECK(strncmp(line, "lgwcal 1 ", 9) == 0);
+		fclose(f);
+	}
+
+	memset(&txpkt, 0, sizeof(txpkt));
+	txpkt.freq_hz = F_TX;
+	txpkt.tx_mode = IMMEDIATE;
+	txpkt.rf_power = 14;
+	txpkt.modulation = MOD_LORA;
+	txpkt.bandwidth = BW_125KHZ;
+	txpkt.datarate = DR_LORA_SF7;
+	txpkt.coderate = CR_LORA_4_5;
+	txpkt.preamble = 8;
+	txpkt.size = 4;
+	CHECK(lgw_send(txpkt) == LGW_HAL_SUCCESS);
+	CHECK(lgw_sim_get_tx(SIM_BOARD, lgw_sim_tx_count(SIM_BOARD) - 1, &tx[0]) == LGW_SIM_SUCCESS);
+	wait_ms(50);
+
+	/* warm start, same corrections without calibrating */
+	t = start_ms(&ret);
+	printf("warm start: %u ms\n", t);
+	CHECK(ret == LGW_HAL_SUCCESS);
+	CHECK(t < 1500);
+	for (i = 0; i < (int)ARRAY_SIZE(iq_reg); ++i) {
+		lgw_reg_r(iq_reg[i], &val);
+		CHECK(val == iq_val[i]);
+	}
+	CHECK(lgw_send(txpkt) == LGW_HAL_SUCCESS);
+	CHECK(lgw_sim_get_tx(SIM_BOARD, lgw_sim_tx_count(SIM_BOARD) - 1, &tx[1]) == LGW_SIM_SUCCESS);
+	CHECK((tx[1].offset_i == tx[0].offset_i) && (tx[1].offset_q == tx[0].offset_q));
+	CHECK(tx[0].offset_i != 0);
+	wait_ms(50);
+
+	/* another board calibrates */
+	lgw_stop();
+	calconf.board_id += 1;
+	CHECK(lgw_cal_setconf(calconf) == LGW_HAL_SUCCESS);
+	t = start_ms(&ret);
+	CHECK(ret == LGW_HAL_SUCCESS);
+	CHECK(t >= 1500);
+	t = start_ms(&ret);
+	CHECK(ret == LGW_HAL_SUCCESS);
+	CHECK(t < 1500);
+
+	/* a damaged cache is ignored and replaced */
+	f = fopen(cal_file, "w");
+	if (f != NULL) {
+		fputs("lgwcal 1 0123456789ABCDF0", f);
+		fclose(f);
+	}
+	t = start_ms(&ret);
+	CHECK(ret == LGW_HAL_SUCCESS);
+	CHECK(t >= 1500);
+	t = start_ms(&ret);
+	CHECK(ret == LGW_HAL_SUCCESS);
+	CHECK(t < 1500);
+
+	/* back to the defaults */
+	lgw_stop();
+	calconf.cache_enable = false;
+	CHECK(lgw_cal_setconf(calconf) == LGW_HAL_SUCCESS);
+	lgw_sim_set_cal_time(SIM_BOARD, LGW_SIM_CAL_TIME);
+	CHECK(lgw_start() == LGW_HAL_SUCCESS);
+	remove(cal_file);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_fw(void) {
+	const char cal_file[] = "/tmp/test_loragw_sim_fw.cal";
+	struct lgw_conf_cal_s calconf;
+	struct lgw_fw_stat_s st0, st1;
+	struct lgw_sim_counters_s cnt;
+	int ret;
+
+	printf("--- firmware loading ---\n");
+	lgw_sim_set_cal_time(SIM_BOARD, 300);
+
+	/* calibrating: the AGC MCU goes from one firmware to the other, and the
+	calibration one also reaches the arbiter program RAM, still on SPI after the reset */
+	CHECK(lgw_fw_stat(NULL) == LGW_HAL_ERROR);
+	lgw_fw_stat(&st0);
+	start_ms(&ret);
+	CHECK(ret == LGW_HAL_SUCCESS);
+	lgw_fw_stat(&st1);
+	CHECK((st1.arb.nb_load == st0.arb.nb_load + 1) && (st1.arb.nb_skip == st0.arb.nb_skip));
+	CHECK((st1.agc.nb_load == st0.agc.nb_load + 2) && (st1.agc.nb_skip == st0.agc.nb_skip));
+	CHECK((st1.arb.crc != 0) && (st1.agc.crc != 0) && (st1.arb.crc != st1.agc.crc));
+	CHECK((st1.arb.nb_fail == 0) && (st1.agc.nb_fail == 0));
+	printf("write %u us, readback %u us\n", st1.agc.load_us, st1.agc.verify_us);
+
+	/* without calibration, nothing to write */
+	remove(cal_file);
+	memset(&calconf, 0, sizeof(calconf));
+	calconf.cache_enable = true;
+	strcpy(calconf.cache_file, cal_file);
+	lgw_stop();
+	CHECK(lgw_cal_setconf(calconf) == LGW_HAL_SUCCESS);
+	start_ms(&ret);
+	CHECK(ret == LGW_HAL_SUCCESS);
+	lgw_fw_stat(&st0);
+	lgw_stop();
+	lgw_sim_reset_counters(SIM_BOARD);
+	start_ms(&ret);
+	CHECK(ret == LGW_HAL_SUCCESS);
+	lgw_fw_stat(&st1);
+	lgw_sim_get_counters(SIM_BOARD, &cnt);
+	printf("warm start: %u bytes written, %u bytes read\n", cnt.bytes_w, cnt.bytes_r);
+	CHECK((st1.arb.nb_load == st0.arb.nb_load) && (st1.arb.nb_skip == st0.arb.nb_skip + 1));
+	CHECK((st1.agc.nb_load == st0.agc.nb_load) && (st1.agc.nb_skip == st0.agc.nb_skip + 1));
+	CHECK(cnt.bytes_w < MCU_FW_BYTE);
+
+	/* program RAM erased behind the HAL back: the readback catches it */
+	lgw_stop();
+	lgw_sim_power_cycle(SIM_BOARD);
+	start_ms(&ret);
+	CHECK(ret == LGW_HAL_SUCCESS);
+	lgw_fw_stat(&st0);
+	CHECK((st0.arb.nb_load == st1.arb.nb_load + 1) && (st0.agc.nb_load == st1.agc.nb_load + 1));
+	CHECK((st0.arb.crc == st1.arb.crc) && (st0.agc.crc == st1.agc.crc));
+	CHECK((st0.arb.nb_fail == 0) && (st0.agc.nb_fail == 0));
+
+	/* back to the defaults */
+	lgw_stop();
+	calconf.cache_enable = false;
+	CHECK(lgw_cal_setconf(calconf) == LGW_HAL_SUCCESS);
+	lgw_sim_set_cal_time(SIM_BOARD, LGW_SIM_CAL_TIME);
+	CHECK(lgw_start() == LGW_HAL_SUCCESS);
+	remove(cal_file);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_spi_conf(void) {
+	struct lgw_spi_conf_s conf, conf0;
+	struct lgw_sim_counters_s cnt;
+	uint8_t buf[1000];
+
+	printf("--- SPI settings ---\n");
+	CHECK(lgw_spi_getconf(&conf0) == LGW_SPI_SUCCESS);
+	CHECK(conf0.chunk_size == LGW_BURST_CHUNK);
+
+	/* out of range */
+	conf.speed_hz = LGW_SPI_SPEED_MAX + 1;
+	conf.chunk_size = 0;
+	CHECK(lgw_spi_setconf(NULL, conf) == LGW_SPI_ERROR);
+	conf.speed_hz = 0;
+	conf.chunk_size = LGW_BURST_CHUNK_MIN - 1;
+	CHECK(lgw_spi_setconf(NULL, conf) == LGW_SPI_ERROR);
+	conf.chunk_size = LGW_BURST_CHUNK_MAX + 1;
+	CHECK(lgw_spi_setconf(NULL, conf) == LGW_SPI_ERROR);
+
+	/* 0 keeps the current value */
+	conf.speed_hz = 2000000;
+	conf.chunk_size = 0;
+	CHECK(lgw_spi_setconf(NULL, conf) == LGW_SPI_SUCCESS);
+	conf.speed_hz = 0;
+	conf.chunk_size = 256;
+	CHECK(lgw_spi_setconf(NULL, conf) == LGW_SPI_SUCCESS);
+	lgw_spi_getconf(&conf);
+	CHECK((conf.speed_hz == 2000000) && (conf.chunk_size == 256));
+
+	/* a burst is split in chunks of the configured size */
+	lgw_sim_reset_counters(SIM_BOARD);
+	CHECK(lgw_reg_rb(LGW_RX_DATA_BUF_DATA, buf, sizeof buf) == LGW_REG_SUCCESS);
+	lgw_sim_get_counters(SIM_BOARD, &cnt);
+	CHECK((cnt.spi_rb == 1) && (cnt.spi_chunks == 4));
+
+	CHECK(lgw_spi_setconf(NULL, conf0) == LGW_SPI_SUCCESS);
+	lgw_sim_reset_counters(SIM_BOARD);
+	CHECK(lgw_reg_rb(LGW_RX_DATA_BUF_DATA, buf, sizeof buf) == LGW_REG_SUCCESS);
+	lgw_sim_get_counters(SIM_BOARD, &cnt);
+	CHECK((cnt.spi_rb == 1) && (cnt.spi_chunks == 1));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void *trace_rx(void *arg) {
+	struct trace_rx_s *rx = (struct trace_rx_s *)arg;
+
+	rx->nb_pkt = lgw_receive(LGW_PKT_FIFO_SIZE, rx->pkt);
+	rx->nb_wait = lgw_receive_wait(LGW_PKT_FIFO_SIZE, rx->pkt + LGW_PKT_FIFO_SIZE - 1, 20); /* nothing left, interrupt wait timeout */
+	return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_trace(void) {
+	const char trc_file[] = "/tmp/test_loragw_sim.trc";
+	const char cut_file[] = "/tmp/test_loragw_sim_cut.trc";
+	struct lgw_trace_stat_s st;
+	struct lgw_sim_counters_s cnt;
+	struct lgw_sim_rx_s in;
+	struct trace_rx_s rx_rec, rx_rep;
+	struct lgw_pkt_tx_s tx;
+	struct timespec t0, t1;
+	pthread_t thrid;
+	uint32_t cnt_rec, cnt_rep;
+	uint8_t buf[4096];
+	char line[256];
+	FILE *f, *g;
+	size_t n;
+	int i, nb_line, nb_frame;
+	bool bol;
+
+	printf("--- SPI trace ---\n");
+	lgw_stop();
+
+	/* record: start, packets received by another thread, counter read after the thread */
+	CHECK(lgw_trace_record(trc_file) == LGW_TRACE_SUCCESS);
+	CHECK(lgw_trace_record(trc_file) == LGW_TRACE_ERROR);
+	CHECK(lgw_trace_replay(trc_file) == LGW_TRACE_ERROR);
+	CHECK(lgw_start() == LGW_HAL_SUCCESS);
+	memset(&in, 0, sizeof in);
+	in.status = STAT_CRC_OK;
+	in.datarate = DR_LORA_SF9;
+	in.coderate = CR_LORA_4_6;
+	in.bandwidth = BW_125KHZ;
+	in.rssi = -95.0;
+	in.snr = 4.5;
+	in.count_us = lgw_sim_get_count(SIM_BOARD) + 50000;
+	for (i = 0; i < 3; ++i) {
+		in.if_chain = i;
+		in.size = 20 + 40 * i;
+		memset(in.payload, 0xA0 + i, in.size);
+		CHECK(lgw_sim_inject_rx(SIM_BOARD, &in) == LGW_SIM_SUCCESS);
+	}
+	memset(&rx_rec, 0, sizeof rx_rec);
+	CHECK(pthread_create(&thrid, NULL, trace_rx, &rx_rec) == 0);
+	pthread_join(thrid, NULL);
+	CHECK((rx_rec.nb_pkt == 3) && (rx_rec.nb_wait == 0));
+	CHECK(lgw_get_instcnt(&cnt_rec) == LGW_HAL_SUCCESS);
+	CHECK(lgw_stop() == LGW_HAL_SUCCESS);
+	CHECK(lgw_trace_stop() == LGW_TRACE_SUCCESS);
+	lgw_trace_stat(&st);
+	CHECK((st.mode == LGW_TRACE_OFF) && (st.nb_record > 100) && (st.nb_mismatch == 0));
+	printf("recorded %u transactions, %llu bytes, %llu us\n", st.nb_record, (unsigned long long)st.nb_byte, (unsigned long long)st.time_us);
+
+	/* replay, the counter is read before the RX thread starts this time */
+	lgw_sim_power_cycle(SIM_BOARD); /* must not be accessed */
+	lgw_sim_reset_counters(SIM_BOARD);
+	CHECK(lgw_trace_replay(trc_file) == LGW_TRACE_SUCCESS);
+	lgw_trace_stat(&st);
+	CHECK((st.mode == LGW_TRACE_REPLAY) && (st.nb_record == 0) && (st.nb_total > 100));
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	CHECK(lgw_start() == LGW_HAL_SUCCESS);
+	CHECK(lgw_get_instcnt(&cnt_rep) == LGW_HAL_SUCCESS);
+	CHECK(cnt_rep == cnt_rec);
+	memset(&rx_rep, 0, sizeof rx_rep);
+	CHECK(pthread_create(&thrid, NULL, trace_rx, &rx_rep) == 0);
+	pthread_join(thrid, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	CHECK((rx_rep.nb_pkt == 3) && (rx_rep.nb_wait == 0));
+	for (i = 0; i < 3; ++i) {
+		CHECK((rx_rep.pkt[i].if_chain == rx_rec.pkt[i].if_chain) && (rx_rep.pkt[i].count_us == rx_rec.pkt[i].count_us) && (rx_rep.pkt[i].rssi == rx_rec.pkt[i].rssi));
+		CHECK((rx_rep.pkt[i].size == rx_rec.pkt[i].size) && (memcmp(rx_rep.pkt[i].payload, rx_rec.pkt[i].payload, rx_rep.pkt[i].size) == 0));
+	}
+	lgw_trace_stat(&st);
+	CHECK(st.nb_mismatch == 0);
+	printf("replayed in %u us\n", elapsed_us(&t0, &t1));
+
+	/* a call that is not in the trace fails without consuming it */
+	memset(&tx, 0, sizeof tx);
+	tx.freq_hz = F_TX;
+	tx.tx_mode = IMMEDIATE;
+	tx.rf_power = 14;
+	tx.modulation = MOD_LORA;
+	tx.bandwidth = BW_125KHZ;
+	tx.datarate = DR_LORA_SF7;
+	tx.coderate = CR_LORA_4_5;
+	tx.preamble = 8;
+	tx.size = 4;
+	CHECK(lgw_send(tx) == LGW_HAL_ERROR);
+	lgw_trace_stat(&st);
+	CHECK((st.nb_mismatch > 0) && (st.first_mismatch > 0));
+	CHECK(lgw_trace_stop() == LGW_TRACE_ERROR); /* still connected */
+	CHECK(lgw_stop() == LGW_HAL_SUCCESS);
+	lgw_trace_stat(&st);
+	CHECK(st.nb_record == st.nb_total);
+	CHECK(lgw_trace_stop() == LGW_TRACE_SUCCESS);
+	lgw_sim_get_counters(SIM_BOARD, &cnt);
+	CHECK(cnt.spi_w + cnt.spi_r + cnt.spi_wb + cnt.spi_rb + cnt.spi_wm == 0);
+
+	/* text conversion, one line per transaction plus one per multiple write frame */
+	f = tmpfile();
+	CHECK(lgw_trace_dump(trc_file, f) == LGW_TRACE_SUCCESS);
+	rewind(f);
+	nb_line = 0;
+	nb_frame = 0;
+	bol = true;
+	while (fgets(line, sizeof line, f) != NULL) { /* long bursts take several fgets */
+		if (bol && (line[0] == ' ')) {
+			nb_frame += 1;
+		} else if (bol && (line[0] != '#')) {
+			nb_line += 1;
+		}
+		bol = (line[strlen(line) - 1] == '\n');
+	}
+	fclose(f);
+	CHECK((nb_line == (int)st.nb_total) && (nb_frame > 0));
+	CHECK(lgw_trace_dump("/dev/null", stdout) == LGW_TRACE_ERROR);
+
+	/* a truncated last record is ignored */
+	f = fopen(trc_file, "rb");
+	g = fopen(cut_file, "wb");
+	CHECK((f != NULL) && (g != NULL));
+	if ((f != NULL) && (g != NULL)) {
+		fseek(f, 0, SEEK_END);
+		n = (size_t)ftell(f) - 1;
+		rewind(f);
+		while (n > 0) {
+			i = (int)fread(buf, 1, (n < sizeof buf) ? n : sizeof buf, f);
+			fwrite(buf, 1, i, g);
+			n -= i;
+		}
+	}
+	if (f != NULL) {
+		fclose(f);
+	}
+	if (g != NULL) {
+		fclose(g);
+	}
+	CHECK(lgw_trace_replay(cut_file) == LGW_TRACE_SUCCESS);
+	lgw_trace_stat(&st);
+	CHECK(st.nb_total == (uint32_t)nb_line - 1);
+	CHECK(lgw_trace_stop() == LGW_TRACE_SUCCESS);
+
+	remove(trc_file);
+	remove(cut_file);
+	CHECK(lgw_start() == LGW_HAL_SUCCESS);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_stats(void) {
+	struct lgw_sim_rx_s in;
+	struct lgw_pkt_rx_s out[LGW_PKT_FIFO_SIZE];
+	struct lgw_pkt_tx_s txpkt;
+	struct lgw_sim_counters_s cnt;
+	struct lgw_stats_s st;
+	uint32_t nb;
+	int i;
+
+	printf("--- HAL statistics ---\n");
+	CHECK(lgw_get_stats(NULL) == LGW_HAL_ERROR);
+	lgw_reset_stats();
+	lgw_sim_reset_counters(SIM_BOARD);
+	CHECK(lgw_get_stats(&st) == LGW_HAL_SUCCESS);
+	CHECK((st.spi_nb == 0) && (st.rx_fetch == 0) && (st.tx_pkt == 0) && (st.rx_time.nb == 0) && (st.rx_time.max_us == 0));
+
+	/* 3 CRC OK, 1 CRC bad and 1 without CRC */
+	memset(&in, 0, sizeof(in));
+	in.if_chain = 0;
+	in.datarate = DR_LORA_SF7;
+	in.coderate = CR_LORA_4_5;
+	in.bandwidth = BW_125KHZ;
+	in.size = 12;
+	for (i=0; i<5; ++i) {
+		in.status = (i < 3) ? STAT_CRC_OK : ((i == 3) ? STAT_CRC_BAD : STAT_NO_CRC);
+		CHECK(lgw_sim_inject_rx(SIM_BOARD, &in) == LGW_SIM_SUCCESS);
+	}
+	CHECK(lgw_receive(2, out) == 2);
+	CHECK(lgw_receive(LGW_PKT_FIFO_SIZE, out) == 3);
+	CHECK(lgw_receive(LGW_PKT_FIFO_SIZE, out) == 0);
+
+	/* one packet sent, one rejected */
+	memset(&txpkt, 0, sizeof(txpkt));
+	txpkt.freq_hz = F_TX;
+	txpkt.tx_mode = IMMEDIATE;
+	txpkt.rf_power = 14;
+	txpkt.modulation = MOD_LORA;
+	txpkt.bandwidth = BW_125KHZ;
+	txpkt.datarate = DR_LORA_SF7;
+	txpkt.coderate = CR_LORA_4_5;
+	txpkt.size = 10;
+	CHECK(lgw_send_ptr(&txpkt) == LGW_HAL_SUCCESS);
+	txpkt.size = 300;
+	CHECK(lgw_send_ptr(&txpkt) == LGW_HAL_ERROR);
+
+	CHECK(lgw_get_stats(&st) == LGW_HAL_SUCCESS);
+	lgw_sim_get_counters(SIM_BOARD, &cnt);
+	CHECK(st.spi_nb == (uint64_t)cnt.spi_w + cnt.spi_r + cnt.spi_wb + cnt.spi_rb + cnt.spi_wm);
+	CHECK(st.spi_bytes_w == cnt.bytes_w);
+	CHECK(st.spi_bytes_r == cnt.bytes_r);
+	CHECK((st.rx_fetch == 3) && (st.rx_pkt == 5) && (st.rx_error == 0));
+	CHECK((st.rx_crc_ok == 3) && (st.rx_crc_bad == 1) && (st.rx_no_crc == 1));
+	CHECK((st.tx_pkt == 1) && (st.tx_error == 1));
+	CHECK((st.rx_time.nb == 3) && (st.tx_time.nb == 2));
+	for (nb = 0, i = 0; i < LGW_STATS_HIST_NB; ++i) {
+		nb += st.rx_time.hist[i];
+	}
+	CHECK(nb == st.rx_time.nb);
+	CHECK((st.rx_time.max_us <= st.rx_time.total_us) && (st.rx_time.total_us <= 3 * (uint64_t)st.rx_time.max_us));
+	printf("%llu SPI transactions, %llu bytes written, %llu bytes read, %llu page switches\n", (unsigned long long)st.spi_nb, (unsigned long long)st.spi_bytes_w, (unsigned long long)st.spi_bytes_r, (unsigned long long)st.page_switch);
+	printf("lgw_receive: %u calls, average %llu us, max %u us\n", st.rx_time.nb, (unsigned long long)(st.rx_time.total_us / st.rx_time.nb), st.rx_time.max_us);
+
+	/* not reset by a restart, reset on request */
+	CHECK(lgw_stop() == LGW_HAL_SUCCESS);
+	CHECK(lgw_start() == LGW_HAL_SUCCESS);
+	CHECK(lgw_receive(LGW_PKT_FIFO_SIZE, out) == 0);
+	lgw_get_stats(&st);
+	CHECK((st.rx_fetch == 4) && (st.tx_pkt == 1));
+	lgw_reset_stats();
+	lgw_get_stats(&st);
+	CHECK((st.spi_nb == 0) && (st.page_switch == 0) && (st.rx_fetch == 0) && (st.rx_time.nb == 0) && (st.rx_time.hist[0] == 0) && (st.tx_time.total_us == 0));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* start a board, receive packets tagged with its number and send one packet */
+static void *ctx_run(void *arg) {
+	struct ctx_board_s *cb = (struct ctx_board_s *)arg;
+	struct lgw_sim_rx_s in;
+	struct lgw_pkt_rx_s out[LGW_PKT_FIFO_SIZE];
+	struct lgw_pkt_tx_s txpkt;
+	int i, j, n;
+
+	cb->start = lgw_ctx_start(cb->ctx);
+	if (cb->start != LGW_HAL_SUCCESS) {
+		return NULL;
+	}
+
+	memset(&in, 0, sizeof(in));
+	in.status = STAT_CRC_OK;
+	in.datarate = DR_LORA_SF7;
+	in.coderate = CR_LORA_4_5;
+	in.bandwidth = BW_125KHZ;
+	in.size = 16;
+	for (i = 0; i < CTX_PKT_NB; i += 4) {
+		for (j = 0; j < 4; ++j) {
+			in.if_chain = j;
+			memset(in.payload, cb->board * 16 + j, in.size);
+			lgw_sim_inject_rx(cb->board, &in);
+		}
+		n = lgw_ctx_receive(cb->ctx, LGW_PKT_FIFO_SIZE, out);
+		for (j = 0; j < n; ++j) {
+			if ((out[j].size != 16) || (out[j].payload[0] != cb->board * 16 + out[j].if_chain) || (out[j].payload[15] != out[j].payload[0])) {
+				cb->nb_bad += 1;
+			}
+		}
+		cb->nb_pkt += (n > 0) ? n : 0;
+	}
+
+	memset(&txpkt, 0, sizeof(txpkt));
+	txpkt.freq_hz = cb->f_tx;
+	txpkt.rf_chain = cb->rf_chain;
+	txpkt.tx_mode = IMMEDIATE;
+	txpkt.rf_power = 14;
+	txpkt.modulation = MOD_LORA;
+	txpkt.bandwidth = BW_125KHZ;
+	txpkt.datarate = DR_LORA_SF7;
+	txpkt.coderate = CR_LORA_4_5;
+	txpkt.size = 8;
+	memset(txpkt.payload, cb->board, txpkt.size);
+	cb->send = lgw_ctx_send(cb->ctx, &txpkt);
+	return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_ctx(void) {
+	struct ctx_board_s cb[2];
+	struct lgw_ctx_s *bad;
+	struct lgw_conf_rxrf_s rfconf;
+	struct lgw_sim_counters_s cnt;
+	struct lgw_sim_tx_s tx;
+	struct timespec t0, t1;
+	pthread_t thrid[2];
+	uint8_t status_var;
+	int i;
+
+	printf("--- HAL contexts, two more boards ---\n");
+	CHECK(lgw_ctx_free(NULL) == LGW_HAL_ERROR);
+
+	/* a context on a device that does not exist cannot be started */
+	bad = lgw_ctx_new("9");
+	CHECK(bad != NULL);
+	CHECK(lgw_ctx_start(bad) == LGW_HAL_ERROR);
+	CHECK(lgw_ctx_free(bad) == LGW_HAL_SUCCESS);
+
+	memset(cb, 0, sizeof cb);
+	for (i = 0; i < 2; ++i) {
+		cb[i].board = SIM_BOARD + 1 + i;
+		cb[i].rf_chain = i;
+		cb[i].f_tx = F_TX + 200000 * i;
+		cb[i].ctx = lgw_ctx_new((i == 0) ? "1" : "2");
+		CHECK(cb[i].ctx != NULL);
+		lgw_sim_power_cycle(cb[i].board);
+		lgw_sim_set_cal_time(cb[i].board, 300);
+
+		/* same configuration as the default context, selected in this thread */
+		CHECK(lgw_ctx_select(cb[i].ctx) == NULL);
+		configure();
+		CHECK(lgw_ctx_select(NULL) == cb[i].ctx);
+	}
+	/* second board: TX on radio B, configured through the context */
+	memset(&rfconf, 0, sizeof(rfconf));
+	rfconf.enable = true;
+	rfconf.freq_hz = F_RX_B;
+	rfconf.rssi_offset = LGW_SIM_RSSI_OFFSET;
+	rfconf.type = LGW_RADIO_TYPE_SX1257;
+	rfconf.tx_enable = true;
+	CHECK(lgw_ctx_rxrf_setconf(cb[1].ctx, 1, rfconf) == LGW_HAL_SUCCESS);
+
+	/* both boards run at the same time, the default one is left alone */
+	lgw_sim_reset_counters(SIM_BOARD);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < 2; ++i) {
+		CHECK(pthread_create(&thrid[i], NULL, ctx_run, &cb[i]) == 0);
+	}
+	for (i = 0; i < 2; ++i) {
+		pthread_join(thrid[i], NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	printf("two boards started and run in %u ms\n", elapsed_us(&t0, &t1) / 1000);
+	for (i = 0; i < 2; ++i) {
+		CHECK(cb[i].start == LGW_HAL_SUCCESS);
+		CHECK((cb[i].nb_pkt == CTX_PKT_NB) && (cb[i].nb_bad == 0));
+		CHECK(cb[i].send == LGW_HAL_SUCCESS);
+		CHECK(lgw_sim_tx_count(cb[i].board) == 1);
+		CHECK(lgw_sim_get_tx(cb[i].board, 0, &tx) == LGW_SIM_SUCCESS);
+		CHECK((abs((int)tx.freq_hz - (int)cb[i].f_tx) < 62) && (tx.rf_chain == cb[i].rf_chain) && (tx.size == 8) && (tx.payload[0] == cb[i].board));
+		CHECK(lgw_ctx_status(cb[i].ctx, TX_STATUS, &status_var) == LGW_HAL_SUCCESS);
+		CHECK(status_var == TX_EMITTING);
+	}
+	lgw_sim_get_counters(SIM_BOARD, &cnt);
+	CHECK(cnt.spi_w + cnt.spi_r + cnt.spi_wb + cnt.spi_rb + cnt.spi_wm == 0);
+	CHECK(lgw_status(TX_STATUS, &status_var) == LGW_HAL_SUCCESS); /* default context still running */
+
+	/* a running or selected context cannot be released */
+	CHECK(lgw_ctx_free(cb[0].ctx) == LGW_HAL_ERROR);
+	for (i = 0; i < 2; ++i) {
+		CHECK(lgw_ctx_stop(cb[i].ctx) == LGW_HAL_SUCCESS);
+	}
+	lgw_ctx_select(cb[0].ctx);
+	CHECK(lgw_ctx_free(cb[0].ctx) == LGW_HAL_ERROR);
+	lgw_ctx_select(NULL);
+	for (i = 0; i < 2; ++i) {
+		CHECK(lgw_ctx_free(cb[i].ctx) == LGW_HAL_SUCCESS);
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_reg_acc(void) {
+	/* one register of each layout: byte, bits with and without offset, multi-byte, signed or not */
+	static const struct reg_acc_s reg[] = {
+		{ LGW_SW_TEST_REG1, lgw_reg_r_sw_test_reg1, lgw_reg_w_sw_test_reg1, { -128, 127, -1 } },
+		{ LGW_SW_TEST_REG2, lgw_reg_r_sw_test_reg2, lgw_reg_w_sw_test_reg2, { -32, 31, -7 } },
+		{ LGW_SW_TEST_REG3, lgw_reg_r_sw_test_reg3, lgw_reg_w_sw_test_reg3, { -32768, 32767, -300 } },
+		{ LGW_TX_GAIN, lgw_reg_r_tx_gain, lgw_reg_w_tx_gain, { 3, 0, 2 } },
+		{ LGW_GPS_POL, lgw_reg_r_gps_pol, lgw_reg_w_gps_pol, { 0, 1, 0 } },
+		{ LGW_MAX_PAYLOAD_LEN, lgw_reg_r_max_payload_len, lgw_reg_w_max_payload_len, { 255, 0, 128 } },
+		{ LGW_ADJUST_MODEM_START_OFFSET_SF12_RDX4, lgw_reg_r_adjust_modem_start_offset_sf12_rdx4, lgw_reg_w_adjust_modem_start_offset_sf12_rdx4, { 4095, 0, 1234 } },
+		{ LGW_IF_FREQ_0, lgw_reg_r_if_freq_0, lgw_reg_w_if_freq_0, { -4096, 4095, -384 } }
+	};
+	struct lgw_reg_stats_s st0, st1, st2;
+	struct timespec t0, t1, t2;
+	int32_t save, val;
+	int i, j, ok;
+
+	printf("--- generated register accessors ---\n");
+	for (i = 0; i < (int)(sizeof reg / sizeof reg[0]); ++i) {
+		CHECK(lgw_reg_r(reg[i].id, &save) == LGW_REG_SUCCESS);
+		ok = 1;
+		for (j = 0; j < 3; ++j) {
+			/* accessor write, generic read, then the reverse */
+			ok &= (reg[i].w(reg[i].val[j]) == LGW_REG_SUCCESS);
+			ok &= (lgw_reg_r(reg[i].id, &val) == LGW_REG_SUCCESS) && (val == reg[i].val[j]);
+			ok &= (lgw_reg_w(reg[i].id, reg[i].val[(j+1)%3]) == LGW_REG_SUCCESS);
+			ok &= (reg[i].r(&val) == LGW_REG_SUCCESS) && (val == reg[i].val[(j+1)%3]);
+			/* a change of value costs the same SPI traffic on both paths */
+			lgw_reg_stats(&st0);
+			lgw_reg_w(reg[i].id, reg[i].val[j]);
+			lgw_reg_stats(&st1);
+			reg[i].w(reg[i].val[(j+1)%3]);
+			lgw_reg_stats(&st2);
+			ok &= (st1.nb_spi - st0.nb_spi) == (st2.nb_spi - st1.nb_spi);
+			ok &= (st1.nb_byte_w - st0.nb_byte_w) == (st2.nb_byte_w - st1.nb_byte_w);
+		}
+		CHECK(ok == 1);
+		lgw_reg_w(reg[i].id, save);
+	}
+
+	/* the neighbour bits of a bit field are kept */
+	lgw_reg_r(LGW_GPS_EN, &save);
+	lgw_reg_w_gps_pol(1);
+	lgw_reg_w_gps_en(0);
+	CHECK((lgw_reg_r(LGW_GPS_POL, &val) == LGW_REG_SUCCESS) && (val == 1));
+	lgw_reg_w_gps_en(save);
+
+	/* with the register shadow, a write of the same value is only a lookup */
+	lgw_reg_w_tx_gain(1);
+	lgw_reg_stats(&st0);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < 100000; ++i) {
+		lgw_reg_w(LGW_TX_GAIN, 1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	for (i = 0; i < 100000; ++i) {
+		lgw_reg_w_tx_gain(1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	lgw_reg_stats(&st1);
+	CHECK(st1.nb_spi == st0.nb_spi);
+	printf("skipped write: lgw_reg_w %u ns, lgw_reg_w_tx_gain %u ns\n", elapsed_us(&t0, &t1) / 100, elapsed_us(&t1, &t2) / 100);
+
+	/* read-only register */
+	CHECK((lgw_reg_r_version(&val) == LGW_REG_SUCCESS) && (val == loregs[LGW_VERSION].dflt));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* give a NMEA stream to the parser in reads of chunk bytes, return the number of sentences completed */
+static int nmea_feed(const char *data, int size, int chunk, enum gps_msg *msg) {
+	int nb_msg = 0;
+	int i = 0;
+	int n, used;
+	enum gps_msg m;
+
+	while (i < size) {
+		n = ((size - i) < chunk) ? (size - i) : chunk;
+		while (n > 0) { /* one read can hold several sentences */
+			m = lgw_parse_nmea_stream(data + i, n, &used);
+			if (m != UNKNOWN) {
+				if (nb_msg < NMEA_MSG_NB) {
+					msg[nb_msg] = m;
+				}
+				nb_msg += 1;
+			}
+			i += used;
+			n -= used;
+		}
+	}
+	return nb_msg;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_nmea(void) {
+	static const char rmc[] = "$GPRMC,083559.25,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A*50\r\n";
+	static const char gga[] = "$GPGGA,083559.25,4717.11437,N,00833.91522,E,1,08,1.01,499.6,M,48.0,M,,*5F\r\n";
+	static const char stream[] =
+		"$GPGGA,0835" /* truncated by the GPS, dropped at the next '$' */
+		"$GPRMC,083559.25,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A*50\r\n"
+		"$GPGGA,083559.25,4717.11437,N,00833.91522,E,1,08,1.01,499.6,M,48.0,M,,*5F\r\n"
+		"$GPGSA,A,3,23,29,07,08,09,18,26,28,,,,,1.94,1.18,1.54*0D\r\n"
+		"$GPZDA,083600.50,09,12,2002,00,00*64\r\n"
+		"$GPGSV,3,1,10,23,38,230,44,29,71,156,47,07,29,116,41,08,09,081,36*7f\r\n";
+	static const enum gps_msg expect[] = { NMEA_RMC, NMEA_GGA, NMEA_GSA, NMEA_ZDA, IGNORED };
+	static const char bad_cs[] = "$GPRMC,083601.00,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A*58\r\n";
+	static const char bad_char[] = "$GPRMC,083601.00,A,4717.11437,N,00833\n";
+	char line[128];
+	enum gps_msg msg[NMEA_MSG_NB];
+	struct timespec utc0, utc;
+	struct coord_s loc0, loc;
+	struct lgw_gps_fix_s fix;
+	int size = sizeof stream - 1;
+	int chunk, ok, used;
+
+	printf("--- NMEA stream parser ---\n");
+
+	/* same time and position as the line parser */
+	strcpy(line, rmc);
+	CHECK(lgw_parse_nmea(line, sizeof line) == NMEA_RMC);
+	strcpy(line, gga);
+	CHECK(lgw_parse_nmea(line, sizeof line) == NMEA_GGA);
+	CHECK(lgw_gps_get(&utc0, &loc0, NULL) == LGW_GPS_SUCCESS);
+	CHECK(utc0.tv_sec == 1039422959);
+	CHECK(lgw_parse_nmea_stream(rmc, sizeof rmc - 1, NULL) == NMEA_RMC);
+	CHECK(lgw_parse_nmea_stream(gga, sizeof gga - 1, NULL) == NMEA_GGA);
+	CHECK(lgw_gps_get(&utc, &loc, NULL) == LGW_GPS_SUCCESS);
+	CHECK((utc.tv_sec == utc0.tv_sec) && (utc.tv_nsec == utc0.tv_nsec));
+	CHECK((loc.lat == loc0.lat) && (loc.lon == loc0.lon) && (loc.alt == loc0.alt));
+
+	/* the same sentences whatever the reads, down to one byte at a time */
+	ok = 1;
+	for (chunk = 1; chunk <= size; ++chunk) {
+		ok &= (nmea_feed(stream, size, chunk, msg) == (int)ARRAY_SIZE(expect));
+		ok &= (memcmp(msg, expect, sizeof expect) == 0);
+	}
+	CHECK(ok == 1);
+
+	/* ZDA gives the time, GSA the quality of the fix */
+	CHECK(lgw_gps_get(&utc, NULL, NULL) == LGW_GPS_SUCCESS);
+	CHECK((utc.tv_sec == 1039422960) && (utc.tv_nsec == 500000000));
+	CHECK(lgw_gps_get_fix(&fix) == LGW_GPS_SUCCESS);
+	CHECK((fix.mode == 'A') && (fix.nb_sat == 8) && (fix.dim == 3));
+	CHECK((fabs(fix.pdop - 1.94) < 1e-3) && (fabs(fix.hdop - 1.18) < 1e-3) && (fabs(fix.vdop - 1.54) < 1e-3));
+
+	/* a bad checksum or a broken line is rejected and leaves the time as it was */
+	CHECK(lgw_parse_nmea_stream(bad_cs, sizeof bad_cs - 1, &used) == INVALID);
+	CHECK(used == (int)sizeof bad_cs - 3);
+	CHECK(lgw_parse_nmea_stream(bad_char, sizeof bad_char - 1, &used) == INVALID);
+	CHECK(used == (int)sizeof bad_char - 1);
+	CHECK(lgw_gps_get(&utc, NULL, NULL) == LGW_GPS_SUCCESS);
+	CHECK(utc.tv_sec == 1039422960);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* counter of the simulated drifting clock at t seconds after the first PPS, with +/-0.3 us of jitter if seed is not NULL */
+static uint32_t fit_count(double t, uint32_t *seed) {
+	double us = 1E6 * (t + (FIT_XTAL_ERR * t) + (0.5 * FIT_DRIFT * t * t));
+
+	if (seed != NULL) {
+		*seed = (*seed * 1103515245) + 12345;
+		us += 0.6 * ((double)(*seed >> 16) / 65536.0) - 0.3;
+	}
+	return FIT_CNT0 + (uint32_t)(int64_t)floor(us);
+}
+
+/* error of the conversion of a timestamp taken t seconds after the first PPS */
+static double fit_error_us(struct tref ref, uint32_t count_us, double t) {
+	struct timespec utc;
+
+	if (lgw_cnt2utc(ref, count_us, &utc) != LGW_GPS_SUCCESS) {
+		return 1E9;
+	}
+	return ((double)(utc.tv_sec - FIT_UTC0) - t) * 1E6 + (1E-3 * utc.tv_nsec);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_gps_fit(void) {
+	static uint32_t cnt[FIT_CONV_NB];
+	static struct timespec utc[FIT_CONV_NB];
+	static uint32_t cnt_n[FIT_CONV_NB];
+	static struct timespec utc_n[FIT_CONV_NB];
+	struct tref_fit fit;
+	struct tref ref, ref_old;
+	struct timespec pps, t0, t1, t2;
+	uint32_t seed = 1;
+	uint32_t nb_glitch = 0;
+	uint32_t inst, trig, tog, nb0, nb;
+	double err, err_us, t;
+	double max_err = 0.0, max_old = 0.0, max_hold = 0.0, max_ratio = 0.0;
+	int i, k, ok;
+
+	printf("--- GPS time reference fit ---\n");
+	memset(&ref, 0, sizeof ref);
+	memset(&ref_old, 0, sizeof ref_old);
+	CHECK(lgw_gps_fit_init(&fit) == LGW_GPS_SUCCESS);
+	CHECK(lgw_gps_fit_err(&fit, FIT_CNT0, &err_us) == LGW_GPS_ERROR);
+
+	/* one PPS per second, with glitches and an outage */
+	ok = 1;
+	for (k = 0; k < FIT_PPS_NB; ++k) {
+		if ((k < 200) || (k >= 260)) {
+			pps.tv_sec = FIT_UTC0 + k;
+			pps.tv_nsec = 0;
+			if ((k % 23) == 11) { /* PPS glitch */
+				lgw_gps_sync_fit(&fit, &ref, fit_count(k, &seed) + 250, pps);
+				lgw_gps_sync(&ref_old, fit_count(k, &seed) + 250, pps);
+				nb_glitch += 1;
+			} else {
+				lgw_gps_sync_fit(&fit, &ref, fit_count(k, &seed), pps);
+				lgw_gps_sync(&ref_old, fit_count(k, &seed), pps);
+			}
+		}
+		if (k < FIT_PPS_NB / 10) {
+			continue;
+		}
+
+		/* a packet received between two PPS */
+		t = k + 0.5;
+		err = fabs(fit_error_us(ref, fit_count(t, NULL), t));
+		ok &= (lgw_gps_fit_err(&fit, fit_count(t, NULL), &err_us) == LGW_GPS_SUCCESS);
+		if ((err / (err_us + 0.5)) > max_ratio) {
+			max_ratio = err / (err_us + 0.5);
+		}
+		if ((k >= 200) && (k < 260)) {
+			max_hold = (err > max_hold) ? err : max_hold;
+		} else if ((k >= 300) || (k < 200)) {
+			max_err = (err > max_err) ? err : max_err;
+			err = fabs(fit_error_us(ref_old, fit_count(t, NULL), t));
+			max_old = (err > max_old) ? err : max_old;
+		}
+	}
+	printf("max error: lgw_gps_sync %.2f us, lgw_gps_sync_fit %.2f us, %.2f us after 60 s without PPS\n", max_old, max_err, max_hold);
+	printf("clock error %.4f ppm (+/-%.4f), residuals %.2f us, %u sync points rejected\n", (fit.xtal_err - 1.0) * 1E6, fit.xtal_sd * 1E6, fit.res_us, fit.nb_reject);
+	CHECK(ok == 1);
+	CHECK(fit.nb_reject == nb_glitch);
+	CHECK(max_err < 1.5);
+	CHECK(max_hold < 10.0);
+	CHECK(max_ratio < 3.0);
+	t = FIT_PPS_NB - 1;
+	CHECK(fabs(fit.xtal_err - (1.0 + FIT_XTAL_ERR + (FIT_DRIFT * t))) < 0.05E-6);
+
+	/* the concentrator restarts: the fit follows after FIT_ABER_MAX points */
+	for (i = 0, ok = 0; i < 3; ++i, ++k) {
+		pps.tv_sec = FIT_UTC0 + k;
+		ok += (lgw_gps_sync_fit(&fit, &ref, fit_count(k, &seed) + 1000000000, pps) == LGW_GPS_SUCCESS);
+	}
+	CHECK(ok == 1);
+	for (i = 0; i < 8; ++i, ++k) {
+		pps.tv_sec = FIT_UTC0 + k;
+		lgw_gps_sync_fit(&fit, &ref, fit_count(k, &seed) + 1000000000, pps);
+	}
+	CHECK(fabs(fit_error_us(ref, fit_count(k - 0.5, NULL) + 1000000000, k - 0.5)) < 1.5);
+	CHECK(fit.nb_reject == nb_glitch + 2);
+
+	/* arrays: same result as one timestamp at a time */
+	for (i = 0; i < FIT_CONV_NB; ++i) {
+		cnt[i] = ref.count_us + (uint32_t)(i * 7919);
+	}
+	ok = 1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (k = 0; k < 100; ++k) {
+		for (i = 0; i < FIT_CONV_NB; ++i) {
+			lgw_cnt2utc(ref, cnt[i], &utc[i]);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	for (k = 0; k < 100; ++k) {
+		ok &= (lgw_cnt2utc_n(ref, cnt, utc_n, FIT_CONV_NB) == LGW_GPS_SUCCESS);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	for (i = 0; i < FIT_CONV_NB; ++i) {
+		err = (double)(utc_n[i].tv_sec - utc[i].tv_sec) * 1E9 + (double)(utc_n[i].tv_nsec - utc[i].tv_nsec);
+		ok &= (fabs(err) <= 1.0) && (utc_n[i].tv_nsec >= 0) && (utc_n[i].tv_nsec < 1000000000);
+	}
+	CHECK(ok == 1);
+	printf("cnt -> utc: lgw_cnt2utc %u ns, lgw_cnt2utc_n %u ns per timestamp\n", elapsed_us(&t0, &t1) * 10 / FIT_CONV_NB, elapsed_us(&t1, &t2) * 10 / FIT_CONV_NB);
+	ok = (lgw_utc2cnt_n(ref, utc, cnt_n, FIT_CONV_NB) == LGW_GPS_SUCCESS);
+	for (i = 0; i < FIT_CONV_NB; ++i) {
+		lgw_utc2cnt(ref, utc[i], &cnt[i]);
+		ok &= (cnt_n[i] == cnt[i]);
+	}
+	CHECK(ok == 1);
+	ref.systime = 0;
+	CHECK(lgw_cnt2utc_n(ref, cnt, utc_n, FIT_CONV_NB) == LGW_GPS_ERROR);
+
+	/* simulated concentrator: after a counter read, the trigger timestamp is
+	the end of the capture suspension until the next PPS, and is recognized */
+	CHECK(lgw_get_gps_toggle(&nb0, &tog) == LGW_HAL_SUCCESS);
+	CHECK(lgw_get_instcnt(&inst) == LGW_HAL_SUCCESS);
+	CHECK(lgw_get_trigcnt(&trig) == LGW_HAL_SUCCESS);
+	CHECK(lgw_get_gps_toggle(&nb, &tog) == LGW_HAL_SUCCESS);
+	printf("counter read at %u, trigger timestamp %u, last PPS at %u\n", inst, trig, inst - (inst % 1000000));
+	CHECK((nb == nb0 + 1) && (tog == inst));
+	CHECK((trig - tog) < LGW_GPS_TOGGLE_US);
+	wait_us(1000000 - (trig % 1000000) + 10000);
+	CHECK(lgw_get_trigcnt(&trig) == LGW_HAL_SUCCESS);
+	CHECK(((trig % 1000000) == 0) && ((trig - tog) >= LGW_GPS_TOGGLE_US) && ((trig - tog) < 1000000));
+	CHECK((lgw_get_gps_toggle(&nb, &tog) == LGW_HAL_SUCCESS) && (nb == nb0 + 1));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SNR-like value, skewed: sum of uniform values plus rare deep fades */
+static double stat_value(uint32_t *seed) {
+	double x = 0.0;
+	int i;
+
+	for (i = 0; i < 4; ++i) {
+		*seed = (*seed * 1103515245) + 12345;
+		x += (double)(*seed >> 16) / 65536.0;
+	}
+	x = 3.0 * (x - 2.0) + 5.0;
+	if ((*seed >> 16) % 20 == 0) {
+		x -= 8.0;
+	}
+	return x;
+}
+
+static int stat_cmp(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_stat(void) {
+	static double val[STAT_SORT_NB];
+	const double p[LGW_STAT_QUANT_NB] = {0.05, 0.5, 0.95};
+	const int quant[LGW_STAT_QUANT_NB] = {LGW_STAT_P5, LGW_STAT_P50, LGW_STAT_P95};
+	struct lgw_stat_s stat;
+	struct timespec t0, t1;
+	uint32_t seed = 7;
+	double mean = 0.0, var = 0.0, sd, err, max_err = 0.0;
+	int i, ok;
+
+	printf("--- Streaming statistics ---\n");
+	CHECK(lgw_stat_init(NULL) == LGW_STAT_ERROR);
+	CHECK(lgw_stat_init(&stat) == LGW_STAT_SUCCESS);
+	CHECK(isnan(lgw_stat_mean(&stat)) && isnan(lgw_stat_sd(&stat)) && isnan(lgw_stat_quantile(&stat, LGW_STAT_P50)));
+
+	/* a few values: exact, interpolated percentiles */
+	lgw_stat_add(&stat, 3.0);
+	lgw_stat_add(&stat, -1.0);
+	lgw_stat_add(&stat, 2.0);
+	CHECK((stat.nb == 3) && (stat.min == -1.0) && (stat.max == 3.0));
+	CHECK(fabs(lgw_stat_mean(&stat) - (4.0 / 3.0)) < 1E-12);
+	CHECK(lgw_stat_quantile(&stat, LGW_STAT_P50) == 2.0);
+	CHECK(fabs(lgw_stat_quantile(&stat, LGW_STAT_P5) - (-1.0 + 0.1 * 3.0)) < 1E-12);
+	CHECK(isnan(lgw_stat_quantile(&stat, LGW_STAT_QUANT_NB)));
+
+	/* large offset: the variance of the deviations, not of the values */
+	lgw_stat_init(&stat);
+	lgw_stat_add(&stat, 1E9 + 4.0);
+	lgw_stat_add(&stat, 1E9 + 7.0);
+	lgw_stat_add(&stat, 1E9 + 13.0);
+	lgw_stat_add(&stat, 1E9 + 16.0);
+	CHECK(fabs(lgw_stat_sd(&stat) - sqrt(22.5)) < 1E-6);
+
+	/* against the exact statistics of the same values */
+	lgw_stat_init(&stat);
+	for (i = 0; i < STAT_SORT_NB; ++i) {
+		val[i] = stat_value(&seed);
+		lgw_stat_add(&stat, val[i]);
+		mean += val[i];
+	}
+	mean /= STAT_SORT_NB;
+	for (i = 0; i < STAT_SORT_NB; ++i) {
+		var += (val[i] - mean) * (val[i] - mean);
+	}
+	sd = sqrt(var / STAT_SORT_NB);
+	qsort(val, STAT_SORT_NB, sizeof val[0], stat_cmp);
+	CHECK(stat.nb == STAT_SORT_NB);
+	CHECK(fabs(lgw_stat_mean(&stat) - mean) < 1E-9);
+	CHECK(fabs(lgw_stat_sd(&stat) - sd) < 1E-9);
+	CHECK((stat.min == val[0]) && (stat.max == val[STAT_SORT_NB - 1]));
+	for (i = 0; i < LGW_STAT_QUANT_NB; ++i) {
+		err = fabs(lgw_stat_quantile(&stat, quant[i]) - val[(int)(p[i] * (STAT_SORT_NB - 1))]);
+		max_err = (err > max_err) ? err : max_err;
+	}
+	printf("mean %.3f, sd %.3f, p5 %.3f, p50 %.3f, p95 %.3f, max percentile error %.4f\n", lgw_stat_mean(&stat), lgw_stat_sd(&stat), lgw_stat_quantile(&stat, LGW_STAT_P5), lgw_stat_quantile(&stat, LGW_STAT_P50), lgw_stat_quantile(&stat, LGW_STAT_P95), max_err);
+	CHECK(max_err < 0.02 * sd);
+
+	/* slow drift of 2 dB over the series (eg. a node moving away) */
+	lgw_stat_init(&stat);
+	for (i = 0; i < STAT_SORT_NB; ++i) {
+		val[i] = stat_value(&seed) - (2.0 * i) / STAT_SORT_NB;
+		lgw_stat_add(&stat, val[i]);
+	}
+	qsort(val, STAT_SORT_NB, sizeof val[0], stat_cmp);
+	ok = 1;
+	for (i = 0; i < LGW_STAT_QUANT_NB; ++i) {
+		ok &= (fabs(lgw_stat_quantile(&stat, quant[i]) - val[(int)(p[i] * (STAT_SORT_NB - 1))]) < 0.1 * sd);
+	}
+	CHECK(ok == 1);
+
+	/* long series, uniform values */
+	lgw_stat_init(&stat);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < STAT_LONG_NB; ++i) {
+		seed = (seed * 1103515245) + 12345;
+		lgw_stat_add(&stat, (double)(seed >> 8) / 16777216.0);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	printf("%u values in %u ms\n", stat.nb, elapsed_us(&t0, &t1) / 1000);
+	CHECK(stat.nb == STAT_LONG_NB);
+	CHECK(fabs(lgw_stat_mean(&stat) - 0.5) < 0.002);
+	CHECK(fabs(lgw_stat_sd(&stat) - sqrt(1.0 / 12.0)) < 0.002);
+	ok = 1;
+	for (i = 0; i < LGW_STAT_QUANT_NB; ++i) {
+		ok &= (fabs(lgw_stat_quantile(&stat, quant[i]) - p[i]) < 0.005);
+	}
+	CHECK(ok == 1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* client of the control test, connected to CTL_PATH */
+static int ctl_connect(void) {
+	struct sockaddr_un addr;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, CTL_PATH);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof addr) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* one reply line, without its newline, -1 if none within 1 s */
+static int ctl_read(int fd, char *line, size_t size) {
+	struct pollfd pfd = {fd, POLLIN, 0};
+	size_t n = 0;
+
+	while (n < size - 1) {
+		if ((poll(&pfd, 1, 1000) != 1) || (recv(fd, line + n, 1, 0) != 1)) {
+			return -1;
+		}
+		if (line[n] == '\n') {
+			break;
+		}
+		++n;
+	}
+	line[n] = '\0';
+	return (int)n;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void test_ctl(void) {
+	struct lgw_ctl_s ctl;
+	struct timespec t0, t1;
+	char cmd[LGW_CTL_LINE_SIZE];
+	char reply[LGW_CTL_LINE_SIZE];
+	char long_cmd[2 * LGW_CTL_LINE_SIZE];
+	FILE *f;
+	int fd, i, j;
+
+	printf("--- Control socket ---\n");
+
+	/* never replaces a file that is not a socket */
+	unlink(CTL_PATH); /* left by an interrupted run */
+	f = fopen(CTL_PATH, "w");
+	if (f != NULL) {
+		fclose(f);
+	}
+	CHECK(lgw_ctl_open(&ctl, CTL_PATH) == LGW_CTL_ERROR);
+	unlink(CTL_PATH);
+	memset(long_cmd, 'a', sizeof long_cmd - 1);
+	long_cmd[sizeof long_cmd - 1] = '\0';
+	CHECK(lgw_ctl_open(&ctl, long_cmd) == LGW_CTL_ERROR);
+	CHECK(lgw_ctl_open(&ctl, CTL_PATH) == LGW_CTL_SUCCESS);
+
+	/* no client: the timeout */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	i = lgw_ctl_wait(&ctl, 50, cmd, sizeof cmd);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	CHECK((i == 0) && (elapsed_us(&t0, &t1) >= 45000) && (elapsed_us(&t0, &t1) < 500000));
+	CHECK(lgw_ctl_reply(&ctl, "OK") == LGW_CTL_ERROR);
+
+	/* two commands at once, the second one ended by CR LF and sent in two parts */
+	fd = ctl_connect();
+	CHECK(fd >= 0);
+	CHECK(lgw_ctl_wait(&ctl, 100, cmd, sizeof cmd) == 0); /* accepted */
+	send(fd, "start a.csv\n\nsta", 16, 0);
+	CHECK((lgw_ctl_wait(&ctl, 100, cmd, sizeof cmd) == 1) && (strcmp(cmd, "start a.csv") == 0));
+	CHECK(lgw_ctl_reply(&ctl, "OK campaign %d started", 1) == LGW_CTL_SUCCESS);
+	CHECK((ctl_read(fd, reply, sizeof reply) > 0) && (strcmp(reply, "OK campaign 1 started") == 0));
+	CHECK(lgw_ctl_wait(&ctl, 0, cmd, sizeof cmd) == 0); /* empty line, then "sta" not ended */
+	send(fd, "tus\r\n", 5, 0);
+	CHECK((lgw_ctl_wait(&ctl, 100, cmd, sizeof cmd) == 1) && (strcmp(cmd, "status") == 0));
+
+	/* too long for the buffer of the caller, then for the buffer of the socket */
+	send(fd, "0123456789\nstop\n", 16, 0);
+	CHECK((lgw_ctl_wait(&ctl, 100, cmd, 8) == 1) && (strcmp(cmd, "stop") == 0));
+	CHECK((ctl_read(fd, reply, sizeof reply) > 0) && (strncmp(reply, "ERROR", 5) == 0));
+	long_cmd[sizeof long_cmd - 1] = '\n';
+	send(fd, long_cmd, sizeof long_cmd, 0);
+	send(fd, "quit\n", 5, 0);
+	for (i = 0; (i < 4) && (lgw_ctl_wait(&ctl, 100, cmd, sizeof cmd) == 0); ++i);
+	CHECK((i < 4) && (strcmp(cmd, "quit") == 0));
+	CHECK((ctl_read(fd, reply, sizeof reply) > 0) && (strncmp(reply, "ERROR", 5) == 0));
+
+	/* the next client once the first one disconnects */
+	close(fd);
+	CHECK(lgw_ctl_wait(&ctl, 100, cmd, sizeof cmd) == 0);
+	CHECK(lgw_ctl_reply(&ctl, "OK") == LGW_CTL_ERROR);
+	fd = ctl_connect();
+	CHECK(fd >= 0);
+	send(fd, "status\n", 7, 0);
+	for (i = 0; (i < 4) && (lgw_ctl_wait(&ctl, 100, cmd, sizeof cmd) == 0); ++i);
+	CHECK((i < 4) && (strcmp(cmd, "status") == 0));
+	CHECK(lgw_ctl_reply(&ctl, "OK") == LGW_CTL_SUCCESS);
+	CHECK((ctl_read(fd, reply, sizeof reply) == 2) && (strcmp(reply, "OK") == 0));
+	close(fd);
+
+	/* a client that disconnects before the error reply to its long line, for
+	the buffer of the caller then for the buffer of the socket: the reply fails,
+	nothing is left of it for the next client */
+	for (j = 0; j < 2; ++j) {
+		for (i = 0; (i < 4) && (ctl.client >= 0); ++i) {
+			lgw_ctl_wait(&ctl, 100, cmd, sizeof cmd); /* the previous client disconnected */
+		}
+		fd = ctl_connect();
+		CHECK(lgw_ctl_wait(&ctl, 100, cmd, sizeof cmd) == 0); /* accepted */
+		memset(long_cmd, 'b', sizeof long_cmd);
+		long_cmd[(j == 0) ? 100 : 300] = '\n';
+		send(fd, long_cmd, (j == 0) ? 101 : 300, 0);
+		close(fd);
+		for (i = 0; (i < 4) && (ctl.client >= 0); ++i) {
+			CHECK(lgw_ctl_wait(&ctl, 100, cmd, 64) == 0);
+		}
+		CHECK((i < 4) && (ctl.len == 0) && (ctl.discard == 0));
+		fd = ctl_connect();
+		CHECK(fd >= 0);
+		send(fd, "status\n", 7, 0);
+		for (i = 0; (i < 4) && (lgw_ctl_wait(&ctl, 100, cmd, sizeof cmd) == 0); ++i);
+		CHECK((i < 4) && (strcmp(cmd, "status") == 0));
+		close(fd);
+	}
+
+	CHECK(lgw_ctl_close(&ctl) == LGW_CTL_SUCCESS);
+	CHECK(access(CTL_PATH, F_OK) != 0);
+	CHECK(lgw_ctl_close(&ctl) == LGW_CTL_ERROR);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+	struct lgw_sim_counters_s cnt;
+	int i;
+
+	printf("Beginning of test for loragw_hal.c on simulated concentrator\n");
+	printf("*** Library version information ***\n%s\n\n", lgw_version_info());
+
+	lgw_sim_select(SIM_BOARD);
+	lgw_sim_power_cycle(SIM_BOARD);
+	configure();
+
+	/* connect, configure and start the LoRa concentrator */
+	i = lgw_start();
+	CHECK(i == LGW_HAL_SUCCESS);
+	if (i != LGW_HAL_SUCCESS) {
+		printf("*** Impossible to start concentrator ***\n");
+		return -1;
+	}
+	lgw_sim_get_counters(SIM_BOARD, &cnt);
+	printf("*** Concentrator started (%u single, %u burst, %u multiple SPI transactions of %u frames) ***\n", cnt.spi_w + cnt.spi_r, cnt.spi_wb + cnt.spi_rb, cnt.spi_wm, cnt.wm_frames);
+
+	test_rx();
+	test_rx_burst();
+	test_tx();
+	test_shadow();
+	test_batch();
+	test_reg_list();
+	test_tx_desc();
+	test_rx_wait();
+	test_txq();
+	test_lut();
+	test_cal();
+	test_fw();
+	test_spi_conf();
+	test_trace();
+	test_stats();
+	test_ctx();
+	test_reg_acc();
+	test_nmea();
+	test_gps_fit();
+	test_stat();
+	test_ctl();
+
+	lgw_stop();
+
+	printf("\n%d checks, %d failed\n", nb_check, nb_fail);
+	printf("End of test for loragw_hal.c on simulated concentrator\n");
+	return (nb_fail == 0) ? 0 : -1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
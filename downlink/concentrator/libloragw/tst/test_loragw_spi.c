@@ -9,6 +9,12 @@
 Description:
 	Minimum test program for the loragw_spi 'library'
 	Use logic analyser to check the results.
+	With -b, benchmark of the SPI link instead: single reads and writes, and
+	burst reads and writes of several sizes, for each SPI clock and chunk size
+	given on the command line. Reports the throughput and the latency
+	percentiles of each case, and checks that the bursts read back what was
+	written (the MCU program RAM is used as scratch memory, lgw_start reloads
+	the firmwares afterwards). Returns a non-zero value if a check failed.
 
 License: Revised BSD License, see LICENSE.TXT file include in the project
 Maintainer: Sylvain Miermont
@@ -18,8 +24,20 @@ Maintainer: Sylvain Miermont
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
 #include <stdint.h>
+#include <stdbool.h>	/* bool type */
 #include <stdio.h>
+#include <stdlib.h>		/* qsort strtoul */
+#include <string.h>		/* memcmp */
+#include <time.h>		/* clock_gettime */
+#include <unistd.h>		/* getopt */
 
 #include "loragw_spi.h"
 
@@ -34,51 +52,332 @@ Maintainer: Sylvain Miermont
 #define BURST_TEST_SIZE 2500 /* >> LGW_BURST_CHUNK */
 #define TIMING_REPEAT	1	 /* repeat transactions multiple times for timing characterisation */
 
+#define BENCH_NB_DEFAULT	200		/* transactions per measurement */
+#define BENCH_NB_MAX		100000
+#define BENCH_LIST_MAX		16		/* values per swept parameter */
+#define BENCH_SIZE_MAX		8192	/* size of the MCU program RAM */
+
+/* SX1301 registers used by the benchmark */
+#define ADDR_PAGE		0
+#define ADDR_VERSION	1
+#define ADDR_PROM_ADDR	9
+#define ADDR_PROM_DATA	10
+#define ADDR_MCU_CTRL	106	/* page 0 */
+#define MCU_CTRL_BENCH	0x0B	/* both MCUs in reset, only the arbiter program RAM on SPI */
+
+enum bench_op_e {
+	OP_R,	/* single read */
+	OP_W,	/* single write */
+	OP_RB,	/* burst read */
+	OP_WB	/* burst write */
+};
+
 /* -------------------------------------------------------------------------- */
-/* --- MAIN FUNCTION -------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
-int main()
-{
+static void *spi_target = NULL;
+
+static uint32_t lat_ns[BENCH_NB_MAX];
+static uint8_t pattern[BENCH_SIZE_MAX];
+static uint8_t check[BENCH_SIZE_MAX];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void usage(void);
+
+static int parse_list(const char *str, uint32_t *list, uint32_t min, uint32_t max);
+
+static int cmp_u32(const void *a, const void *b);
+
+static uint32_t elapsed_ns(const struct timespec *t0, const struct timespec *t1);
+
+static int prom_read(uint8_t *data, uint16_t size);
+
+static int bench(enum bench_op_e op, uint16_t size, int nb);
+
+static int run_test(void);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* describe command line options */
+static void usage(void) {
+	printf( "Available options:\n");
+	printf( " -h print this help\n");
+	printf( " -b run the benchmark instead of the logic analyser test\n");
+	printf( " -n <uint> number of transactions per measurement (default %d)\n", BENCH_NB_DEFAULT);
+	printf( " -s <uint>[,<uint>...] SPI clocks to test, in Hz (default: current)\n");
+	printf( " -c <uint>[,<uint>...] burst chunk sizes to test, in bytes (default: current)\n");
+	printf( " -z <uint>[,<uint>...] burst sizes to test, in bytes (default: 16,256,1024,4096,8192)\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* comma-separated list of integers, returns the number of values or -1 */
+static int parse_list(const char *str, uint32_t *list, uint32_t min, uint32_t max) {
+	char *end;
+	unsigned long x;
+	int nb = 0;
+
+	while (nb < BENCH_LIST_MAX) {
+		x = strtoul(str, &end, 0);
+		if ((end == str) || (x < min) || (x > max)) {
+			return -1;
+		}
+		list[nb++] = (uint32_t)x;
+		if (*end == '\0') {
+			return nb;
+		} else if (*end != ',') {
+			return -1;
+		}
+		str = end + 1;
+	}
+	return -1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int cmp_u32(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t elapsed_ns(const struct timespec *t0, const struct timespec *t1) {
+	return (uint32_t)((t1->tv_sec - t0->tv_sec) * 1000000000 + (t1->tv_nsec - t0->tv_nsec));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* read the program RAM from address 0, not timed */
+static int prom_read(uint8_t *data, uint16_t size) {
+	uint8_t dummy;
+	int x;
+
+	x = lgw_spi_w(spi_target, ADDR_PROM_ADDR, 0);
+	x |= lgw_spi_r(spi_target, ADDR_PROM_DATA, &dummy); /* the first read after setting the address is a dummy */
+	x |= lgw_spi_rb(spi_target, ADDR_PROM_DATA, data, size);
+	return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* nb transactions, latencies in lat_ns, returns the number of failed transactions */
+static int bench(enum bench_op_e op, uint16_t size, int nb) {
+	struct timespec t0, t1;
+	uint8_t ref = 0, data = 0;
+	int nb_err = 0;
+	int i, j, x = LGW_SPI_SUCCESS;
+
+	/* reference values */
+	if (op == OP_R) {
+		lgw_spi_r(spi_target, ADDR_VERSION, &ref);
+	} else if (op == OP_RB) {
+		for (j = 0; j < size; ++j) {
+			pattern[j] = (uint8_t)(j * 7 + 1);
+		}
+		lgw_spi_w(spi_target, ADDR_PROM_ADDR, 0);
+		lgw_spi_wb(spi_target, ADDR_PROM_DATA, pattern, size);
+	}
+
+	for (i = 0; i < nb; ++i) {
+		/* untimed setup */
+		if (op == OP_WB) {
+			for (j = 0; j < size; ++j) {
+				pattern[j] = (uint8_t)(i + j * 13);
+			}
+			lgw_spi_w(spi_target, ADDR_PROM_ADDR, 0);
+		} else if (op == OP_RB) {
+			lgw_spi_w(spi_target, ADDR_PROM_ADDR, 0);
+			lgw_spi_r(spi_target, ADDR_PROM_DATA, &data);
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		switch (op) {
+			case OP_R: x = lgw_spi_r(spi_target, ADDR_VERSION, &data); break;
+			case OP_W: x = lgw_spi_w(spi_target, ADDR_PROM_ADDR, (uint8_t)i); break;
+			case OP_RB: x = lgw_spi_rb(spi_target, ADDR_PROM_DATA, check, size); break;
+			case OP_WB: x = lgw_spi_wb(spi_target, ADDR_PROM_DATA, pattern, size); break;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		lat_ns[i] = elapsed_ns(&t0, &t1);
+
+		/* untimed check */
+		if (op == OP_WB) {
+			x |= prom_read(check, size);
+		}
+		if ((x != LGW_SPI_SUCCESS) || ((op == OP_R) && (data != ref)) || (((op == OP_RB) || (op == OP_WB)) && (memcmp(check, pattern, size) != 0))) {
+			nb_err += 1;
+		}
+	}
+	return nb_err;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* original test, to be checked with a logic analyser */
+static int run_test(void) {
 	int i;
-	void *spi_target = NULL;
 	uint8_t data = 0;
 	uint8_t dataout[BURST_TEST_SIZE];
 	uint8_t datain[BURST_TEST_SIZE];
-	
+
 	for (i = 0; i < BURST_TEST_SIZE; ++i) {
 		dataout[i] = 0x30 + (i % 10); /* ASCCI code for 0 -> 9 */
 		datain[i] = 0x23; /* garbage data, to be overwritten by received data */
 	}
-	
-	printf("Beginning of test for loragw_spi.c\n");
-	lgw_spi_open(&spi_target);
-	
+
 	/* normal R/W test */
 	for (i = 0; i < TIMING_REPEAT; ++i)
 		lgw_spi_w(spi_target, 0xAA, 0x96);
 	for (i = 0; i < TIMING_REPEAT; ++i)
 		lgw_spi_r(spi_target, 0x55, &data);
-	
+
 	/* burst R/W test, small bursts << LGW_BURST_CHUNK */
 	for (i = 0; i < TIMING_REPEAT; ++i)
 		lgw_spi_wb(spi_target, 0x55, dataout, 16);
 	for (i = 0; i < TIMING_REPEAT; ++i)
 		lgw_spi_rb(spi_target, 0x55, datain, 16);
-	
+
 	/* burst R/W test, large bursts >> LGW_BURST_CHUNK */
 	for (i = 0; i < TIMING_REPEAT; ++i)
 		lgw_spi_wb(spi_target, 0x5A, dataout, ARRAY_SIZE(dataout));
 	for (i = 0; i < TIMING_REPEAT; ++i)
 		lgw_spi_rb(spi_target, 0x5A, datain, ARRAY_SIZE(datain));
-	
+
 	/* last read (blocking), just to be sure no to quit before the FTDI buffer is flushed */
 	lgw_spi_r(spi_target, 0x55, &data);
 	printf("data received (simple read): %d\n",data);
-	
+	return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+	static const char *op_name[] = {"read", "write", "burst_read", "burst_write"};
+	struct lgw_spi_conf_s conf;
+	uint32_t speed[BENCH_LIST_MAX];
+	uint32_t chunk[BENCH_LIST_MAX];
+	uint32_t size[BENCH_LIST_MAX] = {16, 256, 1024, 4096, 8192};
+	int nb_speed = 0, nb_chunk = 0, nb_size = 5;
+	bool bench_mode = false;
+	int nb = BENCH_NB_DEFAULT;
+	uint64_t total_ns;
+	int nb_err, nb_fail = 0;
+	int i, s, c, z, op;
+
+	/* parse command line options */
+	while ((i = getopt(argc, argv, "hbn:s:c:z:")) != -1) {
+		switch (i) {
+			case 'b':
+				bench_mode = true;
+				break;
+			case 'n':
+				if ((sscanf(optarg, "%i", &nb) != 1) || (nb < 1) || (nb > BENCH_NB_MAX)) {
+					printf("ERROR: invalid number of transactions (1 to %d)\n", BENCH_NB_MAX);
+					usage();
+					return -1;
+				}
+				break;
+			case 's':
+				nb_speed = parse_list(optarg, speed, LGW_SPI_SPEED_MIN, LGW_SPI_SPEED_MAX);
+				if (nb_speed < 0) {
+					printf("ERROR: invalid SPI clock list (%d to %d Hz)\n", LGW_SPI_SPEED_MIN, LGW_SPI_SPEED_MAX);
+					usage();
+					return -1;
+				}
+				break;
+			case 'c':
+				nb_chunk = parse_list(optarg, chunk, LGW_BURST_CHUNK_MIN, LGW_BURST_CHUNK_MAX);
+				if (nb_chunk < 0) {
+					printf("ERROR: invalid chunk size list (%d to %d bytes)\n", LGW_BURST_CHUNK_MIN, LGW_BURST_CHUNK_MAX);
+					usage();
+					return -1;
+				}
+				break;
+			case 'z':
+				nb_size = parse_list(optarg, size, 1, BENCH_SIZE_MAX);
+				if (nb_size < 0) {
+					printf("ERROR: invalid burst size list (1 to %d bytes)\n", BENCH_SIZE_MAX);
+					usage();
+					return -1;
+				}
+				break;
+			case 'h':
+			default:
+				usage();
+				return -1;
+		}
+	}
+
+	printf("Beginning of test for loragw_spi.c\n");
+	if (lgw_spi_open(&spi_target) != LGW_SPI_SUCCESS) {
+		printf("ERROR: failed to open the SPI link\n");
+		return -1;
+	}
+	if (bench_mode == false) {
+		run_test();
+		lgw_spi_close(spi_target);
+		printf("End of test for loragw_spi.c\n");
+		return 0;
+	}
+
+	/* current settings by default */
+	lgw_spi_getconf(&conf);
+	if (nb_speed == 0) {
+		speed[nb_speed++] = conf.speed_hz;
+	}
+	if (nb_chunk == 0) {
+		chunk[nb_chunk++] = conf.chunk_size;
+	}
+
+	/* MCUs held in reset, arbiter program RAM used as scratch memory */
+	lgw_spi_w(spi_target, ADDR_PAGE, 0);
+	lgw_spi_w(spi_target, ADDR_MCU_CTRL, MCU_CTRL_BENCH);
+
+	printf("op;clock_hz;chunk;size;nb;bytes_per_s;trans_per_s;p50_us;p90_us;p99_us;max_us;errors\n");
+	for (s = 0; s < nb_speed; ++s) {
+		for (c = 0; c < nb_chunk; ++c) {
+			conf.speed_hz = speed[s];
+			conf.chunk_size = (uint16_t)chunk[c];
+			if (lgw_spi_setconf(spi_target, conf) != LGW_SPI_SUCCESS) {
+				printf("ERROR: failed to set SPI clock %u Hz, chunk size %u\n", speed[s], chunk[c]);
+				nb_fail += 1;
+				continue;
+			}
+			for (op = OP_R; op <= OP_WB; ++op) {
+				if ((op <= OP_W) && (c > 0)) {
+					continue; /* single transactions do not depend on the chunk size */
+				}
+				for (z = 0; z < nb_size; ++z) {
+					if ((op <= OP_W) && (z > 0)) {
+						break;
+					}
+					nb_err = bench(op, (op <= OP_W) ? 1 : (uint16_t)size[z], nb);
+					nb_fail += nb_err;
+					total_ns = 1;
+					for (i = 0; i < nb; ++i) {
+						total_ns += lat_ns[i];
+					}
+					qsort(lat_ns, nb, sizeof lat_ns[0], cmp_u32);
+					printf("%s;%u;%u;%u;%d;%.0f;%.0f;%.1f;%.1f;%.1f;%.1f;%d\n", op_name[op], speed[s], chunk[c], (op <= OP_W) ? 1 : size[z], nb,
+						1e9 * nb * ((op <= OP_W) ? 1 : size[z]) / total_ns, 1e9 * nb / total_ns,
+						lat_ns[nb / 2] / 1e3, lat_ns[(nb * 9) / 10] / 1e3, lat_ns[(nb * 99) / 100] / 1e3, lat_ns[nb - 1] / 1e3, nb_err);
+				}
+			}
+		}
+	}
+
 	lgw_spi_close(spi_target);
+	printf("%d failed transactions\n", nb_fail);
 	printf("End of test for loragw_spi.c\n");
-	
-	return 0;
+
+	return (nb_fail == 0) ? 0 : -1;
 }
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -33,7 +33,26 @@ Maintainer: Sylvain Miermont
 
 #define LGW_SPI_SUCCESS	 0
 #define LGW_SPI_ERROR	-1
-#define LGW_BURST_CHUNK	 1024
+#define LGW_SPI_TIMEOUT	 1	/* lgw_spi_irq_wait returned without interrupt */
+#define LGW_BURST_CHUNK	 1024	/* default size of the chunks bursts are split into, and largest multiple write frame */
+#define LGW_SPI_WM_MAX	 64	/* maximum number of frames in a multiple write */
+
+#define LGW_BURST_CHUNK_MIN	16		/* chunk sizes accepted by lgw_spi_setconf */
+#define LGW_BURST_CHUNK_MAX	4096
+#define LGW_SPI_SPEED_MIN	100000		/* SPI clocks accepted by lgw_spi_setconf, in Hz */
+#define LGW_SPI_SPEED_MAX	30000000	/* above the 10 MHz of the SX1301 datasheet, validate with test_loragw_spi -b */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_spi_conf_s
+@brief SPI link settings, shared by all the links opened by the program
+*/
+struct lgw_spi_conf_s {
+	uint32_t	speed_hz;	/*!> SPI clock, in Hz (0 to keep the current one) */
+	uint16_t	chunk_size;	/*!> maximum number of data bytes per transfer of a burst (0 to keep the current one) */
+};
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
@@ -46,6 +65,17 @@ Maintainer: Sylvain Miermont
 
 int lgw_spi_open(void **spi_target_ptr);
 
+/**
+@brief LoRa concentrator SPI setup, on a given device
+@param spi_target_ptr pointer on a generic pointer to SPI target (implementation dependant)
+@param dev device the concentrator is connected to, NULL for the one lgw_spi_open uses (native: spidev path, sim: board number in decimal, ftdi: NULL only)
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+
+Links opened on different devices are independent and can be used by
+different threads at the same time.
+*/
+int lgw_spi_open_dev(void **spi_target_ptr, const char *dev);
+
 /**
 @brief LoRa concentrator SPI close
 @param spi_target generic pointer to SPI target (implementation dependant)
@@ -54,6 +84,24 @@ int lgw_spi_open(void **spi_target_ptr);
 
 int lgw_spi_close(void *spi_target);
 
+/**
+@brief Set the SPI clock and the size of the chunks bursts are split into
+@param spi_target generic pointer to an opened SPI target to update it at once, NULL to only apply the settings at the next lgw_spi_open
+@param conf settings, see lgw_spi_conf_s
+@return status of operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+
+Must not be called while another thread is using the link. Backends that
+cannot change the clock of an opened link apply it at the next lgw_spi_open.
+*/
+int lgw_spi_setconf(void *spi_target, struct lgw_spi_conf_s conf);
+
+/**
+@brief Get the current SPI clock and chunk size
+@param conf pointer to a structure that will be filled with the settings
+@return status of operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_getconf(struct lgw_spi_conf_s *conf);
+
 /**
 @brief LoRa concentrator SPI single-byte write
 @param spi_target generic pointer to SPI target (implementation dependant)
@@ -92,6 +140,30 @@ int lgw_spi_wb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size);
 */
 int lgw_spi_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size);
 
+/**
+@brief LoRa concentrator SPI multiple write, several write frames in one transaction
+@param spi_target generic pointer to SPI target (implementation dependant)
+@param address array of 7-bit register addresses, one per frame
+@param size array of frame sizes, in byte(s), one per frame
+@param data concatenation of the data bytes of all frames
+@param nb number of frames (between 1 and LGW_SPI_WM_MAX)
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+
+Each frame is equivalent to a lgw_spi_w (size 1) or a lgw_spi_wb (size > 1),
+chip select is released between frames.
+*/
+int lgw_spi_wm(void *spi_target, uint8_t *address, uint16_t *size, uint8_t *data, uint16_t nb);
+
+/**
+@brief Wait for the concentrator interrupt line to be raised
+@param spi_target generic pointer to SPI target (implementation dependant)
+@param timeout_ms maximum time to wait, in milliseconds
+@return LGW_SPI_SUCCESS if the line is raised, LGW_SPI_TIMEOUT on timeout, LGW_SPI_ERROR if there is no interrupt line
+
+The line is raised while the RX packet FIFO is not empty.
+*/
+int lgw_spi_irq_wait(void *spi_target, uint32_t timeout_ms);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,117 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Streaming statistics of a series of values (eg. the SNR of the packets of
+	a test): count, mean and standard deviation (Welford), min, max and the
+	5th, 50th and 95th percentiles (P-square estimators). The memory used does
+	not depend on the number of values, nothing is stored.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_STAT_H
+#define _LORAGW_STAT_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+
+#include "config.h"	/* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_STAT_SUCCESS	 0
+#define LGW_STAT_ERROR		-1
+
+#define LGW_STAT_QUANT_NB	3	/* number of percentiles estimated */
+#define LGW_STAT_P5			0	/* index of the 5th percentile */
+#define LGW_STAT_P50		1	/* index of the median */
+#define LGW_STAT_P95		2	/* index of the 95th percentile */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_p2_s
+@brief P-square estimator of one quantile (Jain & Chlamtac), 5 markers
+*/
+struct lgw_p2_s {
+	double		p;		/*!> quantile estimated, between 0 and 1 */
+	double		q[5];	/*!> marker heights, q[2] is the estimate; the first values, sorted, until there are 5 */
+	uint32_t	n[5];	/*!> marker positions */
+	double		np[5];	/*!> desired marker positions */
+};
+
+/**
+@struct lgw_stat_s
+@brief Statistics of the values added since lgw_stat_init
+*/
+struct lgw_stat_s {
+	uint32_t	nb;		/*!> number of values */
+	double		mean;	/*!> running mean */
+	double		m2;		/*!> sum of the squared deviations from the running mean */
+	double		min;
+	double		max;
+	struct lgw_p2_s	quant[LGW_STAT_QUANT_NB];	/*!> 5th, 50th and 95th percentiles */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Clear the statistics
+@param stat pointer to the statistics to initialize
+@return LGW_STAT_ERROR if stat is NULL, LGW_STAT_SUCCESS else
+*/
+int lgw_stat_init(struct lgw_stat_s *stat);
+
+/**
+@brief Add a value to the statistics, in constant time
+@param stat pointer to the statistics
+@param x value
+@return LGW_STAT_ERROR if stat is NULL, LGW_STAT_SUCCESS else
+*/
+int lgw_stat_add(struct lgw_stat_s *stat, double x);
+
+/**
+@brief Mean of the values
+@param stat pointer to the statistics
+@return mean, NAN if there is no value
+*/
+double lgw_stat_mean(const struct lgw_stat_s *stat);
+
+/**
+@brief Standard deviation of the values (of the population, divided by nb)
+@param stat pointer to the statistics
+@return standard deviation, NAN if there is no value
+*/
+double lgw_stat_sd(const struct lgw_stat_s *stat);
+
+/**
+@brief Estimate of a percentile of the values
+@param stat pointer to the statistics
+@param i LGW_STAT_P5, LGW_STAT_P50 or LGW_STAT_P95
+@return estimate, NAN if there is no value or i is invalid
+
+Exact (interpolated between the sorted values) up to 5 values, then a P-square
+estimate: it converges to the quantile of the distribution of the values, to a
+few percent of their standard deviation after a few hundred values. The
+values are expected in no particular order around a stable level: a series
+that drifts by more than its standard deviation (or sorted values) biases the
+5th and 95th percentiles.
+*/
+double lgw_stat_quantile(const struct lgw_stat_s *stat, int i);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
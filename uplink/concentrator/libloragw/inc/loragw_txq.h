@@ -0,0 +1,111 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Just-in-time TX queue on top of lgw_send, lgw_status and lgw_get_instcnt.
+	Packets are kept ordered by emission time, rejected if they overlap a
+	packet already queued (time on air plus a guard interval), and handed to
+	the concentrator shortly before their slot, once the TX modem is free, so
+	that a packet can never replace one that is still pending.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+#ifndef _LORAGW_TXQ_H
+#define _LORAGW_TXQ_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+
+#include "config.h"	/* library configuration options (dynamically generated) */
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_TXQ_SUCCESS		 0
+#define LGW_TXQ_ERROR		-1
+#define LGW_TXQ_FULL		 1	/* no room left in the queue */
+#define LGW_TXQ_COLLISION	 2	/* overlaps a queued or pending packet */
+#define LGW_TXQ_TOO_LATE	 3	/* the slot is too close to be loaded in time */
+
+#define LGW_TXQ_NB_MAX		64		/* number of packets a queue can hold */
+#define LGW_TXQ_LEAD_US		20000	/* a packet is loaded in the TX modem at most this long before it starts */
+#define LGW_TXQ_MARGIN_US	3000	/* and at least this long before (TX_START_DELAY and SPI transfer) */
+#define LGW_TXQ_GUARD_US	10000	/* default gap kept between two packets */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_txq_s
+@brief TX queue, to be used by a single thread
+*/
+struct lgw_txq_s {
+	struct lgw_pkt_tx_s	pkt[LGW_TXQ_NB_MAX];	/*!> queued packets, TIMESTAMPED, ordered by count_us */
+	uint32_t	toa_us[LGW_TXQ_NB_MAX];	/*!> time on air of each queued packet */
+	int			nb;			/*!> number of queued packets */
+	uint32_t	guard_us;	/*!> gap kept between two packets (LGW_TXQ_GUARD_US after lgw_txq_init) */
+	bool		busy;		/*!> a packet was handed to the concentrator */
+	uint32_t	busy_start;	/*!> start of the packet handed to the concentrator */
+	uint32_t	busy_end;	/*!> end of the packet handed to the concentrator */
+	uint32_t	nb_sent;	/*!> number of packets handed to lgw_send */
+	uint32_t	nb_collision;	/*!> number of packets rejected because of an overlap */
+	uint32_t	nb_late;	/*!> number of packets rejected or dropped because their slot was too close */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Empty a TX queue and reset its counters
+@param txq pointer to the queue
+*/
+void lgw_txq_init(struct lgw_txq_s *txq);
+
+/**
+@brief Add a packet to the queue, no concentrator access
+@param txq pointer to the queue
+@param pkt_data packet to send, TIMESTAMPED or IMMEDIATE (ON_GPS is not supported)
+@param now_us current value of the concentrator counter (see lgw_get_instcnt)
+@return LGW_TXQ_SUCCESS if queued, LGW_TXQ_FULL, LGW_TXQ_COLLISION, LGW_TXQ_TOO_LATE or LGW_TXQ_ERROR else
+
+An IMMEDIATE packet is queued as a TIMESTAMPED packet in the first slot after
+the last queued or pending packet (plus the guard interval), or LGW_TXQ_LEAD_US
+from now if the queue is idle.
+*/
+int lgw_txq_enqueue(struct lgw_txq_s *txq, const struct lgw_pkt_tx_s *pkt_data, uint32_t now_us);
+
+/**
+@brief Hand the packets whose slot is near to the concentrator
+@param txq pointer to the queue
+@param next_us pointer to receive the time after which lgw_txq_run must be called again (0 if the queue is empty)
+@return LGW_TXQ_ERROR if a HAL call failed, LGW_TXQ_SUCCESS else
+
+Calls lgw_get_instcnt, lgw_status and lgw_send: in a multithreaded
+application, the caller must hold the lock that serializes the HAL calls.
+Packets that could not be loaded before their slot are dropped and counted in
+nb_late.
+*/
+int lgw_txq_run(struct lgw_txq_s *txq, uint32_t *next_us);
+
+/**
+@brief Number of packets waiting in the queue
+@param txq pointer to the queue
+@return number of queued packets, not counting the one handed to the concentrator
+*/
+int lgw_txq_count(const struct lgw_txq_s *txq);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -58,4 +58,16 @@ void wait_ms(unsigned long a) {
 	return;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void wait_us(unsigned long a) {
+	struct timespec dly;
+
+	dly.tv_sec = a / 1000000;
+	dly.tv_nsec = ((long)a % 1000000) * 1000;
+
+	clock_nanosleep(CLOCK_MONOTONIC, 0, &dly, NULL);
+	return;
+}
+
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,284 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Raw packet capture in a memory-mapped ring file
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* printf fprintf */
+#include <string.h>		/* memcpy memset */
+#include <time.h>		/* time gmtime_r */
+#include <fcntl.h>		/* open posix_fallocate */
+#include <unistd.h>		/* close ftruncate */
+#include <sys/mman.h>	/* mmap msync munmap */
+#include <sys/stat.h>	/* fstat */
+
+#include "loragw_cap.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_HAL == 1
+	#define DEBUG_MSG(str)				fprintf(stderr, str)
+	#define DEBUG_PRINTF(fmt, args...)	fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+	#define CHECK_NULL(a)				if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_CAP_ERROR;}
+#else
+	#define DEBUG_MSG(str)
+	#define DEBUG_PRINTF(fmt, args...)
+	#define CHECK_NULL(a)				if(a==NULL){return LGW_CAP_ERROR;}
+#endif
+
+/* a reader of the file only sees the records published by the header */
+#define STORE_RELEASE(a,v)	__atomic_store_n(&(a), (v), __ATOMIC_RELEASE)
+#define LOAD_ACQUIRE(a)		__atomic_load_n(&(a), __ATOMIC_ACQUIRE)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+/*
+File format, host byte order (bom tells it):
+	header: 64 bytes, struct cap_hdr_s
+	records: nb_rec times struct lgw_cap_rec_s, record i of the ring at
+		CAP_HDR_SIZE + i * sizeof(struct lgw_cap_rec_s)
+Record n (from 0) since the file was created is in slot n % nb_rec; the file
+holds the records nb_write - min(nb_write, nb_rec) to nb_write - 1.
+*/
+#define CAP_MAGIC		"LGWC"
+#define CAP_VERSION		1
+#define CAP_BOM			0x01020304
+#define CAP_HDR_SIZE	64
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct cap_hdr_s {
+	char		magic[4];
+	uint16_t	version;
+	uint16_t	rec_size;
+	uint32_t	nb_rec;
+	uint32_t	bom;
+	int64_t		start;		/* creation time, seconds since the Epoch */
+	uint64_t	nb_write;	/* records written, updated after each record */
+	uint8_t		reserved[CAP_HDR_SIZE - 32];
+};
+
+/* the layout of the file must not depend on the compiler */
+typedef char cap_rec_size_check[(sizeof(struct lgw_cap_rec_s) == 96) ? 1 : -1];
+typedef char cap_hdr_size_check[(sizeof(struct cap_hdr_s) == CAP_HDR_SIZE) ? 1 : -1];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+void cap_dump_rec(FILE *out, const struct lgw_cap_rec_s *rec);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* one CSV line */
+void cap_dump_rec(FILE *out, const struct lgw_cap_rec_s *rec) {
+	static const char *bw_name[] = {"", "500000", "250000", "125000", "62500", "31200", "15600", "7800"};
+	static const char *cr_name[] = {"", "4/5", "4/6", "4/7", "4/8"};
+	const char *status;
+	time_t t = (time_t)rec->utc_sec;
+	struct tm x;
+	int i;
+
+	gmtime_r(&t, &x);
+	switch (rec->status) {
+		case STAT_CRC_OK: status = "CRC_OK"; break;
+		case STAT_CRC_BAD: status = "CRC_BAD"; break;
+		case STAT_NO_CRC: status = "NO_CRC"; break;
+		default: status = "UNDEFINED";
+	}
+	fprintf(out, "%04i-%02i-%02iT%02i:%02i:%02i.%06liZ,%s,%u,%u,%u,%u,%s,", x.tm_year + 1900, x.tm_mon + 1, x.tm_mday, x.tm_hour, x.tm_min, x.tm_sec, (long)rec->utc_nsec / 1000, (rec->flags & LGW_CAP_UTC_GPS) ? "GPS" : "host", rec->count_us, rec->freq_hz, rec->rf_chain, rec->if_chain, status);
+	if (rec->modulation == MOD_LORA) {
+		for (i = 7; (i <= 12) && (rec->datarate != (1u << (i - 6))); ++i);
+		fprintf(out, "LORA,%s,SF%d,%s,", (rec->bandwidth < 8) ? bw_name[rec->bandwidth] : "", (i <= 12) ? i : 0, (rec->coderate < 5) ? cr_name[rec->coderate] : "");
+	} else if (rec->modulation == MOD_FSK) {
+		fprintf(out, "FSK,,%u,,", rec->datarate);
+	} else {
+		fprintf(out, ",,,,");
+	}
+	fprintf(out, "%+.1f,%+.2f,%+.2f,%+.2f,%04X,%u,", rec->rssi, rec->snr, rec->snr_min, rec->snr_max, rec->crc, rec->size);
+	for (i = 0; (i < rec->size) && (i < LGW_CAP_PAYLOAD_SIZE); ++i) {
+		fprintf(out, "%02X", rec->payload[i]);
+	}
+	fputc('\n', out);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_cap_open(struct lgw_cap_s *cap, const char *path, uint32_t nb_rec) {
+	struct cap_hdr_s *hdr;
+
+	CHECK_NULL(cap);
+	CHECK_NULL(path);
+	memset(cap, 0, sizeof *cap);
+	cap->fd = -1;
+	if ((nb_rec == 0) || (nb_rec > LGW_CAP_NB_MAX)) {
+		DEBUG_MSG("ERROR: INVALID NUMBER OF CAPTURE RECORDS\n");
+		return LGW_CAP_ERROR;
+	}
+
+	cap->map_size = CAP_HDR_SIZE + (size_t)nb_rec * sizeof(struct lgw_cap_rec_s);
+	cap->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (cap->fd < 0) {
+		DEBUG_PRINTF("ERROR: IMPOSSIBLE TO CREATE %s\n", path);
+		return LGW_CAP_ERROR;
+	}
+	/* allocated now, a full storage is detected here and not by a SIGBUS in the RX thread */
+	if ((ftruncate(cap->fd, (off_t)cap->map_size) != 0) || (posix_fallocate(cap->fd, 0, (off_t)cap->map_size) != 0)) {
+		DEBUG_MSG("ERROR: IMPOSSIBLE TO ALLOCATE THE CAPTURE FILE\n");
+		close(cap->fd);
+		cap->fd = -1;
+		return LGW_CAP_ERROR;
+	}
+	cap->map = mmap(NULL, cap->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, cap->fd, 0);
+	if (cap->map == MAP_FAILED) {
+		DEBUG_MSG("ERROR: IMPOSSIBLE TO MAP THE CAPTURE FILE\n");
+		cap->map = NULL;
+		close(cap->fd);
+		cap->fd = -1;
+		return LGW_CAP_ERROR;
+	}
+	memset(cap->map, 0, cap->map_size); /* touch every page */
+
+	hdr = (struct cap_hdr_s *)cap->map;
+	memcpy(hdr->magic, CAP_MAGIC, sizeof hdr->magic);
+	hdr->version = CAP_VERSION;
+	hdr->rec_size = sizeof(struct lgw_cap_rec_s);
+	hdr->nb_rec = nb_rec;
+	hdr->bom = CAP_BOM;
+	hdr->start = (int64_t)time(NULL);
+	cap->nb_rec = nb_rec;
+	DEBUG_PRINTF("Note: capture of %u records (%u bytes) in %s\n", nb_rec, (unsigned)cap->map_size, path);
+	return LGW_CAP_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_cap_write(struct lgw_cap_s *cap, const struct lgw_pkt_rx_s *pkt, const struct timespec *utc, bool utc_gps) {
+	struct lgw_cap_rec_s *rec;
+	uint16_t size;
+
+	CHECK_NULL(cap);
+	CHECK_NULL(cap->map);
+	CHECK_NULL(pkt);
+	CHECK_NULL(utc);
+
+	rec = (struct lgw_cap_rec_s *)(cap->map + CAP_HDR_SIZE) + cap->next;
+	rec->utc_sec = (int64_t)utc->tv_sec;
+	rec->utc_nsec = (int32_t)utc->tv_nsec;
+	rec->count_us = pkt->count_us;
+	rec->freq_hz = pkt->freq_hz;
+	rec->datarate = pkt->datarate;
+	rec->rssi = pkt->rssi;
+	rec->snr = pkt->snr;
+	rec->snr_min = pkt->snr_min;
+	rec->snr_max = pkt->snr_max;
+	rec->crc = pkt->crc;
+	rec->size = pkt->size;
+	rec->if_chain = pkt->if_chain;
+	rec->rf_chain = pkt->rf_chain;
+	rec->status = pkt->status;
+	rec->modulation = pkt->modulation;
+	rec->bandwidth = pkt->bandwidth;
+	rec->coderate = pkt->coderate;
+	rec->flags = utc_gps ? LGW_CAP_UTC_GPS : 0;
+	size = (pkt->size < LGW_CAP_PAYLOAD_SIZE) ? pkt->size : LGW_CAP_PAYLOAD_SIZE;
+	memcpy(rec->payload, pkt->payload, size);
+	memset(rec->payload + size, 0, LGW_CAP_PAYLOAD_SIZE - size);
+
+	cap->nb_write += 1;
+	cap->next = (cap->next + 1 == cap->nb_rec) ? 0 : cap->next + 1;
+	STORE_RELEASE(((struct cap_hdr_s *)cap->map)->nb_write, cap->nb_write);
+	return LGW_CAP_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_cap_close(struct lgw_cap_s *cap) {
+	int i = LGW_CAP_SUCCESS;
+
+	CHECK_NULL(cap);
+	CHECK_NULL(cap->map);
+	if (msync(cap->map, cap->map_size, MS_SYNC) != 0) {
+		DEBUG_MSG("ERROR: IMPOSSIBLE TO WRITE THE CAPTURE FILE\n");
+		i = LGW_CAP_ERROR;
+	}
+	munmap(cap->map, cap->map_size);
+	close(cap->fd);
+	cap->map = NULL;
+	cap->fd = -1;
+	return i;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_cap_dump(const char *path, FILE *out, uint64_t *nb_out) {
+	const struct cap_hdr_s *hdr;
+	const struct lgw_cap_rec_s *rec;
+	struct stat st;
+	uint8_t *map;
+	uint64_t nb_write, n, first;
+	int fd;
+
+	CHECK_NULL(path);
+	CHECK_NULL(out);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return LGW_CAP_ERROR;
+	}
+	if ((fstat(fd, &st) != 0) || (st.st_size < CAP_HDR_SIZE)) {
+		close(fd);
+		return LGW_CAP_ERROR;
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return LGW_CAP_ERROR;
+	}
+	hdr = (const struct cap_hdr_s *)map;
+	if ((memcmp(hdr->magic, CAP_MAGIC, sizeof hdr->magic) != 0) || (hdr->version != CAP_VERSION) || (hdr->bom != CAP_BOM) || (hdr->rec_size != sizeof(struct lgw_cap_rec_s)) || (hdr->nb_rec == 0) || ((uint64_t)st.st_size < CAP_HDR_SIZE + (uint64_t)hdr->nb_rec * sizeof(struct lgw_cap_rec_s))) {
+		DEBUG_MSG("ERROR: NOT A CAPTURE FILE\n");
+		munmap(map, (size_t)st.st_size);
+		return LGW_CAP_ERROR;
+	}
+
+	nb_write = LOAD_ACQUIRE(((struct cap_hdr_s *)map)->nb_write);
+	first = (nb_write > hdr->nb_rec) ? nb_write - hdr->nb_rec : 0;
+	fprintf(out, "utc,utc_src,count_us,freq_hz,rf_chain,if_chain,status,modulation,bandwidth,datarate,coderate,rssi,snr,snr_min,snr_max,crc,size,payload\n");
+	for (n = first; n < nb_write; ++n) {
+		rec = (const struct lgw_cap_rec_s *)(map + CAP_HDR_SIZE) + (n % hdr->nb_rec);
+		cap_dump_rec(out, rec);
+	}
+	if (nb_out != NULL) {
+		*nb_out = nb_write - first;
+	}
+	munmap(map, (size_t)st.st_size);
+	return LGW_CAP_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,274 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Control socket, line commands over a local stream socket
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdio.h>		/* fprintf vsnprintf */
+#include <stdarg.h>		/* va_list */
+#include <string.h>		/* memcpy memmove memchr */
+#include <errno.h>		/* errno EINTR */
+#include <unistd.h>		/* close unlink */
+#include <poll.h>		/* poll */
+#include <sys/socket.h>	/* socket bind listen accept recv send */
+#include <sys/stat.h>	/* lstat */
+#include <sys/un.h>		/* struct sockaddr_un */
+
+#include "loragw_ctl.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_HAL == 1
+	#define DEBUG_MSG(str)				fprintf(stderr, str)
+	#define DEBUG_PRINTF(fmt, args...)	fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+	#define CHECK_NULL(a)				if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_CTL_ERROR;}
+#else
+	#define DEBUG_MSG(str)
+	#define DEBUG_PRINTF(fmt, args...)
+	#define CHECK_NULL(a)				if(a==NULL){return LGW_CTL_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define CTL_BACKLOG		4	/* clients waiting for the current one to disconnect */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+void ctl_drop_client(struct lgw_ctl_s *ctl);
+
+int ctl_line(struct lgw_ctl_s *ctl, char *line, size_t size);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+void ctl_drop_client(struct lgw_ctl_s *ctl) {
+	if (ctl->client >= 0) {
+		close(ctl->client);
+	}
+	ctl->client = -1;
+	ctl->len = 0;
+	ctl->discard = 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* take the first full line out of the receive buffer, 1 if there was one */
+int ctl_line(struct lgw_ctl_s *ctl, char *line, size_t size) {
+	char *nl;
+	size_t n;
+	int found = 0;
+
+	while ((found == 0) && ((nl = memchr(ctl->buf, '\n', ctl->len)) != NULL)) {
+		n = nl - ctl->buf;
+		if ((n > 0) && (ctl->buf[n-1] == '\r')) {
+			--n;
+		}
+		if (ctl->discard == 1) {
+			ctl->discard = 0; /* end of the line that was too long */
+		} else if (n >= size) {
+			lgw_ctl_reply(ctl, "ERROR command too long");
+			if (ctl->client < 0) {
+				return 0; /* the reply failed and the client was dropped with its buffer */
+			}
+		} else if (n > 0) { /* empty lines are ignored */
+			memcpy(line, ctl->buf, n);
+			line[n] = '\0';
+			found = 1;
+		}
+		n = nl - ctl->buf + 1;
+		ctl->len -= n;
+		memmove(ctl->buf, ctl->buf + n, ctl->len);
+	}
+	if (found == 1) {
+		return 1;
+	}
+	if (ctl->len == sizeof ctl->buf) {
+		/* no newline in a full buffer, drop the line up to its end */
+		if (ctl->discard == 0) {
+			lgw_ctl_reply(ctl, "ERROR command too long");
+			if (ctl->client < 0) {
+				return 0; /* the next client starts with a new line */
+			}
+		}
+		ctl->len = 0;
+		ctl->discard = 1;
+	}
+	return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_ctl_open(struct lgw_ctl_s *ctl, const char *path) {
+	struct sockaddr_un addr;
+	struct stat st;
+
+	CHECK_NULL(ctl);
+	CHECK_NULL(path);
+	ctl->fd = -1;
+	ctl->client = -1;
+	ctl->len = 0;
+	ctl->discard = 0;
+	if ((strlen(path) == 0) || (strlen(path) >= sizeof addr.sun_path) || (strlen(path) >= sizeof ctl->path)) {
+		DEBUG_MSG("ERROR: INVALID CONTROL SOCKET PATH\n");
+		return LGW_CTL_ERROR;
+	}
+	strcpy(ctl->path, path);
+
+	/* a socket left by a previous run refuses connections, but prevents bind */
+	if (lstat(path, &st) == 0) {
+		if (!S_ISSOCK(st.st_mode)) {
+			DEBUG_MSG("ERROR: CONTROL SOCKET PATH IS ANOTHER KIND OF FILE\n");
+			return LGW_CTL_ERROR;
+		}
+		unlink(path);
+	}
+
+	ctl->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (ctl->fd < 0) {
+		DEBUG_MSG("ERROR: IMPOSSIBLE TO CREATE THE CONTROL SOCKET\n");
+		return LGW_CTL_ERROR;
+	}
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if ((bind(ctl->fd, (struct sockaddr *)&addr, sizeof addr) != 0) || (listen(ctl->fd, CTL_BACKLOG) != 0)) {
+		DEBUG_MSG("ERROR: IMPOSSIBLE TO LISTEN ON THE CONTROL SOCKET\n");
+		close(ctl->fd);
+		ctl->fd = -1;
+		return LGW_CTL_ERROR;
+	}
+	return LGW_CTL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctl_wait(struct lgw_ctl_s *ctl, int timeout_ms, char *line, size_t size) {
+	struct pollfd pfd;
+	ssize_t n;
+	int i;
+
+	CHECK_NULL(ctl);
+	CHECK_NULL(line);
+	if ((ctl->fd < 0) || (size == 0)) {
+		return LGW_CTL_ERROR;
+	}
+
+	/* a command received with the previous one */
+	if (ctl_line(ctl, line, size) == 1) {
+		return 1;
+	}
+
+	/* the next client waits in the backlog until the current one disconnects */
+	pfd.fd = (ctl->client >= 0) ? ctl->client : ctl->fd;
+	pfd.events = POLLIN;
+	i = poll(&pfd, 1, timeout_ms);
+	if (i < 0) {
+		return (errno == EINTR) ? 0 : LGW_CTL_ERROR;
+	} else if (i == 0) {
+		return 0;
+	}
+
+	if (ctl->client < 0) {
+		ctl->client = accept(ctl->fd, NULL, NULL);
+		if (ctl->client < 0) {
+			return ((errno == EINTR) || (errno == ECONNABORTED)) ? 0 : LGW_CTL_ERROR;
+		}
+		DEBUG_MSG("Note: control client connected\n");
+		return 0;
+	}
+
+	n = recv(ctl->client, ctl->buf + ctl->len, sizeof ctl->buf - ctl->len, 0);
+	if (n <= 0) {
+		if ((n < 0) && (errno == EINTR)) {
+			return 0;
+		}
+		DEBUG_MSG("Note: control client disconnected\n");
+		ctl_drop_client(ctl);
+		return 0;
+	}
+	ctl->len += n;
+	return ctl_line(ctl, line, size);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctl_reply(struct lgw_ctl_s *ctl, const char *fmt, ...) {
+	char reply[LGW_CTL_LINE_SIZE];
+	va_list ap;
+	size_t len, done = 0;
+	ssize_t n;
+	int i;
+
+	CHECK_NULL(ctl);
+	CHECK_NULL(fmt);
+	if (ctl->client < 0) {
+		return LGW_CTL_ERROR;
+	}
+	va_start(ap, fmt);
+	i = vsnprintf(reply, sizeof reply - 1, fmt, ap);
+	va_end(ap);
+	if (i < 0) {
+		return LGW_CTL_ERROR;
+	}
+	len = ((size_t)i < sizeof reply - 1) ? (size_t)i : sizeof reply - 2; /* truncated */
+	reply[len++] = '\n';
+
+	/* never blocks the caller, a client that does not read its replies loses them */
+	while (done < len) {
+		n = send(ctl->client, reply + done, len - done, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				DEBUG_MSG("WARNING: control client does not read, reply dropped\n");
+				return LGW_CTL_ERROR;
+			}
+			ctl_drop_client(ctl);
+			return LGW_CTL_ERROR;
+		}
+		done += n;
+	}
+	return LGW_CTL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctl_close(struct lgw_ctl_s *ctl) {
+	CHECK_NULL(ctl);
+	if (ctl->fd < 0) {
+		return LGW_CTL_ERROR;
+	}
+	ctl_drop_client(ctl);
+	close(ctl->fd);
+	ctl->fd = -1;
+	unlink(ctl->path);
+	return LGW_CTL_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
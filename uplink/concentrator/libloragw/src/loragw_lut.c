@@ -0,0 +1,118 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	LoRa timing lookup tables, generated at compile time
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+
+#include "loragw_lut.h"
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+/* table generator: f(b,s,i) for i, i+1, ... i+N-1 */
+#define LUT_REP4(f,b,s,i)	f(b,s,(i)), f(b,s,(i)+1), f(b,s,(i)+2), f(b,s,(i)+3)
+#define LUT_REP16(f,b,s,i)	LUT_REP4(f,b,s,(i)), LUT_REP4(f,b,s,(i)+4), LUT_REP4(f,b,s,(i)+8), LUT_REP4(f,b,s,(i)+12)
+#define LUT_REP64(f,b,s,i)	LUT_REP16(f,b,s,(i)), LUT_REP16(f,b,s,(i)+16), LUT_REP16(f,b,s,(i)+32), LUT_REP16(f,b,s,(i)+48)
+#define LUT_REP256(f,b,s,i)	LUT_REP64(f,b,s,(i)), LUT_REP64(f,b,s,(i)+64), LUT_REP64(f,b,s,(i)+128), LUT_REP64(f,b,s,(i)+192)
+
+/* b is the bandwidth index (0: 500 kHz, 1: 250 kHz, 2: 125 kHz), s the spreading factor */
+#define LUT_SHIFT(b)		(2 - (b))	/* log2(bandwidth / 125 kHz) */
+#define LUT_LDRO(b,s)		((((b) == 2) && ((s) >= 11)) || (((b) == 1) && ((s) == 12)))	/* symbols longer than 16 ms: 'PPM offset' in RX, low datarate optimization in TX */
+
+/* RX timestamp correction, x is the payload size plus 2 bytes if the CRC is enabled */
+#define RX_X(m,b)			((m) ? 114u : (16u << (b)))	/* base delay, m = 1 for the multi-SF modems */
+#define RX_Y(s,k)			((1u << ((s)-1)) * ((s)+1) + (k) * (1u << ((s)-4)))
+#define RX_IS_SHORT(s,x)	(((s) >= 7) && (2u*(x) == (unsigned)(s) - 7u))	/* payload fits in the first 8 symbols */
+#define RX_BASE(m,b,s)		(RX_X(m,b) + (RX_Y(s, 4u - LUT_LDRO(b,s)) >> LUT_SHIFT(b)))
+#define RX_SHORT(m,b,s)		(RX_X(m,b) + (RX_Y(s, 3u) >> LUT_SHIFT(b)) + ((32u * ((s) - 2)) >> LUT_SHIFT(b)))
+#define RX_SYM(b,s,x)		(RX_IS_SHORT(s,x) ? 0 : ((2u*(x) - (s) + 6u) % ((s) - 2u*LUT_LDRO(b,s))) + 1)
+#define RX_SYM_ROW(b,s)		{ LUT_REP256(RX_SYM,b,s,0), RX_SYM(b,s,256), RX_SYM(b,s,257) }
+#define RX_SYM_BW(b)		{ RX_SYM_ROW(b,6), RX_SYM_ROW(b,7), RX_SYM_ROW(b,8), RX_SYM_ROW(b,9), RX_SYM_ROW(b,10), RX_SYM_ROW(b,11), RX_SYM_ROW(b,12) }
+#define RX_SF_ROW(f,m,b)	{ f(m,b,6), f(m,b,7), f(m,b,8), f(m,b,9), f(m,b,10), f(m,b,11), f(m,b,12) }
+#define RX_MODEM(f,m)		{ RX_SF_ROW(f,m,0), RX_SF_ROW(f,m,1), RX_SF_ROW(f,m,2) }
+
+/* TX time on air, n = 2*size + 4 if CRC + 5 if explicit header, the payload has 4*(n-s+2) bits after the first 8 symbols */
+#define TOA_BLK(b,s,n)		(((n) + 2 > (s)) ? ((n) + 2 - (s) + (s) - 2*LUT_LDRO(b,s) - 1) / ((s) - 2*LUT_LDRO(b,s)) : 0)
+#define TOA_BLK_ROW(b,s)	{ LUT_REP256(TOA_BLK,b,s,0), LUT_REP256(TOA_BLK,b,s,256), LUT_REP4(TOA_BLK,b,s,512), LUT_REP4(TOA_BLK,b,s,516) }
+#define TOA_BLK_BW(b)		{ TOA_BLK_ROW(b,7), TOA_BLK_ROW(b,8), TOA_BLK_ROW(b,9), TOA_BLK_ROW(b,10), TOA_BLK_ROW(b,11), TOA_BLK_ROW(b,12) }
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define LUT_BW_NB		3	/* 500, 250 and 125 kHz */
+#define LUT_RX_SF_NB	7	/* SF6 to SF12 */
+#define LUT_RX_X_NB		258	/* 255 bytes of payload + 2 bytes of CRC */
+#define LUT_TOA_SF_NB	6	/* SF7 to SF12 */
+#define LUT_TOA_N_NB	520	/* 2*255 + 4 + 5 */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
+
+/* delay of the modem, LoRa header and fixed part of the payload */
+static const uint16_t lut_rx_base[2][LUT_BW_NB][LUT_RX_SF_NB] = { RX_MODEM(RX_BASE,0), RX_MODEM(RX_BASE,1) };
+
+/* whole delay of the packets whose payload fits in the first 8 symbols */
+static const uint16_t lut_rx_short[2][LUT_BW_NB][LUT_RX_SF_NB] = { RX_MODEM(RX_SHORT,0), RX_MODEM(RX_SHORT,1) };
+
+/* number of symbols of the last block processed after the end of the packet, 0 for the short packets */
+static const uint8_t lut_rx_sym[LUT_BW_NB][LUT_RX_SF_NB][LUT_RX_X_NB] = { RX_SYM_BW(0), RX_SYM_BW(1), RX_SYM_BW(2) };
+
+/* number of blocks of (4 + CR) symbols after the first 8 payload symbols */
+static const uint8_t lut_toa_blk[LUT_BW_NB][LUT_TOA_SF_NB][LUT_TOA_N_NB] = { TOA_BLK_BW(0), TOA_BLK_BW(1), TOA_BLK_BW(2) };
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+uint32_t lgw_lut_rx_delay(uint8_t if_type, uint8_t bandwidth, uint8_t sf, uint8_t cr, bool crc_en, uint8_t size) {
+	unsigned m, b, s, v;
+
+	if (((if_type != IF_LORA_STD) && (if_type != IF_LORA_MULTI)) || !IS_LORA_BW(bandwidth) || (sf < 6) || (sf > 12)) {
+		return 0;
+	}
+	m = (if_type == IF_LORA_MULTI) ? 1 : 0;
+	b = bandwidth - BW_500KHZ;
+	s = sf - 6;
+
+	v = lut_rx_sym[b][s][size + (crc_en ? 2 : 0)];
+	if (v == 0) {
+		return lut_rx_short[m][b][s];
+	}
+	return lut_rx_base[m][b][s] + (((16 + 4 * (uint32_t)cr) * v) >> LUT_SHIFT(b));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t lgw_lut_lora_toa(uint8_t bandwidth, uint8_t sf, uint8_t coderate, bool crc_en, bool no_header, uint16_t size, uint16_t preamble) {
+	unsigned b, n;
+	uint32_t t_sym, nb_sym;
+
+	if (!IS_LORA_BW(bandwidth) || (sf < 7) || (sf > 12) || !IS_LORA_CR(coderate) || (size > 255)) {
+		return 0;
+	}
+	b = bandwidth - BW_500KHZ;
+	n = 2 * size + (crc_en ? 4 : 0) + (no_header ? 0 : 5);
+
+	/* (preamble + 4.25 + 8 + blocks) symbols of 2^SF / BW, a multiple of 4 us */
+	t_sym = 2u << (b + sf);
+	nb_sym = preamble + 4 + 8 + lut_toa_blk[b][sf-7][n] * (coderate + 4);
+	return nb_sym * t_sym + t_sym / 4;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
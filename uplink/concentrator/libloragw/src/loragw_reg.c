@@ -23,8 +23,11 @@ Maintainer: Sylvain Miermont
 #include <stdint.h>		/* C99 types */
 #include <stdbool.h>	/* bool type */
 #include <stdio.h>		/* printf fprintf */
+#include <stdlib.h>		/* malloc free */
+#include <string.h>		/* memset memcpy strlen */
 
 #include "loragw_spi.h"
+#include "loragw_trace.h"
 #include "loragw_reg.h"
 
 /* -------------------------------------------------------------------------- */
@@ -41,18 +44,10 @@ Maintainer: Sylvain Miermont
 	#define CHECK_NULL(a)				if(a==NULL){return LGW_REG_ERROR;}
 #endif
 
-/* -------------------------------------------------------------------------- */
-/* --- PRIVATE TYPES -------------------------------------------------------- */
-
-struct lgw_reg_s {
-	int8_t		page;		/*!< page containing the register (-1 for all pages) */
-	uint8_t		addr;		/*!< base address of the register (7 bit) */
-	uint8_t		offs;		/*!< position of the register LSB (between 0 to 7) */
-	bool		sign;		/*!< 1 indicates the register is signed (2 complem.) */
-	uint8_t		leng;		/*!< number of bits in the register */
-	bool		rdon;		/*!< 1 indicates a read-only register */
-	int32_t		dflt;		/*!< register default value */
-};
+/* statistics counters, updated and read by any thread without lock */
+#define STAT_ADD(x, n)	__atomic_fetch_add(&(x), (n), __ATOMIC_RELAXED)
+#define STAT_GET(x)		__atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STAT_CLR(x)		__atomic_store_n(&(x), 0, __ATOMIC_RELAXED)
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
@@ -60,6 +55,15 @@ struct lgw_reg_s {
 #define PAGE_ADDR		0x00
 #define PAGE_MASK		0x03
 
+#define SHADOW_ROW_NB	5		/* 4 pages + one row for the registers common to all pages */
+#define SHADOW_COMMON	4		/* row of the registers common to all pages */
+#define SHADOW_OWNED	0x01	/* byte only contains registers that are changed by the host */
+#define SHADOW_VALID	0x02	/* shadow value is known to match the concentrator */
+#define SHADOW_DFLT		0x04	/* all bits of the byte have a documented default value */
+
+#define BATCH_FRAME_NB	LGW_SPI_WM_MAX	/* maximum number of frames queued in a batch */
+#define BATCH_BYTE_NB	1024	/* maximum number of data bytes queued in a batch */
+
 /*
 auto generated register mapping for C code : 11-Jul-2013 13:20:40
 this file contains autogenerated C struct used to access the LoRa register from the Primer firmware
@@ -395,35 +399,402 @@ const struct lgw_reg_s loregs[LGW_TOTALREGS] = {
 	{1,33,0,0,8,0,0}		/* TX_TRIG_ALL (alias) */
 };
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* state of the connection to one concentrator */
+struct lgw_reg_ctx_s {
+	void		*spi_target;	/* generic pointer to the SPI device */
+	char		*spi_dev;	/* device opened by lgw_connect, NULL for the SPI backend default */
+	int			regpage;	/* keep the value of the register page selected */
+	uint32_t	page_switch_cnt;	/* number of writes to the page register */
+
+	/*
+	Host-side copy of the register file, used to write sub-byte registers without
+	reading them first and to skip writes that would not change anything.
+	Only bytes that contain exclusively host-owned registers are shadowed: bytes
+	containing a read-only register, a data port, a buffer pointer, a trigger or a
+	command register are always accessed on the SPI link.
+	*/
+	bool		shadow_enable;
+	bool		shadow_init_done;
+	uint8_t		shadow_val[SHADOW_ROW_NB][128];
+	uint8_t		shadow_flag[SHADOW_ROW_NB][128];
+	uint8_t		shadow_dflt[SHADOW_ROW_NB][128];
+	struct lgw_reg_shadow_stat_s	shadow_stat;
+
+	/*
+	Queue of write frames (page switches included) sent in a single SPI
+	transaction when the batch is committed. Any register read flushes the queue
+	first, so the order of the accesses seen by the concentrator is unchanged.
+	*/
+	int			batch_depth;	/* number of nested lgw_reg_batch_begin */
+	uint16_t	batch_nb;	/* number of frames queued */
+	uint16_t	batch_len;	/* number of data bytes queued */
+	uint8_t		batch_addr[BATCH_FRAME_NB];
+	uint16_t	batch_size[BATCH_FRAME_NB];
+	uint8_t		batch_data[BATCH_BYTE_NB];
+};
+
+#define REG_CTX_INIT	{ .spi_target = NULL, .spi_dev = NULL, .regpage = -1, .shadow_enable = true }
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
-void *lgw_spi_target = NULL; /*! generic pointer to the SPI device */
-static int lgw_regpage = -1; /*! keep the value of the register page selected */
+static struct lgw_reg_stats_s reg_stats; /* SPI traffic of all the concentrators since the program started or lgw_reg_reset_stats */
+
+/* connection used by the functions that have no context, see lgw_reg_ctx_select */
+static struct lgw_reg_ctx_s reg_ctx_dflt = REG_CTX_INIT;
+
+/* connection the calling thread accesses */
+static __thread struct lgw_reg_ctx_s *rc = &reg_ctx_dflt;
+
+/* writable registers that the hardware modifies, or whose write has a side effect */
+static const uint16_t shadow_volatile[] = {
+	LGW_PAGE_REG, LGW_SOFT_RESET,
+	LGW_RX_DATA_BUF_ADDR, LGW_RX_DATA_BUF_DATA,
+	LGW_TX_DATA_BUF_ADDR, LGW_TX_DATA_BUF_DATA,
+	LGW_CAPTURE_RAM_ADDR, LGW_MCU_PROM_ADDR, LGW_MCU_PROM_DATA,
+	LGW_RX_PACKET_DATA_FIFO_NUM_STORED,
+	LGW_START_BIST0, LGW_START_BIST1, LGW_CLEAR_BIST0, LGW_CLEAR_BIST1,
+	LGW_EMERGENCY_FORCE_HOST_CTRL,
+	LGW_RADIO_SELECT, /* command channel to the AGC MCU, repeated values are meaningful */
+	LGW_CAPTURE_START, LGW_CAPTURE_FORCE_TRIGGER,
+	/* RX image rejection, set by the calibration firmware */
+	LGW_IQ_MISMATCH_A_AMP_COEFF, LGW_IQ_MISMATCH_A_PHI_COEFF, LGW_IQ_MISMATCH_B_AMP_COEFF, LGW_IQ_MISMATCH_B_SEL_I, LGW_IQ_MISMATCH_B_PHI_COEFF
+};
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
 
+/* count one SPI transaction */
+static void spi_count(uint32_t nb_byte_w, uint32_t nb_byte_r) {
+	STAT_ADD(reg_stats.nb_spi, 1);
+	STAT_ADD(reg_stats.nb_byte_w, nb_byte_w);
+	STAT_ADD(reg_stats.nb_byte_r, nb_byte_r);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* send all queued write frames */
+static int batch_flush(void) {
+	int spi_stat = LGW_SPI_SUCCESS;
+
+	if (rc->batch_nb > 0) {
+		spi_stat = lgw_trace_wm(rc->spi_target, rc->batch_addr, rc->batch_size, rc->batch_data, rc->batch_nb);
+		spi_count(rc->batch_len, 0);
+		rc->batch_nb = 0;
+		rc->batch_len = 0;
+	}
+	return spi_stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* write frame, sent immediately or queued if a batch is open */
+static int spi_write(uint8_t addr, uint8_t *data, uint16_t size) {
+	int spi_stat = LGW_SPI_SUCCESS;
+
+	if ((rc->batch_depth > 0) && (size <= BATCH_BYTE_NB)) {
+		if ((rc->batch_nb == BATCH_FRAME_NB) || ((rc->batch_len + size) > BATCH_BYTE_NB)) {
+			spi_stat = batch_flush();
+		}
+		rc->batch_addr[rc->batch_nb] = addr;
+		rc->batch_size[rc->batch_nb] = size;
+		memcpy(rc->batch_data + rc->batch_len, data, size);
+		rc->batch_nb += 1;
+		rc->batch_len += size;
+		return spi_stat;
+	}
+	spi_stat = batch_flush(); /* frame too big to be queued, keep the order */
+	spi_count(size, 0);
+	if (size == 1) {
+		spi_stat += lgw_trace_w(rc->spi_target, addr, data[0]);
+	} else {
+		spi_stat += lgw_trace_wb(rc->spi_target, addr, data, size);
+	}
+	return spi_stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int page_switch(uint8_t target) {
-	lgw_regpage = PAGE_MASK & target;
-	lgw_spi_w(lgw_spi_target, PAGE_ADDR, (uint8_t)lgw_regpage);
-	return LGW_REG_SUCCESS;
+	uint8_t page;
+
+	rc->regpage = PAGE_MASK & target;
+	page = (uint8_t)rc->regpage;
+	rc->page_switch_cnt += 1;
+	STAT_ADD(reg_stats.nb_page_switch, 1);
+	return spi_write(PAGE_ADDR, &page, 1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* registers that keep their position in a list: common to all pages or with a side effect */
+static bool list_barrier(uint16_t register_id) {
+	int i;
+
+	if (loregs[register_id].page == -1) {
+		return true;
+	}
+	for (i=0; i<(int)ARRAY_SIZE(shadow_volatile); ++i) {
+		if (register_id == shadow_volatile[i]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* single access of a register list */
+static int reg_list_access(uint16_t register_id, int32_t *reg_value, bool write) {
+	if (write == true) {
+		return lgw_reg_w(register_id, *reg_value);
+	} else {
+		return lgw_reg_r(register_id, reg_value);
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* access a list of registers page by page, current page first */
+static int reg_list(uint16_t *register_id, int32_t *reg_value, uint16_t nb, bool write, uint16_t *nb_page_switch) {
+	int reg_stat = LGW_REG_SUCCESS;
+	uint32_t cnt0 = rc->page_switch_cnt;
+	int start, end, i, k;
+	int first, pg;
+
+	/* check input parameters */
+	CHECK_NULL(register_id);
+	CHECK_NULL(reg_value);
+	for (i=0; i<nb; ++i) {
+		if (register_id[i] >= LGW_TOTALREGS) {
+			DEBUG_MSG("ERROR: REGISTER NUMBER OUT OF DEFINED RANGE\n");
+			return LGW_REG_ERROR;
+		}
+	}
+
+	/* check if SPI is initialised */
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
+		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+		return LGW_REG_ERROR;
+	}
+
+	/* the list is cut in segments by barrier registers, only accesses inside a segment are reordered */
+	for (start=0; start<nb; start=end) {
+		if (list_barrier(register_id[start]) == true) {
+			reg_stat |= reg_list_access(register_id[start], &reg_value[start], write);
+			end = start + 1;
+			continue;
+		}
+		for (end=start; (end<nb) && (list_barrier(register_id[end]) == false); ++end);
+		first = rc->regpage;
+		for (k=-1; k<4; ++k) {
+			pg = (k == -1) ? first : k;
+			if (k == first) {
+				continue; /* already done */
+			}
+			for (i=start; i<end; ++i) {
+				if (loregs[register_id[i]].page == pg) {
+					reg_stat |= reg_list_access(register_id[i], &reg_value[i], write);
+				}
+			}
+		}
+	}
+
+	if (nb_page_switch != NULL) {
+		*nb_page_switch = (uint16_t)(rc->page_switch_cnt - cnt0);
+	}
+	return (reg_stat == LGW_REG_SUCCESS) ? LGW_REG_SUCCESS : LGW_REG_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* find which bytes can be shadowed and their reset value, from the register map */
+static void shadow_init(void) {
+	struct lgw_reg_s r;
+	uint8_t covered[SHADOW_ROW_NB][128];
+	uint8_t mask;
+	int i, j, k, row, size_byte;
+
+	memset(rc->shadow_flag, 0, sizeof rc->shadow_flag);
+	memset(rc->shadow_dflt, 0, sizeof rc->shadow_dflt);
+	memset(covered, 0, sizeof covered);
+	for (row=0; row<SHADOW_ROW_NB; ++row) {
+		for (j=0; j<128; ++j) {
+			rc->shadow_flag[row][j] = SHADOW_OWNED;
+		}
+	}
+	for (i=0; i<LGW_TOTALREGS; ++i) {
+		r = loregs[i];
+		row = (r.page == -1) ? SHADOW_COMMON : r.page;
+		size_byte = (r.offs + r.leng + 7) / 8;
+		for (k=0; k<size_byte; ++k) {
+			if (r.rdon == true) {
+				rc->shadow_flag[row][r.addr+k] &= ~SHADOW_OWNED;
+			}
+			if (size_byte == 1) {
+				mask = ((1 << r.leng) - 1) << r.offs;
+				rc->shadow_dflt[row][r.addr] = (rc->shadow_dflt[row][r.addr] & ~mask) | (((uint8_t)r.dflt << r.offs) & mask);
+				covered[row][r.addr] |= mask;
+			} else {
+				rc->shadow_dflt[row][r.addr+k] = (uint8_t)(r.dflt >> (8*k));
+				covered[row][r.addr+k] = 0xFF;
+			}
+		}
+	}
+	for (i=0; i<(int)ARRAY_SIZE(shadow_volatile); ++i) {
+		r = loregs[shadow_volatile[i]];
+		row = (r.page == -1) ? SHADOW_COMMON : r.page;
+		size_byte = (r.offs + r.leng + 7) / 8;
+		for (k=0; k<size_byte; ++k) {
+			rc->shadow_flag[row][r.addr+k] &= ~SHADOW_OWNED;
+		}
+	}
+	for (row=0; row<SHADOW_ROW_NB; ++row) {
+		for (j=0; j<128; ++j) {
+			if (covered[row][j] == 0xFF) {
+				rc->shadow_flag[row][j] |= SHADOW_DFLT;
+			}
+		}
+	}
+	rc->shadow_init_done = true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* forget everything, the concentrator state is unknown */
+static void shadow_invalidate(void) {
+	int row, j;
+
+	for (row=0; row<SHADOW_ROW_NB; ++row) {
+		for (j=0; j<128; ++j) {
+			rc->shadow_flag[row][j] &= ~SHADOW_VALID;
+		}
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* after a soft reset, registers are back to their default value */
+static void shadow_reset(void) {
+	int row, j;
+
+	for (row=0; row<SHADOW_ROW_NB; ++row) {
+		for (j=0; j<128; ++j) {
+			if ((rc->shadow_flag[row][j] & (SHADOW_OWNED|SHADOW_DFLT)) == (SHADOW_OWNED|SHADOW_DFLT)) {
+				rc->shadow_val[row][j] = rc->shadow_dflt[row][j];
+				rc->shadow_flag[row][j] |= SHADOW_VALID;
+			} else {
+				rc->shadow_flag[row][j] &= ~SHADOW_VALID;
+			}
+		}
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* pointer to the shadow of a byte if it is host-owned and known, NULL otherwise */
+static uint8_t *shadow_get(int8_t page, uint8_t addr) {
+	int row = (page == -1) ? SHADOW_COMMON : page;
+
+	if ((rc->shadow_enable == false) || ((rc->shadow_flag[row][addr] & (SHADOW_OWNED|SHADOW_VALID)) != (SHADOW_OWNED|SHADOW_VALID))) {
+		return NULL;
+	}
+	return &rc->shadow_val[row][addr];
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* record the value of a byte that was read from or written to the concentrator */
+static void shadow_set(int8_t page, uint8_t addr, uint8_t val) {
+	int row = (page == -1) ? SHADOW_COMMON : page;
+
+	if ((rc->shadow_flag[row][addr] & SHADOW_OWNED) != 0) {
+		rc->shadow_val[row][addr] = val;
+		rc->shadow_flag[row][addr] |= SHADOW_VALID;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* account for a write that was not needed, and for the page switch it would have caused */
+static void shadow_skip(int8_t page) {
+	rc->shadow_stat.nb_write_saved += 1;
+	if ((page != -1) && (page != rc->regpage)) {
+		rc->shadow_stat.nb_page_saved += 1;
+	}
 }
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
+struct lgw_reg_ctx_s *lgw_reg_ctx_new(const char *spi_dev) {
+	static const struct lgw_reg_ctx_s init = REG_CTX_INIT;
+	struct lgw_reg_ctx_s *ctx;
+
+	ctx = malloc(sizeof *ctx);
+	if (ctx == NULL) {
+		DEBUG_MSG("ERROR: MALLOC FAIL\n");
+		return NULL;
+	}
+	*ctx = init;
+	if (spi_dev != NULL) {
+		ctx->spi_dev = malloc(strlen(spi_dev) + 1);
+		if (ctx->spi_dev == NULL) {
+			free(ctx);
+			return NULL;
+		}
+		memcpy(ctx->spi_dev, spi_dev, strlen(spi_dev) + 1);
+	}
+	return ctx;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_ctx_free(struct lgw_reg_ctx_s *ctx) {
+	CHECK_NULL(ctx);
+	if ((ctx == &reg_ctx_dflt) || (ctx == rc) || (ctx->spi_target != NULL)) {
+		DEBUG_MSG("ERROR: CONNECTION IN USE\n");
+		return LGW_REG_ERROR;
+	}
+	free(ctx->spi_dev);
+	free(ctx);
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+struct lgw_reg_ctx_s *lgw_reg_ctx_select(struct lgw_reg_ctx_s *ctx) {
+	struct lgw_reg_ctx_s *prev = rc;
+
+	rc = (ctx == NULL) ? &reg_ctx_dflt : ctx;
+	return (prev == &reg_ctx_dflt) ? NULL : prev;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /* Concentrator connect */
 int lgw_connect(void) {
 	int spi_stat = LGW_SPI_SUCCESS;
 	uint8_t u = 0;
 	
-	if (lgw_spi_target != NULL) {
+	if (rc->spi_target != NULL) {
 		DEBUG_MSG("WARNING: concentrator was already connected\n");
-		lgw_spi_close(lgw_spi_target);
+		lgw_trace_close(rc->spi_target);
 	}
+	/* nothing is known about the register file until it is read, written or reset */
+	if (rc->shadow_init_done == false) {
+		shadow_init();
+	}
+	shadow_invalidate();
+	memset(&rc->shadow_stat, 0, sizeof rc->shadow_stat);
+	rc->batch_depth = 0;
+	rc->batch_nb = 0;
+	rc->batch_len = 0;
 	/* open the SPI link */
-	spi_stat = lgw_spi_open(&lgw_spi_target);
+	spi_stat = lgw_trace_open_dev(&rc->spi_target, rc->spi_dev);
 	if (spi_stat != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR CONNECTING CONCENTRATOR\n");
 		return LGW_REG_ERROR;
@@ -431,8 +802,8 @@ int lgw_connect(void) {
 	/* checking the version register to properly configure SPI interface */
 	/* We want to know if there is an FPGA in between the host and SX1301 */
 	/* For this, we rely on expected version registers */
-	spi_stat = lgw_spi_w(lgw_spi_target, 118, 1); /* set the SPI mux select */
-	spi_stat |= lgw_spi_r(lgw_spi_target, loregs[LGW_VERSION].addr, &u);
+	spi_stat = lgw_trace_w(rc->spi_target, 118, 1); /* set the SPI mux select */
+	spi_stat |= lgw_trace_r(rc->spi_target, loregs[LGW_VERSION].addr, &u);
 	if (spi_stat != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR READING VERSION REGISTER\n");
 		return LGW_REG_ERROR;
@@ -442,15 +813,15 @@ int lgw_connect(void) {
 		return LGW_REG_ERROR;
 	} else if (u != loregs[LGW_VERSION].dflt) {
 		/* check FPGA version if there is one (addr 118 is only valid for FPGA) */
-		spi_stat |= lgw_spi_w(lgw_spi_target, 118, 1); /* set the SPI mux select */
-		spi_stat |= lgw_spi_r(lgw_spi_target, loregs[LGW_VERSION].addr, &u);
+		spi_stat |= lgw_trace_w(rc->spi_target, 118, 1); /* set the SPI mux select */
+		spi_stat |= lgw_trace_r(rc->spi_target, loregs[LGW_VERSION].addr, &u);
 		if (u != 16) { /* 16 is the expected version for FPGA */
 			DEBUG_MSG("ERROR: NOT EXPECTED FPGA VERSION\n");
 			return LGW_REG_ERROR;
 		}
 		/* check SX1301 version */
-		spi_stat |= lgw_spi_w(lgw_spi_target, 118, 0); /* set the SPI mux select */
-		spi_stat |= lgw_spi_r(lgw_spi_target, loregs[LGW_VERSION].addr, &u);
+		spi_stat |= lgw_trace_w(rc->spi_target, 118, 0); /* set the SPI mux select */
+		spi_stat |= lgw_trace_r(rc->spi_target, loregs[LGW_VERSION].addr, &u);
 		if (u != loregs[LGW_VERSION].dflt) {
 			DEBUG_MSG("ERROR: NOT EXPECTED CHIP VERSION\n");
 			return LGW_REG_ERROR;
@@ -461,15 +832,15 @@ int lgw_connect(void) {
 		return LGW_REG_ERROR;
 	}
 	/* write 0 to the page/reset register */
-	spi_stat = lgw_spi_w(lgw_spi_target, loregs[LGW_PAGE_REG].addr, 0);
+	spi_stat = lgw_trace_w(rc->spi_target, loregs[LGW_PAGE_REG].addr, 0);
 	if (spi_stat != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR WRITING PAGE REGISTER\n");
 		return LGW_REG_ERROR;
 	} else {
-		lgw_regpage = 0;
+		rc->regpage = 0;
 	}
 	/* checking the chip ID */
-	spi_stat = lgw_spi_r(lgw_spi_target, loregs[LGW_CHIP_ID].addr, &u);
+	spi_stat = lgw_trace_r(rc->spi_target, loregs[LGW_CHIP_ID].addr, &u);
 	if (spi_stat != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR READING CHIP_ID REGISTER\n");
 		return LGW_REG_ERROR;
@@ -488,9 +859,12 @@ int lgw_connect(void) {
 
 /* Concentrator disconnect */
 int lgw_disconnect(void) {
-	if (lgw_spi_target != NULL) {
-		lgw_spi_close(lgw_spi_target);
-		lgw_spi_target = NULL;
+	if (rc->spi_target != NULL) {
+		batch_flush();
+		rc->batch_depth = 0;
+		lgw_trace_close(rc->spi_target);
+		rc->spi_target = NULL;
+		shadow_invalidate();
 		DEBUG_MSG("Note: success disconnecting the concentrator\n");
 		return LGW_REG_SUCCESS;
 	} else {
@@ -504,12 +878,15 @@ int lgw_disconnect(void) {
 /* soft-reset function */
 int lgw_soft_reset(void) {
 	/* check if SPI is initialised */
-	if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
 		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
 		return LGW_REG_ERROR;
 	}
-	lgw_spi_w(lgw_spi_target, 0, 0x80); /* 1 -> SOFT_RESET bit */
-	lgw_regpage = 0; /* reset the paging static variable */
+	batch_flush();
+	lgw_trace_w(rc->spi_target, 0, 0x80); /* 1 -> SOFT_RESET bit */
+	spi_count(1, 0);
+	rc->regpage = 0; /* reset the paging static variable */
+	shadow_reset();
 	return LGW_REG_SUCCESS;
 }
 
@@ -525,7 +902,7 @@ int lgw_reg_check(FILE *f) {
 	int i;
 	
 	/* check if SPI is initialised */
-	if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
 		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
 		fprintf(f, "ERROR: CONCENTRATOR UNCONNECTED\n");
 		return LGW_REG_ERROR;
@@ -550,10 +927,8 @@ int lgw_reg_check(FILE *f) {
 
 /* Write to a register addressed by name */
 int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
-	int spi_stat = LGW_SPI_SUCCESS;
 	struct lgw_reg_s r;
-	uint8_t buf[4] = "\x00\x00\x00\x00";
-	int i, size_byte;
+	int reg_stat;
 	
 	/* check input parameters */
 	if (register_id >= LGW_TOTALREGS) {
@@ -562,7 +937,7 @@ int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
 	}
 	
 	/* check if SPI is initialised */
-	if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
 		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
 		return LGW_REG_ERROR;
 	}
@@ -587,54 +962,36 @@ int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
 		return LGW_REG_ERROR;
 	}
 	
-	/* select proper register page if needed */
-	if ((r.page != -1) && (r.page != lgw_regpage)) {
-		spi_stat += page_switch(r.page);
-	}
-	
 	if ((r.leng == 8) && (r.offs == 0)) {
 		/* direct write */
-		spi_stat += lgw_spi_w(lgw_spi_target, r.addr, (uint8_t)reg_value);
+		reg_stat = lgw_reg_wbyte(r.page, r.addr, (uint8_t)reg_value);
 	} else if ((r.offs + r.leng) <= 8) {
 		/* single-byte read-modify-write, offs:[0-7], leng:[1-7] */
-		spi_stat += lgw_spi_r(lgw_spi_target, r.addr, &buf[0]);
-		buf[1] = ((1 << r.leng) - 1) << r.offs; /* bit mask */
-		buf[2] = ((uint8_t)reg_value) << r.offs; /* new data offsetted */
-		buf[3] = (~buf[1] & buf[0]) | (buf[1] & buf[2]); /* mixing old & new data */
-		spi_stat += lgw_spi_w(lgw_spi_target, r.addr, buf[3]);
+		reg_stat = lgw_reg_wbits(r.page, r.addr, ((1 << r.leng) - 1) << r.offs, ((uint8_t)reg_value) << r.offs);
 	} else if ((r.offs == 0) && (r.leng > 0) && (r.leng <= 32)) {
 		/* multi-byte direct write routine */
-		size_byte = (r.leng + 7) / 8; /* add a byte if it's not an exact multiple of 8 */ 
-		for (i=0; i<size_byte; ++i) {
-			/* big endian register file for a file on N bytes
-			Least significant byte is stored in buf[0], most one in buf[N-1] */
-			buf[i] = (uint8_t)(0x000000FF & reg_value);
-			reg_value = (reg_value >> 8);
-		}
-		spi_stat += lgw_spi_wb(lgw_spi_target, r.addr, buf, size_byte); /* write the register in one burst */
+		reg_stat = lgw_reg_wmulti(r.page, r.addr, (r.leng + 7) / 8, reg_value); /* add a byte if it's not an exact multiple of 8 */
 	} else {
 		/* register spanning multiple memory bytes but with an offset */
 		DEBUG_MSG("ERROR: REGISTER SIZE AND OFFSET ARE NOT SUPPORTED\n");
 		return LGW_REG_ERROR;
 	}
 	
-	if (spi_stat != LGW_SPI_SUCCESS) {
-		DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER WRITE\n");
-		return LGW_REG_ERROR;
-	} else {
-		return LGW_REG_SUCCESS;
+	/* the MCU may change any register while it has control of the register file */
+	if ((register_id == LGW_EMERGENCY_FORCE_HOST_CTRL) && ((reg_value & 0x01) == 0)) {
+		shadow_invalidate();
 	}
+	
+	return reg_stat;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /* Read to a register addressed by name */
 int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
-	int spi_stat = LGW_SPI_SUCCESS;
 	struct lgw_reg_s r;
 	uint8_t bufu[4] = "\x00\x00\x00\x00";
 	int8_t *bufs = (int8_t *)bufu;
-	int i, size_byte;
 	uint32_t u = 0;
 	
 	/* check input parameters */
@@ -644,23 +1001,14 @@ int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
 		return LGW_REG_ERROR;
 	}
 	
-	/* check if SPI is initialised */
-	if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
-		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
-		return LGW_REG_ERROR;
-	}
-	
 	/* get register struct from the struct array */
 	r = loregs[register_id];
 	
-	/* select proper register page if needed */
-	if ((r.page != -1) && (r.page != lgw_regpage)) {
-		spi_stat += page_switch(r.page);
-	}
-	
 	if ((r.offs + r.leng) <= 8) {
 		/* read one byte, then shift and mask bits to get reg value with sign extension if needed */
-		spi_stat += lgw_spi_r(lgw_spi_target, r.addr, &bufu[0]);
+		if (lgw_reg_rbyte(r.page, r.addr, &bufu[0]) != LGW_REG_SUCCESS) {
+			return LGW_REG_ERROR;
+		}
 		bufu[1] = bufu[0] << (8 - r.leng - r.offs); /* left-align the data */
 		if (r.sign == true) {
 			bufs[2] = bufs[1] >> (8 - r.leng); /* right align the data with sign extension (ARITHMETIC right shift) */
@@ -670,11 +1018,8 @@ int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
 			*reg_value = (int32_t)bufu[2]; /* unsigned pointer -> no sign extension */
 		}
 	} else if ((r.offs == 0) && (r.leng > 0) && (r.leng <= 32)) {
-		size_byte = (r.leng + 7) / 8; /* add a byte if it's not an exact multiple of 8 */ 
-		spi_stat += lgw_spi_rb(lgw_spi_target, r.addr, bufu, size_byte);
-		u = 0;
-		for (i=(size_byte-1); i>=0; --i) {
-			u = (uint32_t)bufu[i] + (u << 8); /* transform a 4-byte array into a 32 bit word */
+		if (lgw_reg_rmulti(r.page, r.addr, (r.leng + 7) / 8, &u) != LGW_REG_SUCCESS) { /* add a byte if it's not an exact multiple of 8 */
+			return LGW_REG_ERROR;
 		}
 		if (r.sign == true) {
 			u = u << (32 - r.leng); /* left-align the data */
@@ -688,6 +1033,65 @@ int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
 		return LGW_REG_ERROR;
 	}
 	
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Point to a register by name and do a burst write */
+int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
+	/* check input parameters */
+	if (register_id >= LGW_TOTALREGS) {
+		DEBUG_MSG("ERROR: REGISTER NUMBER OUT OF DEFINED RANGE\n");
+		return LGW_REG_ERROR;
+	}
+	
+	/* reject write to read-only registers */
+	if (loregs[register_id].rdon == 1){
+		DEBUG_MSG("ERROR: TRYING TO BURST WRITE A READ-ONLY REGISTER\n");
+		return LGW_REG_ERROR;
+	}
+	
+	return lgw_reg_wburst(loregs[register_id].page, loregs[register_id].addr, data, size);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Point to a register by name and do a burst read */
+int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
+	/* check input parameters */
+	if (register_id >= LGW_TOTALREGS) {
+		DEBUG_MSG("ERROR: REGISTER NUMBER OUT OF DEFINED RANGE\n");
+		return LGW_REG_ERROR;
+	}
+	
+	return lgw_reg_rburst(loregs[register_id].page, loregs[register_id].addr, data, size);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_wbyte(int8_t page, uint8_t addr, uint8_t val) {
+	int spi_stat = LGW_SPI_SUCCESS;
+	uint8_t *sh;
+	
+	/* check if SPI is initialised */
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
+		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+		return LGW_REG_ERROR;
+	}
+	
+	/* skipped if the register already has that value */
+	sh = shadow_get(page, addr);
+	if ((sh != NULL) && (*sh == val)) {
+		shadow_skip(page);
+		return LGW_REG_SUCCESS;
+	}
+	if ((page != -1) && (page != rc->regpage)) {
+		spi_stat += page_switch(page);
+	}
+	spi_stat += spi_write(addr, &val, 1);
+	shadow_set(page, addr, val);
+	
 	if (spi_stat != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER WRITE\n");
 		return LGW_REG_ERROR;
@@ -698,44 +1102,188 @@ int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-/* Point to a register by name and do a burst write */
-int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
+int lgw_reg_wbits(int8_t page, uint8_t addr, uint8_t mask, uint8_t val) {
 	int spi_stat = LGW_SPI_SUCCESS;
-	struct lgw_reg_s r;
+	uint8_t old = 0, mixed;
+	uint8_t *sh;
 	
-	/* check input parameters */
-	CHECK_NULL(data);
-	if (size == 0) {
-		DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+	/* check if SPI is initialised */
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
+		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
 		return LGW_REG_ERROR;
 	}
-	if (register_id >= LGW_TOTALREGS) {
-		DEBUG_MSG("ERROR: REGISTER NUMBER OUT OF DEFINED RANGE\n");
+	
+	/* the read is replaced by the shadow value when the byte is host-owned */
+	sh = shadow_get(page, addr);
+	if (sh != NULL) {
+		old = *sh;
+		rc->shadow_stat.nb_read_saved += 1;
+	} else {
+		if ((page != -1) && (page != rc->regpage)) {
+			spi_stat += page_switch(page);
+		}
+		spi_stat += batch_flush();
+		spi_stat += lgw_trace_r(rc->spi_target, addr, &old);
+		spi_count(0, 1);
+	}
+	mixed = (~mask & old) | (mask & val); /* mixing old & new data */
+	if ((sh != NULL) && (mixed == old)) {
+		shadow_skip(page);
+	} else {
+		if ((page != -1) && (page != rc->regpage)) {
+			spi_stat += page_switch(page);
+		}
+		spi_stat += spi_write(addr, &mixed, 1);
+		shadow_set(page, addr, mixed);
+	}
+	
+	if (spi_stat != LGW_SPI_SUCCESS) {
+		DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER WRITE\n");
 		return LGW_REG_ERROR;
+	} else {
+		return LGW_REG_SUCCESS;
 	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_wmulti(int8_t page, uint8_t addr, uint8_t size_byte, int32_t val) {
+	int spi_stat = LGW_SPI_SUCCESS;
+	uint8_t buf[4];
+	uint8_t *sh;
+	bool same = true;
+	int i;
 	
 	/* check if SPI is initialised */
-	if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
 		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
 		return LGW_REG_ERROR;
 	}
 	
-	/* get register struct from the struct array */
-	r = loregs[register_id];
+	for (i=0; i<size_byte; ++i) {
+		/* big endian register file for a file on N bytes
+		Least significant byte is stored in buf[0], most one in buf[N-1] */
+		buf[i] = (uint8_t)(0x000000FF & val);
+		val = (val >> 8);
+		sh = shadow_get(page, addr+i);
+		if ((sh == NULL) || (*sh != buf[i])) {
+			same = false;
+		}
+	}
+	if (same == true) {
+		shadow_skip(page);
+		return LGW_REG_SUCCESS;
+	}
+	if ((page != -1) && (page != rc->regpage)) {
+		spi_stat += page_switch(page);
+	}
+	spi_stat += spi_write(addr, buf, size_byte); /* write the register in one burst */
+	for (i=0; i<size_byte; ++i) {
+		shadow_set(page, addr+i, buf[i]);
+	}
 	
-	/* reject write to read-only registers */
-	if (r.rdon == 1){
-		DEBUG_MSG("ERROR: TRYING TO BURST WRITE A READ-ONLY REGISTER\n");
+	if (spi_stat != LGW_SPI_SUCCESS) {
+		DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER WRITE\n");
+		return LGW_REG_ERROR;
+	} else {
+		return LGW_REG_SUCCESS;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_rbyte(int8_t page, uint8_t addr, uint8_t *val) {
+	int spi_stat = LGW_SPI_SUCCESS;
+	
+	/* check if SPI is initialised */
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
+		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+		return LGW_REG_ERROR;
+	}
+	
+	if ((page != -1) && (page != rc->regpage)) {
+		spi_stat += page_switch(page);
+	}
+	spi_stat += batch_flush();
+	spi_stat += lgw_trace_r(rc->spi_target, addr, val);
+	spi_count(0, 1);
+	shadow_set(page, addr, *val);
+	
+	if (spi_stat != LGW_SPI_SUCCESS) {
+		DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER READ\n");
+		return LGW_REG_ERROR;
+	} else {
+		return LGW_REG_SUCCESS;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_rmulti(int8_t page, uint8_t addr, uint8_t size_byte, uint32_t *val) {
+	int spi_stat = LGW_SPI_SUCCESS;
+	uint8_t buf[4] = "\x00\x00\x00\x00";
+	uint32_t u = 0;
+	int i;
+	
+	/* check if SPI is initialised */
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
+		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+		return LGW_REG_ERROR;
+	}
+	
+	if ((page != -1) && (page != rc->regpage)) {
+		spi_stat += page_switch(page);
+	}
+	spi_stat += batch_flush();
+	spi_stat += lgw_trace_rb(rc->spi_target, addr, buf, size_byte);
+	spi_count(0, size_byte);
+	for (i=(size_byte-1); i>=0; --i) {
+		u = (uint32_t)buf[i] + (u << 8); /* transform a 4-byte array into a 32 bit word */
+		shadow_set(page, addr+i, buf[i]);
+	}
+	*val = u;
+	
+	if (spi_stat != LGW_SPI_SUCCESS) {
+		DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER READ\n");
+		return LGW_REG_ERROR;
+	} else {
+		return LGW_REG_SUCCESS;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_wburst(int8_t page, uint8_t addr, uint8_t *data, uint16_t size) {
+	int spi_stat = LGW_SPI_SUCCESS;
+	int i;
+	
+	/* check input parameters */
+	CHECK_NULL(data);
+	if (size == 0) {
+		DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+		return LGW_REG_ERROR;
+	}
+	
+	/* check if SPI is initialised */
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
+		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
 		return LGW_REG_ERROR;
 	}
 	
 	/* select proper register page if needed */
-	if ((r.page != -1) && (r.page != lgw_regpage)) {
-		spi_stat += page_switch(r.page);
+	if ((page != -1) && (page != rc->regpage)) {
+		spi_stat += page_switch(page);
 	}
 	
 	/* do the burst write */
-	spi_stat += lgw_spi_wb(lgw_spi_target, r.addr, data, size);
+	spi_stat += spi_write(addr, data, size);
+	
+	/* a burst to a data port stays on the same address, otherwise the address auto-increments */
+	if ((rc->shadow_flag[(page == -1) ? SHADOW_COMMON : page][addr] & SHADOW_OWNED) != 0) {
+		for (i=0; (i<size) && ((addr+i)<128); ++i) {
+			shadow_set(page, addr+i, data[i]);
+		}
+	}
 	
 	if (spi_stat != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER BURST WRITE\n");
@@ -747,10 +1295,8 @@ int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-/* Point to a register by name and do a burst read */
-int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
+int lgw_reg_rburst(int8_t page, uint8_t addr, uint8_t *data, uint16_t size) {
 	int spi_stat = LGW_SPI_SUCCESS;
-	struct lgw_reg_s r;
 	
 	/* check input parameters */
 	CHECK_NULL(data);
@@ -758,27 +1304,22 @@ int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
 		DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
 		return LGW_REG_ERROR;
 	}
-	if (register_id >= LGW_TOTALREGS) {
-		DEBUG_MSG("ERROR: REGISTER NUMBER OUT OF DEFINED RANGE\n");
-		return LGW_REG_ERROR;
-	}
 	
 	/* check if SPI is initialised */
-	if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
 		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
 		return LGW_REG_ERROR;
 	}
 	
-	/* get register struct from the struct array */
-	r = loregs[register_id];
-	
 	/* select proper register page if needed */
-	if ((r.page != -1) && (r.page != lgw_regpage)) {
-		spi_stat += page_switch(r.page);
+	if ((page != -1) && (page != rc->regpage)) {
+		spi_stat += page_switch(page);
 	}
 	
 	/* do the burst read */
-	spi_stat += lgw_spi_rb(lgw_spi_target, r.addr, data, size);
+	spi_stat += batch_flush();
+	spi_stat += lgw_trace_rb(rc->spi_target, addr, data, size);
+	spi_count(0, size);
 	
 	if (spi_stat != LGW_SPI_SUCCESS) {
 		DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER BURST READ\n");
@@ -788,4 +1329,105 @@ int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
 	}
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_shadow(bool enable) {
+	if ((enable == true) && (rc->shadow_init_done == false)) {
+		shadow_init();
+	}
+	shadow_invalidate();
+	rc->shadow_enable = enable;
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_shadow_stat(struct lgw_reg_shadow_stat_s *stat) {
+	CHECK_NULL(stat);
+	*stat = rc->shadow_stat;
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_stats(struct lgw_reg_stats_s *stats) {
+	CHECK_NULL(stats);
+	stats->nb_spi = STAT_GET(reg_stats.nb_spi);
+	stats->nb_byte_w = STAT_GET(reg_stats.nb_byte_w);
+	stats->nb_byte_r = STAT_GET(reg_stats.nb_byte_r);
+	stats->nb_page_switch = STAT_GET(reg_stats.nb_page_switch);
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_reg_reset_stats(void) {
+	STAT_CLR(reg_stats.nb_spi);
+	STAT_CLR(reg_stats.nb_byte_w);
+	STAT_CLR(reg_stats.nb_byte_r);
+	STAT_CLR(reg_stats.nb_page_switch);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_wl(uint16_t *register_id, int32_t *reg_value, uint16_t nb, uint16_t *nb_page_switch) {
+	return reg_list(register_id, reg_value, nb, true, nb_page_switch);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_rl(uint16_t *register_id, int32_t *reg_value, uint16_t nb, uint16_t *nb_page_switch) {
+	return reg_list(register_id, reg_value, nb, false, nb_page_switch);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_batch_begin(void) {
+	/* check if SPI is initialised */
+	if ((rc->spi_target == NULL) || (rc->regpage < 0)) {
+		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+		return LGW_REG_ERROR;
+	}
+	rc->batch_depth += 1;
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_batch_commit(void) {
+	if (rc->batch_depth == 0) {
+		DEBUG_MSG("ERROR: NO REGISTER BATCH OPEN\n");
+		return LGW_REG_ERROR;
+	}
+	rc->batch_depth -= 1;
+	if ((rc->batch_depth == 0) && (batch_flush() != LGW_SPI_SUCCESS)) {
+		DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER BATCH WRITE\n");
+		return LGW_REG_ERROR;
+	}
+	return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_reg_irq_wait(uint32_t timeout_ms) {
+	int spi_stat;
+
+	/* check if SPI is initialised */
+	if (rc->spi_target == NULL) {
+		DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+		return LGW_REG_ERROR;
+	}
+
+	/* no register access and no batch flush here: the HAL never leaves a batch
+	open between calls, and another thread may be in the middle of one */
+	spi_stat = lgw_trace_irq_wait(rc->spi_target, timeout_ms);
+	if (spi_stat == LGW_SPI_SUCCESS) {
+		return LGW_REG_SUCCESS;
+	} else if (spi_stat == LGW_SPI_TIMEOUT) {
+		return LGW_REG_TIMEOUT;
+	} else {
+		return LGW_REG_ERROR;
+	}
+}
+
 /* --- EOF ------------------------------------------------------------------ */
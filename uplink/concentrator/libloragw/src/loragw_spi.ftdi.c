@@ -50,23 +50,42 @@ Maintainer: Sylvain Miermont
 #define READ_ACCESS		0x00
 #define WRITE_ACCESS	0x80
 
+/* MPSSE command stream overhead of a frame: CS assert, write command header, CS release, idle */
+#define WM_FRAME_OVERHEAD	(3 + 3 + 3 + 3)
+
 /* parameters for a FT2232H */
 #define VID		0x0403
 #define PID		0x6014
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static uint32_t spi_speed = SIX_MHZ; /* clock of the links opened by lgw_spi_open */
+static uint16_t spi_chunk = LGW_BURST_CHUNK; /* bytes per FastWrite/FastRead of a burst */
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
 /* SPI initialization and configuration */
 int lgw_spi_open(void **spi_target_ptr) {
+	return lgw_spi_open_dev(spi_target_ptr, NULL);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_open_dev(void **spi_target_ptr, const char *dev) {
 	struct mpsse_context *mpsse = NULL;
 	int a, b;
 	
 	/* check input variables */
 	CHECK_NULL(spi_target_ptr); /* cannot be null, must point on a void pointer (*spi_target_ptr can be null) */
+	if (dev != NULL) {
+		DEBUG_MSG("ERROR: ONLY THE FIRST FTDI ADAPTER CAN BE OPENED\n");
+		return LGW_SPI_ERROR;
+	}
 	
 	/* try to open the first available FTDI device matching VID/PID parameters */
-	mpsse = OpenIndex(VID,PID,SPI0, SIX_MHZ, MSB, IFACE_A, NULL, NULL, 0);
+	mpsse = OpenIndex(VID,PID,SPI0, spi_speed, MSB, IFACE_A, NULL, NULL, 0);
 	if (mpsse == NULL) {
 		DEBUG_MSG("ERROR: MPSSE OPEN FUNCTION RETURNED NULL\n");
 		return LGW_SPI_ERROR;
@@ -107,6 +126,45 @@ int lgw_spi_close(void *spi_target) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+/* SPI clock and burst chunk size */
+int lgw_spi_setconf(void *spi_target, struct lgw_spi_conf_s conf) {
+	struct mpsse_context *mpsse = spi_target;
+
+	/* check input variables */
+	if ((conf.speed_hz != 0) && ((conf.speed_hz < LGW_SPI_SPEED_MIN) || (conf.speed_hz > LGW_SPI_SPEED_MAX))) {
+		DEBUG_PRINTF("ERROR: SPI CLOCK %u HZ OUT OF RANGE\n", conf.speed_hz);
+		return LGW_SPI_ERROR;
+	}
+	if ((conf.chunk_size != 0) && ((conf.chunk_size < LGW_BURST_CHUNK_MIN) || (conf.chunk_size > LGW_BURST_CHUNK_MAX))) {
+		DEBUG_PRINTF("ERROR: CHUNK SIZE %u OUT OF RANGE\n", conf.chunk_size);
+		return LGW_SPI_ERROR;
+	}
+
+	if (conf.speed_hz != 0) {
+		if ((mpsse != NULL) && (SetClock(mpsse, conf.speed_hz) != MPSSE_OK)) {
+			DEBUG_MSG("ERROR: MPSSE FAILED TO SET THE CLOCK\n");
+			return LGW_SPI_ERROR;
+		}
+		spi_speed = conf.speed_hz;
+	}
+	if (conf.chunk_size != 0) {
+		spi_chunk = conf.chunk_size;
+	}
+	DEBUG_PRINTF("Note: SPI clock %u Hz, %u bytes chunks\n", spi_speed, spi_chunk);
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_getconf(struct lgw_spi_conf_s *conf) {
+	CHECK_NULL(conf);
+	conf->speed_hz = spi_speed;
+	conf->chunk_size = spi_chunk;
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /* Simple write */
 /* transaction time: .6 to 1 ms typically */
 int lgw_spi_w(void *spi_target, uint8_t address, uint8_t data) {
@@ -209,7 +267,7 @@ int lgw_spi_wb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 	size_to_do = size + 1; /* add a byte for the address */
 	
 	/* allocate data buffer */
-	buf_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
+	buf_size = (size_to_do < spi_chunk) ? size_to_do : spi_chunk;
 	out_buf = malloc(buf_size);
 	if (out_buf == NULL) {
 		DEBUG_MSG("ERROR: MALLOC FAIL\n");
@@ -219,14 +277,14 @@ int lgw_spi_wb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 	/* start MPSSE transaction */
 	a = Start(mpsse);
 	for (i=0; size_to_do > 0; ++i) {
-		chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
+		chunk_size = (size_to_do < spi_chunk) ? size_to_do : spi_chunk;
 		if (i == 0) {
 			/* first chunk, need to append the address */
 			out_buf[0] = command;
 			memcpy(out_buf+1, data, chunk_size-1);
 		} else {
 			/* following chunks, just copy the data */
-			offset = (i * LGW_BURST_CHUNK) - 1;
+			offset = (i * spi_chunk) - 1;
 			memcpy(out_buf, data + offset, chunk_size);
 		}
 		b = FastWrite(mpsse, (char *)out_buf, chunk_size);
@@ -278,8 +336,8 @@ int lgw_spi_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 	a = Start(mpsse);
 	b = FastWrite(mpsse, (char *)&command, 1);
 	for (i=0; size_to_do > 0; ++i) {
-		chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-		offset = i * LGW_BURST_CHUNK;
+		chunk_size = (size_to_do < spi_chunk) ? size_to_do : spi_chunk;
+		offset = i * spi_chunk;
 		c = FastRead(mpsse, (char *)(data + offset), chunk_size);
 		size_to_do -= chunk_size; /* subtract the quantity of data already transferred */
 	}
@@ -295,4 +353,94 @@ int lgw_spi_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 	}
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Multiple write (one buffered MPSSE command stream, same pin sequence as Start/FastWrite/Stop) */
+/* transaction time: close to a single lgw_spi_w for a few frames, one USB write instead of 3 per frame */
+int lgw_spi_wm(void *spi_target, uint8_t *address, uint16_t *size, uint8_t *data, uint16_t nb) {
+	struct mpsse_context *mpsse = spi_target;
+	uint8_t *out_buf = NULL;
+	int buf_size = 0;
+	int offset = 0;
+	int n = 0;
+	int a;
+	int i;
+	
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	CHECK_NULL(address);
+	CHECK_NULL(size);
+	CHECK_NULL(data);
+	if ((nb == 0) || (nb > LGW_SPI_WM_MAX)) {
+		DEBUG_MSG("ERROR: INVALID NUMBER OF FRAMES\n");
+		return LGW_SPI_ERROR;
+	}
+	for (i=0; i<nb; ++i) {
+		if ((size[i] == 0) || (size[i] > LGW_BURST_CHUNK)) {
+			DEBUG_MSG("ERROR: INVALID FRAME SIZE\n");
+			return LGW_SPI_ERROR;
+		}
+		buf_size += WM_FRAME_OVERHEAD + 1 + size[i];
+	}
+	
+	/* allocate command stream buffer */
+	out_buf = malloc(buf_size);
+	if (out_buf == NULL) {
+		DEBUG_MSG("ERROR: MALLOC FAIL\n");
+		return LGW_SPI_ERROR;
+	}
+	
+	/* build the command stream */
+	for (i=0; i<nb; ++i) {
+		if ((address[i] & 0x80) != 0) {
+			DEBUG_MSG("WARNING: SPI address > 127\n");
+		}
+		/* chip select asserted (Start) */
+		out_buf[n++] = SET_BITS_LOW;
+		out_buf[n++] = mpsse->pstart;
+		out_buf[n++] = mpsse->tris;
+		/* command byte + data bytes (FastWrite) */
+		out_buf[n++] = mpsse->tx;
+		out_buf[n++] = 0xFF & size[i]; /* length - 1, command byte included */
+		out_buf[n++] = 0xFF & (size[i] >> 8);
+		out_buf[n++] = WRITE_ACCESS | (address[i] & 0x7F);
+		memcpy(out_buf + n, data + offset, size[i]);
+		n += size[i];
+		offset += size[i];
+		/* chip select released (Stop) */
+		out_buf[n++] = SET_BITS_LOW;
+		out_buf[n++] = mpsse->pstop;
+		out_buf[n++] = mpsse->tris;
+		out_buf[n++] = SET_BITS_LOW;
+		out_buf[n++] = mpsse->pidle;
+		out_buf[n++] = mpsse->tris;
+	}
+	
+	/* single USB transfer */
+	a = ftdi_write_data(&mpsse->ftdi, out_buf, n);
+	
+	/* deallocate command stream buffer */
+	free(out_buf);
+	
+	/* determine return code */
+	if (a != n) {
+		DEBUG_MSG("ERROR: SPI MULTIPLE WRITE FAILURE\n");
+		return LGW_SPI_ERROR;
+	} else {
+		DEBUG_MSG("Note: SPI multiple write success\n");
+		return LGW_SPI_SUCCESS;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Interrupt wait, no interrupt line on the FTDI bridge */
+int lgw_spi_irq_wait(void *spi_target, uint32_t timeout_ms) {
+	/* check input variables */
+	CHECK_NULL(spi_target);
+
+	(void)timeout_ms;
+	return LGW_SPI_ERROR;
+}
+
 /* --- EOF ------------------------------------------------------------------ */
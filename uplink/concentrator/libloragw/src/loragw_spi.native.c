@@ -54,15 +54,27 @@ Maintainer: Sylvain Miermont
 
 #define READ_ACCESS		0x00
 #define WRITE_ACCESS	0x80
-#define SPI_SPEED		8000000
+#define SPI_SPEED		8000000 /* default clock */
 #define SPI_DEV_PATH	"/dev/spidev0.0"
 //#define SPI_DEV_PATH	"/dev/spidev32766.0"
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static uint32_t spi_speed = SPI_SPEED; /* clock of the transfers */
+static uint16_t spi_chunk = LGW_BURST_CHUNK; /* bytes per ioctl of a burst, must not exceed the spidev buffer size */
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
 /* SPI initialization and configuration */
 int lgw_spi_open(void **spi_target_ptr) {
+	return lgw_spi_open_dev(spi_target_ptr, NULL);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_open_dev(void **spi_target_ptr, const char *dev_path) {
 	int *spi_device = NULL;
 	int dev;
 	int a=0, b=0;
@@ -79,9 +91,13 @@ int lgw_spi_open(void **spi_target_ptr) {
 	}
 
 	/* open SPI device */
-	dev = open(SPI_DEV_PATH, O_RDWR);
+	if (dev_path == NULL) {
+		dev_path = SPI_DEV_PATH;
+	}
+	dev = open(dev_path, O_RDWR);
 	if (dev < 0) {
-		DEBUG_PRINTF("ERROR: failed to open SPI device %s\n", SPI_DEV_PATH);
+		DEBUG_PRINTF("ERROR: failed to open SPI device %s\n", dev_path);
+		free(spi_device);
 		return LGW_SPI_ERROR;
 	}
 
@@ -97,7 +113,7 @@ int lgw_spi_open(void **spi_target_ptr) {
 	}
 
 	/* setting SPI max clk (in Hz) */
-	i = SPI_SPEED;
+	i = spi_speed;
 	a = ioctl(dev, SPI_IOC_WR_MAX_SPEED_HZ, &i);
 	b = ioctl(dev, SPI_IOC_RD_MAX_SPEED_HZ, &i);
 	if ((a < 0) || (b < 0)) {
@@ -152,6 +168,13 @@ int lgw_spi_open(void **spi_target_ptr) {
 	}
 #endif
 
+	/*  If an IRQ PIN has been defined, it is used to wait for received packets */
+#ifdef LGW_SX1301_IRQ_PIN
+	if ((lgw_gpio_export(LGW_SX1301_IRQ_PIN) < 0) || (lgw_gpio_direction(LGW_SX1301_IRQ_PIN, LGW_GPIO_IN) < 0) || (lgw_gpio_edge(LGW_SX1301_IRQ_PIN, LGW_GPIO_EDGE_RISING) < 0)) {
+		DEBUG_MSG("WARNING: FAILED TO CONFIGURE SX1301 IRQ PIN\n");
+	}
+#endif
+
 	*spi_device = dev;
 	*spi_target_ptr = (void *)spi_device;
 	DEBUG_MSG("Note: SPI port opened and configured ok\n");
@@ -179,6 +202,9 @@ int lgw_spi_close(void *spi_target) {
 		return LGW_SPI_ERROR;
 	}
 #endif
+#ifdef LGW_SX1301_IRQ_PIN
+	lgw_gpio_unexport(LGW_SX1301_IRQ_PIN);
+#endif
 
 	/* determine return code */
 	if (a < 0) {
@@ -192,6 +218,51 @@ int lgw_spi_close(void *spi_target) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+/* SPI clock and burst chunk size */
+int lgw_spi_setconf(void *spi_target, struct lgw_spi_conf_s conf) {
+	uint32_t speed;
+	int a, b;
+
+	/* check input variables */
+	if ((conf.speed_hz != 0) && ((conf.speed_hz < LGW_SPI_SPEED_MIN) || (conf.speed_hz > LGW_SPI_SPEED_MAX))) {
+		DEBUG_PRINTF("ERROR: SPI CLOCK %u HZ OUT OF RANGE\n", conf.speed_hz);
+		return LGW_SPI_ERROR;
+	}
+	if ((conf.chunk_size != 0) && ((conf.chunk_size < LGW_BURST_CHUNK_MIN) || (conf.chunk_size > LGW_BURST_CHUNK_MAX))) {
+		DEBUG_PRINTF("ERROR: CHUNK SIZE %u OUT OF RANGE\n", conf.chunk_size);
+		return LGW_SPI_ERROR;
+	}
+
+	if (conf.speed_hz != 0) {
+		if (spi_target != NULL) {
+			speed = conf.speed_hz;
+			a = ioctl(*(int *)spi_target, SPI_IOC_WR_MAX_SPEED_HZ, &speed);
+			b = ioctl(*(int *)spi_target, SPI_IOC_RD_MAX_SPEED_HZ, &speed);
+			if ((a < 0) || (b < 0)) {
+				DEBUG_MSG("ERROR: SPI PORT FAIL TO SET MAX SPEED\n");
+				return LGW_SPI_ERROR;
+			}
+		}
+		spi_speed = conf.speed_hz;
+	}
+	if (conf.chunk_size != 0) {
+		spi_chunk = conf.chunk_size;
+	}
+	DEBUG_PRINTF("Note: SPI clock %u Hz, %u bytes chunks\n", spi_speed, spi_chunk);
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_getconf(struct lgw_spi_conf_s *conf) {
+	CHECK_NULL(conf);
+	conf->speed_hz = spi_speed;
+	conf->chunk_size = spi_chunk;
+	return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /* Simple write */
 int lgw_spi_w(void *spi_target, uint8_t address, uint8_t data) {
 	int spi_device;
@@ -215,7 +286,7 @@ int lgw_spi_w(void *spi_target, uint8_t address, uint8_t data) {
 	memset(&k, 0, sizeof(k)); /* clear k */
 	k.tx_buf = (unsigned long) out_buf;
 	k.len = ARRAY_SIZE(out_buf);
-	k.speed_hz = SPI_SPEED;
+	k.speed_hz = spi_speed;
 	k.cs_change = 1;
 	k.bits_per_word = 8;
 	a = ioctl(spi_device, SPI_IOC_MESSAGE(1), &k);
@@ -307,8 +378,8 @@ int lgw_spi_wb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 	k[0].cs_change = 0;
 	k[1].cs_change = 1;
 	for (i=0; size_to_do > 0; ++i) {
-		chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-		offset = i * LGW_BURST_CHUNK;
+		chunk_size = (size_to_do < spi_chunk) ? size_to_do : spi_chunk;
+		offset = i * spi_chunk;
 		k[1].tx_buf = (unsigned long)(data + offset);
 		k[1].len = chunk_size;
 		byte_transfered += (ioctl(spi_device, SPI_IOC_MESSAGE(2), &k) - 1 );
@@ -361,8 +432,8 @@ int lgw_spi_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 	k[0].cs_change = 0;
 	k[1].cs_change = 1;
 	for (i=0; size_to_do > 0; ++i) {
-		chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-		offset = i * LGW_BURST_CHUNK;
+		chunk_size = (size_to_do < spi_chunk) ? size_to_do : spi_chunk;
+		offset = i * spi_chunk;
 		k[1].rx_buf = (unsigned long)(data + offset);
 		k[1].len = chunk_size;
 		byte_transfered += (ioctl(spi_device, SPI_IOC_MESSAGE(2), &k) - 1 );
@@ -380,4 +451,86 @@ int lgw_spi_rb(void *spi_target, uint8_t address, uint8_t *data, uint16_t size)
 	}
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Multiple write, all frames in a single ioctl */
+int lgw_spi_wm(void *spi_target, uint8_t *address, uint16_t *size, uint8_t *data, uint16_t nb) {
+	int spi_device;
+	uint8_t command[LGW_SPI_WM_MAX];
+	struct spi_ioc_transfer k[2*LGW_SPI_WM_MAX];
+	int offset = 0;
+	int size_total = 0;
+	int a;
+	int i;
+
+	/* check input parameters */
+	CHECK_NULL(spi_target);
+	CHECK_NULL(address);
+	CHECK_NULL(size);
+	CHECK_NULL(data);
+	if ((nb == 0) || (nb > LGW_SPI_WM_MAX)) {
+		DEBUG_MSG("ERROR: INVALID NUMBER OF FRAMES\n");
+		return LGW_SPI_ERROR;
+	}
+
+	spi_device = *(int *)spi_target; /* must check that spi_target is not null beforehand */
+
+	/* one command transfer and one data transfer per frame, CS released after the data */
+	memset(&k, 0, sizeof(k)); /* clear k */
+	for (i=0; i<nb; ++i) {
+		if ((size[i] == 0) || (size[i] > LGW_BURST_CHUNK)) {
+			DEBUG_MSG("ERROR: INVALID FRAME SIZE\n");
+			return LGW_SPI_ERROR;
+		}
+		if ((address[i] & 0x80) != 0) {
+			DEBUG_MSG("WARNING: SPI address > 127\n");
+		}
+		command[i] = WRITE_ACCESS | (address[i] & 0x7F);
+		k[2*i].tx_buf = (unsigned long) &command[i];
+		k[2*i].len = 1;
+		k[2*i].cs_change = 0;
+		k[2*i+1].tx_buf = (unsigned long)(data + offset);
+		k[2*i+1].len = size[i];
+		k[2*i+1].cs_change = 1;
+		offset += size[i];
+		size_total += 1 + size[i];
+	}
+
+	/* I/O transaction */
+	a = ioctl(spi_device, SPI_IOC_MESSAGE(2*nb), &k);
+	DEBUG_PRINTF("MULTIPLE WRITE: %d frames # transferred %d \n", nb, a);
+
+	/* determine return code */
+	if (a != size_total) {
+		DEBUG_MSG("ERROR: SPI MULTIPLE WRITE FAILURE\n");
+		return LGW_SPI_ERROR;
+	} else {
+		DEBUG_MSG("Note: SPI multiple write success\n");
+		return LGW_SPI_SUCCESS;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Interrupt wait, on the GPIO wired to the SX1301 interrupt output */
+int lgw_spi_irq_wait(void *spi_target, uint32_t timeout_ms) {
+	/* check input variables */
+	CHECK_NULL(spi_target);
+
+#ifdef LGW_SX1301_IRQ_PIN
+	switch (lgw_gpio_wait(LGW_SX1301_IRQ_PIN, (int)timeout_ms)) {
+		case LGW_GPIO_HIGH:
+			return LGW_SPI_SUCCESS;
+		case LGW_GPIO_LOW:
+			return LGW_SPI_TIMEOUT;
+		default:
+			DEBUG_MSG("ERROR: FAILED TO WAIT FOR SX1301 IRQ\n");
+			return LGW_SPI_ERROR;
+	}
+#else
+	(void)timeout_ms;
+	return LGW_SPI_ERROR;
+#endif
+}
+
 /* --- EOF ------------------------------------------------------------------ */
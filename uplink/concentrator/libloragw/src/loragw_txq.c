@@ -0,0 +1,218 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Just-in-time TX queue
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* printf fprintf */
+#include <string.h>		/* memmove */
+
+#include "loragw_txq.h"
+#include "loragw_hal.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_HAL == 1
+	#define DEBUG_MSG(str)				fprintf(stderr, str)
+	#define DEBUG_PRINTF(fmt, args...)	fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+	#define CHECK_NULL(a)				if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_TXQ_ERROR;}
+#else
+	#define DEBUG_MSG(str)
+	#define DEBUG_PRINTF(fmt, args...)
+	#define CHECK_NULL(a)				if(a==NULL){return LGW_TXQ_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define		TXQ_POLL_US		1000	/* how often to check the TX modem while the previous packet is not finished */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+int32_t txq_diff(uint32_t a, uint32_t b);
+
+bool txq_overlap(uint32_t start_a, uint32_t toa_a, uint32_t start_b, uint32_t toa_b, uint32_t guard_us);
+
+void txq_pop(struct lgw_txq_s *txq);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* signed distance between two counter values, valid across the 32-bit wrap-around */
+int32_t txq_diff(uint32_t a, uint32_t b) {
+	return (int32_t)(a - b);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+bool txq_overlap(uint32_t start_a, uint32_t toa_a, uint32_t start_b, uint32_t toa_b, uint32_t guard_us) {
+	return (txq_diff(start_a, start_b + toa_b + guard_us) < 0) && (txq_diff(start_b, start_a + toa_a + guard_us) < 0);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void txq_pop(struct lgw_txq_s *txq) {
+	txq->nb -= 1;
+	memmove(&txq->pkt[0], &txq->pkt[1], txq->nb * sizeof txq->pkt[0]);
+	memmove(&txq->toa_us[0], &txq->toa_us[1], txq->nb * sizeof txq->toa_us[0]);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+void lgw_txq_init(struct lgw_txq_s *txq) {
+	memset(txq, 0, sizeof *txq);
+	txq->guard_us = LGW_TXQ_GUARD_US;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_txq_enqueue(struct lgw_txq_s *txq, const struct lgw_pkt_tx_s *pkt_data, uint32_t now_us) {
+	struct lgw_pkt_tx_s pkt;
+	uint32_t toa, start;
+	int i;
+
+	CHECK_NULL(txq);
+	CHECK_NULL(pkt_data);
+
+	if (txq->nb >= LGW_TXQ_NB_MAX) {
+		DEBUG_MSG("ERROR: TX QUEUE FULL\n");
+		return LGW_TXQ_FULL;
+	}
+	toa = lgw_time_on_air(pkt_data);
+	if (toa == 0) {
+		DEBUG_MSG("ERROR: INVALID TX PARAMETERS, NO TIME ON AIR\n");
+		return LGW_TXQ_ERROR;
+	}
+	if (txq->busy && (txq_diff(txq->busy_end, now_us) <= 0)) {
+		txq->busy = false; /* the packet handed to the concentrator is over */
+	}
+
+	pkt = *pkt_data;
+	if (pkt.tx_mode == IMMEDIATE) {
+		/* first slot after everything already planned */
+		start = now_us + LGW_TXQ_LEAD_US;
+		if (txq->busy && (txq_diff(txq->busy_end + txq->guard_us, start) > 0)) {
+			start = txq->busy_end + txq->guard_us;
+		}
+		if ((txq->nb > 0) && (txq_diff(txq->pkt[txq->nb-1].count_us + txq->toa_us[txq->nb-1] + txq->guard_us, start) > 0)) {
+			start = txq->pkt[txq->nb-1].count_us + txq->toa_us[txq->nb-1] + txq->guard_us;
+		}
+		pkt.tx_mode = TIMESTAMPED;
+		pkt.count_us = start;
+	} else if (pkt.tx_mode == TIMESTAMPED) {
+		if (txq_diff(pkt.count_us, now_us) < LGW_TXQ_MARGIN_US) {
+			DEBUG_PRINTF("Note: TX slot %u too close to current time %u\n", pkt.count_us, now_us);
+			txq->nb_late += 1;
+			return LGW_TXQ_TOO_LATE;
+		}
+	} else {
+		DEBUG_MSG("ERROR: TX QUEUE ONLY HANDLES TIMESTAMPED AND IMMEDIATE PACKETS\n");
+		return LGW_TXQ_ERROR;
+	}
+
+	/* the packet must not overlap anything planned, including the pending one */
+	if (txq->busy && txq_overlap(pkt.count_us, toa, txq->busy_start, txq->busy_end - txq->busy_start, txq->guard_us)) {
+		txq->nb_collision += 1;
+		return LGW_TXQ_COLLISION;
+	}
+	for (i = 0; i < txq->nb; ++i) {
+		if (txq_overlap(pkt.count_us, toa, txq->pkt[i].count_us, txq->toa_us[i], txq->guard_us)) {
+			DEBUG_PRINTF("Note: TX slot %u-%u overlaps queued packet %u-%u\n", pkt.count_us, pkt.count_us + toa, txq->pkt[i].count_us, txq->pkt[i].count_us + txq->toa_us[i]);
+			txq->nb_collision += 1;
+			return LGW_TXQ_COLLISION;
+		}
+	}
+
+	/* keep the queue ordered by start time */
+	for (i = 0; i < txq->nb; ++i) {
+		if (txq_diff(txq->pkt[i].count_us, pkt.count_us) > 0) {
+			break;
+		}
+	}
+	memmove(&txq->pkt[i+1], &txq->pkt[i], (txq->nb - i) * sizeof txq->pkt[0]);
+	memmove(&txq->toa_us[i+1], &txq->toa_us[i], (txq->nb - i) * sizeof txq->toa_us[0]);
+	txq->pkt[i] = pkt;
+	txq->toa_us[i] = toa;
+	txq->nb += 1;
+	return LGW_TXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_txq_run(struct lgw_txq_s *txq, uint32_t *next_us) {
+	uint32_t now;
+	int32_t dt;
+	uint8_t tx_status;
+
+	CHECK_NULL(txq);
+	CHECK_NULL(next_us);
+
+	*next_us = 0;
+	while (txq->nb > 0) {
+		if (lgw_get_instcnt(&now) != LGW_HAL_SUCCESS) {
+			return LGW_TXQ_ERROR;
+		}
+
+		/* too late to load the packet, sending it anyway would delay the next ones */
+		dt = txq_diff(txq->pkt[0].count_us, now);
+		if (dt < LGW_TXQ_MARGIN_US) {
+			DEBUG_PRINTF("WARNING: TX slot %u missed, dropped at %u\n", txq->pkt[0].count_us, now);
+			txq->nb_late += 1;
+			txq_pop(txq);
+			continue;
+		}
+
+		/* not yet */
+		if (dt > LGW_TXQ_LEAD_US) {
+			*next_us = dt - LGW_TXQ_LEAD_US;
+			return LGW_TXQ_SUCCESS;
+		}
+
+		/* never replace a packet that is still scheduled or being emitted */
+		if (lgw_status(TX_STATUS, &tx_status) != LGW_HAL_SUCCESS) {
+			return LGW_TXQ_ERROR;
+		}
+		if (tx_status != TX_FREE) {
+			*next_us = ((dt - LGW_TXQ_MARGIN_US) < TXQ_POLL_US) ? (uint32_t)(dt - LGW_TXQ_MARGIN_US) + 1 : TXQ_POLL_US;
+			return LGW_TXQ_SUCCESS;
+		}
+
+		if (lgw_send_ptr(&txq->pkt[0]) != LGW_HAL_SUCCESS) {
+			DEBUG_MSG("ERROR: lgw_send FAILED, PACKET DROPPED\n");
+			txq_pop(txq);
+			return LGW_TXQ_ERROR;
+		}
+		txq->busy = true;
+		txq->busy_start = txq->pkt[0].count_us;
+		txq->busy_end = txq->pkt[0].count_us + txq->toa_us[0];
+		txq->nb_sent += 1;
+		txq_pop(txq);
+	}
+	return LGW_TXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_txq_count(const struct lgw_txq_s *txq) {
+	return txq->nb;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,93 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Convert a packet capture written by lgw_cap_write to CSV, oldest packet
+	first; the capture can still be open by the program writing it
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdio.h>		/* printf fopen */
+#include <stdlib.h>		/* EXIT_* */
+#include <unistd.h>		/* getopt */
+
+#include "loragw_cap.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* describe command line options */
+static void usage(void) {
+	printf( "Usage: test_loragw_cap [-o <CSV file>] <capture file>\n");
+	printf( "Available options:\n");
+	printf( " -h print this help\n");
+	printf( " -o <path> write the CSV to a file instead of the standard output\n");
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+	FILE *out = stdout;
+	const char *out_path = NULL;
+	uint64_t nb = 0;
+	int i;
+
+	while ((i = getopt(argc, argv, "ho:")) != -1) {
+		switch (i) {
+			case 'o':
+				out_path = optarg;
+				break;
+			case 'h':
+			default:
+				usage();
+				return EXIT_FAILURE;
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	if (out_path != NULL) {
+		out = fopen(out_path, "w");
+		if (out == NULL) {
+			fprintf(stderr, "ERROR: impossible to create %s\n", out_path);
+			return EXIT_FAILURE;
+		}
+	}
+	i = lgw_cap_dump(argv[optind], out, &nb);
+	if (out != stdout) {
+		fclose(out);
+	}
+	if (i != LGW_CAP_SUCCESS) {
+		fprintf(stderr, "ERROR: %s is not a packet capture\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	if (out != stdout) {
+		printf("%llu packets written to %s\n", (unsigned long long)nb, out_path);
+	}
+	return EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
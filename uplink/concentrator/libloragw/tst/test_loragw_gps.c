@@ -8,6 +8,13 @@
 
 Description:
 	Minimum test program for the loragw_gps 'library'
+	With -b, benchmark of the NMEA parsers on a recorded capture instead (no
+	GPS nor concentrator needed): lgw_parse_nmea is given one sentence per
+	call, like a canonical read of the TTY returns them, lgw_parse_nmea_stream
+	is given the capture in fixed-size reads.
+	With -f, emulation of a GPS on a pseudo-terminal instead, to test the
+	programs that read a GPS without one: a fix (RMC, GGA, GSA, ZDA) is written
+	every second of the host clock, SIGUSR1 toggles the fix on and off.
 
 License: Revised BSD License, see LICENSE.TXT file include in the project
 Maintainer: Sylvain Miermont
@@ -29,24 +36,45 @@ Maintainer: Sylvain Miermont
 #include <stdio.h>		/* printf */
 #include <string.h>		/* memset */
 #include <signal.h>		/* sigaction */
-#include <stdlib.h>		/* exit */
-#include <unistd.h>		/* read */
+#include <stdlib.h>		/* exit posix_openpt */
+#include <stdarg.h>		/* va_list */
+#include <unistd.h>		/* read, getopt */
+#include <time.h>		/* clock_gettime clock_nanosleep */
+#include <fcntl.h>		/* posix_openpt */
+#include <termios.h>	/* tcsetattr */
 
 #include "loragw_hal.h"
 #include "loragw_gps.h"
 #include "loragw_aux.h"
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define		BENCH_LOOP_DEFAULT	200 /* number of passes over the capture */
+#define		BENCH_READ_DEFAULT	64 /* size of the reads given to the stream parser */
+#define		BENCH_FILE_MAX		(16 * 1024 * 1024)
+#define		FEED_DELAY_NS		100000000 /* the sentences of a fix follow the PPS by 100 ms */
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
 static int exit_sig = 0; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
 static int quit_sig = 0; /* 1 -> application terminates without shutting down the hardware */
+static volatile sig_atomic_t fix_sig = 0; /* 1 -> the emulated GPS loses or regains its fix (SIGUSR1) */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
 
 static void sig_handler(int sigio);
 
+static void usage(void);
+
+static int bench(const char *path, int nb_loop, int read_size);
+
+static int nmea_write(int fd, const char *fmt, ...);
+
+static int feed(void);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -55,17 +83,216 @@ static void sig_handler(int sigio) {
 		quit_sig = 1;;
 	} else if ((sigio == SIGINT) || (sigio == SIGTERM)) {
 		exit_sig = 1;
+	} else if (sigio == SIGUSR1) {
+		fix_sig = 1;
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* describe command line options */
+static void usage(void) {
+	printf( "Available options:\n");
+	printf( " -h print this help\n");
+	printf( " -b <path> benchmark the NMEA parsers on a capture file instead of the GPS test\n");
+	printf( " -n <uint> number of passes over the capture (default %d)\n", BENCH_LOOP_DEFAULT);
+	printf( " -r <uint> size of the reads given to the stream parser (default %d)\n", BENCH_READ_DEFAULT);
+	printf( " -f emulate a GPS on a pseudo-terminal, one fix per second (SIGUSR1 toggles the fix)\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* parse a capture with both parsers, print their throughput and compare their final solution */
+static int bench(const char *path, int nb_loop, int read_size) {
+	FILE *f;
+	char *cap; /* whole capture */
+	long cap_size;
+	char line[128]; /* sentence buffer of lgw_parse_nmea, as filled by a canonical read */
+	struct timespec t0, t1;
+	struct timespec utc[2];
+	struct coord_s loc[2];
+	int nb_sentence[2] = {0, 0};
+	int nb_rmc[2] = {0, 0};
+	uint64_t nb_copy = 0; /* bytes copied to sentence buffers */
+	double dt[2];
+	enum gps_msg msg;
+	int loop, i, j, n, used;
+	int err = 0;
+
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		printf("ERROR: impossible to open %s\n", path);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	cap_size = ftell(f);
+	rewind(f);
+	if ((cap_size <= 0) || (cap_size > BENCH_FILE_MAX)) {
+		printf("ERROR: invalid capture size\n");
+		fclose(f);
+		return -1;
+	}
+	cap = malloc(cap_size);
+	if ((cap == NULL) || (fread(cap, 1, cap_size, f) != (size_t)cap_size)) {
+		printf("ERROR: impossible to read %s\n", path);
+		free(cap);
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+
+	/* legacy parser, one sentence per call in a buffer it modifies */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (loop = 0; loop < nb_loop; ++loop) {
+		for (i = 0; i < cap_size; i = j + 1) {
+			for (j = i; (j < cap_size) && (cap[j] != '\n'); ++j);
+			n = ((j - i) < (int)sizeof(line)) ? (j - i) : (int)sizeof(line) - 1;
+			memcpy(line, cap + i, n);
+			line[n] = 0;
+			nb_copy += n;
+			msg = lgw_parse_nmea(line, sizeof(line));
+			nb_sentence[0] += 1;
+			nb_rmc[0] += (msg == NMEA_RMC) ? 1 : 0;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	dt[0] = (t1.tv_sec - t0.tv_sec) + 1E-9 * (t1.tv_nsec - t0.tv_nsec);
+	memset(utc, 0, sizeof utc);
+	memset(loc, 0, sizeof loc);
+	err |= lgw_gps_get(&utc[0], &loc[0], NULL);
+
+	/* stream parser, fixed-size reads straight from the capture */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (loop = 0; loop < nb_loop; ++loop) {
+		for (i = 0; i < cap_size; i += read_size) {
+			n = ((cap_size - i) < read_size) ? (cap_size - i) : read_size;
+			for (j = 0; j < n; j += used) {
+				msg = lgw_parse_nmea_stream(cap + i + j, n - j, &used);
+				if (msg != UNKNOWN) {
+					nb_sentence[1] += 1;
+					nb_rmc[1] += (msg == NMEA_RMC) ? 1 : 0;
+				}
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	dt[1] = (t1.tv_sec - t0.tv_sec) + 1E-9 * (t1.tv_nsec - t0.tv_nsec);
+	err |= lgw_gps_get(&utc[1], &loc[1], NULL);
+	free(cap);
+
+	printf("parser;sentences;RMC;MB/s;sentences/s;bytes copied\n");
+	printf("lgw_parse_nmea;%d;%d;%.1f;%.0f;%llu\n", nb_sentence[0], nb_rmc[0], 1E-6 * cap_size * nb_loop / dt[0], nb_sentence[0] / dt[0], (unsigned long long)nb_copy);
+	printf("lgw_parse_nmea_stream;%d;%d;%.1f;%.0f;0\n", nb_sentence[1], nb_rmc[1], 1E-6 * cap_size * nb_loop / dt[1], nb_sentence[1] / dt[1]);
+
+	/* both must end with the same solution */
+	if ((err != LGW_GPS_SUCCESS) || (nb_rmc[0] != nb_rmc[1]) || (utc[0].tv_sec != utc[1].tv_sec) || (utc[0].tv_nsec != utc[1].tv_nsec) || (loc[0].lat != loc[1].lat) || (loc[0].lon != loc[1].lon) || (loc[0].alt != loc[1].alt)) {
+		printf("ERROR: the parsers do not agree\n");
+		return -1;
 	}
+	printf("Both parsers agree: %ld.%09ld, lat %.6f, lon %.6f, alt %d\n", (long)utc[1].tv_sec, utc[1].tv_nsec, loc[1].lat, loc[1].lon, loc[1].alt);
+	return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* format a NMEA sentence (without '$' and checksum), and write it with its checksum */
+static int nmea_write(int fd, const char *fmt, ...) {
+	char s[128];
+	va_list ap;
+	uint8_t cs = 0;
+	int i, n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(s + 1, sizeof s - 8, fmt, ap);
+	va_end(ap);
+	if ((n < 0) || (n >= (int)sizeof s - 8)) {
+		return -1;
+	}
+	s[0] = '$';
+	for (i = 1; i <= n; ++i) {
+		cs ^= (uint8_t)s[i];
+	}
+	n += sprintf(s + n + 1, "*%02X\r\n", cs) + 1;
+	return (write(fd, s, n) == n) ? 0 : -1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* emulate a GPS on a pseudo-terminal, until a signal is received */
+static int feed(void) {
+	int fd, sfd;
+	const char *name;
+	struct termios ttyopt;
+	struct timespec next;
+	struct tm x;
+	bool fix = true;
+	char t[16], d[16];
+
+	/* master side for this program, slave side for the program under test */
+	fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if ((fd < 0) || (grantpt(fd) != 0) || (unlockpt(fd) != 0) || ((name = ptsname(fd)) == NULL)) {
+		printf("ERROR: impossible to create a pseudo-terminal\n");
+		return -1;
+	}
+	/* keep the slave open (no hang-up between two readers) and without echo */
+	sfd = open(name, O_RDWR | O_NOCTTY);
+	if ((sfd < 0) || (tcgetattr(sfd, &ttyopt) != 0)) {
+		printf("ERROR: impossible to open %s\n", name);
+		return -1;
+	}
+	ttyopt.c_lflag &= ~(ECHO | ECHONL);
+	tcsetattr(sfd, TCSANOW, &ttyopt);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK); /* never wait for a slow reader */
+	printf("GPS emulated on %s, one fix per second (kill -USR1 %d to toggle the fix)\n", name, (int)getpid());
+	fflush(stdout);
+
+	clock_gettime(CLOCK_REALTIME, &next);
+	while ((quit_sig != 1) && (exit_sig != 1)) {
+		/* a PPS at each second of the host clock, the sentences a bit later */
+		next.tv_sec += 1;
+		next.tv_nsec = FEED_DELAY_NS;
+		if (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &next, NULL) != 0) {
+			continue;
+		}
+		if (fix_sig == 1) {
+			fix_sig = 0;
+			fix = !fix;
+			printf("GPS fix %s\n", fix ? "regained" : "lost");
+			fflush(stdout);
+		}
+		gmtime_r(&next.tv_sec, &x);
+		strftime(t, sizeof t, "%H%M%S.00", &x);
+		strftime(d, sizeof d, "%d%m%y", &x);
+		if (fix) {
+			nmea_write(fd, "GPRMC,%s,A,4717.11437,N,00833.91522,E,0.004,77.52,%s,,,A", t, d);
+			nmea_write(fd, "GPGGA,%s,4717.11437,N,00833.91522,E,1,08,1.01,499.6,M,48.0,M,,", t);
+			nmea_write(fd, "GPGSA,A,3,23,29,07,08,09,18,26,28,,,,,1.94,1.18,1.54");
+		} else {
+			nmea_write(fd, "GPRMC,%s,V,,,,,,,%s,,,N", t, d);
+			nmea_write(fd, "GPGGA,%s,,,,,0,00,99.99,,,,,,", t);
+			nmea_write(fd, "GPGSA,A,1,,,,,,,,,,,,,99.99,99.99,99.99");
+		}
+		strftime(t, sizeof t, "%H%M%S.00,%d,%m,%Y", &x);
+		nmea_write(fd, "GPZDA,%s,00,00", t);
+	}
+
+	close(sfd);
+	close(fd);
+	return 0;
 }
 
 /* -------------------------------------------------------------------------- */
 /* --- MAIN FUNCTION -------------------------------------------------------- */
 
-int main()
+int main(int argc, char **argv)
 {
 	struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
 	
 	int i;
+	const char *bench_path = NULL;
+	int nb_loop = BENCH_LOOP_DEFAULT;
+	int read_size = BENCH_READ_DEFAULT;
+	bool feed_gps = false;
 	char tmp_str[80];
 	
 	/* serial variables */
@@ -85,6 +312,39 @@ int main()
 	uint32_t x, z;
 	struct timespec y;
 	
+	/* parse command line options */
+	while ((i = getopt(argc, argv, "hb:n:r:f")) != -1) {
+		switch (i) {
+			case 'f':
+				feed_gps = true;
+				break;
+			case 'b':
+				bench_path = optarg;
+				break;
+			case 'n':
+				nb_loop = atoi(optarg);
+				if (nb_loop <= 0) {
+					usage();
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'r':
+				read_size = atoi(optarg);
+				if (read_size <= 0) {
+					usage();
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'h':
+			default:
+				usage();
+				return EXIT_FAILURE;
+		}
+	}
+	if (bench_path != NULL) {
+		return (bench(bench_path, nb_loop, read_size) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	
 	/* configure signal handling */
 	sigemptyset(&sigact.sa_mask);
 	sigact.sa_flags = 0;
@@ -93,6 +353,11 @@ int main()
 	sigaction(SIGINT, &sigact, NULL);
 	sigaction(SIGTERM, &sigact, NULL);
 	
+	if (feed_gps) {
+		sigaction(SIGUSR1, &sigact, NULL);
+		return (feed() == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	
 	/* Intro message and library information */
 	printf("Beginning of test for loragw_gps.c\n");
 	printf("*** Library version information ***\n%s\n***\n", lgw_version_info());
@@ -0,0 +1,639 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+	Throughput benchmark of the gateway receive path against the simulated
+	concentrator (CFG_SPI=sim), no hardware needed.
+	A radio thread puts packets in the simulated RX FIFO at a fixed rate
+	(they are lost when the FIFO is full), and the packets are received,
+	checked and logged in CSV format either by a single loop (receive,
+	process, write and flush one packet at a time, like the concentrator
+	programs used to do) or by a pipeline of three threads (RX -> processing
+	-> writer) linked by lgw_ring buffers. Each flush of the log file costs
+	the latency of the storage of a gateway.
+	Prints the sustained number of packets per second and the packets lost by
+	both, and checks that every packet the pipeline drops is counted.
+	Then runs the pipeline at 1000 packets per second with and without a raw
+	capture (lgw_cap_write from the RX thread), compares the time the RX
+	thread spends per packet and checks the capture file.
+	Usage: test_loragw_pipe [number of packets] [packets per second]
+	Returns a non-zero value on failure.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Maintainer: Sylvain Miermont
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+	#define _XOPEN_SOURCE 600
+#else
+	#define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>		/* C99 types */
+#include <stdbool.h>	/* bool type */
+#include <stdio.h>		/* printf snprintf fwrite tmpfile */
+#include <stdlib.h>		/* atoi mkstemp */
+#include <unistd.h>		/* close unlink */
+#include <string.h>		/* memset */
+#include <time.h>		/* clock_gettime */
+#include <pthread.h>	/* pthread_create pthread_mutex */
+
+#include "loragw_hal.h"
+#include "loragw_aux.h"
+#include "loragw_ring.h"
+#include "loragw_cap.h"
+#include "loragw_sim.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define CHECK(cond)		check((cond), #cond, __LINE__)
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define		SIM_BOARD		0
+#define		F_RX			867500000
+#define		F_TX			869525000
+#define		NB_PKT_DEFAULT	10000	/* packets sent by the radio thread for each run */
+#define		PPS_DEFAULT		10000	/* rate of the radio thread, in packets per second */
+#define		FLUSH_COST_US	100		/* emulated latency of a log file flush (SD card) */
+#define		PKT_SIZE		20
+#define		TX_EVERY		1000	/* one downlink is scheduled every TX_EVERY packets */
+#define		RING_NB			256
+#define		RING_NB_SMALL	2	/* rings too small to keep up, to check the drop counters */
+#define		RX_WAIT_MS		10
+#define		IDLE_US			100	/* sleep of a consumer thread that found its ring empty */
+#define		LINE_SIZE		256
+#define		CAP_NB_PKT		3000	/* packets sent by the radio thread for the capture runs */
+#define		CAP_PPS			1000	/* rate of the radio thread for the capture runs */
+#define		CAP_NB_REC		1024	/* records of the capture file, less than CAP_NB_PKT to wrap around */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct pipe_item_s {
+	struct timespec		fetch_time;
+	struct lgw_pkt_rx_s	pkt;
+};
+
+struct pipe_s {
+	struct lgw_ring_s	rx_ring;	/* RX thread -> processing thread */
+	struct lgw_ring_s	log_ring;	/* processing thread -> writer thread */
+	FILE				*log_file;
+	struct lgw_cap_s	*cap;		/* raw capture written by the RX thread, NULL for none */
+	volatile bool		rx_stop;	/* set once the radio thread sent everything */
+	volatile bool		proc_stop;	/* set once the RX thread exited */
+	volatile bool		log_stop;	/* set once the processing thread exited */
+	uint32_t			nb_rx;		/* packets fetched by the RX thread */
+	uint32_t			nb_proc;	/* packets checked by the processing thread */
+	uint32_t			nb_log;		/* packets written by the writer thread */
+	uint32_t			nb_seq_err;	/* packets received out of order */
+	uint32_t			nb_tx;		/* downlinks sent */
+	uint32_t			nb_flush;	/* calls to fflush done by the writer thread */
+	uint64_t			rx_ns;		/* time spent by the RX thread on the fetched packets, after lgw_receive */
+	uint64_t			cap_ns;		/* part of rx_ns spent in lgw_cap_write */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static int nb_check = 0;
+static int nb_fail = 0;
+
+static pthread_mutex_t mx_concent = PTHREAD_MUTEX_INITIALIZER; /* serializes the HAL calls of the RX and processing threads */
+
+static uint32_t radio_nb_pkt = NB_PKT_DEFAULT;
+static uint32_t radio_pps = PPS_DEFAULT;
+static uint32_t radio_lost; /* packets that found the RX FIFO full */
+static volatile bool radio_done;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void check(bool cond, const char *str, int line);
+
+static void configure(void);
+
+static double elapsed_s(const struct timespec *t0, const struct timespec *t1);
+
+static uint64_t elapsed_ns(const struct timespec *t0, const struct timespec *t1);
+
+static void *thread_radio(void *arg);
+
+static uint32_t pkt_seq(const struct lgw_pkt_rx_s *p);
+
+static int send_downlink(const struct lgw_pkt_rx_s *p);
+
+static int format_line(char *line, int size, const struct pipe_item_s *item);
+
+static void *thread_rx(void *arg);
+
+static void *thread_proc(void *arg);
+
+static void *thread_writer(void *arg);
+
+static void log_flush(FILE *log_file);
+
+static double run_single(void);
+
+static double run_pipeline(uint32_t ring_nb, struct lgw_cap_s *cap, struct pipe_s *pipe);
+
+static void test_capture(void);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void check(bool cond, const char *str, int line) {
+	++nb_check;
+	if (!cond) {
+		++nb_fail;
+		printf("FAIL (line %d): %s\n", line, str);
+	}
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void configure(void) {
+	struct lgw_conf_board_s boardconf;
+	struct lgw_conf_rxrf_s rfconf;
+	struct lgw_conf_rxif_s ifconf;
+
+	memset(&boardconf, 0, sizeof(boardconf));
+	boardconf.lorawan_public = true;
+	boardconf.clksrc = 1;
+	lgw_board_setconf(boardconf);
+
+	memset(&rfconf, 0, sizeof(rfconf));
+	rfconf.enable = true;
+	rfconf.freq_hz = F_RX;
+	rfconf.rssi_offset = LGW_SIM_RSSI_OFFSET;
+	rfconf.type = LGW_RADIO_TYPE_SX1257;
+	rfconf.tx_enable = true;
+	lgw_rxrf_setconf(0, rfconf);
+
+	memset(&ifconf, 0, sizeof(ifconf));
+	ifconf.enable = true;
+	ifconf.rf_chain = 0;
+	ifconf.freq_hz = 0;
+	ifconf.datarate = DR_LORA_MULTI;
+	lgw_rxif_setconf(0, ifconf);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double elapsed_s(const struct timespec *t0, const struct timespec *t1) {
+	return (double)(t1->tv_sec - t0->tv_sec) + (double)(t1->tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+static uint64_t elapsed_ns(const struct timespec *t0, const struct timespec *t1) {
+	return (uint64_t)((int64_t)(t1->tv_sec - t0->tv_sec) * 1000000000 + (t1->tv_nsec - t0->tv_nsec));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* send numbered packets at a fixed rate, whether the host keeps up or not */
+static void *thread_radio(void *arg) {
+	struct lgw_sim_rx_s in;
+	struct timespec t;
+	uint32_t i;
+
+	(void)arg;
+	memset(&in, 0, sizeof(in));
+	in.if_chain = 0;
+	in.status = STAT_CRC_OK;
+	in.datarate = DR_LORA_SF7;
+	in.coderate = CR_LORA_4_5;
+	in.bandwidth = BW_125KHZ;
+	in.rssi = -80.0;
+	in.snr = 9.5;
+	in.size = PKT_SIZE;
+	memset(in.payload, 0xA5, in.size);
+	radio_lost = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	for (i = 0; i < radio_nb_pkt; ++i) {
+		in.payload[0] = (uint8_t)(i >> 24);
+		in.payload[1] = (uint8_t)(i >> 16);
+		in.payload[2] = (uint8_t)(i >> 8);
+		in.payload[3] = (uint8_t)i;
+		if (lgw_sim_inject_rx(SIM_BOARD, &in) != LGW_SIM_SUCCESS) {
+			++radio_lost; /* FIFO full */
+		}
+		t.tv_nsec += 1000000000 / radio_pps;
+		if (t.tv_nsec >= 1000000000) {
+			t.tv_nsec -= 1000000000;
+			t.tv_sec += 1;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+	}
+	radio_done = true;
+	return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t pkt_seq(const struct lgw_pkt_rx_s *p) {
+	return ((uint32_t)p->payload[0] << 24) | ((uint32_t)p->payload[1] << 16) | ((uint32_t)p->payload[2] << 8) | p->payload[3];
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* same downlink as the join response of the concentrator programs */
+static int send_downlink(const struct lgw_pkt_rx_s *p) {
+	struct lgw_pkt_tx_s tx;
+	int i;
+
+	memset(&tx, 0, sizeof(tx));
+	tx.freq_hz = F_TX;
+	tx.tx_mode = TIMESTAMPED;
+	tx.count_us = p->count_us + 2000000;
+	tx.rf_chain = 0;
+	tx.rf_power = 14;
+	tx.modulation = MOD_LORA;
+	tx.bandwidth = BW_125KHZ;
+	tx.datarate = DR_LORA_SF12;
+	tx.coderate = CR_LORA_4_5;
+	tx.invert_pol = true;
+	tx.preamble = 8;
+	tx.size = 3;
+	pthread_mutex_lock(&mx_concent);
+	i = lgw_send_ptr(&tx);
+	pthread_mutex_unlock(&mx_concent);
+	return i;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* one CSV line, in the format of the packet logger */
+static int format_line(char *line, int size, const struct pipe_item_s *item) {
+	const struct lgw_pkt_rx_s *p = &item->pkt;
+	struct tm x;
+	int n, j;
+
+	gmtime_r(&item->fetch_time.tv_sec, &x);
+	n = snprintf(line, size, "\"%04i-%02i-%02i %02i:%02i:%02i.%03liZ\",%10u,%10u,%u,%2d,%3u,%+.0f,%+5.1f,\"", x.tm_year + 1900, x.tm_mon + 1, x.tm_mday, x.tm_hour, x.tm_min, x.tm_sec, item->fetch_time.tv_nsec / 1000000, p->count_us, p->freq_hz, p->rf_chain, p->if_chain, p->size, p->rssi, p->snr);
+	for (j = 0; (j < p->size) && (n < size - 4); ++j) {
+		if ((j > 0) && (j%4 == 0)) line[n++] = '-';
+		n += snprintf(line + n, size - n, "%02X", p->payload[j]);
+	}
+	line[n++] = '"';
+	line[n++] = '\n';
+	return n;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* drain the RX FIFO into the RX ring, sleep on the FIFO when it is empty */
+static void *thread_rx(void *arg) {
+	struct pipe_s *pipe = (struct pipe_s *)arg;
+	struct lgw_pkt_rx_s rxpkt[LGW_PKT_FIFO_SIZE];
+	struct pipe_item_s item;
+	struct timespec t0, t1, t2;
+	bool stop;
+	int nb_pkt, i;
+
+	for (;;) {
+		stop = pipe->rx_stop; /* read before the fetch, so that no packet is left behind */
+		pthread_mutex_lock(&mx_concent);
+		nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+		pthread_mutex_unlock(&mx_concent);
+		if (nb_pkt == LGW_HAL_ERROR) {
+			printf("ERROR: failed packet fetch\n");
+			break;
+		} else if (nb_pkt == 0) {
+			if (stop) {
+				break;
+			}
+			lgw_rx_wait(RX_WAIT_MS); /* no register access, lgw_send can run meanwhile */
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		clock_gettime(CLOCK_REALTIME, &item.fetch_time);
+		t1 = t0;
+		if (pipe->cap != NULL) {
+			for (i = 0; i < nb_pkt; ++i) {
+				lgw_cap_write(pipe->cap, &rxpkt[i], &item.fetch_time, false);
+			}
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+		}
+		for (i = 0; i < nb_pkt; ++i) {
+			item.pkt = rxpkt[i];
+			lgw_ring_push(&pipe->rx_ring, &item); /* dropped and counted if full */
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+		pipe->rx_ns += elapsed_ns(&t0, &t2);
+		pipe->cap_ns += elapsed_ns(&t0, &t1);
+		pipe->nb_rx += nb_pkt;
+	}
+	return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void *thread_proc(void *arg) {
+	struct pipe_s *pipe = (struct pipe_s *)arg;
+	struct pipe_item_s item;
+	uint32_t seq_next = 0;
+
+	for (;;) {
+		if (lgw_ring_pop(&pipe->rx_ring, &item) != LGW_RING_SUCCESS) {
+			if (pipe->proc_stop && (lgw_ring_count(&pipe->rx_ring) == 0)) {
+				break;
+			}
+			wait_us(IDLE_US);
+			continue;
+		}
+		if (pkt_seq(&item.pkt) < seq_next) {
+			++pipe->nb_seq_err;
+		}
+		seq_next = pkt_seq(&item.pkt) + 1;
+		if ((pkt_seq(&item.pkt) % TX_EVERY) == 0) {
+			if (send_downlink(&item.pkt) == LGW_HAL_SUCCESS) {
+				++pipe->nb_tx;
+			}
+		}
+		++pipe->nb_proc;
+		lgw_ring_push(&pipe->log_ring, &item);
+	}
+	return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* write lines as they come, flush only when there is nothing left to write */
+static void *thread_writer(void *arg) {
+	struct pipe_s *pipe = (struct pipe_s *)arg;
+	struct pipe_item_s item;
+	char line[LINE_SIZE];
+	bool dirty = false;
+
+	for (;;) {
+		if (lgw_ring_pop(&pipe->log_ring, &item) != LGW_RING_SUCCESS) {
+			if (dirty) {
+				log_flush(pipe->log_file);
+				++pipe->nb_flush;
+				dirty = false;
+			}
+			if (pipe->log_stop && (lgw_ring_count(&pipe->log_ring) == 0)) {
+				break;
+			}
+			wait_us(IDLE_US);
+			continue;
+		}
+		fwrite(line, 1, format_line(line, sizeof line, &item), pipe->log_file);
+		dirty = true;
+		++pipe->nb_log;
+	}
+	return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void log_flush(FILE *log_file) {
+	fflush(log_file);
+	wait_us(FLUSH_COST_US);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* receive, process, write and flush one packet at a time */
+static double run_single(void) {
+	struct lgw_pkt_rx_s rxpkt[LGW_PKT_FIFO_SIZE];
+	struct pipe_item_s item;
+	struct timespec t0, t1;
+	pthread_t radio;
+	FILE *log_file;
+	char line[LINE_SIZE];
+	uint32_t nb_log = 0;
+	uint32_t seq_next = 0;
+	uint32_t nb_seq_err = 0;
+	bool stop;
+	int nb_pkt, i;
+
+	log_file = tmpfile();
+	CHECK(log_file != NULL);
+	radio_done = false;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	pthread_create(&radio, NULL, thread_radio, NULL);
+	for (;;) {
+		stop = radio_done; /* read before the fetch, so that no packet is left behind */
+		nb_pkt = lgw_receive_wait(ARRAY_SIZE(rxpkt), rxpkt, RX_WAIT_MS);
+		if (nb_pkt <= 0) {
+			if (stop || (nb_pkt < 0)) {
+				break;
+			}
+			continue;
+		}
+		clock_gettime(CLOCK_REALTIME, &item.fetch_time);
+		for (i = 0; i < nb_pkt; ++i) {
+			item.pkt = rxpkt[i];
+			if (pkt_seq(&item.pkt) < seq_next) {
+				++nb_seq_err;
+			}
+			seq_next = pkt_seq(&item.pkt) + 1;
+			if ((pkt_seq(&item.pkt) % TX_EVERY) == 0) {
+				send_downlink(&item.pkt);
+			}
+			fwrite(line, 1, format_line(line, sizeof line, &item), log_file);
+			log_flush(log_file);
+			++nb_log;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	pthread_join(radio, NULL);
+	fclose(log_file);
+
+	CHECK(nb_log + radio_lost == radio_nb_pkt);
+	CHECK(nb_seq_err == 0);
+	return nb_log / elapsed_s(&t0, &t1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static double run_pipeline(uint32_t ring_nb, struct lgw_cap_s *cap, struct pipe_s *pipe) {
+	struct timespec t0, t1;
+	pthread_t radio, rx, proc, writer;
+	int i;
+
+	memset(pipe, 0, sizeof *pipe);
+	pipe->cap = cap;
+	i = lgw_ring_init(&pipe->rx_ring, sizeof(struct pipe_item_s), ring_nb);
+	CHECK(i == LGW_RING_SUCCESS);
+	i = lgw_ring_init(&pipe->log_ring, sizeof(struct pipe_item_s), ring_nb);
+	CHECK(i == LGW_RING_SUCCESS);
+	pipe->log_file = tmpfile();
+	CHECK(pipe->log_file != NULL);
+
+	radio_done = false;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	pthread_create(&writer, NULL, thread_writer, pipe);
+	pthread_create(&proc, NULL, thread_proc, pipe);
+	pthread_create(&rx, NULL, thread_rx, pipe);
+	pthread_create(&radio, NULL, thread_radio, NULL);
+
+	/* stop the stages one after the other, each one empties its input first */
+	pthread_join(radio, NULL);
+	pipe->rx_stop = true;
+	pthread_join(rx, NULL);
+	pipe->proc_stop = true;
+	pthread_join(proc, NULL);
+	pipe->log_stop = true;
+	pthread_join(writer, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	fclose(pipe->log_file);
+	lgw_ring_free(&pipe->rx_ring);
+	lgw_ring_free(&pipe->log_ring);
+	return pipe->nb_log / elapsed_s(&t0, &t1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* same pipeline at a realistic rate, with and without raw capture */
+static void test_capture(void) {
+	struct lgw_cap_s cap;
+	struct pipe_s pipe;
+	char path[] = "/tmp/test_loragw_pipe_XXXXXX";
+	char line[LINE_SIZE];
+	FILE *csv;
+	uint64_t nb_out = 0;
+	uint32_t seq, seq_next, nb_line = 0, nb_seq_err = 0;
+	uint32_t rx_ns, lost;
+	int fd;
+
+	radio_nb_pkt = CAP_NB_PKT;
+	radio_pps = CAP_PPS;
+	run_pipeline(RING_NB, NULL, &pipe);
+	rx_ns = (uint32_t)(pipe.rx_ns / pipe.nb_rx);
+	lost = radio_lost;
+
+	fd = mkstemp(path);
+	CHECK(fd >= 0);
+	close(fd);
+	CHECK(lgw_cap_open(&cap, path, 0) == LGW_CAP_ERROR);
+	CHECK(lgw_cap_dump(path, stdout, NULL) == LGW_CAP_ERROR); /* empty file */
+	CHECK(lgw_cap_open(&cap, path, CAP_NB_REC) == LGW_CAP_SUCCESS);
+	run_pipeline(RING_NB, &cap, &pipe);
+	printf("capture       : %u packets at %u packets/s, RX thread %u ns per packet without capture (%u lost), %u ns with (%u lost, %u ns in lgw_cap_write)\n", radio_nb_pkt, radio_pps, rx_ns, lost, (uint32_t)(pipe.rx_ns / pipe.nb_rx), radio_lost, (uint32_t)(pipe.cap_ns / pipe.nb_rx));
+	CHECK(pipe.nb_rx + radio_lost == radio_nb_pkt);
+	CHECK(cap.nb_write == pipe.nb_rx);
+
+	/* the file holds the last CAP_NB_REC packets received, in order, even before it is closed */
+	csv = tmpfile();
+	CHECK(csv != NULL);
+	CHECK(lgw_cap_dump(path, csv, &nb_out) == LGW_CAP_SUCCESS);
+	CHECK(nb_out == CAP_NB_REC);
+	rewind(csv);
+	seq_next = 0;
+	if (fgets(line, sizeof line, csv) != NULL) { /* column names */
+		while (fgets(line, sizeof line, csv) != NULL) {
+			if ((sscanf(strrchr(line, ',') + 1, "%8x", &seq) != 1) || (seq < seq_next)) { /* payload, first 4 bytes */
+				++nb_seq_err;
+			}
+			seq_next = seq + 1;
+			++nb_line;
+		}
+	}
+	CHECK(nb_line == CAP_NB_REC);
+	CHECK(nb_seq_err == 0);
+	CHECK(lgw_cap_close(&cap) == LGW_CAP_SUCCESS);
+	rewind(csv);
+	nb_out = 0;
+	CHECK((lgw_cap_dump(path, csv, &nb_out) == LGW_CAP_SUCCESS) && (nb_out == CAP_NB_REC));
+	fclose(csv);
+	unlink(path);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+	struct lgw_ring_s ring;
+	struct pipe_s pipe;
+	uint32_t v;
+	double pps_single, pps_pipe;
+	int i;
+
+	if (argc > 1) {
+		radio_nb_pkt = (uint32_t)atoi(argv[1]);
+		if (radio_nb_pkt < TX_EVERY) {
+			radio_nb_pkt = TX_EVERY;
+		}
+	}
+	if (argc > 2) {
+		radio_pps = (uint32_t)atoi(argv[2]);
+		if ((radio_pps == 0) || (radio_pps > 1000000)) {
+			radio_pps = PPS_DEFAULT;
+		}
+	}
+
+	printf("Beginning of benchmark of the receive pipeline on simulated concentrator\n");
+	printf("*** Library version information ***\n%s\n\n", lgw_version_info());
+
+	/* ring basics */
+	CHECK(lgw_ring_init(&ring, sizeof(uint32_t), 3) == LGW_RING_ERROR);
+	CHECK(lgw_ring_init(&ring, sizeof(uint32_t), 4) == LGW_RING_SUCCESS);
+	for (v = 0; v < 6; ++v) {
+		i = lgw_ring_push(&ring, &v);
+		CHECK(i == ((v < 4) ? LGW_RING_SUCCESS : LGW_RING_FULL));
+	}
+	CHECK(lgw_ring_count(&ring) == 4);
+	CHECK(lgw_ring_drops(&ring) == 2);
+	for (i = 0; i < 4; ++i) {
+		CHECK((lgw_ring_pop(&ring, &v) == LGW_RING_SUCCESS) && (v == (uint32_t)i));
+	}
+	CHECK(lgw_ring_pop(&ring, &v) == LGW_RING_EMPTY);
+	lgw_ring_free(&ring);
+
+	lgw_sim_select(SIM_BOARD);
+	lgw_sim_power_cycle(SIM_BOARD);
+	configure();
+	i = lgw_start();
+	CHECK(i == LGW_HAL_SUCCESS);
+	if (i != LGW_HAL_SUCCESS) {
+		printf("*** Impossible to start concentrator ***\n");
+		return -1;
+	}
+
+	printf("%u packets at %u packets/s, %u us per log flush\n", radio_nb_pkt, radio_pps, FLUSH_COST_US);
+
+	pps_single = run_single();
+	printf("single loop   : %8.0f packets/s logged, %u lost in the RX FIFO (one flush per packet)\n", pps_single, radio_lost);
+
+	pps_pipe = run_pipeline(RING_NB, NULL, &pipe);
+	printf("pipeline      : %8.0f packets/s logged, %u lost in the RX FIFO (%u flushes, %u downlinks, highest ring fill %u/%u)\n", pps_pipe, radio_lost, pipe.nb_flush, pipe.nb_tx, pipe.rx_ring.nb_max, RING_NB);
+	CHECK(pipe.nb_rx + radio_lost == radio_nb_pkt);
+	CHECK(pipe.nb_log == pipe.nb_rx);
+	CHECK(pipe.nb_seq_err == 0);
+	CHECK(lgw_ring_drops(&pipe.rx_ring) + lgw_ring_drops(&pipe.log_ring) == 0);
+
+	/* with tiny rings, packets may be lost, but every one of them is counted */
+	run_pipeline(RING_NB_SMALL, NULL, &pipe);
+	printf("small rings   : %u packets logged, %u dropped before processing, %u before writing\n", pipe.nb_log, lgw_ring_drops(&pipe.rx_ring), lgw_ring_drops(&pipe.log_ring));
+	CHECK(pipe.nb_rx + radio_lost == radio_nb_pkt);
+	CHECK(pipe.nb_proc + lgw_ring_drops(&pipe.rx_ring) == pipe.nb_rx);
+	CHECK(pipe.nb_log + lgw_ring_drops(&pipe.log_ring) == pipe.nb_proc);
+	CHECK(pipe.nb_seq_err == 0);
+
+	test_capture();
+
+	lgw_stop();
+
+	printf("\n%d checks, %d failed\n", nb_check, nb_fail);
+	printf("End of benchmark of the receive pipeline on simulated concentrator\n");
+	return (nb_fail == 0) ? 0 : -1;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
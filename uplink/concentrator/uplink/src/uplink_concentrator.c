@@ -14,22 +14,40 @@
 #include <string.h>		/* memset */
 #include <signal.h>		/* sigaction */
 #include <time.h>		/* time clock_gettime strftime gmtime clock_nanosleep*/
-#include <unistd.h>		/* getopt access */
+#include <unistd.h>		/* getopt access read close */
 #include <stdlib.h>		/* atoi */
-#include <math.h>
+#include <pthread.h>	/* pthread_create pthread_mutex */
+#include <poll.h>		/* poll */
 
 #include "parson.h"
 #include "loragw_hal.h"
+#include "loragw_aux.h"
+#include "loragw_spi.h"
+#include "loragw_trace.h"
+#include "loragw_ring.h"
+#include "loragw_txq.h"
+#include "loragw_gps.h"
+#include "loragw_stat.h"
+#include "loragw_cap.h"
+#include "loragw_ctl.h"
+#include "gw_conf.h"
 
 // CONSTANTS
 
-#define ROUTER_ID "0200000000EEFFC0"
-#define DEVICE_ID "0123456789ABCDEF"
+#define ROUTER_ID 0x0200000000EEFFC0ULL // default, "router_ID" in gateway_conf
+#define DEVICE_ID 0x0123456789ABCDEFULL // followed when no "devices" are configured
+#define DEV_MAX_NB GW_CONF_DEV_MAX // devices followed at the same time
+#define DEV_TABLE_NB 128 // slots of the device table, a power of 2 at least twice DEV_MAX_NB
 
 #define JOIN_RESPONSE_FREQ 869525000 // 869.525 MHz 
 #define JOIN_RESPONSE_DELAY 2000000 // 6 seconds in us
 #define JOIN_RF_CHAIN 0
 #define JOIN_RESPONSE_POWER 14
+#define RX_WAIT_MS 100 // longest wait for a packet before checking the exit signals
+#define FETCH_PKT_NB 16 // packets fetched at once
+#define GPS_POLL_MS 100 // longest wait for the GPS before checking the exit signals
+#define GPS_REF_MAX_AGE 30 // seconds without PPS sync before the host clock is used again
+#define CAPTURE_NB 262144 // default records of the capture file, 24 MB, "capture_size" in gateway_conf
 
 #define JOIN_REQ_MSG 1
 #define TEST_MSG 2
@@ -37,318 +55,277 @@
 #define ALL_TESTS_ENDED_MSG 4
 #define INVALID_MSG -1
 
-#define MAX_MSGS_PER_SETTING 100
+#define PIPE_RING_NB 256 // packets buffered between the RX and processing threads
+#define RESULT_RING_NB 16 // ended series buffered between the processing and writer threads
+#define PIPE_IDLE_MS 1 // sleep of a thread that found its input ring empty
+
+#define CTL_WAIT_MS 100 // longest wait for a control command before checking the exit signals
+#define CTL_ACK_MS 1000 // longest wait for a campaign command to reach the writer thread
+#define CMD_RING_NB 4 // campaign commands buffered between the main and processing threads
+
+#define CAMPAIGN_RESULT 0 // result ring item: an ended series
+#define CAMPAIGN_START 1 // close the result file and open the one of the next campaign
+#define CAMPAIGN_STOP 2 // close the result file, tests are no longer followed
+
+#define BENCH_PKT_NB 10000000 // packets classified by the -b benchmark
+#define BENCH_SET_NB 256 // different packets in the benchmark, a power of 2
 
 // PRIVATE MACROS
 
 #define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
 #define MSG(args...)	fprintf(stderr, "uplink_concentrator: " args) /* message that is destined to the user */
 
+/* stop flags and campaign state shared between threads */
+#define STORE_RELEASE(a,v)	__atomic_store_n(&(a), (v), __ATOMIC_RELEASE)
+#define LOAD_ACQUIRE(a)		__atomic_load_n(&(a), __ATOMIC_ACQUIRE)
+
 // PRIVATE VARIABLES (GLOBAL)
 
 /* signal handling variables */
 struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
-static int exit_sig = 0; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
-static int quit_sig = 0; /* 1 -> application terminates without shutting down the hardware */
+static volatile sig_atomic_t exit_sig = 0; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
+static volatile sig_atomic_t quit_sig = 0; /* 1 -> application terminates without shutting down the hardware */
+static volatile sig_atomic_t stats_sig = 0; /* 1 -> the RX thread prints the HAL statistics (SIGUSR1) */
 
 /* configuration variables needed by the application  */
+struct gw_conf_s gw_conf; /* merged configuration files */
+char *conf_snapshot = NULL; /* binary snapshot of the configuration (-c), always parse the files if NULL */
 uint64_t lgwm = 0; /* LoRa gateway MAC address */
 char lgwm_str[17];
+uint64_t router_id = ROUTER_ID; /* ID of the test network, bytes 1 to 8 of the payloads */
 
 /* clock and log file management */
 time_t now_time;
 time_t log_start_time;
-static int size = 0;
 
 char *result_file_name = "results.csv";
 FILE* result_file = NULL;
 
-float snr[MAX_MSGS_PER_SETTING];
+/* one series of test messages, written as one line of the result file */
+struct series_s {
+	uint64_t dev_eui; /* device that sent the series */
+	int size; /* packet size */
+	struct lgw_stat_s snr; /* SNR of the test packets, snr.nb is the number of packets received */
+	struct lgw_stat_s rssi; /* RSSI of the test packets */
+	struct lgw_stat_s snr_min; /* minimum SNR within each test packet */
+	struct lgw_stat_s snr_max; /* maximum SNR within each test packet */
+	struct lgw_pkt_rx_s end; /* END_TEST_MSG packet, carries the parameters of the series */
+	struct timespec start_utc; /* UTC time of the first test packet */
+	struct timespec end_utc; /* UTC time of the END_TEST_MSG packet */
+	bool utc_gps; /* both times come from the GPS time reference */
+};
+
+/* followed devices, open addressing with linear probing on the binary DevEUI
+(bytes 9 to 16 of the payloads), filled before the threads are started and
+then only used by the processing thread */
+struct device_s {
+	bool used; /* slot holds a device */
+	bool ended; /* the device sent ALL_TESTS_ENDED_MSG */
+	uint64_t eui; /* DevEUI */
+	struct series_s series; /* current series of the device */
+};
+static struct device_s dev_table[DEV_TABLE_NB];
+static int dev_nb = 0; /* number of devices in the table */
+static int dev_ended_nb = 0; /* number of devices that finished all their tests, written by the processing thread */
+
+/* GPS time reference */
+static int gps_tty_fd = -1; /* GPS serial port, -1 if there is no GPS */
+static int gps_stop = 0; /* 1 -> the GPS thread exits */
+static pthread_mutex_t mx_timeref = PTHREAD_MUTEX_INITIALIZER; /* protects the GPS time reference and its fit */
+static struct tref time_reference_gps; /* time reference used for timestamp -> UTC conversion */
+static struct tref_fit gps_fit; /* PPS sync points of the time reference */
+static bool gps_ref_valid = false; /* is the time reference valid */
+
+/* receive pipeline: RX thread -> processing thread -> writer thread */
+struct pipe_item_s {
+	struct timespec utc; /* UTC time of the packet, from the GPS time reference or the host clock at the fetch */
+	bool utc_gps; /* utc comes from the GPS time reference */
+	struct lgw_pkt_rx_s pkt;
+};
+static struct lgw_ring_s rx_ring; /* received packets */
+static struct lgw_ring_s result_ring; /* ended series */
+static struct lgw_cap_s capture; /* raw capture, written by the RX thread only */
+static pthread_mutex_t mx_concent = PTHREAD_MUTEX_INITIALIZER; /* serializes the HAL calls of the RX and processing threads */
+static int proc_stop = 0; /* 1 -> the RX thread exited, the processing thread empties its ring and exits */
+static int result_stop = 0; /* 1 -> the processing thread exited, the writer thread empties its ring and exits */
+static int rx_error = 0; /* 1 -> packet fetch failed */
+static struct lgw_txq_s txq; /* join responses, used by the processing thread only */
+
+/* daemon mode (-d): campaigns started and stopped on the control socket, the
+concentrator stays started between them; commands go through the processing
+thread, so that the series of a campaign are all written before its file is
+closed */
+struct campaign_cmd_s {
+	int type; /* CAMPAIGN_xxx */
+	uint32_t seq; /* written to campaign_ack by the writer thread once done, 0 for no acknowledge */
+	char file[GW_CONF_PATH_SIZE]; /* result file of CAMPAIGN_START */
+};
+struct result_s {
+	struct campaign_cmd_s cmd;
+	struct series_s series; /* ended series of CAMPAIGN_RESULT */
+};
+char *ctl_path = NULL; /* control socket, NULL to run a single campaign from start to exit */
+static struct lgw_ctl_s ctl; /* used by the main thread only */
+static struct lgw_ring_s cmd_ring; /* campaign commands */
+static int campaign_on = 1; /* test messages are followed, written by the processing thread */
+static uint32_t campaign_ack = 0; /* seq of the last command done by the writer thread */
+static bool campaign_failed = false; /* the writer thread could not create the result file of that command */
+static uint32_t campaign_series = 0; /* series written in the result file of the last campaign */
+static char campaign_file[GW_CONF_PATH_SIZE]; /* result file of the last campaign, used by the writer thread only */
+static int campaign_nb = 0; /* campaigns started, used by the main thread only */
+static uint32_t ctl_seq = 0; /* last command sent, used by the main thread only */
 
 // PRIVATE FUNCTIONS DECLARATION
 
 static void sig_handler(int sigio);
 void usage(void);
-int compare_id(struct lgw_pkt_rx_s*);
+int compare_id(const struct lgw_pkt_rx_s *p, struct device_s **dev);
+uint64_t payload_id(const uint8_t *b);
+struct device_s *dev_find(uint64_t eui);
+struct device_s *dev_add(uint64_t eui);
+void bench_classify(void);
 void configure_gateway(void);
-int parse_SX1301_configuration(const char * conf_file);
-int parse_gateway_configuration(const char * conf_file);
+void configure_calibration(void);
+void configure_spi(void);
+int configure_trace(void);
+void finish_trace(void);
+void print_stats(void);
+void series_reset(struct series_s *series);
+void write_results(const struct series_s *series);
+void write_stat(const struct lgw_stat_s *stat);
+void write_dist(const struct lgw_stat_s *stat);
+void write_utc(const struct timespec *utc);
+bool fetch_utc(const struct lgw_pkt_rx_s *pkt, int nb_pkt, struct timespec *utc);
+void send_join_response(struct lgw_pkt_rx_s* received);
+void run_txq(void);
+void *thread_rx(void *arg);
+void *thread_proc(void *arg);
+void *thread_writer(void *arg);
+void *thread_gps(void *arg);
+void openResultFile(const char *name);
+void campaign_command(struct result_s *res);
+void switch_results(const struct campaign_cmd_s *cmd);
+double campaign_send(int type, const char *file);
+void control_command(const char *line);
+void run_control(void);
 
 // PRIVATE FUNCTIONS DEFINITION
 
+/* load the configuration files (or their snapshot), exit if they are invalid */
 void configure_gateway(void) {
-	/* configuration file related */
-	const char global_conf_fname[] = "global_conf.json"; /* contain global (typ. network-wide) configuration */
-	const char local_conf_fname[] = "local_conf.json"; /* contain node specific configuration, overwrite global parameters for parameters that are defined in both */
-	const char debug_conf_fname[] = "debug_conf.json"; /* if present, all other configuration files are ignored */
-
-	/* configuration files management */
-	if (access(debug_conf_fname, R_OK) == 0) {
-	/* if there is a debug conf, parse only the debug conf */
-		MSG("INFO: found debug configuration file %s, other configuration files will be ignored\n", debug_conf_fname);
-		parse_SX1301_configuration(debug_conf_fname);
-		parse_gateway_configuration(debug_conf_fname);
-	} else if (access(global_conf_fname, R_OK) == 0) {
-	/* if there is a global conf, parse it and then try to parse local conf  */
-		MSG("INFO: found global configuration file %s, trying to parse it\n", global_conf_fname);
-		parse_SX1301_configuration(global_conf_fname);
-		parse_gateway_configuration(global_conf_fname);
-		if (access(local_conf_fname, R_OK) == 0) {
-			MSG("INFO: found local configuration file %s, trying to parse it\n", local_conf_fname);
-			parse_SX1301_configuration(local_conf_fname);
-			parse_gateway_configuration(local_conf_fname);
-		}
-	} else if (access(local_conf_fname, R_OK) == 0) {
-	/* if there is only a local conf, parse it and that's all */
-		MSG("INFO: found local configuration file %s, trying to parse it\n", local_conf_fname);
-		parse_SX1301_configuration(local_conf_fname);
-		parse_gateway_configuration(local_conf_fname);
-	} else {
-		MSG("ERROR: failed to find any configuration file named %s, %s or %s\n", global_conf_fname, local_conf_fname, debug_conf_fname);
+	int i;
+
+	if (gw_conf_load(&gw_conf, conf_snapshot) != GW_CONF_SUCCESS) {
+		MSG("ERROR: invalid or missing configuration, exiting\n");
 		exit(EXIT_FAILURE);
 	}
+	gw_conf_print(&gw_conf);
+	if (gw_conf_apply(&gw_conf) != GW_CONF_SUCCESS) {
+		MSG("ERROR: configuration refused by the HAL, exiting\n");
+		exit(EXIT_FAILURE);
+	}
+	lgwm = gw_conf.gateway_id;
+	if (gw_conf.router_id != 0) {
+		router_id = gw_conf.router_id;
+	}
+	if (gw_conf.capture_nb == 0) {
+		gw_conf.capture_nb = CAPTURE_NB;
+	}
 	
+	for (i = 0; i < gw_conf.dev_nb; ++i) {
+		dev_add(gw_conf.dev_eui[i]);
+	}
+	if (dev_nb == 0) {
+		dev_add(DEVICE_ID);
+		MSG("INFO: no devices configured, following %016llX\n", (unsigned long long)DEVICE_ID);
+	}
+}
+
+/* reuse the calibration of the previous start of this gateway, if a cache file is configured */
+void configure_calibration(void) {
+	struct lgw_conf_cal_s calconf;
+
+	if (gw_conf.cal_cache_file[0] == '\0') {
+		return;
+	}
+	memset(&calconf, 0, sizeof calconf);
+	calconf.cache_enable = true;
+	calconf.board_id = lgwm;
+	memcpy(calconf.cache_file, gw_conf.cal_cache_file, sizeof calconf.cache_file); /* same size, always terminated */
+	if (lgw_cal_setconf(calconf) != LGW_HAL_SUCCESS) {
+		MSG("WARNING: failed to configure the calibration cache\n");
+	}
 }
 
-int parse_SX1301_configuration(const char * conf_file) {
+/* apply the SPI settings of the configuration file, before lgw_start opens the link */
+void configure_spi(void) {
+	if ((gw_conf.spi.speed_hz == 0) && (gw_conf.spi.chunk_size == 0)) {
+		return;
+	}
+	if (lgw_spi_setconf(NULL, gw_conf.spi) != LGW_SPI_SUCCESS) {
+		MSG("WARNING: invalid SPI settings, library defaults used\n");
+	}
+}
+
+/* start recording or replaying the SPI traffic, before lgw_start opens the link */
+int configure_trace(void) {
 	int i;
-	const char conf_obj[] = "SX1301_conf";
-	char param_name[32]; /* used to generate variable parameter names */
-	const char *str; /* used to store string value from JSON object */
-	struct lgw_conf_board_s boardconf;
-	struct lgw_conf_rxrf_s rfconf;
-	struct lgw_conf_rxif_s ifconf;
-	JSON_Value *root_val;
-	JSON_Object *root = NULL;
-	JSON_Object *conf = NULL;
-	JSON_Value *val;
-	uint32_t sf, bw;
-	
-	/* try to parse JSON */
-	root_val = json_parse_file_with_comments(conf_file);
-	root = json_value_get_object(root_val);
-	if (root == NULL) {
-		MSG("ERROR: %s id not a valid JSON file\n", conf_file);
-		exit(EXIT_FAILURE);
+
+	if (gw_conf.spi_trace_file[0] == '\0') {
+		return 0;
 	}
-	conf = json_object_get_object(root, conf_obj);
-	if (conf == NULL) {
-		MSG("INFO: %s does not contain a JSON object named %s\n", conf_file, conf_obj);
+	i = gw_conf.spi_trace_replay ? lgw_trace_replay(gw_conf.spi_trace_file) : lgw_trace_record(gw_conf.spi_trace_file);
+	if (i != LGW_TRACE_SUCCESS) {
+		MSG("ERROR: failed to %s SPI trace %s\n", gw_conf.spi_trace_replay ? "read" : "create", gw_conf.spi_trace_file);
 		return -1;
-	} else {
-		MSG("INFO: %s does contain a JSON object named %s, parsing SX1301 parameters\n", conf_file, conf_obj);
 	}
+	return 0;
+}
 
-	/* set board configuration */
-	memset(&boardconf, 0, sizeof boardconf); /* initialize configuration structure */
-	val = json_object_get_value(conf, "lorawan_public"); /* fetch value (if possible) */
-	if (json_value_get_type(val) == JSONBoolean) {
-		boardconf.lorawan_public = (bool)json_value_get_boolean(val);
-	} else {
-		MSG("WARNING: Data type for lorawan_public seems wrong, please check\n");
-		boardconf.lorawan_public = false;
+/* close the SPI trace and report what was recorded or replayed */
+void finish_trace(void) {
+	struct lgw_trace_stat_s st;
+
+	if (gw_conf.spi_trace_file[0] == '\0') {
+		return;
 	}
-	val = json_object_get_value(conf, "clksrc"); /* fetch value (if possible) */
-	if (json_value_get_type(val) == JSONNumber) {
-		boardconf.clksrc = (uint8_t)json_value_get_number(val);
-	} else {
-		MSG("WARNING: Data type for clksrc seems wrong, please check\n");
-		boardconf.clksrc = 0;
-	}
-	MSG("INFO: lorawan_public %d, clksrc %d\n", boardconf.lorawan_public, boardconf.clksrc);
-	/* all parameters parsed, submitting configuration to the HAL */
-        if (lgw_board_setconf(boardconf) != LGW_HAL_SUCCESS) {
-                MSG("WARNING: Failed to configure board\n");
-	}
-
-	/* set configuration for RF chains */
-	for (i = 0; i < LGW_RF_CHAIN_NB; ++i) {
-		memset(&rfconf, 0, sizeof(rfconf)); /* initialize configuration structure */
-		sprintf(param_name, "radio_%i", i); /* compose parameter path inside JSON structure */
-		val = json_object_get_value(conf, param_name); /* fetch value (if possible) */
-		if (json_value_get_type(val) != JSONObject) {
-			MSG("INFO: no configuration for radio %i\n", i);
-			continue;
-		}
-		/* there is an object to configure that radio, let's parse it */
-		sprintf(param_name, "radio_%i.enable", i);
-		val = json_object_dotget_value(conf, param_name);
-		if (json_value_get_type(val) == JSONBoolean) {
-			rfconf.enable = (bool)json_value_get_boolean(val);
-		} else {
-			rfconf.enable = false;
-		}
-		if (rfconf.enable == false) { /* radio disabled, nothing else to parse */
-			MSG("INFO: radio %i disabled\n", i);
-		} else  { /* radio enabled, will parse the other parameters */
-			snprintf(param_name, sizeof param_name, "radio_%i.freq", i);
-			rfconf.freq_hz = (uint32_t)json_object_dotget_number(conf, param_name);
-			snprintf(param_name, sizeof param_name, "radio_%i.rssi_offset", i);
-			rfconf.rssi_offset = (float)json_object_dotget_number(conf, param_name);
-			snprintf(param_name, sizeof param_name, "radio_%i.type", i);
-			str = json_object_dotget_string(conf, param_name);
-			if (!strncmp(str, "SX1255", 6)) {
-				rfconf.type = LGW_RADIO_TYPE_SX1255;
-			} else if (!strncmp(str, "SX1257", 6)) {
-				rfconf.type = LGW_RADIO_TYPE_SX1257;
-			} else {
-				MSG("WARNING: invalid radio type: %s (should be SX1255 or SX1257)\n", str);
-			}
-			snprintf(param_name, sizeof param_name, "radio_%i.tx_enable", i);
-			val = json_object_dotget_value(conf, param_name);
-			if (json_value_get_type(val) == JSONBoolean) {
-				rfconf.tx_enable = (bool)json_value_get_boolean(val);
-			} else {
-				rfconf.tx_enable = false;
-			}
-			MSG("INFO: radio %i enabled (type %s), center frequency %u, RSSI offset %f, tx enabled %d\n", i, str, rfconf.freq_hz, rfconf.rssi_offset, rfconf.tx_enable);
-		}
-		/* all parameters parsed, submitting configuration to the HAL */
-		if (lgw_rxrf_setconf(i, rfconf) != LGW_HAL_SUCCESS) {
-			MSG("WARNING: invalid configuration for radio %i\n", i);
-		}
+	lgw_trace_stat(&st);
+	if (st.mode == LGW_TRACE_RECORD) {
+		MSG("INFO: %u SPI transactions recorded in %s, %llu bytes\n", st.nb_record, gw_conf.spi_trace_file, (unsigned long long)st.nb_byte);
+	} else if (st.mode == LGW_TRACE_REPLAY) {
+		MSG("INFO: %u of %u SPI transactions replayed, %u call(s) not matching the trace\n", st.nb_record, st.nb_total, st.nb_mismatch);
 	}
-	
-	/* set configuration for LoRa multi-SF channels (bandwidth cannot be set) */
-	for (i = 0; i < LGW_MULTI_NB; ++i) {
-		memset(&ifconf, 0, sizeof(ifconf)); /* initialize configuration structure */
-		sprintf(param_name, "chan_multiSF_%i", i); /* compose parameter path inside JSON structure */
-		val = json_object_get_value(conf, param_name); /* fetch value (if possible) */
-		if (json_value_get_type(val) != JSONObject) {
-			MSG("INFO: no configuration for LoRa multi-SF channel %i\n", i);
+	lgw_trace_stop();
+}
+
+/* print the HAL performance counters, lgw_get_stats needs no lock */
+void print_stats(void) {
+	struct lgw_stats_s st;
+	const struct lgw_stats_hist_s *h;
+	int i, j;
+
+	lgw_get_stats(&st);
+	MSG("INFO: SPI: %llu transactions, %llu bytes written, %llu bytes read, %llu page switches\n", (unsigned long long)st.spi_nb, (unsigned long long)st.spi_bytes_w, (unsigned long long)st.spi_bytes_r, (unsigned long long)st.page_switch);
+	MSG("INFO: RX: %u fetches, %u packets (%u CRC OK, %u CRC bad, %u no CRC), %u errors\n", st.rx_fetch, st.rx_pkt, st.rx_crc_ok, st.rx_crc_bad, st.rx_no_crc, st.rx_error);
+	MSG("INFO: TX: %u packets, %u errors\n", st.tx_pkt, st.tx_error);
+	for (i = 0; i < 2; ++i) {
+		h = (i == 0) ? &st.rx_time : &st.tx_time;
+		if (h->nb == 0) {
 			continue;
 		}
-		/* there is an object to configure that LoRa multi-SF channel, let's parse it */
-		sprintf(param_name, "chan_multiSF_%i.enable", i);
-		val = json_object_dotget_value(conf, param_name);
-		if (json_value_get_type(val) == JSONBoolean) {
-			ifconf.enable = (bool)json_value_get_boolean(val);
-		} else {
-			ifconf.enable = false;
-		}
-		if (ifconf.enable == false) { /* LoRa multi-SF channel disabled, nothing else to parse */
-			MSG("INFO: LoRa multi-SF channel %i disabled\n", i);
-		} else  { /* LoRa multi-SF channel enabled, will parse the other parameters */
-			sprintf(param_name, "chan_multiSF_%i.radio", i);
-			ifconf.rf_chain = (uint32_t)json_object_dotget_number(conf, param_name);
-			sprintf(param_name, "chan_multiSF_%i.if", i);
-			ifconf.freq_hz = (int32_t)json_object_dotget_number(conf, param_name);
-			// TODO: handle individual SF enabling and disabling (spread_factor)
-			MSG("INFO: LoRa multi-SF channel %i enabled, radio %i selected, IF %i Hz, 125 kHz bandwidth, SF 7 to 12\n", i, ifconf.rf_chain, ifconf.freq_hz);
-		}
-		/* all parameters parsed, submitting configuration to the HAL */
-		if (lgw_rxif_setconf(i, ifconf) != LGW_HAL_SUCCESS) {
-			MSG("WARNING: invalid configuration for LoRa multi-SF channel %i\n", i);
-		}
-	}
-	
-	/* set configuration for LoRa standard channel */
-	memset(&ifconf, 0, sizeof(ifconf)); /* initialize configuration structure */
-	val = json_object_get_value(conf, "chan_Lora_std"); /* fetch value (if possible) */
-	if (json_value_get_type(val) != JSONObject) {
-		MSG("INFO: no configuration for LoRa standard channel\n");
-	} else {
-		val = json_object_dotget_value(conf, "chan_Lora_std.enable");
-		if (json_value_get_type(val) == JSONBoolean) {
-			ifconf.enable = (bool)json_value_get_boolean(val);
-		} else {
-			ifconf.enable = false;
-		}
-		if (ifconf.enable == false) {
-			MSG("INFO: LoRa standard channel %i disabled\n", i);
-		} else  {
-			ifconf.rf_chain = (uint32_t)json_object_dotget_number(conf, "chan_Lora_std.radio");
-			ifconf.freq_hz = (int32_t)json_object_dotget_number(conf, "chan_Lora_std.if");
-			bw = (uint32_t)json_object_dotget_number(conf, "chan_Lora_std.bandwidth");
-			switch(bw) {
-				case 500000: ifconf.bandwidth = BW_500KHZ; break;
-				case 250000: ifconf.bandwidth = BW_250KHZ; break;
-				case 125000: ifconf.bandwidth = BW_125KHZ; break;
-				default: ifconf.bandwidth = BW_UNDEFINED;
-			}
-			sf = (uint32_t)json_object_dotget_number(conf, "chan_Lora_std.spread_factor");
-			switch(sf) {
-				case  7: ifconf.datarate = DR_LORA_SF7;  break;
-				case  8: ifconf.datarate = DR_LORA_SF8;  break;
-				case  9: ifconf.datarate = DR_LORA_SF9;  break;
-				case 10: ifconf.datarate = DR_LORA_SF10; break;
-				case 11: ifconf.datarate = DR_LORA_SF11; break;
-				case 12: ifconf.datarate = DR_LORA_SF12; break;
-				default: ifconf.datarate = DR_UNDEFINED;
+		MSG("INFO: %s latency: average %llu us, max %u us, histogram (us:count)", (i == 0) ? "RX" : "TX", (unsigned long long)(h->total_us / h->nb), h->max_us);
+		for (j = 0; j < LGW_STATS_HIST_NB; ++j) {
+			if (h->hist[j] != 0) {
+				fprintf(stderr, " %u:%u", (j == 0) ? 0 : 1u << j, h->hist[j]);
 			}
-			MSG("INFO: LoRa standard channel enabled, radio %i selected, IF %i Hz, %u Hz bandwidth, SF %u\n", ifconf.rf_chain, ifconf.freq_hz, bw, sf);
-		}
-		if (lgw_rxif_setconf(8, ifconf) != LGW_HAL_SUCCESS) {
-			MSG("WARNING: invalid configuration for LoRa standard channel\n");
 		}
+		fprintf(stderr, "\n");
 	}
-	
-	/* set configuration for FSK channel */
-	memset(&ifconf, 0, sizeof(ifconf)); /* initialize configuration structure */
-	val = json_object_get_value(conf, "chan_FSK"); /* fetch value (if possible) */
-	if (json_value_get_type(val) != JSONObject) {
-		MSG("INFO: no configuration for FSK channel\n");
-	} else {
-		val = json_object_dotget_value(conf, "chan_FSK.enable");
-		if (json_value_get_type(val) == JSONBoolean) {
-			ifconf.enable = (bool)json_value_get_boolean(val);
-		} else {
-			ifconf.enable = false;
-		}
-		if (ifconf.enable == false) {
-			MSG("INFO: FSK channel %i disabled\n", i);
-		} else  {
-			ifconf.rf_chain = (uint32_t)json_object_dotget_number(conf, "chan_FSK.radio");
-			ifconf.freq_hz = (int32_t)json_object_dotget_number(conf, "chan_FSK.if");
-			bw = (uint32_t)json_object_dotget_number(conf, "chan_FSK.bandwidth");
-			if      (bw <= 7800)   ifconf.bandwidth = BW_7K8HZ;
-			else if (bw <= 15600)  ifconf.bandwidth = BW_15K6HZ;
-			else if (bw <= 31200)  ifconf.bandwidth = BW_31K2HZ;
-			else if (bw <= 62500)  ifconf.bandwidth = BW_62K5HZ;
-			else if (bw <= 125000) ifconf.bandwidth = BW_125KHZ;
-			else if (bw <= 250000) ifconf.bandwidth = BW_250KHZ;
-			else if (bw <= 500000) ifconf.bandwidth = BW_500KHZ;
-			else ifconf.bandwidth = BW_UNDEFINED;
-			ifconf.datarate = (uint32_t)json_object_dotget_number(conf, "chan_FSK.datarate");
-			MSG("INFO: FSK channel enabled, radio %i selected, IF %i Hz, %u Hz bandwidth, %u bps datarate\n", ifconf.rf_chain, ifconf.freq_hz, bw, ifconf.datarate);
-		}
-		if (lgw_rxif_setconf(9, ifconf) != LGW_HAL_SUCCESS) {
-			MSG("WARNING: invalid configuration for FSK channel\n");
-		}
-	}
-	json_value_free(root_val);
-	return 0;
-}
-
-int parse_gateway_configuration(const char * conf_file) {
-	const char conf_obj[] = "gateway_conf";
-	JSON_Value *root_val;
-	JSON_Object *root = NULL;
-	JSON_Object *conf = NULL;
-	unsigned long long ull = 0;
-	
-	/* try to parse JSON */
-	root_val = json_parse_file_with_comments(conf_file);
-	root = json_value_get_object(root_val);
-	if (root == NULL) {
-		MSG("ERROR: %s id not a valid JSON file\n", conf_file);
-		exit(EXIT_FAILURE);
-	}
-	conf = json_object_get_object(root, conf_obj);
-	if (conf == NULL) {
-		MSG("INFO: %s does not contain a JSON object named %s\n", conf_file, conf_obj);
-		return -1;
-	} else {
-		MSG("INFO: %s does contain a JSON object named %s, parsing gateway parameters\n", conf_file, conf_obj);
+	if (gps_tty_fd >= 0) {
+		pthread_mutex_lock(&mx_timeref);
+		MSG("INFO: GPS: time reference %s, %u PPS sync point(s) rejected, clock error %+.3f ppm, residuals %.2f us\n", gps_ref_valid ? "valid" : "not valid", gps_fit.nb_reject, (gps_fit.xtal_err - 1.0) * 1E6, gps_fit.res_us);
+		pthread_mutex_unlock(&mx_timeref);
 	}
-	
-	/* getting network parameters (only those necessary for the packet logger) */
-	sscanf(json_object_dotget_string(conf, "gateway_ID"), "%llx", &ull);
-	lgwm = ull;
-	MSG("INFO: gateway MAC address is configured to %016llX\n", ull);
-	
-	json_value_free(root_val);
-	return 0;
 }
 
 static void sig_handler(int sigio) {
@@ -356,6 +333,8 @@ static void sig_handler(int sigio) {
 		quit_sig = 1;;
 	} else if ((sigio == SIGINT) || (sigio == SIGTERM)) {
 		exit_sig = 1;
+	} else if (sigio == SIGUSR1) {
+		stats_sig = 1;
 	}
 }
 
@@ -365,62 +344,144 @@ void usage(void) {
 	printf( "Available options:\n");
 	printf( " -h print this help\n");
 	printf( " -r choose result file name\n");
+	printf( " -b benchmark the classification of the received packets and exit\n");
+	printf( " -c <file> keep a snapshot of the configuration, reused while the JSON files do not change\n");
+	printf( " -d <socket> daemon mode: wait for campaigns to be started on this control socket, -r is not used\n");
 }
 
-/* compare router id and device id and returns received message type */
-int compare_id(struct lgw_pkt_rx_s *p) {
-	
-	int j;
-	char router_id[16 + 1];
-	char device_id[16 + 1];
-
-	if (p->status != STAT_CRC_OK)
+/* check the router id and device id, returns received message type and the device that sent it */
+int compare_id(const struct lgw_pkt_rx_s *p, struct device_s **dev) {
+	if ((p->status != STAT_CRC_OK) || (p->size < 17)) {
 		return INVALID_MSG;
-	else {
-		for (j = 1; j <= 8; ++j) {
-			sprintf(router_id + 2*(j-1), "%02X", p->payload[j]);
-		}		
-		for (j = 9; j <= 16; ++j) {
-			sprintf(device_id + 2*(j-9), "%02X", p->payload[j]);
-		}
-		
-		if (strcmp(device_id, DEVICE_ID) || strcmp(router_id, ROUTER_ID))
+	}
+	if (payload_id(&p->payload[1]) != router_id) {
+		return INVALID_MSG;
+	}
+	*dev = dev_find(payload_id(&p->payload[9]));
+	if (*dev == NULL) {
+		return INVALID_MSG;
+	}
+
+	switch (p->payload[0]) {
+		case 0:
+			return JOIN_REQ_MSG;
+		case 1:
+			return TEST_MSG;
+		case 2:
+			return END_TEST_MSG;
+		case 3:
+			return ALL_TESTS_ENDED_MSG;
+		default:
 			return INVALID_MSG;
+	}
+}
 
-		switch (p->payload[0]) {
-			case 0:
-				return JOIN_REQ_MSG;
-			case 1:
-				return TEST_MSG;
-			case 2:
-				return END_TEST_MSG;
-			case 3:
-				return ALL_TESTS_ENDED_MSG;
-			default:
-				return INVALID_MSG;
+/* 8-byte ID of a payload, most significant byte first (as printed) */
+uint64_t payload_id(const uint8_t *b) {
+	uint64_t id = 0;
+	int i;
+
+	for (i = 0; i < 8; ++i) {
+		id = (id << 8) | b[i];
+	}
+	return id;
+}
+
+/* device of the table, NULL if not followed */
+struct device_s *dev_find(uint64_t eui) {
+	unsigned i = (unsigned)((eui * 0x9E3779B97F4A7C15ULL) >> 32) & (DEV_TABLE_NB - 1); /* Fibonacci hashing */
+
+	while (dev_table[i].used) { /* the table is at most half full, a free slot ends the search */
+		if (dev_table[i].eui == eui) {
+			return &dev_table[i];
 		}
+		i = (i + 1) & (DEV_TABLE_NB - 1);
 	}
+	return NULL;
 }
 
-void write_results(int counter, struct lgw_pkt_rx_s* p) {
-	
-    float average_snr = 0;
-    for (int i = 0; i < counter; i++)
-        average_snr += snr[i];
-    average_snr /= counter;  
-	
-    float variance_snr = 0;
-    for (int i = 0; i < counter; i++)
-        variance_snr += pow((snr[i] - average_snr), 2);
-    variance_snr /= counter;
+/* add a device to the table (at most DEV_MAX_NB), or return it if already there */
+struct device_s *dev_add(uint64_t eui) {
+	unsigned i = (unsigned)((eui * 0x9E3779B97F4A7C15ULL) >> 32) & (DEV_TABLE_NB - 1);
+
+	while (dev_table[i].used) {
+		if (dev_table[i].eui == eui) {
+			return &dev_table[i];
+		}
+		i = (i + 1) & (DEV_TABLE_NB - 1);
+	}
+	if (dev_nb >= DEV_MAX_NB) {
+		return NULL;
+	}
+	memset(&dev_table[i], 0, sizeof dev_table[i]);
+	dev_table[i].used = true;
+	dev_table[i].eui = eui;
+	dev_table[i].series.dev_eui = eui;
+	series_reset(&dev_table[i].series);
+	++dev_nb;
+	return &dev_table[i];
+}
 
-    float std_dev_snr = sqrt(variance_snr);
+/* time compare_id on a mix of packets from followed devices, unknown devices and other networks */
+void bench_classify(void) {
+	static struct lgw_pkt_rx_s pkt[BENCH_SET_NB];
+	uint64_t eui[DEV_MAX_NB];
+	uint64_t id;
+	struct device_s *dev;
+	struct timespec start, end;
+	double t;
+	int i, j, n = 0;
+	unsigned long nb_dev = 0;
+
+	for (i = 0; i < DEV_TABLE_NB; ++i) {
+		if (dev_table[i].used) {
+			eui[n++] = dev_table[i].eui;
+		}
+	}
+	for (i = 0; i < BENCH_SET_NB; ++i) {
+		pkt[i].status = STAT_CRC_OK;
+		pkt[i].size = 31;
+		pkt[i].payload[0] = i % 4;
+		switch (i % 4) {
+			case 0: id = eui[(i / 4) % n]; break; /* followed device */
+			case 1: id = eui[(i / 4) % n]; break;
+			case 2: id = 0xA000000000000000ULL + i * 0x10001ULL; break; /* unknown device */
+			default: id = eui[(i / 4) % n]; pkt[i].status = STAT_CRC_BAD; /* corrupted */
+		}
+		for (j = 0; j < 8; ++j) {
+			pkt[i].payload[1 + j] = (uint8_t)(router_id >> (56 - 8 * j));
+			pkt[i].payload[9 + j] = (uint8_t)(id >> (56 - 8 * j));
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < BENCH_PKT_NB; ++i) {
+		if (compare_id(&pkt[i & (BENCH_SET_NB - 1)], &dev) != INVALID_MSG) {
+			nb_dev += (unsigned long)(dev - dev_table) + 1;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	t = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1E9;
+	MSG("INFO: %d packets classified against %d device(s) in %.3f s, %.1f ns per packet (checksum %lu)\n", BENCH_PKT_NB, n, t, t * 1E9 / BENCH_PKT_NB, nb_dev);
+}
+
+/* start a new series, the device does not change */
+void series_reset(struct series_s *series) {
+	series->size = 0;
+	lgw_stat_init(&series->snr);
+	lgw_stat_init(&series->rssi);
+	lgw_stat_init(&series->snr_min);
+	lgw_stat_init(&series->snr_max);
+}
+
+void write_results(const struct series_s *series) {
+	const struct lgw_pkt_rx_s *p = &series->end;
 
     if (result_file != NULL)
     {
 
-		fprintf(result_file, "%+4.1f,", average_snr); // SNR
-		fprintf(result_file, "%i,", counter); // Number of packets received
+		fprintf(result_file, "%+4.1f,", lgw_stat_mean(&series->snr)); // SNR
+		fprintf(result_file, "%u,", series->snr.nb); // Number of packets received
 
 		// crc
 		switch (p->payload[17]) {
@@ -457,7 +518,7 @@ void write_results(int counter, struct lgw_pkt_rx_s* p) {
 		int average_time = p->payload[21] + (p->payload[22] <<8) + (p->payload[23] <<16) + (p->payload[24] <<24);
 		fprintf(result_file, "%i,", average_time); // average tx time
 
-		fprintf(result_file, "%i,", size); // packet size
+		fprintf(result_file, "%i,", series->size); // packet size
 
 		fprintf(result_file, "%i,", p->payload[25]); // messages per setting
 
@@ -466,15 +527,78 @@ void write_results(int counter, struct lgw_pkt_rx_s* p) {
 		int std_dev_time = p->payload[27] + (p->payload[28] <<8) + (p->payload[29] <<16) + (p->payload[30] <<24);
 		fprintf(result_file, "%i,", std_dev_time); // standard deviation of tx time
 
-		fprintf(result_file, "%+4.1f", std_dev_snr); // standard deviation of SNR
+		fprintf(result_file, "%+4.1f,", lgw_stat_sd(&series->snr)); // standard deviation of SNR
+
+		write_utc(&series->start_utc); // first test packet
+		fputs(",", result_file);
+		write_utc(&series->end_utc); // end of the series
+		fputs(series->utc_gps ? ",GPS" : ",host", result_file); // time source
+
+		fprintf(result_file, ",%016llX", (unsigned long long)series->dev_eui); // device
+
+		write_stat(&series->snr); // SNR distribution
+		fprintf(result_file, ",%+.0f,%.1f", lgw_stat_mean(&series->rssi), lgw_stat_sd(&series->rssi)); // RSSI
+		write_stat(&series->rssi);
+		write_dist(&series->snr_min); // minimum SNR within the packets
+		write_dist(&series->snr_max); // maximum SNR within the packets
 
 		fputs("\n", result_file);
+		fflush(result_file);
     }
 }
 
+/* min, max, 5th, 50th and 95th percentiles of a series */
+void write_stat(const struct lgw_stat_s *stat) {
+	fprintf(result_file, ",%+.1f,%+.1f,%+.1f,%+.1f,%+.1f", stat->min, stat->max, lgw_stat_quantile(stat, LGW_STAT_P5), lgw_stat_quantile(stat, LGW_STAT_P50), lgw_stat_quantile(stat, LGW_STAT_P95));
+}
+
+/* mean, 5th, 50th and 95th percentiles of a series */
+void write_dist(const struct lgw_stat_s *stat) {
+	fprintf(result_file, ",%+.1f,%+.1f,%+.1f,%+.1f", lgw_stat_mean(stat), lgw_stat_quantile(stat, LGW_STAT_P5), lgw_stat_quantile(stat, LGW_STAT_P50), lgw_stat_quantile(stat, LGW_STAT_P95));
+}
+
+/* ISO 8601 UTC time, with microseconds */
+void write_utc(const struct timespec *utc) {
+	struct tm x;
+
+	gmtime_r(&utc->tv_sec, &x);
+	fprintf(result_file, "%04i-%02i-%02iT%02i:%02i:%02i.%06liZ", x.tm_year + 1900, x.tm_mon + 1, x.tm_mday, x.tm_hour, x.tm_min, x.tm_sec, utc->tv_nsec / 1000);
+}
+
+/* UTC time of the packets of a fetch: from their timestamps while the GPS time
+reference is valid, else the host clock; returns true for GPS time */
+bool fetch_utc(const struct lgw_pkt_rx_s *pkt, int nb_pkt, struct timespec *utc) {
+	uint32_t count_us[FETCH_PKT_NB];
+	struct timespec host;
+	struct tref ref;
+	bool valid;
+	int i;
+
+	clock_gettime(CLOCK_REALTIME, &host);
+	pthread_mutex_lock(&mx_timeref); /* only held by the GPS thread for a sync, never for I/O */
+	ref = time_reference_gps;
+	valid = gps_ref_valid;
+	pthread_mutex_unlock(&mx_timeref);
+
+	if (valid && (nb_pkt <= FETCH_PKT_NB) && (difftime(host.tv_sec, ref.systime) <= GPS_REF_MAX_AGE)) {
+		for (i = 0; i < nb_pkt; ++i) {
+			count_us[i] = pkt[i].count_us;
+		}
+		if (lgw_cnt2utc_n(ref, count_us, utc, nb_pkt) == LGW_GPS_SUCCESS) {
+			return true;
+		}
+	}
+	for (i = 0; i < nb_pkt; ++i) {
+		utc[i] = host;
+	}
+	return false;
+}
+
 void send_join_response(struct lgw_pkt_rx_s* received) {
  
 	struct lgw_pkt_tx_s join_response;
+	uint32_t now;
+	int i;
 	
 	join_response.freq_hz = JOIN_RESPONSE_FREQ;
 	join_response.tx_mode = TIMESTAMPED;
@@ -494,16 +618,391 @@ void send_join_response(struct lgw_pkt_rx_s* received) {
 	join_response.payload[0]= 0;
 	join_response.payload[1]= 1; 
 	join_response.payload[2]= 2;
-	lgw_send(join_response);
+	pthread_mutex_lock(&mx_concent);
+	lgw_get_instcnt(&now);
+	pthread_mutex_unlock(&mx_concent);
+	i = lgw_txq_enqueue(&txq, &join_response, now);
+	if (i != LGW_TXQ_SUCCESS) {
+		MSG("WARNING: join response not sent, rejected by the TX queue (%d)\n", i);
+		return;
+	}
+	run_txq();
+}
+
+/* hand the queued join responses to the concentrator when their slot is near */
+void run_txq(void) {
+	static struct timespec due; /* when lgw_txq_run must be called again */
+	struct timespec now;
+	uint32_t next_us;
+
+	if (lgw_txq_count(&txq) == 0) {
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if ((now.tv_sec < due.tv_sec) || ((now.tv_sec == due.tv_sec) && (now.tv_nsec < due.tv_nsec))) {
+		return;
+	}
+	pthread_mutex_lock(&mx_concent);
+	if (lgw_txq_run(&txq, &next_us) != LGW_TXQ_SUCCESS) {
+		MSG("WARNING: failed to send a join response\n");
+	}
+	pthread_mutex_unlock(&mx_concent);
+	due.tv_sec = now.tv_sec + next_us / 1000000;
+	due.tv_nsec = now.tv_nsec + (next_us % 1000000) * 1000;
+	if (due.tv_nsec >= 1000000000) {
+		due.tv_sec += 1;
+		due.tv_nsec -= 1000000000;
+	}
+}
+
+/* fetch packets into rx_ring, sleep on the concentrator while the FIFO is empty */
+void *thread_rx(void *arg) {
+	struct lgw_pkt_rx_s rxpkt[FETCH_PKT_NB]; /* array containing up to 16 inbound packets metadata */
+	struct timespec utc[FETCH_PKT_NB];
+	struct pipe_item_s item;
+	int i, nb_pkt;
+
+	(void)arg;
+	while ((LOAD_ACQUIRE(quit_sig) != 1) && (LOAD_ACQUIRE(exit_sig) != 1)) {
+		if (stats_sig == 1) {
+			stats_sig = 0;
+			print_stats();
+		}
+		pthread_mutex_lock(&mx_concent);
+		nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+		pthread_mutex_unlock(&mx_concent);
+		if (nb_pkt == LGW_HAL_ERROR) {
+			MSG("ERROR: failed packet fetch, exiting\n");
+			STORE_RELEASE(rx_error, 1);
+			break;
+		} else if (nb_pkt == 0) {
+			lgw_rx_wait(RX_WAIT_MS); /* no register access, a join response can be sent meanwhile */
+			continue;
+		}
+
+		item.utc_gps = fetch_utc(rxpkt, nb_pkt, utc);
+		for (i=0; i < nb_pkt; ++i) {
+			item.utc = utc[i];
+			item.pkt = rxpkt[i];
+			if (capture.map != NULL) {
+				lgw_cap_write(&capture, &rxpkt[i], &utc[i], item.utc_gps);
+			}
+			if (lgw_ring_push(&rx_ring, &item) != LGW_RING_SUCCESS) {
+				MSG("WARNING: processing thread late, packet dropped\n");
+			}
+		}
+	}
+	return NULL;
+}
+
+/* follow the test series of each device, hand each ended series to the writer thread */
+void *thread_proc(void *arg) {
+	static struct result_s res;
+	struct pipe_item_s item;
+	struct lgw_pkt_rx_s *p = &item.pkt;
+	struct device_s *dev = NULL;
+	struct series_s *series;
+
+	(void)arg;
+	lgw_txq_init(&txq);
+	for (;;) {
+		run_txq();
+		if (lgw_ring_pop(&cmd_ring, &res.cmd) == LGW_RING_SUCCESS) {
+			campaign_command(&res);
+		}
+		if (lgw_ring_pop(&rx_ring, &item) != LGW_RING_SUCCESS) {
+			if (LOAD_ACQUIRE(proc_stop) == 1) {
+				break;
+			}
+			wait_ms(PIPE_IDLE_MS);
+			continue;
+		}
+		if (campaign_on == 0) {
+			continue; /* between two campaigns */
+		}
+
+		switch(compare_id(p, &dev)) {
+			case JOIN_REQ_MSG:
+				MSG("Sending join response to %016llX.\n", (unsigned long long)dev->eui);
+				send_join_response(p);
+				series_reset(&dev->series);
+				if (dev->ended) { /* new campaign */
+					dev->ended = false;
+					STORE_RELEASE(dev_ended_nb, dev_ended_nb - 1);
+				}
+				break;
+			case TEST_MSG:
+				series = &dev->series;
+				if (series->snr.nb == 0) {
+					series->start_utc = item.utc;
+					series->utc_gps = item.utc_gps;
+				}
+				lgw_stat_add(&series->snr, p->snr);
+				lgw_stat_add(&series->rssi, p->rssi);
+				lgw_stat_add(&series->snr_min, p->snr_min);
+				lgw_stat_add(&series->snr_max, p->snr_max);
+				series->size = p->size;
+				break;
+			case END_TEST_MSG:
+				series = &dev->series;
+				if (series->snr.nb != 0) {
+					series->end = *p;
+					series->end_utc = item.utc;
+					series->utc_gps = series->utc_gps && item.utc_gps;
+					res.cmd.type = CAMPAIGN_RESULT;
+					res.cmd.seq = 0;
+					res.series = *series;
+					if (lgw_ring_push(&result_ring, &res) != LGW_RING_SUCCESS) {
+						MSG("WARNING: writer thread late, series dropped\n");
+					}
+					MSG("Ended series of %016llX: %u packets received.\n", (unsigned long long)dev->eui, series->snr.nb);
+				}
+				series_reset(series);
+				break;
+			case ALL_TESTS_ENDED_MSG:
+				if (!dev->ended) {
+					dev->ended = true;
+					STORE_RELEASE(dev_ended_nb, dev_ended_nb + 1);
+					MSG("All tests of %016llX have been finished (%d/%d devices).\n", (unsigned long long)dev->eui, dev_ended_nb, dev_nb);
+				}
+				if (dev_ended_nb == dev_nb) {
+					MSG("All tests have been finished.\n");
+					if (ctl_path == NULL) {
+						STORE_RELEASE(exit_sig, 1); // ending program
+					} else {
+						/* close the result file, and wait for the next campaign */
+						res.cmd.type = CAMPAIGN_STOP;
+						res.cmd.seq = 0;
+						campaign_command(&res);
+					}
+				}
+				break;
+			default:
+				// message not recognized
+				break;
+		}
+	}
+	return NULL;
 }
 
-void openResultFile() {
-    result_file = fopen(result_file_name, "w");
+/* statistics and result file */
+void *thread_writer(void *arg) {
+	static struct result_s res;
+
+	(void)arg;
+	for (;;) {
+		if (lgw_ring_pop(&result_ring, &res) == LGW_RING_SUCCESS) {
+			if (res.cmd.type == CAMPAIGN_RESULT) {
+				write_results(&res.series);
+				STORE_RELEASE(campaign_series, campaign_series + 1);
+			} else {
+				switch_results(&res.cmd);
+			}
+			continue;
+		}
+		if (LOAD_ACQUIRE(result_stop) == 1) {
+			break;
+		}
+		wait_ms(PIPE_IDLE_MS);
+	}
+	return NULL;
+}
+
+/* read the GPS, and synchronize the time reference on the PPS at each RMC sentence */
+void *thread_gps(void *arg) {
+	char serial_buff[128];
+	struct pollfd pfd;
+	struct timespec utc;
+	uint32_t trig_tstamp;
+	uint32_t toggle_tstamp, nb_toggle;
+	uint32_t nb_drop = 0;
+	ssize_t nb_char;
+	bool valid = false;
+	int i, n, used;
+
+	(void)arg;
+	pfd.fd = gps_tty_fd;
+	pfd.events = POLLIN;
+	while (LOAD_ACQUIRE(gps_stop) != 1) {
+		if (poll(&pfd, 1, GPS_POLL_MS) <= 0) {
+			continue;
+		}
+		nb_char = read(gps_tty_fd, serial_buff, sizeof serial_buff);
+		if (nb_char <= 0) {
+			MSG("WARNING: GPS read failed, packets are stamped with the host clock from now on\n");
+			break;
+		}
+
+		/* sentences can be split across reads */
+		for (n = 0; n < nb_char; n += used) {
+			if (lgw_parse_nmea_stream(serial_buff + n, nb_char - n, &used) != NMEA_RMC) {
+				continue;
+			}
+			if (lgw_gps_get(&utc, NULL, NULL) != LGW_GPS_SUCCESS) {
+				continue; /* no fix, the reference holds over until it is too old */
+			}
+			/* timestamp latched on the PPS that started this second, unless a
+			counter read of another thread suspended the capture since */
+			pthread_mutex_lock(&mx_concent);
+			i = lgw_get_trigcnt(&trig_tstamp);
+			if (i == LGW_HAL_SUCCESS) {
+				i = lgw_get_gps_toggle(&nb_toggle, &toggle_tstamp);
+			}
+			pthread_mutex_unlock(&mx_concent);
+			if (i != LGW_HAL_SUCCESS) {
+				continue;
+			}
+			if ((nb_toggle != 0) && ((trig_tstamp - toggle_tstamp) < LGW_GPS_TOGGLE_US)) {
+				if (nb_drop++ == 0) {
+					MSG("INFO: PPS timestamp overwritten by a counter read, sync point dropped (not shown again)\n");
+				}
+				continue;
+			}
+			pthread_mutex_lock(&mx_timeref);
+			if (lgw_gps_sync_fit(&gps_fit, &time_reference_gps, trig_tstamp, utc) == LGW_GPS_SUCCESS) {
+				gps_ref_valid = true;
+			}
+			i = (gps_ref_valid && !valid);
+			valid = gps_ref_valid;
+			pthread_mutex_unlock(&mx_timeref);
+			if (i) {
+				MSG("INFO: GPS time reference synchronized, packets are stamped with GPS time\n");
+			}
+		}
+	}
+	return NULL;
+}
+
+void openResultFile(const char *name) {
+    result_file = fopen(name, "w");
     if (result_file == NULL) {
-    	MSG("ERROR: could not open result file.\n");
+    	MSG("ERROR: could not open result file %s.\n", name);
     	return;
     }
-    fputs("snr,pkt_count,crc,dr,bw,pow,avg_time,size,msgs_per_setting,test_type,std_dev_time,std_dev_snr\n", result_file);
+    fputs("snr,pkt_count,crc,dr,bw,pow,avg_time,size,msgs_per_setting,test_type,std_dev_time,std_dev_snr,start_utc,end_utc,utc_src,dev_eui,snr_lo,snr_hi,snr_p5,snr_p50,snr_p95,rssi,std_dev_rssi,rssi_min,rssi_max,rssi_p5,rssi_p50,rssi_p95,snr_min,snr_min_p5,snr_min_p50,snr_min_p95,snr_max,snr_max_p5,snr_max_p50,snr_max_p95\n", result_file);
+}
+
+/* start or stop a campaign in the processing thread, then hand the command to the writer thread */
+void campaign_command(struct result_s *res) {
+	int i;
+
+	if (res->cmd.type == CAMPAIGN_START) {
+		/* every device starts again, the series of the previous campaign are dropped */
+		for (i = 0; i < DEV_TABLE_NB; ++i) {
+			dev_table[i].ended = false;
+			series_reset(&dev_table[i].series);
+		}
+		STORE_RELEASE(dev_ended_nb, 0);
+	}
+	STORE_RELEASE(campaign_on, (res->cmd.type == CAMPAIGN_START) ? 1 : 0);
+	if (lgw_ring_push(&result_ring, res) != LGW_RING_SUCCESS) {
+		MSG("WARNING: writer thread late, result file not switched\n");
+	}
+}
+
+/* close the result file of the last campaign and create the one of the next, in the writer thread */
+void switch_results(const struct campaign_cmd_s *cmd) {
+	bool failed = false;
+
+	if (result_file != NULL) {
+		fclose(result_file);
+		result_file = NULL;
+		MSG("INFO: result file %s closed, %u series\n", campaign_file, campaign_series);
+	}
+	if (cmd->type == CAMPAIGN_START) {
+		strcpy(campaign_file, cmd->file);
+		STORE_RELEASE(campaign_series, 0);
+		openResultFile(campaign_file);
+		failed = (result_file == NULL);
+	}
+	if (cmd->seq != 0) {
+		STORE_RELEASE(campaign_failed, failed);
+		STORE_RELEASE(campaign_ack, cmd->seq);
+	}
+}
+
+/* send a campaign command and wait for the writer thread, the time taken in ms, -1 if it did not answer */
+double campaign_send(int type, const char *file) {
+	struct campaign_cmd_s cmd;
+	struct timespec t0, t1;
+	int i;
+
+	memset(&cmd, 0, sizeof cmd);
+	cmd.type = type;
+	cmd.seq = ++ctl_seq;
+	strncpy(cmd.file, file, sizeof cmd.file - 1);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (lgw_ring_push(&cmd_ring, &cmd) != LGW_RING_SUCCESS) {
+		return -1.0;
+	}
+	for (i = 0; LOAD_ACQUIRE(campaign_ack) != cmd.seq; ++i) {
+		if (i >= 10 * CTL_ACK_MS) {
+			return -1.0;
+		}
+		wait_us(100);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0.tv_sec) * 1E3 + (t1.tv_nsec - t0.tv_nsec) / 1E6;
+}
+
+/* execute one command of the control socket and reply to it */
+void control_command(const char *line) {
+	char verb[16] = "";
+	char arg[GW_CONF_PATH_SIZE] = "";
+	struct tm tm;
+	double ms;
+
+	sscanf(line, "%15s %255s", verb, arg); /* GW_CONF_PATH_SIZE - 1, no space in the file name */
+	if (strcmp(verb, "start") == 0) {
+		if (arg[0] == '\0') {
+			time(&now_time);
+			gmtime_r(&now_time, &tm);
+			strftime(arg, sizeof arg, "results_%Y%m%dT%H%M%SZ.csv", &tm);
+		}
+		ms = campaign_send(CAMPAIGN_START, arg);
+		if (ms < 0.0) {
+			lgw_ctl_reply(&ctl, "ERROR campaign not started, the receive pipeline did not answer");
+		} else if (LOAD_ACQUIRE(campaign_failed)) {
+			campaign_send(CAMPAIGN_STOP, "");
+			lgw_ctl_reply(&ctl, "ERROR campaign not started, could not create result file %s", arg);
+		} else {
+			++campaign_nb;
+			MSG("INFO: campaign %d started, results in %s (%.1f ms)\n", campaign_nb, arg, ms);
+			lgw_ctl_reply(&ctl, "OK campaign %d started, results in %s, %.1f ms", campaign_nb, arg, ms);
+		}
+	} else if (strcmp(verb, "stop") == 0) {
+		ms = campaign_send(CAMPAIGN_STOP, "");
+		if (ms < 0.0) {
+			lgw_ctl_reply(&ctl, "ERROR campaign not stopped, the receive pipeline did not answer");
+		} else {
+			MSG("INFO: campaign %d stopped\n", campaign_nb);
+			lgw_ctl_reply(&ctl, "OK campaign %d stopped, %u series", campaign_nb, LOAD_ACQUIRE(campaign_series));
+		}
+	} else if (strcmp(verb, "status") == 0) {
+		lgw_ctl_reply(&ctl, "OK campaign %d %s, %u series, %d/%d devices ended", campaign_nb, LOAD_ACQUIRE(campaign_on) ? "running" : "stopped", LOAD_ACQUIRE(campaign_series), LOAD_ACQUIRE(dev_ended_nb), dev_nb);
+	} else if (strcmp(verb, "quit") == 0) {
+		lgw_ctl_reply(&ctl, "OK exiting");
+		STORE_RELEASE(exit_sig, 1);
+	} else {
+		lgw_ctl_reply(&ctl, "ERROR unknown command, expected start [<file>], stop, status or quit");
+	}
+}
+
+/* daemon mode: serve the control socket until a signal, a quit command or a fetch error */
+void run_control(void) {
+	char line[LGW_CTL_LINE_SIZE];
+	int i;
+
+	MSG("INFO: waiting for campaigns on %s\n", ctl_path);
+	while ((quit_sig != 1) && (LOAD_ACQUIRE(exit_sig) != 1) && (LOAD_ACQUIRE(rx_error) != 1)) {
+		i = lgw_ctl_wait(&ctl, CTL_WAIT_MS, line, sizeof line);
+		if (i == 1) {
+			control_command(line);
+		} else if (i == LGW_CTL_ERROR) {
+			MSG("ERROR: control socket failed, exiting\n");
+			STORE_RELEASE(exit_sig, 1);
+		}
+	}
 }
 
 // MAIN FONCTION
@@ -511,19 +1010,13 @@ void openResultFile() {
 int main(int argc, char **argv)
 {
 	int i; /* loop and temporary variables */
-	struct timespec sleep_time = {0, 3000000}; /* 3 ms */
-	
-	int packet_counter = 0;
 	
-	/* allocate memory for packet fetching and processing */
-	struct lgw_pkt_rx_s rxpkt[16]; /* array containing up to 16 inbound packets metadata */
-	struct lgw_pkt_rx_s *p; /* pointer on a RX packet */
-	int nb_pkt;
-
-	configure_gateway();
+	/* receive pipeline threads */
+	pthread_t thrid_rx, thrid_proc, thrid_writer, thrid_gps;
+	bool bench = false;
 
 	/* parse command line options */
-	while ((i = getopt (argc, argv, "hr:")) != -1) {
+	while ((i = getopt (argc, argv, "hr:bc:d:")) != -1) {
 		switch (i) {
 			case 'h':
 				usage();
@@ -532,6 +1025,15 @@ int main(int argc, char **argv)
 			case 'r':
 				result_file_name = optarg;
 				break;
+			case 'b':
+				bench = true;
+				break;
+			case 'c':
+				conf_snapshot = optarg;
+				break;
+			case 'd':
+				ctl_path = optarg;
+				break;
 			
 			default:
 				MSG("ERROR: argument parsing use -h option for help\n");
@@ -540,6 +1042,12 @@ int main(int argc, char **argv)
 		}
 	}
 
+	configure_gateway();
+	if (bench) {
+		bench_classify();
+		return EXIT_SUCCESS;
+	}
+
 	/* configure signal handling */
 	sigemptyset(&sigact.sa_mask);
 	sigact.sa_flags = 0;
@@ -547,8 +1055,20 @@ int main(int argc, char **argv)
 	sigaction(SIGQUIT, &sigact, NULL);
 	sigaction(SIGINT, &sigact, NULL);
 	sigaction(SIGTERM, &sigact, NULL);
+	sigaction(SIGUSR1, &sigact, NULL);
+
+	/* control socket (optional), before the concentrator is started */
+	if ((ctl_path != NULL) && (lgw_ctl_open(&ctl, ctl_path) != LGW_CTL_SUCCESS)) {
+		MSG("ERROR: impossible to create control socket %s\n", ctl_path);
+		return EXIT_FAILURE;
+	}
 
 	/* starting the concentrator */
+	configure_calibration();
+	configure_spi();
+	if (configure_trace() != 0) {
+		return EXIT_FAILURE;
+	}
 	i = lgw_start();
 	if (i == LGW_HAL_SUCCESS) {
 		MSG("INFO: concentrator started, packet can now be received\n");
@@ -557,58 +1077,81 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
-	openResultFile();
+	/* in daemon mode, no result file until a campaign is started */
+	if (ctl_path == NULL) {
+		openResultFile(result_file_name);
+	} else {
+		campaign_on = 0;
+	}
 	
 	/* transform the MAC address into a string */
 	sprintf(lgwm_str, "%08X%08X", (uint32_t)(lgwm >> 32), (uint32_t)(lgwm & 0xFFFFFFFF));
 
-	/* main loop */
-	while ((quit_sig != 1) && (exit_sig != 1)) {
-		/* fetch packets */
-		nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
-		if (nb_pkt == LGW_HAL_ERROR) {
-			MSG("ERROR: failed packet fetch, exiting\n");
-			return EXIT_FAILURE;
-		} else if (nb_pkt == 0) {
-			clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-		} else {
-			/* local timestamp generation until we get accurate GPS time */
-		}
-		
-		/* log packets */
-		for (i=0; i < nb_pkt; ++i) {
-			p = &rxpkt[i];
-
-			switch(compare_id(p)) {
-				case JOIN_REQ_MSG:
-					MSG("Sending join response.\n");
-					send_join_response(p);
-					packet_counter = 0;
-					size = 0;
-					break;
-				case TEST_MSG:
-					snr[packet_counter] = p->snr;
-					packet_counter++;
-					size = p->size;
-					break;
-				case END_TEST_MSG:
-					if (packet_counter != 0) {				
-						write_results(packet_counter, p);
-						MSG("Ended series: %i packets received.\n", packet_counter);
-					}
-					packet_counter = 0;
-					size = 0;
-					break;
-				case ALL_TESTS_ENDED_MSG:
-					exit_sig = 1; // ending program
-					MSG("All tests have been finished.\n");
-					break;
-				default:
-					// message not recognized
-					break;
+	/* allocate the rings between the threads */
+	if ((lgw_ring_init(&rx_ring, sizeof(struct pipe_item_s), PIPE_RING_NB) != LGW_RING_SUCCESS) || (lgw_ring_init(&result_ring, sizeof(struct result_s), RESULT_RING_NB) != LGW_RING_SUCCESS) || (lgw_ring_init(&cmd_ring, sizeof(struct campaign_cmd_s), CMD_RING_NB) != LGW_RING_SUCCESS)) {
+		MSG("ERROR: failed to allocate the receive pipeline\n");
+		return EXIT_FAILURE;
+	}
+
+	/* raw capture (optional), the file is allocated before the first packet */
+	if ((gw_conf.capture_file[0] != '\0') && (lgw_cap_open(&capture, gw_conf.capture_file, gw_conf.capture_nb) != LGW_CAP_SUCCESS)) {
+		MSG("ERROR: impossible to create capture file %s\n", gw_conf.capture_file);
+		return EXIT_FAILURE;
+	}
+
+	/* GPS (optional), packets are stamped with the host clock until its time reference is valid */
+	if (gw_conf.gps_tty_path[0] != '\0') {
+		lgw_gps_fit_init(&gps_fit);
+		if (lgw_gps_enable(gw_conf.gps_tty_path, NULL, 0, &gps_tty_fd) != LGW_GPS_SUCCESS) {
+			MSG("WARNING: impossible to open GPS serial port %s, packets are stamped with the host clock\n", gw_conf.gps_tty_path);
+			if (gps_tty_fd > 0) {
+				close(gps_tty_fd);
 			}
+			gps_tty_fd = -1;
+		} else if (pthread_create(&thrid_gps, NULL, thread_gps, NULL) != 0) {
+			MSG("ERROR: impossible to create the GPS thread\n");
+			return EXIT_FAILURE;
 		}
 	}
+
+	/* spawn the threads, the consumers first */
+	if ((pthread_create(&thrid_writer, NULL, thread_writer, NULL) != 0) || (pthread_create(&thrid_proc, NULL, thread_proc, NULL) != 0) || (pthread_create(&thrid_rx, NULL, thread_rx, NULL) != 0)) {
+		MSG("ERROR: impossible to create the receive pipeline threads\n");
+		return EXIT_FAILURE;
+	}
+
+	/* the RX thread runs until a signal is received, all tests are finished (or
+	a quit command in daemon mode) or a fetch fails, then each thread empties
+	its input ring before exiting */
+	if (ctl_path != NULL) {
+		run_control();
+	}
+	pthread_join(thrid_rx, NULL);
+	if (gps_tty_fd >= 0) {
+		STORE_RELEASE(gps_stop, 1);
+		pthread_join(thrid_gps, NULL);
+	}
+	STORE_RELEASE(proc_stop, 1);
+	pthread_join(thrid_proc, NULL);
+	STORE_RELEASE(result_stop, 1);
+	pthread_join(thrid_writer, NULL);
+	if (lgw_ring_drops(&rx_ring) + lgw_ring_drops(&result_ring) > 0) {
+		MSG("WARNING: %u packet(s) or series dropped in the receive pipeline\n", lgw_ring_drops(&rx_ring) + lgw_ring_drops(&result_ring));
+	}
+	lgw_ring_free(&rx_ring);
+	lgw_ring_free(&result_ring);
+	lgw_ring_free(&cmd_ring);
+	if (ctl_path != NULL) {
+		lgw_ctl_close(&ctl);
+	}
+	if ((capture.map != NULL) && (lgw_cap_close(&capture) != LGW_CAP_SUCCESS)) {
+		MSG("WARNING: failed to write capture file %s\n", gw_conf.capture_file);
+	}
+	if (rx_error == 1) {
+		print_stats();
+		finish_trace(); /* also the normal end of a replay */
+		return EXIT_FAILURE;
+	}
 	
 	if (exit_sig == 1) {
 		/* clean up before leaving */
@@ -620,8 +1163,15 @@ int main(int argc, char **argv)
 		}
 	}
 
-	fclose(result_file);
+	if (result_file != NULL) {
+		fclose(result_file);
+	}
 	
+	print_stats();
+	finish_trace();
+	if (gps_tty_fd >= 0) {
+		close(gps_tty_fd);
+	}
 	MSG("INFO: Exiting uplink concentrator program\n");
 	return EXIT_SUCCESS;
 }
\ No newline at end of file